@@ -0,0 +1,308 @@
+#pragma once
+
+#include <sys/mman.h>
+#include <numa.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "compiler.hh"
+#include "Transaction.hh"
+
+namespace bench {
+
+// Memory for index rows and bucket arrays, mapped in 2MB huge pages where
+// the system has them reserved (see mount_hugepages.sh), transparent huge
+// pages otherwise, and bound to one NUMA node.
+//
+// Rows come in cache-line size classes. Each thread bump-allocates from a
+// 2MB region of its own and reuses the rows it frees, so allocation mostly
+// takes no locks. Rows a thread frees from other threads' regions go back
+// to the arena in batches, which threads take when their own rows run out;
+// a thread holds at most one partial batch per size class. Memory returns
+// to the system only when the arena is destroyed.
+class row_arena {
+public:
+    static constexpr size_t region_size = 2 << 20;
+    static constexpr size_t granule = CACHE_LINE_SIZE;
+    static constexpr size_t max_size = 4096;
+    static constexpr int max_arenas = 256;
+    static constexpr size_t free_batch = 64;
+
+    // node < 0 leaves placement to the kernel
+    explicit row_arena(int node = -1)
+        : node_(numa_available() < 0 ? -1 : node), id_(next_id()) {}
+    ~row_arena() {
+        for (auto& r : regions_)
+            munmap(r.base, r.size);
+    }
+    row_arena(const row_arena&) = delete;
+    row_arena& operator=(const row_arena&) = delete;
+
+    int node() const {
+        return node_;
+    }
+    size_t mapped_bytes() const {
+        return mapped_bytes_;
+    }
+    // of mapped_bytes(), those in reserved huge pages
+    size_t huge_bytes() const {
+        return huge_bytes_;
+    }
+
+    void* allocate(size_t size) {
+        always_assert(size <= max_size, "row_arena: row too large");
+        size_t cls = size_class(size);
+        thread_cache& tc = cache();
+        if (!tc.free[cls])
+            refill(tc, cls);
+        if (void* p = tc.free[cls]) {
+            tc.free[cls] = *reinterpret_cast<void**>(p);
+            return p;
+        }
+        size_t n = (cls + 1) * granule;
+        if (size_t(tc.end - tc.next) < n) {
+            tc.next = reinterpret_cast<char*>(map(region_size)) + granule;
+            auto h = reinterpret_cast<region_header*>(tc.next - granule);
+            h->owner = this;
+            h->cache = &tc;
+            tc.end = tc.next - granule + region_size;
+        }
+        void* p = tc.next;
+        tc.next += n;
+        return p;
+    }
+    // frees memory from allocate(), of any arena, to the arena it came
+    // from: to the calling thread if the row is in its region
+    static void deallocate(void* p, size_t size) {
+        auto h = reinterpret_cast<region_header*>(
+            reinterpret_cast<uintptr_t>(p) & ~(region_size - 1));
+        row_arena* arena = h->owner;
+        size_t cls = size_class(size);
+        if (arena->cache_slot(arena->id_) == h->cache) {
+            *reinterpret_cast<void**>(p) = h->cache->free[cls];
+            h->cache->free[cls] = p;
+            return;
+        }
+        thread_cache& tc = arena->cache();
+        *reinterpret_cast<void**>(p) = tc.remote[cls];
+        tc.remote[cls] = p;
+        if (++tc.remote_count[cls] == free_batch) {
+            arena->share(cls, p);
+            tc.remote[cls] = nullptr;
+            tc.remote_count[cls] = 0;
+        }
+    }
+
+    // Zero-filled blocks of any size, for bucket arrays
+    void* allocate_large(size_t size) {
+        return map(round_up(size));
+    }
+    void deallocate_large(void* p, size_t size) {
+        size = round_up(size);
+        std::lock_guard<std::mutex> guard(lock_);
+        auto it = std::find_if(regions_.begin(), regions_.end(),
+                               [p] (const region& r) { return r.base == p; });
+        assert(it != regions_.end());
+        mapped_bytes_ -= size;
+        if (it->huge)
+            huge_bytes_ -= size;
+        regions_.erase(it);
+        munmap(p, size);
+    }
+
+private:
+    struct region {
+        void* base;
+        size_t size;
+        bool huge;
+    };
+    struct thread_cache {
+        char* next = nullptr;
+        char* end = nullptr;
+        void* free[max_size / granule] = {};
+        // rows freed from other threads' regions, not yet a whole batch
+        void* remote[max_size / granule] = {};
+        size_t remote_count[max_size / granule] = {};
+    };
+    struct region_header {
+        row_arena* owner;
+        thread_cache* cache;  // of the thread that bump-allocates from it
+    };
+    // A shared batch: the rows are a free list, and the first row's second
+    // word links the next batch
+    static void*& next_batch(void* batch) {
+        return reinterpret_cast<void**>(batch)[1];
+    }
+
+    int node_;
+    int id_;
+    std::mutex lock_;
+    std::vector<region> regions_;
+    std::vector<std::unique_ptr<thread_cache>> caches_;
+    std::mutex batch_lock_;
+    std::atomic<void*> batches_[max_size / granule] = {};
+    std::atomic<size_t> mapped_bytes_ {0};
+    std::atomic<size_t> huge_bytes_ {0};
+
+    static size_t size_class(size_t size) {
+        return (std::max(size, sizeof(void*)) - 1) / granule;
+    }
+    static size_t round_up(size_t size) {
+        return (size + region_size - 1) & ~(region_size - 1);
+    }
+    static int next_id() {
+        static std::atomic<int> ids {0};
+        int id = ids.fetch_add(1);
+        always_assert(id < max_arenas, "row_arena: too many arenas");
+        return id;
+    }
+
+    // the calling thread's cache of arena `id`, null before it allocates
+    // or frees
+    static thread_cache*& cache_slot(int id) {
+        static thread_local thread_cache* caches[max_arenas];
+        return caches[id];
+    }
+    thread_cache& cache() {
+        thread_cache*& tc = cache_slot(id_);
+        if (!tc) {
+            std::lock_guard<std::mutex> guard(lock_);
+            caches_.emplace_back(new thread_cache);
+            tc = caches_.back().get();
+        }
+        return *tc;
+    }
+
+    // Hands a batch of freed rows of class `cls` to the arena
+    void share(size_t cls, void* batch) {
+        std::lock_guard<std::mutex> guard(batch_lock_);
+        next_batch(batch) = batches_[cls].load(std::memory_order_relaxed);
+        batches_[cls].store(batch, std::memory_order_relaxed);
+    }
+    // Gives an empty free list the thread's partial batch, or else a
+    // shared one
+    void refill(thread_cache& tc, size_t cls) {
+        if (tc.remote[cls]) {
+            tc.free[cls] = tc.remote[cls];
+            tc.remote[cls] = nullptr;
+            tc.remote_count[cls] = 0;
+        } else if (batches_[cls].load(std::memory_order_relaxed)) {
+            std::lock_guard<std::mutex> guard(batch_lock_);
+            if (void* batch = batches_[cls].load(std::memory_order_relaxed)) {
+                batches_[cls].store(next_batch(batch), std::memory_order_relaxed);
+                tc.free[cls] = batch;
+            }
+        }
+    }
+
+    // Maps `size` bytes, a multiple of region_size, aligned to region_size
+    void* map(size_t size) {
+        bool huge = true;
+        void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p == MAP_FAILED) {
+            // no reserved huge pages; align the range so that transparent
+            // huge pages can back it
+            huge = false;
+            size_t len = size + region_size;
+            auto q = reinterpret_cast<char*>(mmap(nullptr, len, PROT_READ | PROT_WRITE,
+                                                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+            always_assert(q != MAP_FAILED, "row_arena: out of memory");
+            auto a = reinterpret_cast<char*>(
+                (reinterpret_cast<uintptr_t>(q) + region_size - 1) & ~(region_size - 1));
+            if (a != q)
+                munmap(q, a - q);
+            if (a + size != q + len)
+                munmap(a + size, q + len - (a + size));
+            madvise(a, size, MADV_HUGEPAGE);
+            p = a;
+        }
+        // before the first touch, which places the pages
+        if (node_ >= 0)
+            numa_tonode_memory(p, size, node_);
+        std::lock_guard<std::mutex> guard(lock_);
+        regions_.push_back(region{p, size, huge});
+        mapped_bytes_ += size;
+        if (huge)
+            huge_bytes_ += size;
+        return p;
+    }
+};
+
+// Index rows live in the index's arena, or on the heap without one
+template <typename T, typename... Args>
+inline T* arena_new(row_arena* arena, Args&&... args) {
+    static_assert(alignof(T) <= row_arena::granule, "row_arena: overaligned row");
+    if (!arena)
+        return new T(std::forward<Args>(args)...);
+    return new (arena->allocate(sizeof(T))) T(std::forward<Args>(args)...);
+}
+
+template <typename T>
+inline void arena_free(T* x) {
+    x->~T();
+    row_arena::deallocate(x, sizeof(T));
+}
+
+template <typename T>
+inline void arena_delete(row_arena* arena, T* x) {
+    if (!arena)
+        delete x;
+    else
+        arena_free(x);
+}
+
+template <typename T>
+inline void arena_rcu_delete(row_arena* arena, T* x) {
+    if (!arena)
+        Transaction::rcu_delete(x);
+    else
+        Transaction::rcu_call([] (void* p) { arena_free(static_cast<T*>(p)); }, x);
+}
+
+// Allocates bucket arrays from an arena, or from the heap without one
+template <typename T>
+class arena_allocator {
+public:
+    typedef T value_type;
+
+    arena_allocator(row_arena* arena = nullptr)
+        : arena_(arena) {}
+    template <typename U>
+    arena_allocator(const arena_allocator<U>& other)
+        : arena_(other.arena()) {}
+
+    row_arena* arena() const {
+        return arena_;
+    }
+
+    T* allocate(size_t n) {
+        if (!arena_)
+            return std::allocator<T>().allocate(n);
+        return static_cast<T*>(arena_->allocate_large(n * sizeof(T)));
+    }
+    void deallocate(T* p, size_t n) {
+        if (!arena_)
+            std::allocator<T>().deallocate(p, n);
+        else
+            arena_->deallocate_large(p, n * sizeof(T));
+    }
+
+    template <typename U>
+    bool operator==(const arena_allocator<U>& other) const {
+        return arena_ == other.arena();
+    }
+    template <typename U>
+    bool operator!=(const arena_allocator<U>& other) const {
+        return arena_ != other.arena();
+    }
+
+private:
+    row_arena* arena_;
+};
+
+} // namespace bench
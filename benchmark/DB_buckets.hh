@@ -0,0 +1,488 @@
+#pragma once
+
+#include <emmintrin.h>
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <type_traits>
+#include <vector>
+
+#include "xxhash.h"
+#include "Sto.hh"
+#include "DB_arena.hh"
+
+// Unordered indexes use one-cache-line buckets that hold fingerprints and
+// pointers of their first elements inline, and hash keys with xxHash
+#ifndef BUCKET_FINGERPRINTS
+#define BUCKET_FINGERPRINTS 0
+#endif
+
+namespace bench {
+
+// Hashes keys with xxHash: their bytes, when those represent them
+// uniquely, or their std::hash otherwise
+template <typename K>
+struct xxh_hash {
+    static constexpr unsigned long long seed = 0xdeadbeefdeadbeef;
+
+    size_t operator()(const K& k) const {
+        if constexpr (std::has_unique_object_representations<K>::value)
+            return XXH64(&k, sizeof(K), seed);
+        else {
+            size_t h = std::hash<K>()(k);
+            return XXH64(&h, sizeof(h), seed);
+        }
+    }
+};
+
+// The bucket array of the unordered indexes, which grows while in use.
+//
+// Once the map holds more than max_load elements per bucket, it links a
+// table of twice the buckets behind the current one. Inserters then move
+// move_batch buckets each from the old table to the new one, so no thread
+// ever rehashes the whole map. Old bucket i splits into new buckets i and
+// i + size, which no one uses until bucket i is marked moved, so a move
+// locks only the old bucket. When the last bucket has moved, the old table
+// is freed through RCU.
+//
+// A move marks the old bucket moved, then bumps its version. Lookups that
+// see the mark go on to the new table. A transaction that found a key
+// absent before the move observed the old version and aborts at commit;
+// transactions that looked in other buckets are unaffected.
+//
+// With Fingerprints, each bucket fills one cache line: the version, a tag
+// byte from the hash of each of its first inline_slots elements, their
+// pointers, and a chain for the rest. Lookups compare all tags at once,
+// and load only elements whose tags match, so a lookup usually misses the
+// cache once for the bucket and once for the element it finds.
+template <typename Elem, typename Key, typename Version, typename Hash, typename Pred,
+          bool Fingerprints = false>
+class bucket_map {
+public:
+    static constexpr int inline_slots = 5;
+
+    struct chained_bucket {
+        Elem* head;
+        // incremented on insert; a lookup that found no key observes it, so
+        // that the key is still absent at commit
+        Version version;
+        // set, under the lock, once the elements are in the next table
+        std::atomic<bool> moved;
+
+        chained_bucket() : head(nullptr), version(0), moved(false) {}
+    };
+
+    struct alignas(CACHE_LINE_SIZE) fingerprint_bucket {
+        Version version;
+        // 0 for empty slots; read 8 at a time, through `moved`
+        uint8_t tags[inline_slots];
+        uint8_t pad[7 - inline_slots];
+        std::atomic<bool> moved;
+        Elem* slots[inline_slots];
+        Elem* head;
+
+        fingerprint_bucket()
+            : version(0), tags(), pad(), moved(false), slots(), head(nullptr) {}
+    };
+
+    typedef typename std::conditional<Fingerprints, fingerprint_bucket, chained_bucket>::type bucket;
+
+    static constexpr size_t max_load = 1;
+    static constexpr size_t move_batch = 8;
+    // Links and unlinks are counted on one of count_stripes cache lines,
+    // by thread id; a stripe flushes into nelems_ once it is count_batch
+    // away from 0
+    static constexpr int count_stripes = 16;
+    static constexpr ssize_t count_batch = 32;
+
+    bucket_map(size_t size, row_arena* arena, Hash h, Pred p)
+        : arena_(arena), hasher_(h), pred_(p), root_size_(std::max(size, size_t(1))),
+          head_(make_table(root_size_, arena)), nelems_(0), growing_(false) {
+        static_assert(!Fingerprints || sizeof(fingerprint_bucket) == CACHE_LINE_SIZE,
+                      "bucket_map: fingerprint buckets fill one cache line");
+    }
+    // Shares the elements of `x`, as a copied vector of buckets would; no
+    // one may be using `x`
+    bucket_map(const bucket_map& x)
+        : arena_(x.arena_), hasher_(x.hasher_), pred_(x.pred_), root_size_(x.root_size_),
+          nelems_(x.size()), growing_(false) {
+        table* xt = x.head_.load(std::memory_order_relaxed);
+        always_assert(!xt->next.load(std::memory_order_relaxed), "bucket_map: copied while growing");
+        table* t = make_table(xt->size, arena_);
+        for (size_t i = 0; i != t->size; ++i) {
+            bucket& b = t->buckets[i];
+            const bucket& xb = xt->buckets[i];
+            b.head = xb.head;
+            b.version = xb.version;
+            if constexpr (Fingerprints) {
+                std::copy(xb.tags, xb.tags + inline_slots, b.tags);
+                std::copy(xb.slots, xb.slots + inline_slots, b.slots);
+            }
+        }
+        head_.store(t, std::memory_order_relaxed);
+    }
+    bucket_map& operator=(const bucket_map&) = delete;
+    ~bucket_map() {
+        table* t = head_.load(std::memory_order_relaxed);
+        while (t) {
+            table* next = t->next.load(std::memory_order_relaxed);
+            free_table(t);
+            t = next;
+        }
+        for (table* r : retired_)
+            free_table(r);
+    }
+
+    size_t hash(const Key& k) const {
+        return hasher_(k);
+    }
+    bool key_equal(const Key& a, const Key& b) const {
+        return pred_(a, b);
+    }
+    // Buckets in the newest table
+    size_t nbuckets() const {
+        table* t = head_.load(std::memory_order_acquire);
+        while (table* next = t->next.load(std::memory_order_acquire))
+            t = next;
+        return t->size;
+    }
+    size_t size() const {
+        size_t n = nelems_.load(std::memory_order_relaxed);
+        for (auto& s : counts_)
+            n += s.delta.load(std::memory_order_relaxed);
+        return n;
+    }
+
+    // The bucket that holds keys with hash `h` now
+    bucket& find_bucket(size_t h) {
+        table* t = head_.load(std::memory_order_acquire);
+        bucket* b = &t->buckets[h % t->size];
+        while (b->moved.load(std::memory_order_acquire)) {
+            t = t->next.load(std::memory_order_acquire);
+            b = &t->buckets[h % t->size];
+        }
+        return *b;
+    }
+    // Does not block: returns the bucket for hash `h`, with its version in
+    // `vers` from before any lookup in it
+    bucket& read_bucket(size_t h, Version& vers) {
+        while (true) {
+            bucket& b = find_bucket(h);
+            vers = b.version;
+            fence();
+            if (!b.moved.load(std::memory_order_acquire))
+                return b;
+        }
+    }
+    // Returns the bucket for hash `h`, locked
+    bucket& lock_bucket(size_t h) {
+        while (true) {
+            bucket& b = find_bucket(h);
+            b.version.lock_exclusive();
+            if (!b.moved.load(std::memory_order_relaxed))
+                return b;
+            b.version.unlock_exclusive();
+        }
+    }
+
+    // Finds `k`, whose hash is `h`, in bucket `b`
+    Elem* find(const bucket& b, const Key& k, size_t h) const {
+        if constexpr (Fingerprints) {
+            unsigned m = match(b, tag(h));
+            while (m) {
+                Elem* e = b.slots[__builtin_ctz(m)];
+                if (e && pred_(e->key, k))
+                    return e;
+                m &= m - 1;
+            }
+        } else
+            (void) h;
+        Elem* e = b.head;
+        while (e && !pred_(e->key, k))
+            e = e->next;
+        return e;
+    }
+    // A lookup outside transactions, which retries if the bucket changed
+    Elem* nontrans_find(const Key& k) {
+        size_t h = hash(k);
+        while (true) {
+            // read_bucket rechecks `moved` after reading the version: a
+            // bucket that moved before it was read is empty, at its final
+            // version
+            Version vers;
+            bucket& b = read_bucket(h, vers);
+            Elem* e = find(b, k, h);
+            fence();
+            if (e || (!vers.is_locked() && b.version.value() == vers.value()))
+                return e;
+            relax_fence();
+        }
+    }
+
+    // Prefetches the bucket that a lookup of hash `h` reads first
+    void prefetch_bucket(size_t h) const {
+        table* t = head_.load(std::memory_order_acquire);
+        prefetch(&t->buckets[h % t->size]);
+    }
+    // Prefetches the elements that find(b, k, h) compares first
+    void prefetch_elements(const bucket& b, size_t h) const {
+        if constexpr (Fingerprints) {
+            if (unsigned m = match(b, tag(h))) {
+                for (; m; m &= m - 1)
+                    prefetch(b.slots[__builtin_ctz(m)]);
+                return;
+            }
+        } else
+            (void) h;
+        if (Elem* e = b.head)
+            prefetch(e);
+    }
+
+    // Adds `e`, whose key hashes to `h`, to locked bucket `b`
+    void link(bucket& b, Elem* e, size_t h) {
+        link_in(b, e, h);
+        count(1);
+    }
+    // Removes `e` from locked bucket `b`; returns false if it is not there
+    bool unlink(bucket& b, Elem* e) {
+        if constexpr (Fingerprints) {
+            for (int i = 0; i != inline_slots; ++i)
+                if (b.tags[i] && b.slots[i] == e) {
+                    b.tags[i] = 0;
+                    fence();
+                    b.slots[i] = nullptr;
+                    count(-1);
+                    return true;
+                }
+        }
+        Elem* prev = nullptr;
+        Elem* curr = b.head;
+        while (curr && curr != e) {
+            prev = curr;
+            curr = curr->next;
+        }
+        if (!curr)
+            return false;
+        if (prev)
+            prev->next = curr->next;
+        else
+            b.head = curr->next;
+        count(-1);
+        return true;
+    }
+
+    // Called before each insert, with no bucket locked: starts growing the
+    // map if it is too full, or moves a batch of buckets if it is growing.
+    // The load counts this thread's stripe, but not the other threads'
+    // unflushed ones.
+    void grow() {
+        table* t = head_.load(std::memory_order_acquire);
+        if (table* nt = t->next.load(std::memory_order_acquire)) {
+            move_batch_from(t, nt);
+        } else if (nelems_.load(std::memory_order_relaxed) + stripe().delta.load(std::memory_order_relaxed)
+                   > max_load * t->size
+                   && !growing_.exchange(true, std::memory_order_acquire)) {
+            if (head_.load(std::memory_order_relaxed) == t
+                && !t->next.load(std::memory_order_relaxed))
+                t->next.store(make_table(2 * t->size, arena_), std::memory_order_release);
+            growing_.store(false, std::memory_order_release);
+        }
+    }
+
+    // Scans cover the buckets of the initial table, and the buckets they
+    // split into, in independent ranges
+    size_t scan_ranges(size_t range_buckets) const {
+        return (root_size_ + range_buckets - 1) / range_buckets;
+    }
+    // Calls f(e) for each element in a range. Buckets are locked while
+    // their elements are collected, so moves do not hide elements; scans
+    // must run inside a transaction (for RCU protection)
+    template <typename F>
+    void scan(size_t range, size_t range_buckets, F f) {
+        scan(range, range_buckets, 0, range_buckets, f);
+    }
+    // Same, for the `count` buckets of a range that start at its bucket
+    // `first`; returns false once the range is exhausted
+    template <typename F>
+    bool scan(size_t range, size_t range_buckets, size_t first, size_t count, F f) {
+        table* t = head_.load(std::memory_order_acquire);
+        size_t range_end = std::min(root_size_, (range + 1) * range_buckets);
+        size_t begin = std::min(range_end, range * range_buckets + first);
+        size_t end = std::min(range_end, begin + count);
+        std::vector<Elem*> elems;
+        for (size_t i = begin; i < end; ++i) {
+            // a table's size is root_size_ times a power of two
+            for (size_t j = i; j < t->size; j += root_size_)
+                collect(t, j, elems);
+            for (Elem* e : elems)
+                f(e);
+            elems.clear();
+        }
+        return end < range_end;
+    }
+
+private:
+    struct table {
+        size_t size;
+        bucket* buckets;
+        row_arena* arena;
+        std::atomic<table*> next;
+        // next bucket to move, and buckets moved, to `next`
+        std::atomic<size_t> move_cursor;
+        std::atomic<size_t> moved;
+
+        table(size_t n, row_arena* a)
+            : size(n), buckets(nullptr), arena(a), next(nullptr),
+              move_cursor(0), moved(0) {}
+    };
+
+    row_arena* arena_;
+    Hash hasher_;
+    Pred pred_;
+    size_t root_size_;
+    // the oldest table; the next one, if any, is growing
+    std::atomic<table*> head_;
+    // elements, less the unflushed stripe deltas
+    std::atomic<size_t> nelems_;
+    std::atomic<bool> growing_;
+    struct alignas(CACHE_LINE_SIZE) count_stripe {
+        std::atomic<ssize_t> delta;
+
+        count_stripe() : delta(0) {}
+    };
+    count_stripe counts_[count_stripes];
+    // tables emptied outside transactions, freed with the map
+    std::mutex retired_lock_;
+    std::vector<table*> retired_;
+
+    count_stripe& stripe() {
+        return counts_[TThread::id() % count_stripes];
+    }
+    void count(ssize_t d) {
+        auto& s = stripe().delta;
+        ssize_t v = s.fetch_add(d, std::memory_order_relaxed) + d;
+        if (v >= count_batch || v <= -count_batch)
+            nelems_.fetch_add(size_t(s.exchange(0, std::memory_order_relaxed)),
+                              std::memory_order_relaxed);
+    }
+
+    // Tags are never 0, so they never match empty slots
+    static uint8_t tag(size_t h) {
+        return uint8_t(h >> 56) | 0x80;
+    }
+    // Bit i is set if slot i has tag `t`
+    static unsigned match(const fingerprint_bucket& b, uint8_t t) {
+        __m128i tags = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(b.tags));
+        unsigned m = _mm_movemask_epi8(_mm_cmpeq_epi8(tags, _mm_set1_epi8(char(t))));
+        return m & ((1U << inline_slots) - 1);
+    }
+
+    static table* make_table(size_t size, row_arena* arena) {
+        table* t = new table(size, arena);
+        t->buckets = arena_allocator<bucket>(arena).allocate(size);
+        for (size_t i = 0; i != size; ++i)
+            new (&t->buckets[i]) bucket();
+        return t;
+    }
+    static void free_table(void* p) {
+        table* t = static_cast<table*>(p);
+        for (size_t i = 0; i != t->size; ++i)
+            t->buckets[i].~bucket();
+        arena_allocator<bucket>(t->arena).deallocate(t->buckets, t->size);
+        delete t;
+    }
+
+    void link_in(bucket& b, Elem* e, size_t h) {
+        if constexpr (Fingerprints) {
+            for (int i = 0; i != inline_slots; ++i)
+                if (!b.tags[i]) {
+                    // readers that match the tag find the element
+                    b.slots[i] = e;
+                    fence();
+                    b.tags[i] = tag(h);
+                    return;
+                }
+        } else
+            (void) h;
+        e->next = b.head;
+        fence();
+        b.head = e;
+    }
+
+    void move_batch_from(table* t, table* nt) {
+        size_t i = t->move_cursor.fetch_add(move_batch, std::memory_order_relaxed);
+        if (i >= t->size)
+            return;
+        size_t end = std::min(i + move_batch, t->size);
+        for (size_t j = i; j != end; ++j)
+            move_bucket(t, nt, j);
+        if (t->moved.fetch_add(end - i, std::memory_order_acq_rel) + (end - i) == t->size)
+            retire(t, nt);
+    }
+
+    void move_bucket(table* t, table* nt, size_t i) {
+        bucket& b = t->buckets[i];
+        bucket& lo = nt->buckets[i];
+        bucket& hi = nt->buckets[i + t->size];
+        b.version.lock_exclusive();
+        auto move = [&] (Elem* e) {
+            size_t h = hash(e->key);
+            link_in(h % nt->size == i ? lo : hi, e, h);
+        };
+        if constexpr (Fingerprints) {
+            for (int s = 0; s != inline_slots; ++s)
+                if (b.tags[s])
+                    move(b.slots[s]);
+        }
+        // readers still in the old chain may follow a moved element into a
+        // new chain; they miss keys, but the version bump catches them
+        Elem* e = b.head;
+        while (e) {
+            Elem* next = e->next;
+            move(e);
+            e = next;
+        }
+        if constexpr (Fingerprints) {
+            std::fill(b.tags, b.tags + inline_slots, 0);
+            std::fill(b.slots, b.slots + inline_slots, nullptr);
+        }
+        b.head = nullptr;
+        b.moved.store(true, std::memory_order_release);
+        b.version.inc_nonopaque();
+        b.version.unlock_exclusive();
+    }
+
+    void retire(table* t, table* nt) {
+        head_.store(nt, std::memory_order_release);
+        if (Sto::in_progress())
+            Transaction::rcu_call(free_table, t);
+        else {
+            // loaders may still be looking in t
+            std::lock_guard<std::mutex> guard(retired_lock_);
+            retired_.push_back(t);
+        }
+    }
+
+    void collect(table* t, size_t i, std::vector<Elem*>& elems) {
+        bucket& b = t->buckets[i];
+        b.version.lock_exclusive();
+        if (b.moved.load(std::memory_order_relaxed)) {
+            b.version.unlock_exclusive();
+            table* nt = t->next.load(std::memory_order_acquire);
+            collect(nt, i, elems);
+            collect(nt, i + t->size, elems);
+            return;
+        }
+        if constexpr (Fingerprints) {
+            for (int s = 0; s != inline_slots; ++s)
+                if (b.tags[s])
+                    elems.push_back(b.slots[s]);
+        }
+        for (Elem* e = b.head; e; e = e->next)
+            elems.push_back(e);
+        b.version.unlock_exclusive();
+    }
+};
+
+} // namespace bench
@@ -0,0 +1,228 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <numeric>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "PlatformFeatures.hh"
+#include "Transaction.hh"
+
+namespace bench {
+
+template <typename K, typename V, typename DBParams>
+class ordered_index;
+template <typename K, typename V, typename DBParams>
+class mvcc_ordered_index;
+
+// Indexes whose loads go in key order, split into key ranges
+template <typename Index>
+struct loads_in_order : std::false_type {};
+template <typename K, typename V, typename DBParams>
+struct loads_in_order<ordered_index<K, V, DBParams>> : std::true_type {};
+template <typename K, typename V, typename DBParams>
+struct loads_in_order<mvcc_ordered_index<K, V, DBParams>> : std::true_type {};
+
+// Rows put by bulk loaders, and the time they took, for load reports
+class load_meter {
+public:
+    load_meter()
+        : rows_(loaded_rows()), start_(std::chrono::steady_clock::now()) {}
+
+    static std::atomic<size_t>& loaded_rows() {
+        static std::atomic<size_t> rows {0};
+        return rows;
+    }
+
+    // Prints the rows loaded since construction, and their rate
+    void report() const {
+        size_t rows = loaded_rows() - rows_;
+        std::chrono::duration<double> secs = std::chrono::steady_clock::now() - start_;
+        std::cout << "Loaded " << rows << " rows in " << secs.count() << " s ("
+                  << size_t(rows / secs.count()) << " rows/sec)" << std::endl;
+    }
+
+private:
+    size_t rows_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+// Loads rows into an index outside transactions, from several threads.
+//
+// Rows are added in any order, then put together. For ordered indexes, the
+// rows are sorted, and each thread puts one key range in key order, so
+// threads build separate parts of the tree and each descent finds the
+// previous one's path cached. For unordered indexes, each thread puts the
+// rows whose hashes it owns. Rows with equal keys go to one thread, in the
+// order added, so the last one added wins, as with nontrans_put. Rows get
+// the versions nontrans_put gives them, Sto::initialized_tid().
+//
+// Keys are compared as masstree compares them, as their sizeof(key_type)
+// bytes.
+template <typename Index>
+class bulk_loader {
+public:
+    typedef typename Index::key_type key_type;
+    typedef typename Index::value_type value_type;
+
+    // Fewer rows per thread are loaded by fewer threads
+    static constexpr size_t min_thread_rows = 4096;
+
+    explicit bulk_loader(Index& index)
+        : index_(index) {}
+
+    void add(const key_type& k, const value_type& v) {
+        rows_.emplace_back(k, v);
+    }
+    size_t size() const {
+        return rows_.size();
+    }
+
+    // Puts the rows added into the index and clears them; returns how many
+    // were put
+    size_t load(int nthreads = default_threads()) {
+        size_t n = rows_.size();
+        nthreads = int(std::max(size_t(1), std::min(size_t(nthreads), n / min_thread_rows)));
+        put_all(nthreads, loads_in_order<Index>());
+        rows_.clear();
+        rows_.shrink_to_fit();
+        load_meter::loaded_rows() += n;
+        return n;
+    }
+
+    static int default_threads() {
+        return int(std::max(1u, std::min(std::thread::hardware_concurrency(), 16u)));
+    }
+
+private:
+    typedef std::pair<key_type, value_type> row_type;
+
+    Index& index_;
+    std::vector<row_type> rows_;
+
+    static int compare(const key_type& a, const key_type& b) {
+        return memcmp(&a, &b, sizeof(key_type));
+    }
+
+    // orders row numbers by their rows' keys
+    auto less() const {
+        return [this] (size_t a, size_t b) {
+            return compare(rows_[a].first, rows_[b].first) < 0;
+        };
+    }
+
+    void put(const row_type& row) {
+        index_.nontrans_put(row.first, row.second);
+    }
+
+    void put_all(int nthreads, std::true_type) {
+        std::vector<size_t> order(rows_.size());
+        std::iota(order.begin(), order.end(), size_t(0));
+        // most loaders add rows in key order already
+        if (!std::is_sorted(order.begin(), order.end(), less()))
+            sort(order, nthreads);
+        auto bounds = key_ranges(order, nthreads);
+        run(nthreads, [&] (int t) {
+            for (size_t i = bounds[t]; i != bounds[t + 1]; ++i)
+                put(rows_[order[i]]);
+        });
+    }
+
+    void put_all(int nthreads, std::false_type) {
+        if (nthreads == 1) {
+            for (auto& row : rows_)
+                put(row);
+            return;
+        }
+        // each thread hashes a run of rows, then puts the rows it owns
+        std::vector<int> owners(rows_.size());
+        run(nthreads, [&] (int t) {
+            size_t last = rows_.size() * (t + 1) / nthreads;
+            for (size_t i = rows_.size() * t / nthreads; i != last; ++i)
+                owners[i] = int(index_.hash(rows_[i].first) % nthreads);
+        }, false);
+        run(nthreads, [&] (int t) {
+            for (size_t i = 0; i != rows_.size(); ++i)
+                if (owners[i] == t)
+                    put(rows_[i]);
+        });
+    }
+
+    // Runs f(t) for t in [0, nthreads): on this thread if there is one,
+    // otherwise on new threads, set up for the index if `init`. Thread t
+    // takes thread id t, which the caller must not be using meanwhile
+    // except while it waits here, and is pinned as runner t would be once
+    // the topology is known.
+    template <typename F>
+    static void run(int nthreads, F f, bool init = true) {
+        if (nthreads == 1) {
+            f(0);
+            return;
+        }
+        always_assert(nthreads <= MAX_THREADS, "bulk_loader: too many threads");
+        std::vector<std::thread> threads;
+        for (int t = 0; t != nthreads; ++t)
+            threads.emplace_back([&f, t, init] () {
+                TThread::set_id(t);
+                if (topo_info.num_nodes)
+                    set_affinity(t);
+                if (init)
+                    Index::thread_init();
+                f(t);
+            });
+        for (auto& th : threads)
+            th.join();
+    }
+
+    // Sorts `order` by key, keeping rows with equal keys in the order
+    // added: each thread sorts a run, then adjacent runs merge in rounds
+    void sort(std::vector<size_t>& order, int nthreads) {
+        auto less = this->less();
+        std::vector<size_t> runs;
+        for (int t = 0; t <= nthreads; ++t)
+            runs.push_back(order.size() * t / nthreads);
+        run(nthreads, [&] (int t) {
+            std::stable_sort(order.begin() + runs[t], order.begin() + runs[t + 1], less);
+        }, false);
+        for (size_t width = 1; width < size_t(nthreads); width *= 2) {
+            std::vector<std::thread> threads;
+            for (size_t t = 0; t + width < size_t(nthreads); t += 2 * width) {
+                auto first = order.begin() + runs[t];
+                auto middle = order.begin() + runs[t + width];
+                auto last = order.begin() + runs[std::min(t + 2 * width, size_t(nthreads))];
+                threads.emplace_back([=] () {
+                    std::inplace_merge(first, middle, last, less);
+                });
+            }
+            for (auto& th : threads)
+                th.join();
+        }
+    }
+
+    // Splits sorted `order` into nthreads ranges of about equal size that
+    // do not split equal keys
+    std::vector<size_t> key_ranges(const std::vector<size_t>& order, int nthreads) const {
+        std::vector<size_t> bounds {0};
+        for (int t = 1; t != nthreads; ++t) {
+            size_t b = std::max(bounds.back(), order.size() * t / nthreads);
+            while (b != 0 && b != order.size()
+                   && compare(rows_[order[b - 1]].first, rows_[order[b]].first) == 0)
+                ++b;
+            bounds.push_back(b);
+        }
+        bounds.push_back(order.size());
+        return bounds;
+    }
+};
+
+template <typename Index>
+inline bulk_loader<Index> make_bulk_loader(Index& index) {
+    return bulk_loader<Index>(index);
+}
+
+} // namespace bench
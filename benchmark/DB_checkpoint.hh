@@ -0,0 +1,667 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "DB_index.hh"
+
+// Fuzzy checkpoints and parallel recovery for logged DB tables.
+//
+// A checkpoint begins in epoch G, once every transaction of the previous
+// epochs is durable in the redo log (see TLog), and then copies every
+// committed row with the commit timestamps of its cells while transactions
+// keep running. Row copies may or may not reflect writes made during the
+// scan, so recovery replays every durable log record from epoch G on and
+// uses the per-cell timestamps to skip the writes that a copy already
+// contains. The copies may also reflect commits made during the scan that
+// are not durable yet, so the scan ends in epoch E, the global epoch once
+// it is done, and the checkpoint waits until every transaction through E
+// is durable. A checkpoint lives in <dir>/ckpt-G/, one file per table
+// range, and becomes valid once its MANIFEST, which records G and E, has
+// been synced. Recovery uses the newest checkpoint whose end epoch E is
+// durable.
+//
+// Recovery runs in two parallel phases. Workers first read checkpoint and
+// log files and partition their entries by (table, key hash); every worker
+// then sorts one partition by key and commit timestamp, resolves the final
+// row images and inserts them into the (empty) tables.
+
+namespace bench {
+
+struct checkpoint_file_header {
+    uint32_t table_id;
+    uint32_t ncells;
+};
+
+// Per row, followed by `ncells` commit timestamps, key bytes, value bytes
+struct checkpoint_row_header {
+    uint32_t key_length;
+    uint32_t value_length;
+};
+
+// Type-erased view of a logged table
+class logged_table {
+public:
+    typedef TransactionTid::type tid_type;
+
+    virtual ~logged_table() {}
+
+    virtual uint32_t log_id() const = 0;
+    virtual size_t checkpoint_ranges() const = 0;
+    virtual uint32_t ncells() const = 0;
+    virtual uint32_t value_length() const = 0;
+    virtual void thread_init() = 0;
+
+    // Writes up to `limit` committed rows of `range` from `cursor` (see
+    // range_position); must run inside a transaction. Returns false once the
+    // range is exhausted.
+    virtual bool checkpoint(size_t range, range_position& cursor, size_t limit, FILE* out) = 0;
+
+    // Recovery helpers; `row` and `src` point to (possibly unaligned)
+    // value images
+    virtual void install_cell(char* row, const char* src, int cell) const = 0;
+    virtual void install_commute(char* row, const char* comm) const = 0;
+    virtual void install_patch(char* row, const char* patch) const = 0;
+    virtual void load(const char* key, const char* row) = 0;
+};
+
+template <typename Index>
+class logged_table_impl : public logged_table {
+public:
+    typedef typename Index::key_type key_type;
+    typedef typename Index::value_type value_type;
+    typedef typename Index::comm_type comm_type;
+    typedef typename Index::checkpoint_tids_type checkpoint_tids_type;
+
+    explicit logged_table_impl(Index& index)
+        : index_(index) {}
+
+    uint32_t log_id() const override {
+        return index_.log_id();
+    }
+    size_t checkpoint_ranges() const override {
+        return index_.checkpoint_ranges();
+    }
+    uint32_t ncells() const override {
+        return Index::checkpoint_cells;
+    }
+    uint32_t value_length() const override {
+        return sizeof(value_type);
+    }
+    void thread_init() override {
+        index_.thread_init();
+    }
+
+    // Write errors are left in ferror(out)
+    bool checkpoint(size_t range, range_position& cursor, size_t limit, FILE* out) override {
+        return index_.checkpoint_scan(range, cursor, limit,
+            [&] (const key_type& key, const value_type& row, const checkpoint_tids_type& tids) {
+                checkpoint_row_header hdr{sizeof(key_type), sizeof(value_type)};
+                fwrite(&hdr, sizeof(hdr), 1, out);
+                fwrite(tids.data(), sizeof(tid_type), tids.size(), out);
+                fwrite(&key, sizeof(key_type), 1, out);
+                fwrite(&row, sizeof(value_type), 1, out);
+            });
+    }
+
+    void install_cell(char* row, const char* src, int cell) const override {
+        if constexpr (Index::checkpoint_cells == 1) {
+            (void)cell;
+            memcpy(row, src, sizeof(value_type));
+        } else {
+            typename Index::value_container_type c(0, load_value(row));
+            value_type v = load_value(src);
+            c.install_cell(cell, &v);
+            memcpy(row, &c.row, sizeof(value_type));
+        }
+    }
+    void install_commute(char* row, const char* comm) const override {
+        alignas(comm_type) char cbuf[sizeof(comm_type)];
+        memcpy(cbuf, comm, sizeof(comm_type));
+        value_type v = load_value(row);
+        reinterpret_cast<comm_type*>(cbuf)->operate(v);
+        memcpy(row, &v, sizeof(value_type));
+    }
+    void install_patch(char* row, const char* patch) const override {
+        if constexpr (mv_column_deltas<value_type>) {
+            typedef MvColumnPatch<value_type> patch_type;
+            alignas(patch_type) char pbuf[sizeof(patch_type)];
+            memcpy(pbuf, patch, sizeof(patch_type));
+            value_type v = load_value(row);
+            reinterpret_cast<patch_type*>(pbuf)->apply(v);
+            memcpy(row, &v, sizeof(value_type));
+        } else {
+            (void)row;
+            (void)patch;
+            always_assert(false, "column patch for a table without column deltas");
+        }
+    }
+    void load(const char* key, const char* row) override {
+        alignas(key_type) char kbuf[sizeof(key_type)];
+        memcpy(kbuf, key, sizeof(key_type));
+        index_.nontrans_put(*reinterpret_cast<key_type*>(kbuf), load_value(row));
+    }
+
+private:
+    Index& index_;
+
+    static value_type load_value(const char* p) {
+        alignas(value_type) char vbuf[sizeof(value_type)];
+        memcpy(vbuf, p, sizeof(value_type));
+        return *reinterpret_cast<value_type*>(vbuf);
+    }
+};
+
+// The logged tables of a database, indexed by log id
+class logged_table_set {
+public:
+    template <typename Index>
+    void add(Index& index) {
+        uint32_t id = index.log_id();
+        always_assert(id != 0, "checkpointed tables need a log id");
+        if (tables_.size() <= id)
+            tables_.resize(id + 1);
+        tables_[id].reset(new logged_table_impl<Index>(index));
+    }
+
+    logged_table* find(uint32_t id) const {
+        return id < tables_.size() ? tables_[id].get() : nullptr;
+    }
+    size_t size() const {
+        return tables_.size();
+    }
+    // Initializes every table for the calling thread
+    void thread_init() {
+        for (auto& t : tables_)
+            if (t)
+                t->thread_init();
+    }
+
+private:
+    std::vector<std::unique_ptr<logged_table>> tables_;
+};
+
+namespace checkpoint_files {
+
+inline std::string checkpoint_dir(const std::string& dir, uint64_t epoch) {
+    return dir + "/ckpt-" + std::to_string(epoch);
+}
+inline std::string manifest(const std::string& ckpt_dir) {
+    return ckpt_dir + "/MANIFEST";
+}
+inline std::string table_file(const std::string& ckpt_dir, uint32_t table_id, size_t range) {
+    return ckpt_dir + "/t" + std::to_string(table_id) + "." + std::to_string(range);
+}
+
+inline bool sync_path(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    bool ok = fsync(fd) == 0;
+    close(fd);
+    return ok;
+}
+
+// Begin and end epochs of a checkpoint
+struct checkpoint_manifest {
+    uint64_t begin_epoch;
+    uint64_t end_epoch;
+};
+
+// Begin epoch of the newest valid checkpoint under `dir` whose end epoch is
+// at most `durable`, 0 if none
+inline uint64_t latest_checkpoint(const std::string& dir, uint64_t durable) {
+    uint64_t best = 0;
+    DIR* d = opendir(dir.c_str());
+    if (!d)
+        return 0;
+    while (struct dirent* ent = readdir(d)) {
+        uint64_t epoch;
+        if (sscanf(ent->d_name, "ckpt-%lu", &epoch) != 1 || epoch <= best)
+            continue;
+        FILE* f = fopen(manifest(checkpoint_dir(dir, epoch)).c_str(), "rb");
+        if (!f)
+            continue;
+        checkpoint_manifest m;
+        if (fread(&m, sizeof(m), 1, f) == 1 && m.begin_epoch == epoch
+            && m.end_epoch >= epoch && m.end_epoch <= durable)
+            best = epoch;
+        fclose(f);
+    }
+    closedir(d);
+    return best;
+}
+
+inline bool read_file(const std::string& path, std::vector<char>& out) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    bool ok = fstat(fd, &st) == 0;
+    if (ok) {
+        out.resize(st.st_size);
+        size_t off = 0;
+        while (ok && off != out.size()) {
+            ssize_t r = read(fd, out.data() + off, out.size() - off);
+            ok = r > 0;
+            if (ok)
+                off += r;
+        }
+    }
+    close(fd);
+    return ok;
+}
+
+} // namespace checkpoint_files
+
+// Takes fuzzy checkpoints of a table set using its own worker threads.
+// Transactions may run concurrently. Logging must be enabled and the epoch
+// advancer running: without the redo log nothing can repair the copies,
+// and the checkpoint only becomes valid once the epoch it ends in is
+// durable. Workers copy a range in batches of
+// `batch_rows` rows (buckets, for unordered tables), each in its own
+// transaction, so no epoch is held for the scan of a whole table.
+class db_checkpointer {
+public:
+    static constexpr size_t batch_rows = 4096;
+
+    db_checkpointer(logged_table_set& tables, const std::string& dir,
+                    int nthreads, int first_threadid)
+        : tables_(tables), dir_(dir), nthreads_(nthreads),
+          first_threadid_(first_threadid), next_task_(0), bytes_(0), failed_(false) {
+        always_assert(first_threadid + nthreads <= MAX_THREADS, "too many checkpointer threads");
+    }
+
+    // Takes one checkpoint. Returns its begin epoch, 0 on failure.
+    uint64_t run() {
+        if (!TLog::enabled()) {
+            fprintf(stderr, "checkpoints need the redo log\n");
+            return 0;
+        }
+        uint64_t epoch = Transaction::global_epochs.global_epoch;
+        TLog::wait_durable(epoch - 1);
+        std::string cdir = checkpoint_files::checkpoint_dir(dir_, epoch);
+        if (mkdir(cdir.c_str(), 0777) != 0) {
+            perror(cdir.c_str());
+            return 0;
+        }
+
+        tasks_.clear();
+        for (uint32_t id = 0; id < tables_.size(); ++id)
+            if (logged_table* t = tables_.find(id))
+                for (size_t r = 0; r < t->checkpoint_ranges(); ++r)
+                    tasks_.emplace_back(t, r);
+        next_task_ = 0;
+        bytes_ = 0;
+        failed_ = false;
+
+        std::vector<std::thread> workers;
+        for (int i = 0; i < nthreads_; ++i)
+            workers.emplace_back(&db_checkpointer::worker, this, first_threadid_ + i, cdir);
+        for (auto& w : workers)
+            w.join();
+        if (failed_)
+            return 0;
+
+        // rows copied by the scan may come from commits in any epoch up to
+        // the present one, which must be durable before the copies are used
+        checkpoint_files::checkpoint_manifest m{epoch, Transaction::global_epochs.global_epoch};
+        TLog::wait_durable(m.end_epoch);
+        if (TLog::durable_epoch() < m.end_epoch) {
+            fprintf(stderr, "log shut down before checkpoint epoch %lu became durable\n",
+                    m.end_epoch);
+            return 0;
+        }
+
+        // the manifest commits the checkpoint
+        std::string mpath = checkpoint_files::manifest(cdir);
+        FILE* f = fopen(mpath.c_str(), "wb");
+        if (!f || fwrite(&m, sizeof(m), 1, f) != 1 || fflush(f) != 0
+            || fsync(fileno(f)) != 0) {
+            perror(mpath.c_str());
+            if (f)
+                fclose(f);
+            return 0;
+        }
+        fclose(f);
+        checkpoint_files::sync_path(cdir);
+        checkpoint_files::sync_path(dir_);
+        return epoch;
+    }
+
+    size_t bytes_written() const {
+        return bytes_;
+    }
+
+private:
+    logged_table_set& tables_;
+    std::string dir_;
+    int nthreads_;
+    int first_threadid_;
+    std::vector<std::pair<logged_table*, size_t>> tasks_;
+    std::atomic<size_t> next_task_;
+    std::atomic<size_t> bytes_;
+    std::atomic<bool> failed_;
+
+    void worker(int threadid, std::string cdir) {
+        TThread::set_id(threadid);
+        tables_.thread_init();
+        size_t i;
+        while ((i = next_task_.fetch_add(1)) < tasks_.size()) {
+            logged_table* t = tasks_[i].first;
+            size_t range = tasks_[i].second;
+            std::string path = checkpoint_files::table_file(cdir, t->log_id(), range);
+            FILE* f = fopen(path.c_str(), "wb");
+            if (!f) {
+                perror(path.c_str());
+                failed_ = true;
+                break;
+            }
+            checkpoint_file_header hdr{t->log_id(), t->ncells()};
+            bool ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1;
+            range_position cursor;
+            for (bool more = true; ok && more; ok = !ferror(f)) {
+                TransactionGuard guard;
+                more = t->checkpoint(range, cursor, batch_rows, f);
+            }
+            if (!ok || fflush(f) != 0 || fsync(fileno(f)) != 0) {
+                perror(path.c_str());
+                failed_ = true;
+            } else
+                bytes_ += ftell(f);
+            fclose(f);
+        }
+        Transaction::rcu_thread_exit();
+    }
+};
+
+// Rebuilds a table set from the newest checkpoint and the redo log in `dir`.
+// The tables must be empty and carry the log ids they had when the
+// checkpoint was taken.
+class db_recovery {
+public:
+    typedef TransactionTid::type tid_type;
+
+    db_recovery(logged_table_set& tables, const std::string& dir, int nthreads)
+        : tables_(tables), dir_(dir), nthreads_(nthreads),
+          nparts_(nthreads * 8), checkpoint_epoch_(0), durable_epoch_(0),
+          next_(0), bytes_(0), rows_(0), seconds_(0) {
+        always_assert(nthreads > 0 && nthreads <= MAX_THREADS, "bad recovery thread count");
+    }
+
+    struct stats {
+        uint64_t checkpoint_epoch;
+        uint64_t durable_epoch;
+        size_t bytes_read;      // checkpoint and log bytes
+        size_t rows_loaded;
+        double seconds;
+    };
+
+    // Returns false if `dir` holds no valid checkpoint that ends in a
+    // durable epoch.
+    bool run() {
+        auto t0 = std::chrono::steady_clock::now();
+        durable_epoch_ = TLog::read_durable_epoch(dir_);
+        checkpoint_epoch_ = checkpoint_files::latest_checkpoint(dir_, durable_epoch_);
+        if (checkpoint_epoch_ == 0)
+            return false;
+
+        std::string cdir = checkpoint_files::checkpoint_dir(dir_, checkpoint_epoch_);
+        files_.clear();
+        if (DIR* d = opendir(cdir.c_str())) {
+            while (struct dirent* ent = readdir(d))
+                if (ent->d_name[0] == 't')
+                    files_.push_back({cdir + "/" + ent->d_name, true, {}});
+            closedir(d);
+        }
+        for (int i = 0; i < MAX_THREADS; ++i) {
+            std::string path = TLog::file_name(dir_, i);
+            if (access(path.c_str(), R_OK) == 0)
+                files_.push_back({path, false, {}});
+        }
+
+        parts_.assign(nthreads_, std::vector<std::vector<entry>>(nparts_));
+        next_ = 0;
+        spawn(&db_recovery::read_worker);
+        next_ = 0;
+        spawn(&db_recovery::resolve_worker);
+
+        files_.clear();
+        parts_.clear();
+        seconds_ = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        return true;
+    }
+
+    stats statistics() const {
+        return {checkpoint_epoch_, durable_epoch_, bytes_, rows_, seconds_};
+    }
+
+private:
+    // op value for checkpointed row images
+    static constexpr uint16_t checkpoint_op = 0;
+
+    struct entry {
+        const char* key;
+        const char* value;
+        const char* tids;    // checkpoint entries only
+        tid_type tid;
+        uint32_t table_id;
+        uint32_t key_length;
+        uint16_t op;
+        uint16_t cell;
+    };
+
+    struct input_file {
+        std::string path;
+        bool checkpoint;
+        std::vector<char> data;
+    };
+
+    logged_table_set& tables_;
+    std::string dir_;
+    int nthreads_;
+    size_t nparts_;
+    uint64_t checkpoint_epoch_;
+    uint64_t durable_epoch_;
+    std::vector<input_file> files_;
+    // parts_[worker][partition]
+    std::vector<std::vector<std::vector<entry>>> parts_;
+    std::atomic<size_t> next_;
+    std::atomic<size_t> bytes_;
+    std::atomic<size_t> rows_;
+    double seconds_;
+
+    void spawn(void (db_recovery::*fn)(int)) {
+        std::vector<std::thread> workers;
+        for (int i = 0; i < nthreads_; ++i)
+            workers.emplace_back(fn, this, i);
+        for (auto& w : workers)
+            w.join();
+    }
+
+    void add(int worker, const entry& e) {
+        size_t h = std::hash<std::string_view>()(std::string_view(e.key, e.key_length));
+        parts_[worker][(h ^ (e.table_id * 0x9E3779B97F4A7C15ULL)) % nparts_].push_back(e);
+    }
+
+    // Phase 1: read and partition input files
+    void read_worker(int worker) {
+        size_t i;
+        while ((i = next_.fetch_add(1)) < files_.size()) {
+            input_file& f = files_[i];
+            bool ok = checkpoint_files::read_file(f.path, f.data);
+            always_assert(ok, "cannot read recovery input");
+            bytes_ += f.data.size();
+            if (f.checkpoint)
+                parse_checkpoint(worker, f.data);
+            else
+                parse_log(worker, f.data);
+        }
+    }
+
+    void parse_checkpoint(int worker, const std::vector<char>& data) {
+        const char* p = data.data();
+        const char* end = p + data.size();
+        checkpoint_file_header fh;
+        always_assert(data.size() >= sizeof(fh), "truncated checkpoint file");
+        memcpy(&fh, p, sizeof(fh));
+        p += sizeof(fh);
+        while (p != end) {
+            checkpoint_row_header rh;
+            always_assert(size_t(end - p) >= sizeof(rh), "truncated checkpoint file");
+            memcpy(&rh, p, sizeof(rh));
+            p += sizeof(rh);
+            size_t row_size = fh.ncells * sizeof(tid_type) + size_t(rh.key_length) + rh.value_length;
+            always_assert(size_t(end - p) >= row_size, "truncated checkpoint file");
+            entry e{nullptr, nullptr, p, 0, fh.table_id, rh.key_length, checkpoint_op, 0};
+            p += fh.ncells * sizeof(tid_type);
+            e.key = p;
+            e.value = p + rh.key_length;
+            p += size_t(rh.key_length) + rh.value_length;
+            add(worker, e);
+        }
+    }
+
+    void parse_log(int worker, const std::vector<char>& data) {
+        const char* p = data.data();
+        const char* end = p + data.size();
+        TLogRecord rec;
+        // a torn record can only follow the durable epoch
+        while (size_t(end - p) >= sizeof(rec)) {
+            memcpy(&rec, p, sizeof(rec));
+            if (size_t(end - p) < sizeof(rec) + rec.length)
+                break;
+            p += sizeof(rec);
+            const char* rend = p + rec.length;
+            if (rec.epoch >= checkpoint_epoch_ && rec.epoch <= durable_epoch_) {
+                for (uint32_t n = 0; n < rec.nentries; ++n) {
+                    TLogEntry le;
+                    memcpy(&le, p, sizeof(le));
+                    p += sizeof(le);
+                    entry e{p, p + le.key_length, nullptr, rec.tid, le.table_id,
+                            le.key_length, static_cast<uint16_t>(le.op), le.cell};
+                    p += le.key_length + le.value_length;
+                    add(worker, e);
+                }
+            }
+            p = rend;
+        }
+    }
+
+    // Phase 2: resolve and load one partition at a time
+    void resolve_worker(int worker) {
+        TThread::set_id(worker);
+        tables_.thread_init();
+        std::vector<entry> es;
+        std::vector<char> row;
+        std::vector<tid_type> tids;
+        size_t p;
+        while ((p = next_.fetch_add(1)) < nparts_) {
+            es.clear();
+            for (auto& wp : parts_)
+                es.insert(es.end(), wp[p].begin(), wp[p].end());
+            std::sort(es.begin(), es.end(), [] (const entry& a, const entry& b) {
+                if (a.table_id != b.table_id)
+                    return a.table_id < b.table_id;
+                if (a.key_length != b.key_length)
+                    return a.key_length < b.key_length;
+                if (int c = memcmp(a.key, b.key, a.key_length))
+                    return c < 0;
+                // the checkpoint image comes first, then log records in
+                // commit order
+                if ((a.op == checkpoint_op) != (b.op == checkpoint_op))
+                    return a.op == checkpoint_op;
+                return a.tid < b.tid;
+            });
+
+            size_t loaded = 0;
+            for (auto it = es.begin(); it != es.end(); ) {
+                logged_table* t = tables_.find(it->table_id);
+                always_assert(t, "log record for unknown table");
+                auto group_end = std::find_if(it, es.end(), [&] (const entry& e) {
+                    return e.table_id != it->table_id || e.key_length != it->key_length
+                           || memcmp(e.key, it->key, it->key_length) != 0;
+                });
+                if (resolve(t, it, group_end, row, tids)) {
+                    t->load(it->key, row.data());
+                    ++loaded;
+                }
+                it = group_end;
+            }
+            rows_ += loaded;
+            // release memory early
+            std::vector<entry>().swap(es);
+            for (auto& wp : parts_)
+                std::vector<entry>().swap(wp[p]);
+        }
+        Transaction::rcu_thread_exit();
+    }
+
+    // Computes the final image of one row; returns false if it is absent
+    template <typename It>
+    static bool resolve(logged_table* t, It it, It end, std::vector<char>& row,
+                        std::vector<tid_type>& tids) {
+        row.resize(t->value_length());
+        tids.assign(t->ncells(), 0);
+        bool exists = false;
+        for (; it != end; ++it) {
+            switch (it->op) {
+            case checkpoint_op:
+                memcpy(row.data(), it->value, row.size());
+                memcpy(tids.data(), it->tids, tids.size() * sizeof(tid_type));
+                exists = true;
+                break;
+            case uint16_t(TLogOp::put):
+                // each cell keeps the newer of its image and the put
+                for (size_t c = 0; c < tids.size(); ++c)
+                    if (it->tid > tids[c]) {
+                        t->install_cell(row.data(), it->value, c);
+                        tids[c] = it->tid;
+                        exists = true;
+                    }
+                break;
+            case uint16_t(TLogOp::put_cell):
+                if (exists && it->tid > tids[it->cell]) {
+                    t->install_cell(row.data(), it->value, it->cell);
+                    tids[it->cell] = it->tid;
+                }
+                break;
+            case uint16_t(TLogOp::commute):
+                if (exists && it->tid > tids[it->cell]) {
+                    t->install_commute(row.data(), it->value);
+                    tids[it->cell] = it->tid;
+                }
+                break;
+            case uint16_t(TLogOp::patch):
+                if (exists && it->tid > tids[0]) {
+                    t->install_patch(row.data(), it->value);
+                    tids[0] = it->tid;
+                }
+                break;
+            case uint16_t(TLogOp::remove):
+                if (it->tid > tids[0]) {
+                    exists = false;
+                    tids[0] = it->tid;
+                }
+                break;
+            default:
+                always_assert(false, "bad log entry");
+            }
+        }
+        return exists;
+    }
+};
+
+}; // namespace bench
@@ -13,6 +13,8 @@
 #include "masstree_scan.hh"
 #include "string.hh"
 
+#include <numeric>
+#include <string>
 #include <vector>
 #include "DB_structs.hh"
 #include "VersionSelector.hh"
@@ -20,6 +22,15 @@
 
 #include "TBox.hh"
 #include "TMvBox.hh"
+#include "TSplitIntegerBox.hh"
+#include "DB_arena.hh"
+#include "DB_buckets.hh"
+
+// select_rows overlaps the cache misses of the lookups it batches; without
+// it, select_rows looks keys up one at a time
+#ifndef INDEX_MULTI_GET
+#define INDEX_MULTI_GET 1
+#endif
 
 namespace bench {
 
@@ -119,9 +130,13 @@ public:
             return {false, 0};
     }
 
-    void increment(int_type i) {
+    bool increment(int_type i) {
         auto item = Sto::item(this, 0);
-        item.acquire_write(vers, i);
+        if (item.has_write())
+            item.template write_value<int_type>() += i;
+        else
+            item.acquire_write(vers, i);
+        return true;
     }
 
     bool lock(TransItem& item, Transaction& txn) override {
@@ -144,15 +159,35 @@ private:
     int_type value;
 };
 
+// Plain OCC splits hot integers into per-thread slices
 template <typename DBParams>
 struct integer_box {
-    typedef typename std::conditional<DBParams::MVCC,
-        TMvCommuteIntegerBox, TCommuteIntegerBox<DBParams>>::type type;
+    static constexpr bool splits = !DBParams::MVCC && !DBParams::TicToc
+        && !DBParams::Adaptive && !DBParams::TwoPhaseLock && !DBParams::Swiss;
+    typedef typename std::conditional<DBParams::MVCC, TMvCommuteIntegerBox,
+            typename std::conditional<splits,
+                TSplitIntegerBox<typename get_occ_version<DBParams>::type>,
+                TCommuteIntegerBox<DBParams>>::type>::type type;
 };
 
 // Row/column access specifiers and split version helpers (OCC-only)
 enum class RowAccess : int { None = 0, ObserveExists, ObserveValue, UpdateValue };
 
+// Keys whose lookups select_rows interleaves at a time
+static constexpr size_t multi_get_batch = 16;
+
+// select_rows without INDEX_MULTI_GET
+template <typename Index, typename Access>
+bool select_each(Index& index, const typename Index::key_type* keys, size_t n,
+                 Access access, typename Index::sel_return_type* results) {
+    for (size_t i = 0; i != n; ++i) {
+        results[i] = index.select_row(keys[i], access);
+        if (!std::get<0>(results[i]))
+            return false;
+    }
+    return true;
+}
+
 enum class access_t : int8_t { none = 0, read = 1, write = 2, update = 3 };
 
 template <typename IndexType>
@@ -239,6 +274,99 @@ public:
 
 };
 
+// Batched commit interface for the indexes: one tight loop per commit phase,
+// with statically bound calls to the index's own lock/check/install and the
+// next item's row prefetched.
+template <typename Index>
+class batched_tobject : public TObject {
+public:
+    unsigned lock_batch(TransItem** items, unsigned n, Transaction& txn) override {
+        Index* self = static_cast<Index*>(this);
+        for (unsigned i = 0; i != n; ++i) {
+            if (i + 1 != n)
+                Index::prefetch_item(*items[i + 1]);
+            if (!self->Index::lock(*items[i], txn))
+                return i;
+        }
+        return n;
+    }
+    unsigned check_batch(TransItem** items, unsigned n, Transaction& txn) override {
+        Index* self = static_cast<Index*>(this);
+        for (unsigned i = 0; i != n; ++i) {
+            if (i + 1 != n)
+                Index::prefetch_item(*items[i + 1]);
+            if (!self->Index::check(*items[i], txn))
+                return i;
+        }
+        return n;
+    }
+    void install_batch(TransItem** items, unsigned n, Transaction& txn) override {
+        Index* self = static_cast<Index*>(this);
+        for (unsigned i = 0; i != n; ++i) {
+            if (i + 1 != n)
+                Index::prefetch_item(*items[i + 1]);
+            self->Index::install(*items[i], txn);
+        }
+    }
+};
+
+// Fuzzy checkpoint support (OCC-only)
+template <typename ValueContainer>
+class checkpoint_helpers {
+public:
+    typedef TransactionTid::type type;
+    static constexpr size_t num_versions = ValueContainer::num_versions;
+    typedef std::array<type, num_versions> tids_type;
+
+    // Copies a committed row without tracking it, waiting out concurrent
+    // writers. `tids` receives the commit timestamp of every cell.
+    // Returns false for rows that are inserted but not yet committed.
+    template <typename RowType>
+    static bool stable_read(ValueContainer& c, RowType& row, tids_type& tids) {
+        while (true) {
+            if (c.row_version().value() & TransactionTid::user_bit)
+                return false;
+            bool locked = false;
+            for (size_t i = 0; i < num_versions; ++i) {
+                locked = locked || TransactionTid::is_locked(c.version_at(i).value());
+                tids[i] = commit_timestamp(c.version_at(i));
+            }
+            if (!locked) {
+                fence();
+                row = c.row;
+                fence();
+                bool stable = true;
+                for (size_t i = 0; stable && i < num_versions; ++i)
+                    stable = !TransactionTid::is_locked(c.version_at(i).value())
+                             && commit_timestamp(c.version_at(i)) == tids[i];
+                if (stable)
+                    return true;
+            }
+            relax_fence();
+        }
+    }
+
+    // Log records of TicToc transactions carry the TicToc commit timestamp
+    template <bool Opaque, bool Extend>
+    static type commit_timestamp(const TicTocVersion<Opaque, Extend>& v) {
+        return v.write_timestamp();
+    }
+    template <typename VersImpl>
+    static type commit_timestamp(const VersImpl& v) {
+        return v.value() & TransactionTid::max_value;
+    }
+};
+
+// Where a walk of one checkpoint range resumes. Walks that must not hold
+// an epoch for a whole table (checkpoints, trim sweeps) proceed in bounded
+// batches, each in its own transaction: ordered indexes resume after `key`
+// (empty at the start of the range), unordered ones at bucket `bucket` of
+// the range.
+struct range_position {
+    std::string key;
+    size_t bucket = 0;
+};
+
 template <typename K, typename V, typename DBParams>
 class index_common {
 public:
@@ -287,3 +415,4 @@ public:
 
 #include "DB_uindex.hh"
 #include "DB_oindex.hh"
+#include "DB_bulk.hh"
@@ -1,8 +1,108 @@
 #pragma once
 
 namespace bench {
+
+// A range scan of an ordered index that returns rows in batches. Callers
+// can page through a range, stop early, or use the index between batches,
+// and seek() moves the scan to another key.
+//
+// Each batch is one masstree scan that starts after the last key of the
+// previous batch, and tracks the leaves it visits as range_scan does. The
+// scan only collects elements, prefetching their rows; rows are accessed
+// once the batch is collected. The leaf after the batch is prefetched
+// while the caller consumes the batch.
+template <typename Index, bool Reverse>
+class scan_cursor {
+public:
+    typedef typename Index::key_type key_type;
+    typedef typename Index::value_type value_type;
+    typedef typename Index::internal_elem internal_elem;
+
+    scan_cursor(Index& index, const key_type& begin, const key_type& end,
+                RowAccess access, bool phantom_protection)
+        : index_(index), next_(begin), end_(end), access_(access),
+          phantom_protection_(phantom_protection), inclusive_(true), done_(false) {}
+
+    // Reads the next batch, of at most n rows. Returns false if the
+    // transaction must abort
+    bool next_batch(int n) {
+        assert(n > 0);
+        keys_.clear();
+        elems_.clear();
+        rows_.clear();
+        if (done_)
+            return true;
+        if (!index_.template scan_batch<Reverse>(next_, inclusive_, end_, phantom_protection_,
+                                                 n, keys_, elems_))
+            return false;
+        if (elems_.size() < size_t(n))
+            done_ = true;
+        else {
+            next_ = keys_.back();
+            inclusive_ = false;
+        }
+        // deleted and uncommitted rows are skipped
+        size_t out = 0;
+        for (size_t i = 0; i != elems_.size(); ++i) {
+            const value_type* row;
+            if (!index_.scan_access(elems_[i], access_, row))
+                return false;
+            if (row) {
+                keys_[out++] = keys_[i];
+                rows_.push_back(row);
+            }
+        }
+        keys_.erase(keys_.begin() + out, keys_.end());
+        return true;
+    }
+
+    // The next batch starts at `k`
+    void seek(const key_type& k) {
+        next_ = k;
+        inclusive_ = true;
+        done_ = false;
+    }
+
+    // No batches remain
+    bool done() const {
+        return done_;
+    }
+    size_t size() const {
+        return rows_.size();
+    }
+    const key_type& key(size_t i) const {
+        return keys_[i];
+    }
+    const value_type& row(size_t i) const {
+        return *rows_[i];
+    }
+
+private:
+    Index& index_;
+    key_type next_;
+    key_type end_;
+    RowAccess access_;
+    bool phantom_protection_;
+    bool inclusive_;
+    bool done_;
+    std::vector<key_type> keys_;
+    std::vector<internal_elem*> elems_;
+    std::vector<const value_type*> rows_;
+};
+
+template <typename Leaf>
+inline void prefetch_leaf(const Leaf* leaf) {
+    if (!leaf)
+        return;
+    for (size_t off = 0; off < sizeof(Leaf); off += CACHE_LINE_SIZE)
+        prefetch(reinterpret_cast<const char*>(leaf) + off);
+}
+
 template <typename K, typename V, typename DBParams>
-class ordered_index : public TObject {
+class ordered_index : public batched_tobject<ordered_index<K, V, DBParams>>, public TLogged {
+    // batched commit calls prefetch_item
+    friend class batched_tobject<ordered_index>;
+
 public:
     typedef K key_type;
     typedef V value_type;
@@ -80,11 +180,13 @@ public:
 
     static __thread typename table_params::threadinfo_type *ti;
 
-    ordered_index(size_t init_size) {
+    ordered_index(size_t init_size, row_arena* arena = nullptr)
+        : arena_(arena) {
         this->table_init();
         (void)init_size;
     }
-    ordered_index() {
+    ordered_index()
+        : arena_(nullptr) {
         this->table_init();
     }
 
@@ -97,7 +199,7 @@ public:
 
     static void thread_init() {
         if (ti == nullptr)
-            ti = threadinfo::make(threadinfo::TI_PROCESS, TThread::id());
+            ti = thread_threadinfo(TThread::id());
         Transaction::tinfo[TThread::id()].trans_start_callback = []() {
             ti->rcu_start();
         };
@@ -106,6 +208,16 @@ public:
         };
     }
 
+    // Masstree never frees a threadinfo, so threads that take over a
+    // thread id, such as bulk loaders, reuse the one made for it
+    static typename table_params::threadinfo_type* thread_threadinfo(int threadid) {
+        static typename table_params::threadinfo_type* tis[MAX_THREADS];
+        always_assert(threadid >= 0 && threadid < MAX_THREADS, "bad thread id");
+        if (!tis[threadid])
+            tis[threadid] = threadinfo::make(threadinfo::TI_PROCESS, threadid);
+        return tis[threadid];
+    }
+
     uint64_t gen_key() {
         return fetch_and_add(&key_gen_, 1);
     }
@@ -147,6 +259,7 @@ public:
     select_row(uintptr_t rid, RowAccess access) {
         auto e = reinterpret_cast<internal_elem *>(rid);
         bool ok = true;
+
         TransProxy row_item = Sto::item(this, item_key_t::row_item_key(e));
 
         if (is_phantom(e, row_item))
@@ -229,6 +342,17 @@ public:
         return sel_return_type(false, false, 0, nullptr);
     }
 
+    // Looks up n keys, as n select_row calls would, with their cache
+    // misses overlapped; returns false if the transaction must abort, and
+    // otherwise sets results[i] to the result for keys[i]
+    bool select_rows(const key_type* keys, size_t n, RowAccess access, sel_return_type* results) {
+        return multi_select(keys, n, access, results);
+    }
+    bool select_rows(const key_type* keys, size_t n, std::initializer_list<column_access_t> accesses,
+                     sel_return_type* results) {
+        return multi_select(keys, n, accesses, results);
+    }
+
     void update_row(uintptr_t rid, value_type *new_row) {
         auto e = reinterpret_cast<internal_elem*>(rid);
         auto row_item = Sto::item(this, item_key_t::row_item_key(e));
@@ -302,8 +426,8 @@ public:
             }
 
         } else {
-            auto e = new internal_elem(key, vptr ? *vptr : value_type(),
-                                       false /*!valid*/);
+            auto e = arena_new<internal_elem>(arena_, key, vptr ? *vptr : value_type(),
+                                              false /*!valid*/);
             lp.value() = e;
 
             node_type *node;
@@ -464,48 +588,18 @@ public:
         };
 
         auto value_callback = [&] (const lcdf::Str& key, internal_elem *e, bool& ret, bool& count) {
-            TransProxy row_item = index_read_my_write ? Sto::item(this, item_key_t::row_item_key(e))
-                                                      : Sto::fresh_item(this, item_key_t::row_item_key(e));
-
-            if (index_read_my_write) {
-                if (has_delete(row_item)) {
-                    ret = true;
-                    count = false;
-                    return true;
-                }
-                if (has_row_update(row_item)) {
-                    if (has_insert(row_item))
-                        ret = callback(key_type(key), e->row_container.row);
-                    else
-                        ret = callback(key_type(key), *(row_item.template raw_write_value<value_type *>()));
-                    return true;
-                }
-            }
-
-            bool ok = true;
-            switch (access) {
-                case RowAccess::ObserveValue:
-                case RowAccess::ObserveExists:
-                    ok = row_item.observe(e->version());
-                    break;
-                case RowAccess::None:
-                    break;
-                default:
-                    always_assert(false, "unsupported access type in range_scan");
-                    break;
-            }
-
-            if (!ok)
+            const value_type *row;
+            if (!scan_access(e, access, row))
                 return false;
 
-            // skip invalid (inserted but yet committed) values, but do not abort
-            if (!e->valid()) {
+            // skip deleted and invalid (inserted but yet committed) values, but do not abort
+            if (!row) {
                 ret = true;
                 count = false;
                 return true;
             }
 
-            ret = callback(key_type(key), e->row_container.row);
+            ret = callback(key_type(key), *row);
             return true;
         };
 
@@ -518,6 +612,84 @@ public:
         return scanner.scan_succeeded_;
     }
 
+    // A range scan that returns rows in batches
+    template <bool Reverse = false>
+    scan_cursor<ordered_index<K, V, DBParams>, Reverse>
+    range_cursor(const key_type& begin, const key_type& end,
+                 RowAccess access, bool phantom_protection = true) {
+        return {*this, begin, end, access, phantom_protection};
+    }
+
+    // Collects the keys and elements of up to n rows from `from` on, for a
+    // scan_cursor batch; prefetches the rows, and the leaf after the last
+    template <bool Reverse>
+    bool scan_batch(const key_type& from, bool inclusive, const key_type& end,
+                    bool phantom_protection, int n,
+                    std::vector<key_type>& keys, std::vector<internal_elem*>& elems) {
+        leaf_type *last = nullptr;
+        auto node_callback = [&] (leaf_type* node, nodeversion_value_type version) {
+            last = node;
+            return ((!phantom_protection) || scan_track_node_version(node, version));
+        };
+        auto value_callback = [&] (const lcdf::Str& key, internal_elem *e, bool& ret, bool&) {
+            prefetch(e);
+            keys.push_back(key_type(key));
+            elems.push_back(e);
+            ret = true;
+            return true;
+        };
+
+        range_scanner<decltype(node_callback), decltype(value_callback), Reverse>
+                scanner(end, node_callback, value_callback, n);
+        if (Reverse)
+            table_.rscan(from, inclusive, scanner, *ti);
+        else
+            table_.scan(from, inclusive, scanner, *ti);
+        if (last)
+            prefetch_leaf(Reverse ? last->prev_ : last->safe_next());
+        return scanner.scan_succeeded_;
+    }
+
+    // Accesses the row of a scanned element. Sets `row` to the row the scan
+    // returns, or to nullptr if the scan skips it; returns false if the
+    // transaction must abort
+    bool scan_access(internal_elem *e, RowAccess access, const value_type*& row) {
+        row = nullptr;
+        TransProxy row_item = index_read_my_write ? Sto::item(this, item_key_t::row_item_key(e))
+                                                  : Sto::fresh_item(this, item_key_t::row_item_key(e));
+
+        if (index_read_my_write) {
+            if (has_delete(row_item))
+                return true;
+            if (has_row_update(row_item)) {
+                if (has_insert(row_item))
+                    row = &e->row_container.row;
+                else
+                    row = row_item.template raw_write_value<value_type *>();
+                return true;
+            }
+        }
+
+        bool ok = true;
+        switch (access) {
+            case RowAccess::ObserveValue:
+            case RowAccess::ObserveExists:
+                ok = row_item.observe(e->version());
+                break;
+            case RowAccess::None:
+                break;
+            default:
+                always_assert(false, "unsupported access type in range_scan");
+                break;
+        }
+
+        if (!ok)
+            return false;
+        if (e->valid())
+            row = &e->row_container.row;
+        return true;
+    }
+
     value_type *nontrans_get(const key_type& k) {
         unlocked_cursor_type lp(table_, k);
         bool found = lp.find_unlocked(*ti);
@@ -539,12 +711,42 @@ public:
                copy_row(e, &v);
             lp.finish(0, *ti);
         } else {
-            internal_elem *e = new internal_elem(k, v, true);
+            internal_elem *e = arena_new<internal_elem>(arena_, k, v, true);
             lp.value() = e;
             lp.finish(1, *ti);
         }
     }
 
+    // checkpointing: the whole tree forms a single range, walked in batches
+    // that resume after the last key; scans must run inside a transaction
+    // (for RCU protection)
+    typedef checkpoint_helpers<value_container_type> ckp_helpers;
+    typedef typename ckp_helpers::tids_type checkpoint_tids_type;
+    static constexpr size_t checkpoint_cells = ckp_helpers::num_versions;
+
+    size_t checkpoint_ranges() const {
+        return 1;
+    }
+
+    template <typename Callback>
+    void checkpoint_scan(size_t range, Callback callback) {
+        range_position cursor;
+        checkpoint_scan(range, cursor, 0, callback);
+    }
+    // Scans up to `limit` rows (0: all) of `range` after `cursor`; returns
+    // false once the range is exhausted
+    template <typename Callback>
+    bool checkpoint_scan(size_t range, range_position& cursor, size_t limit, Callback callback) {
+        assert(range == 0);
+        (void)range;
+        value_type row;
+        checkpoint_tids_type tids;
+        return walk_batch(cursor, limit, [&] (const lcdf::Str& key, internal_elem *e) {
+            if (!e->deleted && ckp_helpers::stable_read(e->row_container, row, tids))
+                callback(key_type(key), row, tids);
+        });
+    }
+
     // TObject interface methods
     bool lock(TransItem& item, Transaction &txn) override {
         assert(!is_internode(item));
@@ -584,6 +786,21 @@ public:
         }
     }
 
+    const volatile uint64_t* version_word(const TransItem& item) override {
+        if (is_internode(item))
+            return nullptr;
+        if constexpr (table_params::track_nodes) {
+            if (is_ttnv(item))
+                return &static_cast<leaf_type*>(get_internode_address(item))->get_aux_tracker()->value();
+        }
+        auto key = item.key<item_key_t>();
+        auto e = key.internal_elem_ptr();
+        if (key.is_row_item())
+            return &e->version().value();
+        else
+            return &e->row_container.version_at(key.cell_num()).value();
+    }
+
     void install(TransItem& item, Transaction& txn) override {
         assert(!is_internode(item));
 
@@ -603,6 +820,8 @@ public:
             if (has_delete(item)) {
                 assert(e->valid() && !e->deleted);
                 e->deleted = true;
+                if (this->log_enabled())
+                    this->log_remove(e->key);
                 txn.set_version(e->version());
                 return;
             }
@@ -615,6 +834,8 @@ public:
                     } else if (has_row_cell(item)) {
                         e->row_container.install_cell(comm);
                     }
+                    if (this->log_enabled())
+                        this->log_commute(e->key, comm);
                 } else {
                     value_type *vptr;
                     if (value_is_small) {
@@ -629,13 +850,19 @@ public:
                         } else {
                             copy_row(e, vptr);
                         }
+                        if (this->log_enabled())
+                            this->log_put(e->key, *vptr);
                     } else if (has_row_cell(item)) {
                         // install only the difference part
                         // not sure if works when there are more than 1 minor version fields
                         // should still work
                         e->row_container.install_cell(0, vptr);
+                        if (this->log_enabled())
+                            this->log_put_cell(e->key, 0, *vptr);
                     }
                 }
+            } else if (this->log_enabled()) {
+                this->log_put(e->key, e->row_container.row);
             }
             txn.set_version_unlock(e->version(), item);
         } else {
@@ -646,6 +873,8 @@ public:
                     comm_type &comm = row_item.template write_value<comm_type>();
                     assert(&comm);
                     e->row_container.install_cell(comm);
+                    if (this->log_enabled())
+                        this->log_commute(e->key, comm, key.cell_num());
                 } else {
                     value_type *vptr;
                     if (value_is_small)
@@ -654,6 +883,8 @@ public:
                         vptr = row_item.template raw_write_value<value_type *>();
 
                     e->row_container.install_cell(key.cell_num(), vptr);
+                    if (this->log_enabled())
+                        this->log_put_cell(e->key, key.cell_num(), *vptr);
                 }
             }
 
@@ -764,8 +995,37 @@ protected:
 
 private:
     table_type table_;
+    // where rows live; the heap if null. Tree nodes stay with masstree's
+    // threadinfo allocator
+    row_arena* arena_;
     uint64_t key_gen_;
 
+    // Calls f(key, e) for up to `limit` elements (0: all) after cursor.key,
+    // then leaves the last key visited there; returns true if the walk
+    // stopped at the limit
+    template <typename F>
+    bool walk_batch(range_position& cursor, size_t limit, F f) {
+        size_t n = 0;
+        auto node_callback = [] (leaf_type*, nodeversion_value_type) {
+            return true;
+        };
+        auto value_callback = [&] (const lcdf::Str& key, internal_elem *e, bool& ret, bool& count) {
+            (void)count;
+            f(key, e);
+            ret = true;
+            if (limit && ++n == limit) {
+                cursor.key.assign(key.data(), key.length());
+                return false;
+            }
+            return true;
+        };
+        range_scanner<decltype(node_callback), decltype(value_callback), false>
+            scanner(Str(), node_callback, value_callback, -1);
+        Str start(cursor.key.data(), cursor.key.length());
+        table_.scan(start, cursor.key.empty(), scanner, *ti);
+        return limit && n == limit;
+    }
+
     static bool
     access_all(std::array<access_t, value_container_type::num_versions>& cell_accesses, std::array<TransItem*, value_container_type::num_versions>& cell_items, value_container_type& row_container) {
         for (size_t idx = 0; idx < cell_accesses.size(); ++idx) {
@@ -802,6 +1062,48 @@ private:
         return (!e->valid() && !has_insert(item));
     }
 
+    // Descends to the keys of each batch in key order, so that lookups of
+    // nearby keys find the nodes they share cached, and prefetches the rows
+    // found; then registers them in one pass.
+    template <typename Access>
+    bool multi_select(const key_type* keys, size_t n, Access access, sel_return_type* results) {
+        if (!INDEX_MULTI_GET)
+            return select_each(*this, keys, n, access, results);
+        for (size_t base = 0; base < n; base += multi_get_batch) {
+            size_t m = std::min(n - base, multi_get_batch);
+            const key_type* k = keys + base;
+            sel_return_type* r = results + base;
+            unsigned order[multi_get_batch];
+            internal_elem* elems[multi_get_batch];
+
+            std::iota(order, order + m, 0u);
+            std::sort(order, order + m, [k] (unsigned a, unsigned b) {
+                return Str(k[a]) < Str(k[b]);
+            });
+            for (size_t i = 0; i != m; ++i) {
+                unsigned j = order[i];
+                unlocked_cursor_type lp(table_, k[j]);
+                if (lp.find_unlocked(*ti)) {
+                    elems[j] = lp.value();
+                    prefetch(&elems[j]->version());
+                } else {
+                    elems[j] = nullptr;
+                    if (!register_internode_version(lp.node(), lp))
+                        return false;
+                    r[j] = sel_return_type(true, false, 0, nullptr);
+                }
+            }
+            for (size_t i = 0; i != m; ++i) {
+                if (elems[i]) {
+                    r[i] = select_row(reinterpret_cast<uintptr_t>(elems[i]), access);
+                    if (!std::get<0>(r[i]))
+                        return false;
+                }
+            }
+        }
+        return true;
+    }
+
     bool register_internode_version(node_type *node, unlocked_cursor_type& cursor) {
         if constexpr (table_params::track_nodes) {
             return ttnv_register_node_read_with_snapshot(node, *cursor.get_aux_tracker());
@@ -884,7 +1186,7 @@ private:
         if (found) {
             internal_elem *el = lp.value();
             lp.finish(-1, *ti);
-            Transaction::rcu_delete(el);
+            arena_rcu_delete(arena_, el);
         } else {
             // XXX is this correct?
             lp.finish(0, *ti);
@@ -895,10 +1197,10 @@ private:
     static uintptr_t get_internode_key(node_type* node) {
         return reinterpret_cast<uintptr_t>(node) | internode_bit;
     }
-    static bool is_internode(TransItem& item) {
+    static bool is_internode(const TransItem& item) {
         return (item.key<uintptr_t>() & internode_bit) != 0;
     }
-    static node_type *get_internode_address(TransItem& item) {
+    static node_type *get_internode_address(const TransItem& item) {
         if (is_internode(item)) {
             return reinterpret_cast<node_type *>(item.key<uintptr_t>() & ~internode_bit);
         } else if (is_ttnv(item)) {
@@ -907,11 +1209,17 @@ private:
         assert(false);
         return nullptr;
     }
+    static void prefetch_item(TransItem& item) {
+        if (is_internode(item) || (table_params::track_nodes && is_ttnv(item)))
+            prefetch(get_internode_address(item));
+        else
+            prefetch(item.key<item_key_t>().internal_elem_ptr());
+    }
 
     static uintptr_t get_ttnv_key(node_type* node) {
         return reinterpret_cast<uintptr_t>(node) | ttnv_bit;
     }
-    static bool is_ttnv(TransItem& item) {
+    static bool is_ttnv(const TransItem& item) {
         return (item.key<uintptr_t>() & ttnv_bit);
     }
 
@@ -930,7 +1238,10 @@ __thread typename ordered_index<K, V, DBParams>::table_params::threadinfo_type
 *ordered_index<K, V, DBParams>::ti;
 
 template <typename K, typename V, typename DBParams>
-class mvcc_ordered_index : public TObject {
+class mvcc_ordered_index : public batched_tobject<mvcc_ordered_index<K, V, DBParams>>, public TLogged {
+    // batched commit calls prefetch_item
+    friend class batched_tobject<mvcc_ordered_index>;
+
 public:
     typedef K key_type;
     typedef V value_type;
@@ -938,6 +1249,13 @@ public:
     typedef typename object_type::history_type history_type;
     typedef commutators::Commutator<value_type> comm_type;
 
+    // A row write stored as a column delta (row_cell_bit): the new row, and
+    // the row the transaction read, which it is written over
+    struct column_write {
+        const value_type* row;
+        const value_type* base;
+    };
+
     static constexpr TransItem::flags_type insert_bit = TransItem::user0_bit;
     static constexpr TransItem::flags_type delete_bit = TransItem::user0_bit << 1u;
     static constexpr TransItem::flags_type row_update_bit = TransItem::user0_bit << 2u;
@@ -993,11 +1311,13 @@ public:
 
     static __thread typename table_params::threadinfo_type *ti;
 
-    mvcc_ordered_index(size_t init_size) {
+    mvcc_ordered_index(size_t init_size, row_arena* arena = nullptr)
+        : arena_(arena) {
         this->table_init();
         (void)init_size;
     }
-    mvcc_ordered_index() {
+    mvcc_ordered_index()
+        : arena_(nullptr) {
         this->table_init();
     }
 
@@ -1011,7 +1331,7 @@ public:
 
     static void thread_init() {
         if (ti == nullptr)
-            ti = threadinfo::make(threadinfo::TI_PROCESS, TThread::id());
+            ti = thread_threadinfo(TThread::id());
         Transaction::tinfo[TThread::id()].trans_start_callback = []() {
             ti->rcu_start();
         };
@@ -1020,6 +1340,16 @@ public:
         };
     }
 
+    // Masstree never frees a threadinfo, so threads that take over a
+    // thread id, such as bulk loaders, reuse the one made for it
+    static typename table_params::threadinfo_type* thread_threadinfo(int threadid) {
+        static typename table_params::threadinfo_type* tis[MAX_THREADS];
+        always_assert(threadid >= 0 && threadid < MAX_THREADS, "bad thread id");
+        if (!tis[threadid])
+            tis[threadid] = threadinfo::make(threadinfo::TI_PROCESS, threadid);
+        return tis[threadid];
+    }
+
     uint64_t gen_key() {
         return fetch_and_add(&key_gen_, 1);
     }
@@ -1060,63 +1390,96 @@ public:
     sel_return_type
     select_row(uintptr_t rid, RowAccess access) {
         auto e = reinterpret_cast<internal_elem *>(rid);
-        TransProxy row_item = Sto::item(this, item_key_t::row_item_key(e));
-
         history_type *h = e->row.find(txn_read_tid());
 
         if (h->status_is(UNUSED)) {
             return sel_return_type(true, false, 0, nullptr);
         }
 
-        if (is_phantom(h, row_item))
-            return sel_return_type(true, false, 0, nullptr);
+        if (Sto::read_only()) {
+            // read-only transactions read their snapshot untracked
+            if (h->status_is(DELETED))
+                return sel_return_type(true, false, 0, nullptr);
+        } else {
+            TransProxy row_item = Sto::item(this, item_key_t::row_item_key(e));
 
-        if (index_read_my_write) {
-            if (has_delete(row_item)) {
+            if (is_phantom(h, row_item))
                 return sel_return_type(true, false, 0, nullptr);
-            }
-            if (has_row_update(row_item)) {
-                value_type *vptr;
-                if (has_insert(row_item)) {
+
+            if (index_read_my_write) {
+                if (has_delete(row_item)) {
+                    return sel_return_type(true, false, 0, nullptr);
+                }
+                if (has_row_update(row_item)) {
+                    value_type *vptr;
+                    if (has_insert(row_item)) {
 #if SAFE_FLATTEN
-                    vptr = h->vp_safe_flatten();
-                    if (vptr == nullptr)
-                        return { false, false, 0, nullptr };
+                        vptr = h->vp_safe_flatten();
+                        if (vptr == nullptr)
+                            return { false, false, 0, nullptr };
 #else
-                    vptr = h->vp();
+                        vptr = h->vp();
 #endif
-                } else {
-                    vptr = row_item.template raw_write_value<value_type *>();
+                    } else {
+                        vptr = row_item.template raw_write_value<value_type *>();
+                    }
+                    assert(vptr);
+                    return sel_return_type(true, true, rid, vptr);
                 }
-                assert(vptr);
-                return sel_return_type(true, true, rid, vptr);
             }
+
+            if (access != RowAccess::None)
+                MvAccess::template read<value_type>(row_item, h);
         }
 
         if (access != RowAccess::None) {
-            MvAccess::template read<value_type>(row_item, h);
 #if SAFE_FLATTEN
             auto vp = h->vp_safe_flatten();
             if (vp == nullptr)
                 return { false, false, 0, nullptr };
 #else
-            auto vp = h->vp();
+            auto vp = h->vp_txn();
             assert(vp);
 #endif
+            if constexpr (mv_column_deltas<value_type>) {
+                if (!Sto::read_only())
+                    remember_read_row(e, vp);
+            }
             return sel_return_type(true, true, rid, vp);
         } else {
             return sel_return_type(true, true, rid, nullptr);
         }
     }
 
+    // Versions hold whole rows, so any column access reads the row; updates
+    // that change few columns are stored as column deltas regardless
     sel_return_type
-    select_row(uintptr_t, std::initializer_list<column_access_t>) {
-        always_assert(false, "Not implemented in MVCC, use split table instead.");
-        return { false, false, 0, nullptr };
+    select_row(uintptr_t rid, std::initializer_list<column_access_t> accesses) {
+        return select_row(rid, accesses.size() ? RowAccess::UpdateValue : RowAccess::None);
+    }
+
+    // Looks up n keys, as n select_row calls would, with their cache
+    // misses overlapped; returns false if the transaction must abort, and
+    // otherwise sets results[i] to the result for keys[i]
+    bool select_rows(const key_type* keys, size_t n, RowAccess access, sel_return_type* results) {
+        return multi_select(keys, n, access, results);
+    }
+    bool select_rows(const key_type* keys, size_t n, std::initializer_list<column_access_t> accesses,
+                     sel_return_type* results) {
+        return multi_select(keys, n, accesses, results);
     }
 
     void update_row(uintptr_t rid, value_type* new_row) {
         auto row_item = Sto::item(this, item_key_t::row_item_key(reinterpret_cast<internal_elem *>(rid)));
+        if constexpr (mv_column_deltas<value_type>) {
+            if (has_row_cell(row_item)) {
+                const value_type* base = row_item.has_write()
+                    ? row_item.template write_value<column_write>().base
+                    : row_item.item().template xwrite_value<const value_type*>();
+                row_item.add_write(column_write{new_row, base});
+                return;
+            }
+        }
         // TODO: address this extra copying issue
         row_item.add_write(new_row);
         // Just update the pointer, don't set the actual write flag
@@ -1126,6 +1489,8 @@ public:
 
     void update_row(uintptr_t rid, const comm_type &comm) {
         auto row_item = Sto::item(this, item_key_t::row_item_key(reinterpret_cast<internal_elem *>(rid)));
+        if constexpr (mv_column_deltas<value_type>)
+            row_item.clear_flags(row_cell_bit);
         // TODO: address this extra copying issue
         row_item.add_commute(comm);
     }
@@ -1164,6 +1529,11 @@ public:
             }
 
             if (overwrite) {
+                // a column write's buffer doesn't hold a whole row
+                if (is_column_write(row_item.item()))
+                    row_item.clear_write();
+                if constexpr (mv_column_deltas<value_type>)
+                    row_item.clear_flags(row_cell_bit);
                 row_item.add_write(*vptr);
             } else {
                 // TODO: This now acts like a full read of the value
@@ -1173,7 +1543,7 @@ public:
             }
 
         } else {
-            auto e = new internal_elem(key);
+            auto e = arena_new<internal_elem>(arena_, key);
             lp.value() = e;
 
             node_type *node;
@@ -1236,7 +1606,7 @@ public:
             if (h->status_is(DELETED))
                 return del_return_type(true, false);
             row_item.add_write(0);
-            row_item.add_flags(delete_bit);
+            row_item.clear_flags(row_cell_bit).add_flags(delete_bit);
         } else {
             if (!register_internode_version(lp.node(), lp.full_version_value()))
                 goto abort;
@@ -1258,7 +1628,6 @@ public:
     template <typename Callback, bool Reverse>
     bool range_scan(const key_type& begin, const key_type& end, Callback callback,
                     RowAccess access, bool phantom_protection = true, int limit = -1) {
-        (void)access;  // TODO: Scan ignores writes right now
         assert((limit == -1) || (limit > 0));
         auto node_callback = [&] (leaf_type* node,
                                   typename unlocked_cursor_type::nodeversion_value_type version) {
@@ -1266,51 +1635,112 @@ public:
         };
 
         auto value_callback = [&] (const lcdf::Str& key, internal_elem *e, bool& ret, bool& count) {
-            auto h = e->row.find(txn_read_tid());
+            const value_type *row;
+            if (!scan_access(e, access, row))
+                return false;
+
             // skip invalid (inserted but yet committed) and/or deleted values, but do not abort
-            if (h->status_is(DELETED)) {
+            if (!row) {
                 ret = true;
                 count = false;
                 return true;
             }
 
+            ret = callback(key_type(key), *row);
+            return true;
+        };
+
+        range_scanner<decltype(node_callback), decltype(value_callback), Reverse>
+                scanner(end, node_callback, value_callback, limit);
+        if (Reverse)
+            table_.rscan(begin, true, scanner, *ti);
+        else
+            table_.scan(begin, true, scanner, *ti);
+        return scanner.scan_succeeded_;
+    }
+
+    // A range scan that returns rows in batches
+    template <bool Reverse = false>
+    scan_cursor<mvcc_ordered_index<K, V, DBParams>, Reverse>
+    range_cursor(const key_type& begin, const key_type& end,
+                 RowAccess access, bool phantom_protection = true) {
+        return {*this, begin, end, access, phantom_protection};
+    }
+
+    // Collects the keys and elements of up to n rows from `from` on, for a
+    // scan_cursor batch; prefetches the rows, and the leaf after the last
+    template <bool Reverse>
+    bool scan_batch(const key_type& from, bool inclusive, const key_type& end,
+                    bool phantom_protection, int n,
+                    std::vector<key_type>& keys, std::vector<internal_elem*>& elems) {
+        leaf_type *last = nullptr;
+        auto node_callback = [&] (leaf_type* node, nodeversion_value_type version) {
+            last = node;
+            return ((!phantom_protection) || register_internode_version(node, version));
+        };
+        auto value_callback = [&] (const lcdf::Str& key, internal_elem *e, bool& ret, bool&) {
+            prefetch(e);
+            keys.push_back(key_type(key));
+            elems.push_back(e);
+            ret = true;
+            return true;
+        };
+
+        range_scanner<decltype(node_callback), decltype(value_callback), Reverse>
+                scanner(end, node_callback, value_callback, n);
+        if (Reverse)
+            table_.rscan(from, inclusive, scanner, *ti);
+        else
+            table_.scan(from, inclusive, scanner, *ti);
+        if (last)
+            prefetch_leaf(Reverse ? last->prev_ : last->safe_next());
+        return scanner.scan_succeeded_;
+    }
+
+    // Reads the row of a scanned element at the transaction's timestamp,
+    // tracking the read unless `access` is RowAccess::None. Sets `row` to
+    // the row the scan returns, or to nullptr if the scan skips it; returns
+    // false if the transaction must abort
+    bool scan_access(internal_elem *e, RowAccess access, const value_type*& row) {
+        row = nullptr;
+        auto h = e->row.find(txn_read_tid());
+        if (h->status_is(DELETED))
+            return true;
+
+        // read-only transactions read their snapshot untracked
+        if (!Sto::read_only()) {
             TransProxy row_item = index_read_my_write ? Sto::item(this, item_key_t::row_item_key(e))
                                                       : Sto::fresh_item(this, item_key_t::row_item_key(e));
 
             if (index_read_my_write) {
-                if (has_delete(row_item)) {
-                    ret = true;
-                    count = false;
+                if (has_delete(row_item))
                     return true;
-                }
                 if (has_row_update(row_item)) {
-                    ret = callback(key_type(key), *(row_item.template raw_write_value<value_type *>()));
+                    row = row_item.template raw_write_value<value_type *>();
                     return true;
                 }
             }
 
-            MvAccess::template read<value_type>(row_item, h);
+            switch (access) {
+                case RowAccess::ObserveValue:
+                case RowAccess::ObserveExists:
+                    MvAccess::template read<value_type>(row_item, h);
+                    break;
+                case RowAccess::None:
+                    break;
+                default:
+                    always_assert(false, "unsupported access type in range_scan");
+                    break;
+            }
+        }
 
 #if SAFE_FLATTEN
-            auto vptr = h->vp_safe_flatten();
-            if (vptr == nullptr) {
-                ret = false;
-                return false;
-            }
+        row = h->vp_safe_flatten();
+        return row != nullptr;
 #else
-            auto vptr = h->vp();
+        row = h->vp_txn();
+        return true;
 #endif
-            ret = callback(key_type(key), *vptr);
-            return true;
-        };
-
-        range_scanner<decltype(node_callback), decltype(value_callback), Reverse>
-                scanner(end, node_callback, value_callback, limit);
-        if (Reverse)
-            table_.rscan(begin, true, scanner, *ti);
-        else
-            table_.scan(begin, true, scanner, *ti);
-        return scanner.scan_succeeded_;
     }
 
     value_type *nontrans_get(const key_type& k) {
@@ -1331,13 +1761,55 @@ public:
             e->row.nontrans_access() = v;
             lp.finish(0, *ti);
         } else {
-            internal_elem *e = new internal_elem(k, v);
+            internal_elem *e = arena_new<internal_elem>(arena_, k, v);
             e->row.nontrans_access() = v;
             lp.value() = e;
             lp.finish(1, *ti);
         }
     }
 
+    // checkpointing: the whole tree forms a single range, walked in batches
+    // that resume after the last key, each inside a transaction that
+    // provides the snapshot it copies
+    typedef std::array<TransactionTid::type, 1> checkpoint_tids_type;
+    static constexpr size_t checkpoint_cells = 1;
+
+    size_t checkpoint_ranges() const {
+        return 1;
+    }
+
+    template <typename Callback>
+    void checkpoint_scan(size_t range, Callback callback) {
+        range_position cursor;
+        checkpoint_scan(range, cursor, 0, callback);
+    }
+    // Scans up to `limit` rows (0: all) of `range` after `cursor`; returns
+    // false once the range is exhausted
+    template <typename Callback>
+    bool checkpoint_scan(size_t range, range_position& cursor, size_t limit, Callback callback) {
+        assert(range == 0);
+        (void)range;
+        auto rtid = txn_read_tid();
+        return walk_batch(cursor, limit, [&] (const lcdf::Str& key, internal_elem *e) {
+            history_type *h = e->row.find(rtid);
+            if (!h->status_is(UNUSED) && !h->status_is(DELETED))
+                callback(key_type(key), h->v(), checkpoint_tids_type{{h->wtid()}});
+        });
+    }
+
+    // trim sweeps (mvcc_trim_sweeper) walk the checkpoint ranges in batches
+    // of up to `limit` rows, adding the number of versions unlinked to
+    // `trimmed`; returns false once the range is exhausted. Each batch runs
+    // inside a transaction, which keeps the rows walked alive.
+    bool trim_scan(size_t range, range_position& cursor, size_t limit, size_t& trimmed) {
+        assert(range == 0);
+        (void)range;
+        auto tid = Transaction::mvcc_trim_tid();
+        return walk_batch(cursor, limit, [&] (const lcdf::Str&, internal_elem *e) {
+            trimmed += e->row.trim(tid);
+        });
+    }
+
     // TObject interface methods
     bool lock(TransItem& item, Transaction& txn) override {
         assert(!is_internode(item));
@@ -1365,6 +1837,10 @@ public:
                     Sto::commit_tid(), &e->row, nullptr, hprev);
                 h->status_delete();
                 h->set_delete_cb(this, _delete_cb, e);
+            } else if (is_column_write(item)) {
+                auto& w = item.template write_value<column_write>();
+                h = e->row.new_history(
+                    Sto::commit_tid(), &e->row, w.row, w.base, hprev);
             } else {
                 h = e->row.new_history(
                     Sto::commit_tid(), &e->row, wval, hprev);
@@ -1407,6 +1883,8 @@ public:
         auto e = key.internal_elem_ptr();
         auto h = item.template write_value<history_type*>();
 
+        if (this->log_enabled())
+            log_history(e->key, h);
         e->row.cp_install(h);
     }
 
@@ -1500,8 +1978,37 @@ protected:
 
 private:
     table_type table_;
+    // where rows live; the heap if null. Tree nodes stay with masstree's
+    // threadinfo allocator
+    row_arena* arena_;
     uint64_t key_gen_;
 
+    // Calls f(key, e) for up to `limit` elements (0: all) after cursor.key,
+    // then leaves the last key visited there; returns true if the walk
+    // stopped at the limit
+    template <typename F>
+    bool walk_batch(range_position& cursor, size_t limit, F f) {
+        size_t n = 0;
+        auto node_callback = [] (leaf_type*, nodeversion_value_type) {
+            return true;
+        };
+        auto value_callback = [&] (const lcdf::Str& key, internal_elem *e, bool& ret, bool& count) {
+            (void)count;
+            f(key, e);
+            ret = true;
+            if (limit && ++n == limit) {
+                cursor.key.assign(key.data(), key.length());
+                return false;
+            }
+            return true;
+        };
+        range_scanner<decltype(node_callback), decltype(value_callback), false>
+            scanner(Str(), node_callback, value_callback, -1);
+        Str start(cursor.key.data(), cursor.key.length());
+        table_.scan(start, cursor.key.empty(), scanner, *ti);
+        return limit && n == limit;
+    }
+
     static bool
     access_all(std::array<access_t, internal_elem::num_versions>&, std::array<TransItem*, internal_elem::num_versions>&, internal_elem*) {
         always_assert(false, "Not implemented.");
@@ -1527,8 +2034,86 @@ private:
     static bool is_phantom(const history_type *h, const TransItem& item) {
         return (h->status_is(DELETED) && !has_insert(item));
     }
+    static bool is_column_write(const TransItem& item) {
+        return mv_column_deltas<value_type> && has_row_cell(item) && item.has_write();
+    }
+
+    // Remembers the row a transaction read, which update_row writes over
+    void remember_read_row(internal_elem* e, const value_type* vp) {
+        TransProxy row_item = Sto::item(this, item_key_t::row_item_key(e));
+        if (!row_item.has_write()) {
+            row_item.add_flags(row_cell_bit);
+            row_item.item().template xwrite_value<const value_type*>() = vp;
+        }
+    }
+
+    void log_history(const key_type& key, history_type *h) const {
+        if (h->status_is(DELETED))
+            this->log_remove(key);
+        else if (log_column_delta(key, h))
+            return;
+        else if (h->status_is(DELTA))
+            this->log_commute(key, h->c());
+        else
+            this->log_put(key, h->v());
+    }
+
+    bool log_column_delta(const key_type& key, history_type *h) const {
+        if constexpr (mv_column_deltas<value_type>) {
+            if (h->is_column_delta()) {
+                this->log_patch(key, h->patch());
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Descends to the keys of each batch in key order, so that lookups of
+    // nearby keys find the nodes they share cached, and prefetches the rows
+    // found; then registers them in one pass.
+    template <typename Access>
+    bool multi_select(const key_type* keys, size_t n, Access access, sel_return_type* results) {
+        if (!INDEX_MULTI_GET)
+            return select_each(*this, keys, n, access, results);
+        for (size_t base = 0; base < n; base += multi_get_batch) {
+            size_t m = std::min(n - base, multi_get_batch);
+            const key_type* k = keys + base;
+            sel_return_type* r = results + base;
+            unsigned order[multi_get_batch];
+            internal_elem* elems[multi_get_batch];
+
+            std::iota(order, order + m, 0u);
+            std::sort(order, order + m, [k] (unsigned a, unsigned b) {
+                return Str(k[a]) < Str(k[b]);
+            });
+            for (size_t i = 0; i != m; ++i) {
+                unsigned j = order[i];
+                unlocked_cursor_type lp(table_, k[j]);
+                if (lp.find_unlocked(*ti)) {
+                    elems[j] = lp.value();
+                    prefetch(&elems[j]->row);
+                } else {
+                    elems[j] = nullptr;
+                    if (!register_internode_version(lp.node(), lp.full_version_value()))
+                        return false;
+                    r[j] = sel_return_type(true, false, 0, nullptr);
+                }
+            }
+            for (size_t i = 0; i != m; ++i) {
+                if (elems[i]) {
+                    r[i] = select_row(reinterpret_cast<uintptr_t>(elems[i]), access);
+                    if (!std::get<0>(r[i]))
+                        return false;
+                }
+            }
+        }
+        return true;
+    }
 
     bool register_internode_version(node_type *node, nodeversion_value_type nodeversion) {
+        // snapshot reads need no phantom protection
+        if (Sto::read_only())
+            return true;
         TransProxy item = Sto::item(this, get_internode_key(node));
             return item.add_read(nodeversion);
     }
@@ -1551,7 +2136,7 @@ private:
         if (found) {
             internal_elem *el = lp.value();
             lp.finish(-1, *ti);
-            Transaction::rcu_delete(el);
+            arena_rcu_delete(arena_, el);
         } else {
             // XXX is this correct?
             lp.finish(0, *ti);
@@ -1569,7 +2154,7 @@ private:
         if (found) {
             if ((lp.value() == el) && el->row.is_head(hp)) {
                 lp.finish(-1, *ip->ti);
-                Transaction::rcu_delete(el);
+                arena_rcu_delete(ip->arena_, el);
             } else {
                 lp.finish(0, *ip->ti);
             }
@@ -1588,6 +2173,12 @@ private:
         assert(is_internode(item));
         return reinterpret_cast<node_type *>(item.key<uintptr_t>() & ~internode_bit);
     }
+    static void prefetch_item(TransItem& item) {
+        if (is_internode(item))
+            prefetch(get_internode_address(item));
+        else
+            prefetch(item.key<item_key_t>().internal_elem_ptr());
+    }
 };
 
 template <typename K, typename V, typename DBParams>
@@ -23,7 +23,8 @@ public:
         return start_tsc_;
     }
 
-    void finish(size_t num_txns) {
+    // returns the throughput in txns/sec
+    double finish(size_t num_txns) {
         end_tsc_ = read_tsc();
         if (spawn_perf_) {
             bool ok = Profiler::stop(perf_pid_);
@@ -34,10 +35,12 @@ public:
         double elapsed_time = (double) elapsed_tsc / constants::million / constants::processor_tsc_frequency;
         std::cout << "Elapsed time: " << elapsed_tsc << " ticks" << std::endl;
         std::cout << "Real time: " << elapsed_time << " ms" << std::endl;
-        std::cout << "Throughput: " << (double) num_txns / (elapsed_time / 1000.0) << " txns/sec" << std::endl;
+        double throughput = (double) num_txns / (elapsed_time / 1000.0);
+        std::cout << "Throughput: " << throughput << " txns/sec" << std::endl;
 
         // print STO stats
         Transaction::print_stats();
+        return throughput;
     }
 
 private:
@@ -0,0 +1,188 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <unistd.h>
+
+#include "DB_index.hh"
+
+// Epoch-driven trimming of MVCC version chains.
+//
+// MvObject::trim runs when an abort or a long find() touches a chain
+// (MVCC_TRIMMING), so rows that stop being written and read keep the
+// versions below the trim watermark until something walks them. A sweeper
+// walks the tables range by range as checkpoints do, in batches that each
+// run in their own transaction, and trims every row's chain. Its thread
+// sweeps a bounded number of rows per epoch, resuming where it stopped.
+
+namespace bench {
+
+// Indexes that can be swept: the MVCC ones
+template <typename Index, typename = void>
+struct has_trim_scan : std::false_type {};
+template <typename Index>
+struct has_trim_scan<Index, std::void_t<decltype(std::declval<Index&>().trim_scan(
+        size_t(), std::declval<range_position&>(), size_t(), std::declval<size_t&>()))>>
+    : std::true_type {};
+
+// Type-erased view of a swept table
+class trimmed_table {
+public:
+    virtual ~trimmed_table() {}
+
+    virtual size_t ranges() const = 0;
+    virtual void thread_init() = 0;
+    // Trims up to `limit` rows of `range` from `cursor`, adding the number
+    // of versions unlinked to `trimmed`; returns false once the range is
+    // exhausted
+    virtual bool trim(size_t range, range_position& cursor, size_t limit, size_t& trimmed) = 0;
+};
+
+template <typename Index>
+class trimmed_table_impl : public trimmed_table {
+public:
+    explicit trimmed_table_impl(Index& index)
+        : index_(index) {}
+
+    size_t ranges() const override {
+        return index_.checkpoint_ranges();
+    }
+    void thread_init() override {
+        index_.thread_init();
+    }
+    bool trim(size_t range, range_position& cursor, size_t limit, size_t& trimmed) override {
+        return index_.trim_scan(range, cursor, limit, trimmed);
+    }
+
+private:
+    Index& index_;
+};
+
+// Sweeps a set of tables on its own thread, `epoch_rows` rows (buckets,
+// for unordered tables) per epoch. The epoch advancer must be running.
+// Every batch of `batch_rows` rows runs in its own transaction, so a sweep
+// holds back reclamation only for as long as one batch takes.
+class mvcc_trim_sweeper {
+public:
+    static constexpr size_t batch_rows = 1024;
+
+    explicit mvcc_trim_sweeper(size_t epoch_rows = 64 * batch_rows)
+        : epoch_rows_(epoch_rows), table_(0), range_(0),
+          run_(false), sweeps_(0), trimmed_(0) {
+        always_assert(epoch_rows > 0, "trim sweeps need a row budget");
+    }
+    ~mvcc_trim_sweeper() {
+        stop();
+    }
+
+    // Adds `index` if it keeps versions; other indexes are ignored
+    template <typename Index>
+    void add(Index& index) {
+        if constexpr (has_trim_scan<Index>::value)
+            tables_.emplace_back(new trimmed_table_impl<Index>(index));
+        else
+            (void)index;
+    }
+    size_t size() const {
+        return tables_.size();
+    }
+
+    // Completes the current sweep of every table on the calling thread,
+    // which needs a thread id and the tables' thread_init(); returns the
+    // number of versions unlinked
+    size_t sweep() {
+        size_t n = 0;
+        size_t sweeps = sweeps_;
+        while (sweeps_ == sweeps)
+            n += sweep_rows(batch_rows);
+        return n;
+    }
+
+    // Continues the current sweep for up to `budget` rows, stopping early
+    // if it completes; returns the number of versions unlinked
+    size_t sweep_rows(size_t budget) {
+        if (tables_.empty()) {
+            ++sweeps_;
+            return 0;
+        }
+        size_t n = 0;
+        while (budget) {
+            trimmed_table& t = *tables_[table_];
+            bool more = false;
+            if (range_ < t.ranges()) {
+                size_t limit = std::min(budget, batch_rows);
+                TransactionGuard guard;
+                more = t.trim(range_, cursor_, limit, n);
+                budget -= limit;
+            }
+            if (more)
+                continue;
+            cursor_ = range_position();
+            if (++range_ < t.ranges())
+                continue;
+            range_ = 0;
+            if (++table_ == tables_.size()) {
+                table_ = 0;
+                ++sweeps_;
+                break;
+            }
+        }
+        trimmed_ += n;
+        return n;
+    }
+
+    void start(int threadid) {
+        // reclamation threads take their ids from the top of the id space
+        always_assert(threadid >= 0 && threadid < MAX_THREADS - STO_RCU_WORKERS,
+                      "bad trim sweeper thread id");
+        run_ = true;
+        thread_ = std::thread(&mvcc_trim_sweeper::run, this, threadid);
+    }
+    void stop() {
+        run_ = false;
+        if (thread_.joinable())
+            thread_.join();
+    }
+
+    size_t sweeps() const {
+        return sweeps_;
+    }
+    size_t versions_trimmed() const {
+        return trimmed_;
+    }
+
+private:
+    std::vector<std::unique_ptr<trimmed_table>> tables_;
+    size_t epoch_rows_;
+    // where the current sweep resumes
+    size_t table_;
+    size_t range_;
+    range_position cursor_;
+    std::thread thread_;
+    std::atomic<bool> run_;
+    std::atomic<size_t> sweeps_;
+    std::atomic<size_t> trimmed_;
+
+    void run(int threadid) {
+        TThread::set_id(threadid);
+        for (auto& t : tables_)
+            t->thread_init();
+        auto epoch = Transaction::global_epochs.global_epoch.load();
+        while (run_) {
+            auto e = Transaction::global_epochs.global_epoch.load();
+            if (e != epoch) {
+                epoch = e;
+                sweep_rows(epoch_rows_);
+            } else
+                usleep(std::max(Transaction::get_epoch_cycle() / 4, 100u));
+        }
+        Transaction::rcu_thread_exit();
+    }
+};
+
+} // namespace bench
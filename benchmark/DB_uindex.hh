@@ -3,7 +3,11 @@
 namespace bench {
 // unordered index implemented as hashtable
 template <typename K, typename V, typename DBParams>
-class unordered_index : public index_common<K, V, DBParams>, public TObject {
+class unordered_index : public index_common<K, V, DBParams>,
+                        public batched_tobject<unordered_index<K, V, DBParams>>, public TLogged {
+    // batched commit calls prefetch_item
+    friend class batched_tobject<unordered_index>;
+
 public:
     // Premable
     using C = index_common<K, V, DBParams>;
@@ -36,7 +40,7 @@ public:
 
     typedef typename get_occ_version<DBParams>::type bucket_version_type;
 
-    typedef std::hash<K> Hash;
+    typedef typename std::conditional<BUCKET_FINGERPRINTS, xxh_hash<K>, std::hash<K>>::type Hash;
     typedef std::equal_to<K> Pred;
 
     // our hashtable is an array of linked lists.
@@ -65,24 +69,23 @@ public:
     ~unordered_index() override {}
 
 private:
-    struct bucket_entry {
-        internal_elem *head;
-        // this is the bucket version number, which is incremented on insert
-        // we use it to make sure that an unsuccessful key lookup will still be
-        // unsuccessful at commit time (because this will always be true if no
-        // new inserts have occurred in this bucket)
-        bucket_version_type version;
-        bucket_entry() : head(nullptr), version(0) {}
-    };
-
-    typedef std::vector<bucket_entry> MapType;
-    // this is the hashtable itself, an array of bucket_entry's
+    typedef bucket_map<internal_elem, key_type, bucket_version_type, Hash, Pred,
+                       BUCKET_FINGERPRINTS> MapType;
+    // a bucket's version is incremented on insert; we use it to make sure
+    // that an unsuccessful key lookup will still be unsuccessful at commit
+    // time (because this will always be true if no new inserts have
+    // occurred in this bucket)
+    typedef typename MapType::bucket bucket_entry;
+    // where rows and buckets live; the heap if null
+    row_arena* arena_;
+    // this is the hashtable itself, which grows as rows are inserted
     MapType map_;
-    Hash hasher_;
-    Pred pred_;
 
     uint64_t key_gen_;
 
+    // number of initial buckets per checkpoint range
+    static constexpr size_t checkpoint_range_buckets = 1 << 14;
+
     // used to mark whether a key is a bucket (for bucket version checks)
     // or a pointer (which will always have the lower 3 bits as 0)
     static constexpr uintptr_t bucket_bit = C::item_key_tag;
@@ -100,19 +103,14 @@ public:
         = split_version_helpers<index_t>::template extract_item_list<T>;
 
     // Main constructor
-    unordered_index(size_t size, Hash h = Hash(), Pred p = Pred()) :
-            map_(), hasher_(h), pred_(p), key_gen_(0) {
-        map_.resize(size);
-    }
+    unordered_index(size_t size, row_arena* arena = nullptr, Hash h = Hash(), Pred p = Pred()) :
+            arena_(arena), map_(size, arena, h, p), key_gen_(0) {}
 
     inline size_t hash(const key_type& k) const {
-        return hasher_(k);
+        return map_.hash(k);
     }
     inline size_t nbuckets() const {
-        return map_.size();
-    }
-    inline size_t find_bucket_idx(const key_type& k) const {
-        return hash(k) % nbuckets();
+        return map_.nbuckets();
     }
 
     uint64_t gen_key() {
@@ -121,10 +119,10 @@ public:
 
     sel_return_type
     select_row(const key_type& k, RowAccess access) {
-        bucket_entry& buck = map_[find_bucket_idx(k)];
-        bucket_version_type buck_vers = buck.version;
-        fence();
-        internal_elem *e = find_in_bucket(buck, k);
+        size_t h = hash(k);
+        bucket_version_type buck_vers;
+        bucket_entry& buck = map_.read_bucket(h, buck_vers);
+        internal_elem *e = find_in_bucket(buck, k, h);
 
         if (e != nullptr) {
             return select_row(reinterpret_cast<uintptr_t>(e), access);
@@ -138,10 +136,10 @@ public:
 
     sel_return_type
     select_row(const key_type& k, std::initializer_list<column_access_t> accesses) {
-        bucket_entry& buck = map_[find_bucket_idx(k)];
-        bucket_version_type buck_vers = buck.version;
-        fence();
-        internal_elem *e = find_in_bucket(buck, k);
+        size_t h = hash(k);
+        bucket_version_type buck_vers;
+        bucket_entry& buck = map_.read_bucket(h, buck_vers);
+        internal_elem *e = find_in_bucket(buck, k, h);
 
         if (e != nullptr) {
             return select_row(reinterpret_cast<uintptr_t>(e), accesses);
@@ -157,6 +155,7 @@ public:
     select_row(uintptr_t rid, RowAccess access) {
         auto e = reinterpret_cast<internal_elem*>(rid);
         bool ok = true;
+
         TransProxy row_item = Sto::item(this, item_key_t::row_item_key(e));
 
         if (is_phantom(e, row_item))
@@ -231,6 +230,17 @@ public:
         return sel_return_type(true, true, rid, &(e->row_container.row));
     }
 
+    // Looks up n keys, as n select_row calls would, with their cache
+    // misses overlapped; returns false if the transaction must abort, and
+    // otherwise sets results[i] to the result for keys[i]
+    bool select_rows(const key_type* keys, size_t n, RowAccess access, sel_return_type* results) {
+        return multi_select(keys, n, access, results);
+    }
+    bool select_rows(const key_type* keys, size_t n, std::initializer_list<column_access_t> accesses,
+                     sel_return_type* results) {
+        return multi_select(keys, n, accesses, results);
+    }
+
     void update_row(uintptr_t rid, value_type *new_row) {
         auto e = reinterpret_cast<internal_elem*>(rid);
         auto row_item = Sto::item(this, item_key_t::row_item_key(e));
@@ -245,10 +255,10 @@ public:
 
     ins_return_type
     insert_row(const key_type& k, value_type *vptr, bool overwrite = false) {
-        bucket_entry& buck = map_[find_bucket_idx(k)];
-
-        buck.version.lock_exclusive();
-        internal_elem* e = find_in_bucket(buck, k);
+        size_t h = hash(k);
+        map_.grow();
+        bucket_entry& buck = map_.lock_bucket(h);
+        internal_elem* e = find_in_bucket(buck, k, h);
 
         if (e) {
             buck.version.unlock_exclusive();
@@ -280,8 +290,7 @@ public:
         } else {
             // insert the new row to the table and take note of bucket version changes
             auto buck_vers_0 = bucket_version_type(buck.version.unlocked_value());
-            insert_in_bucket(buck, k, vptr, false);
-            internal_elem *new_head = buck.head;
+            internal_elem *new_head = insert_in_bucket(buck, k, h, vptr, false);
             auto buck_vers_1 = bucket_version_type(buck.version.unlocked_value());
 
             buck.version.unlock_exclusive();
@@ -305,11 +314,11 @@ public:
     // until commit time
     del_return_type
     delete_row(const key_type& k) {
-        bucket_entry& buck = map_[find_bucket_idx(k)];
-        bucket_version_type buck_vers = buck.version;
-        fence();
+        size_t h = hash(k);
+        bucket_version_type buck_vers;
+        bucket_entry& buck = map_.read_bucket(h, buck_vers);
 
-        internal_elem* e = find_in_bucket(buck, k);
+        internal_elem* e = find_in_bucket(buck, k, h);
         if (e) {
             auto item = Sto::item(this, item_key_t::row_item_key(e));
             bool valid = e->valid();
@@ -349,27 +358,55 @@ public:
 
     // non-transactional methods
     value_type* nontrans_get(const key_type& k) {
-        bucket_entry& buck = map_[find_bucket_idx(k)];
-        internal_elem* e = find_in_bucket(buck, k);
+        internal_elem* e = map_.nontrans_find(k);
         if (e == nullptr)
             return nullptr;
         return &(e->row_container.row);
     }
 
     void nontrans_put(const key_type& k, const value_type& v) {
-        bucket_entry& buck = map_[find_bucket_idx(k)];
-        buck.version.lock_exclusive();
-        internal_elem *e = find_in_bucket(buck, k);
+        size_t h = hash(k);
+        map_.grow();
+        bucket_entry& buck = map_.lock_bucket(h);
+        internal_elem *e = find_in_bucket(buck, k, h);
         if (e == nullptr) {
-            internal_elem *new_head = new internal_elem(k, v, true);
-            new_head->next = buck.head;
-            buck.head = new_head;
+            map_.link(buck, arena_new<internal_elem>(arena_, k, v, true), h);
         } else {
             copy_row(e, &v);
         }
         buck.version.unlock_exclusive();
     }
 
+    // checkpointing: the table is scanned in independent ranges of buckets;
+    // scans must run inside a transaction (for RCU protection)
+    typedef checkpoint_helpers<value_container_type> ckp_helpers;
+    typedef typename ckp_helpers::tids_type checkpoint_tids_type;
+    static constexpr size_t checkpoint_cells = ckp_helpers::num_versions;
+
+    size_t checkpoint_ranges() const {
+        return map_.scan_ranges(checkpoint_range_buckets);
+    }
+
+    template <typename Callback>
+    void checkpoint_scan(size_t range, Callback callback) {
+        range_position cursor;
+        checkpoint_scan(range, cursor, 0, callback);
+    }
+    // Scans up to `limit` buckets (0: all) of `range` from `cursor`;
+    // returns false once the range is exhausted
+    template <typename Callback>
+    bool checkpoint_scan(size_t range, range_position& cursor, size_t limit, Callback callback) {
+        value_type row;
+        checkpoint_tids_type tids;
+        size_t count = limit ? limit : checkpoint_range_buckets;
+        bool more = map_.scan(range, checkpoint_range_buckets, cursor.bucket, count, [&] (internal_elem* e) {
+            if (!e->deleted && ckp_helpers::stable_read(e->row_container, row, tids))
+                callback(e->key, row, tids);
+        });
+        cursor.bucket += count;
+        return more;
+    }
+
     // TObject interface methods
     bool lock(TransItem& item, Transaction& txn) override {
         assert(!is_bucket(item));
@@ -396,6 +433,17 @@ public:
         }
     }
 
+    const volatile uint64_t* version_word(const TransItem& item) override {
+        if (is_bucket(item))
+            return &bucket_address(item)->version.value();
+        auto key = item.key<item_key_t>();
+        auto e = key.internal_elem_ptr();
+        if (key.is_row_item())
+            return &e->version().value();
+        else
+            return &e->row_container.version_at(key.cell_num()).value();
+    }
+
     void install(TransItem& item, Transaction& txn) override {
         assert(!is_bucket(item));
         auto key = item.key<item_key_t>();
@@ -406,6 +454,8 @@ public:
                 assert(e->valid() && !e->deleted);
                 e->deleted = true;
                 fence();
+                if (this->log_enabled())
+                    this->log_remove(e->key);
                 txn.set_version(e->version());
                 return;
             }
@@ -419,14 +469,22 @@ public:
                     } else if (has_row_cell(item)) {
                         e->row_container.install_cell(comm);
                     }
+                    if (this->log_enabled())
+                        this->log_commute(e->key, comm);
                 } else {
                     auto vptr = item.write_value<value_type*>();
                     if (has_row_update(item)) {
                         copy_row(e, vptr);
+                        if (this->log_enabled())
+                            this->log_put(e->key, *vptr);
                     } else if (has_row_cell(item)) {
                         e->row_container.install_cell(0, vptr);
+                        if (this->log_enabled())
+                            this->log_put_cell(e->key, 0, *vptr);
                     }
                 }
+            } else if (this->log_enabled()) {
+                this->log_put(e->key, e->row_container.row);
             }
             txn.set_version_unlock(e->version(), item);
         } else {
@@ -436,9 +494,13 @@ public:
                     comm_type &comm = row_item.template write_value<comm_type>();
                     assert(&comm);
                     e->row_container.install_cell(comm);
+                    if (this->log_enabled())
+                        this->log_commute(e->key, comm, key.cell_num());
                 } else {
                     auto vptr = row_item.template raw_write_value<value_type*>();
                     e->row_container.install_cell(key.cell_num(), vptr);
+                    if (this->log_enabled())
+                        this->log_put_cell(e->key, key.cell_num(), *vptr);
                 }
             }
             txn.set_version_unlock(e->row_container.version_at(key.cell_num()), item);
@@ -489,62 +551,84 @@ private:
 
     // remove a k-v node during transactions (with locks)
     void _remove(internal_elem *el) {
-        bucket_entry& buck = map_[find_bucket_idx(el->key)];
-        buck.version.lock_exclusive();
-        internal_elem *prev = nullptr;
-        internal_elem *curr = buck.head;
-        while (curr != nullptr && curr != el) {
-            prev = curr;
-            curr = curr->next;
-        }
-        assert(curr);
-        if (prev != nullptr)
-            prev->next = curr->next;
-        else
-            buck.head = curr->next;
+        bucket_entry& buck = map_.lock_bucket(hash(el->key));
+        bool found = map_.unlink(buck, el);
+        assert(found);
+        (void) found;
         buck.version.unlock_exclusive();
-        Transaction::rcu_delete(curr);
+        arena_rcu_delete(arena_, el);
     }
     // non-transactional remove by key
     bool remove(const key_type& k) {
-        bucket_entry& buck = map_[find_bucket_idx(k)];
-        buck.version.lock_exclusive();
-        internal_elem *prev = nullptr;
-        internal_elem *curr = buck.head;
-        while (curr != nullptr && !pred_(curr->key, k)) {
-            prev = curr;
-            curr = curr->next;
-        }
+        size_t h = hash(k);
+        bucket_entry& buck = map_.lock_bucket(h);
+        internal_elem *curr = find_in_bucket(buck, k, h);
         if (curr == nullptr) {
             buck.version.unlock_exclusive();
             return false;
         }
-        if (prev != nullptr)
-            prev->next = curr->next;
-        else
-            buck.head = curr->next;
+        map_.unlink(buck, curr);
         buck.version.unlock_exclusive();
-        delete curr;
+        arena_delete(arena_, curr);
         return true;
     }
     // insert a k-v node to a bucket
-    void insert_in_bucket(bucket_entry& buck, const key_type& k, const value_type *v, bool valid) {
+    internal_elem *insert_in_bucket(bucket_entry& buck, const key_type& k, size_t h,
+                                    const value_type *v, bool valid) {
         assert(buck.version.is_locked());
 
-        internal_elem *new_head = new internal_elem(k, v ? *v : value_type(), valid);
-        internal_elem *curr_head = buck.head;
-
-        new_head->next = curr_head;
-        buck.head = new_head;
+        internal_elem *new_head = arena_new<internal_elem>(arena_, k, v ? *v : value_type(), valid);
+        map_.link(buck, new_head, h);
 
         buck.version.inc_nonopaque();
+        return new_head;
     }
     // find a key's k-v node (internal_elem) within a bucket
-    internal_elem *find_in_bucket(const bucket_entry& buck, const key_type& k) {
-        internal_elem *curr = buck.head;
-        while (curr && !pred_(curr->key, k))
-            curr = curr->next;
-        return curr;
+    internal_elem *find_in_bucket(const bucket_entry& buck, const key_type& k, size_t h) {
+        return map_.find(buck, k, h);
+    }
+
+    // Runs the lookups of each batch in stages: hashing, reading buckets,
+    // then searching them, with each stage prefetching what the next loads.
+    // The rows found are prefetched too, and registered in a last pass.
+    template <typename Access>
+    bool multi_select(const key_type* keys, size_t n, Access access, sel_return_type* results) {
+        if (!INDEX_MULTI_GET)
+            return select_each(*this, keys, n, access, results);
+        for (size_t base = 0; base < n; base += multi_get_batch) {
+            size_t m = std::min(n - base, multi_get_batch);
+            const key_type* k = keys + base;
+            sel_return_type* r = results + base;
+            size_t hs[multi_get_batch];
+            bucket_entry* bucks[multi_get_batch];
+            bucket_version_type vers[multi_get_batch];
+            internal_elem* elems[multi_get_batch];
+
+            for (size_t i = 0; i != m; ++i) {
+                hs[i] = hash(k[i]);
+                map_.prefetch_bucket(hs[i]);
+            }
+            for (size_t i = 0; i != m; ++i) {
+                bucks[i] = &map_.read_bucket(hs[i], vers[i]);
+                map_.prefetch_elements(*bucks[i], hs[i]);
+            }
+            for (size_t i = 0; i != m; ++i) {
+                elems[i] = find_in_bucket(*bucks[i], k[i], hs[i]);
+                if (elems[i])
+                    prefetch(&elems[i]->version());
+            }
+            for (size_t i = 0; i != m; ++i) {
+                if (elems[i])
+                    r[i] = select_row(reinterpret_cast<uintptr_t>(elems[i]), access);
+                else if (!Sto::item(this, make_bucket_key(*bucks[i])).observe(vers[i]))
+                    r[i] = sel_abort;
+                else
+                    r[i] = { true, false, 0, nullptr };
+                if (!std::get<0>(r[i]))
+                    return false;
+            }
+        }
+        return true;
     }
 
     static bool is_phantom(internal_elem *e, const TransItem& item) {
@@ -562,6 +646,12 @@ private:
         uintptr_t bucket_key = item.key<uintptr_t>();
         return reinterpret_cast<bucket_entry*>(bucket_key & ~bucket_bit);
     }
+    static void prefetch_item(const TransItem& item) {
+        if (is_bucket(item))
+            prefetch(bucket_address(item));
+        else
+            prefetch(item.key<item_key_t>().internal_elem_ptr());
+    }
 
     static void copy_row(internal_elem *e, comm_type &comm) {
         e->row_container.row = comm.operate(e->row_container.row);
@@ -575,7 +665,11 @@ private:
 
 // MVCC variant
 template <typename K, typename V, typename DBParams>
-class mvcc_unordered_index : public index_common<K, V, DBParams>, public TObject {
+class mvcc_unordered_index : public index_common<K, V, DBParams>,
+                             public batched_tobject<mvcc_unordered_index<K, V, DBParams>>, public TLogged {
+    // batched commit calls prefetch_item
+    friend class batched_tobject<mvcc_unordered_index>;
+
 public:
     // Premable
     using C = index_common<K, V, DBParams>;
@@ -608,9 +702,16 @@ public:
 
     typedef MvObject<value_type> object_type;
     typedef typename object_type::history_type history_type;
+
+    // A row write stored as a column delta (row_cell_bit): the new row, and
+    // the row the transaction read, which it is written over
+    struct column_write {
+        const value_type* row;
+        const value_type* base;
+    };
     typedef typename get_occ_version<DBParams>::type bucket_version_type;
 
-    typedef std::hash<K> Hash;
+    typedef typename std::conditional<BUCKET_FINGERPRINTS, xxh_hash<K>, std::hash<K>>::type Hash;
     typedef std::equal_to<K> Pred;
 
     // our hashtable is an array of linked lists. 
@@ -628,24 +729,23 @@ public:
     ~mvcc_unordered_index() override {}
 
 private:
-    struct bucket_entry {
-        internal_elem *head;
-        // this is the bucket version number, which is incremented on insert
-        // we use it to make sure that an unsuccessful key lookup will still be
-        // unsuccessful at commit time (because this will always be true if no
-        // new inserts have occurred in this bucket)
-        bucket_version_type version;
-        bucket_entry() : head(nullptr), version(0) {}
-    };
-
-    typedef std::vector<bucket_entry> MapType;
-    // this is the hashtable itself, an array of bucket_entry's
+    typedef bucket_map<internal_elem, key_type, bucket_version_type, Hash, Pred,
+                       BUCKET_FINGERPRINTS> MapType;
+    // a bucket's version is incremented on insert; we use it to make sure
+    // that an unsuccessful key lookup will still be unsuccessful at commit
+    // time (because this will always be true if no new inserts have
+    // occurred in this bucket)
+    typedef typename MapType::bucket bucket_entry;
+    // where rows and buckets live; the heap if null
+    row_arena* arena_;
+    // this is the hashtable itself, which grows as rows are inserted
     MapType map_;
-    Hash hasher_;
-    Pred pred_;
 
     uint64_t key_gen_;
 
+    // number of initial buckets per checkpoint range
+    static constexpr size_t checkpoint_range_buckets = 1 << 14;
+
     // used to mark whether a key is a bucket (for bucket version checks)
     // or a pointer (which will always have the lower 3 bits as 0)
     static constexpr uintptr_t bucket_bit = C::item_key_tag;
@@ -657,19 +757,14 @@ public:
     using item_key_t = typename split_version_helpers<index_t>::item_key_t;
 
     // Main constructor
-    mvcc_unordered_index(size_t size, Hash h = Hash(), Pred p = Pred()) :
-            map_(), hasher_(h), pred_(p), key_gen_(0) {
-        map_.resize(size);
-    }
+    mvcc_unordered_index(size_t size, row_arena* arena = nullptr, Hash h = Hash(), Pred p = Pred()) :
+            arena_(arena), map_(size, arena, h, p), key_gen_(0) {}
 
     inline size_t hash(const key_type& k) const {
-        return hasher_(k);
+        return map_.hash(k);
     }
     inline size_t nbuckets() const {
-        return map_.size();
-    }
-    inline size_t find_bucket_idx(const key_type& k) const {
-        return hash(k) % nbuckets();
+        return map_.nbuckets();
     }
 
     uint64_t gen_key() {
@@ -678,14 +773,17 @@ public:
 
     sel_return_type
     select_row(const key_type& k, RowAccess access) {
-        bucket_entry& buck = map_[find_bucket_idx(k)];
-        bucket_version_type buck_vers = buck.version;
-        fence();
-        internal_elem *e = find_in_bucket(buck, k);
+        size_t h = hash(k);
+        bucket_version_type buck_vers;
+        bucket_entry& buck = map_.read_bucket(h, buck_vers);
+        internal_elem *e = find_in_bucket(buck, k, h);
 
         if (e != nullptr) {
             return select_row(reinterpret_cast<uintptr_t>(e), access);
         } else {
+            // keys deleted after a snapshot stay linked until it ends
+            if (Sto::read_only())
+                return { true, false, 0, nullptr };
             if (!Sto::item(this, make_bucket_key(buck)).observe(buck_vers)) {
                 return sel_abort;
             }
@@ -695,10 +793,10 @@ public:
 
     sel_return_type
     select_row(const key_type& k, std::initializer_list<column_access_t> accesses) {
-        bucket_entry& buck = map_[find_bucket_idx(k)];
-        bucket_version_type buck_vers = buck.version;
-        fence();
-        internal_elem *e = find_in_bucket(buck, k);
+        size_t h = hash(k);
+        bucket_version_type buck_vers;
+        bucket_entry& buck = map_.read_bucket(h, buck_vers);
+        internal_elem *e = find_in_bucket(buck, k, h);
 
         if (e != nullptr) {
             return select_row(reinterpret_cast<uintptr_t>(e), accesses);
@@ -713,77 +811,112 @@ public:
     sel_return_type
     select_row(uintptr_t rid, RowAccess access) {
         auto e = reinterpret_cast<internal_elem*>(rid);
-        TransProxy row_item = Sto::item(this, item_key_t::row_item_key(e));
-
         history_type* h = e->row.find(txn_read_tid());
 
         if (h->status_is(UNUSED))
             return { true, false, 0, nullptr };
 
-        if (is_phantom(h, row_item))
-            return { true, false, 0, nullptr };
+        if (Sto::read_only()) {
+            // read-only transactions read their snapshot untracked
+            if (h->status_is(DELETED))
+                return { true, false, 0, nullptr };
+        } else {
+            TransProxy row_item = Sto::item(this, item_key_t::row_item_key(e));
 
-        if (index_read_my_write) {
-            if (has_delete(row_item))
+            if (is_phantom(h, row_item))
                 return { true, false, 0, nullptr };
-            if (has_row_update(row_item)) {
-                value_type* vptr = nullptr;
-                if (has_insert(row_item)) {
+
+            if (index_read_my_write) {
+                if (has_delete(row_item))
+                    return { true, false, 0, nullptr };
+                if (has_row_update(row_item)) {
+                    value_type* vptr = nullptr;
+                    if (has_insert(row_item)) {
 #if SAFE_FLATTEN
-                    vptr = h->vp_safe_flatten();
-                    if (vptr == nullptr)
-                        return { false, false, 0, nullptr };
+                        vptr = h->vp_safe_flatten();
+                        if (vptr == nullptr)
+                            return { false, false, 0, nullptr };
 #else
-                    vptr = h->vp();
+                        vptr = h->vp();
 #endif
-                } else {
-                    vptr = row_item.template raw_write_value<value_type*>();
+                    } else {
+                        vptr = row_item.template raw_write_value<value_type*>();
+                    }
+                    assert(vptr);
+                    return { true, true, rid, vptr };
                 }
-                assert(vptr);
-                return { true, true, rid, vptr };
             }
+
+            if (access != RowAccess::None)
+                MvAccess::template read<value_type>(row_item, h);
         }
 
         if (access != RowAccess::None) {
-            MvAccess::template read<value_type>(row_item, h);
 #if SAFE_FLATTEN
             auto vp = h->vp_safe_flatten();
             if (vp == nullptr)
                 return { false, false, 0, nullptr };
 #else
-            auto vp = h->vp();
+            auto vp = h->vp_txn();
             assert(vp);
 #endif
+            if constexpr (mv_column_deltas<value_type>) {
+                if (!Sto::read_only())
+                    remember_read_row(e, vp);
+            }
             return { true, true, rid, vp };
         } else {
             return { true, true, rid, nullptr };
         }
     }
 
+    // Versions hold whole rows, so any column access reads the row; updates
+    // that change few columns are stored as column deltas regardless
     sel_return_type
-    select_row(uintptr_t, std::initializer_list<column_access_t>) {
-        always_assert(false, "Not implemented in MVCC, use split table instead.");
-        return { false, false, 0, nullptr };
+    select_row(uintptr_t rid, std::initializer_list<column_access_t> accesses) {
+        return select_row(rid, accesses.size() ? RowAccess::UpdateValue : RowAccess::None);
+    }
+
+    // Looks up n keys, as n select_row calls would, with their cache
+    // misses overlapped; returns false if the transaction must abort, and
+    // otherwise sets results[i] to the result for keys[i]
+    bool select_rows(const key_type* keys, size_t n, RowAccess access, sel_return_type* results) {
+        return multi_select(keys, n, access, results);
+    }
+    bool select_rows(const key_type* keys, size_t n, std::initializer_list<column_access_t> accesses,
+                     sel_return_type* results) {
+        return multi_select(keys, n, accesses, results);
     }
 
     void update_row(uintptr_t rid, value_type *new_row) {
         auto e = reinterpret_cast<internal_elem*>(rid);
         auto row_item = Sto::item(this, item_key_t::row_item_key(e));
+        if constexpr (mv_column_deltas<value_type>) {
+            if (has_row_cell(row_item)) {
+                const value_type* base = row_item.has_write()
+                    ? row_item.template write_value<column_write>().base
+                    : row_item.item().template xwrite_value<const value_type*>();
+                row_item.add_write(column_write{new_row, base});
+                return;
+            }
+        }
         row_item.add_write(new_row);
     }
     
     void update_row(uintptr_t rid, const comm_type &comm) {
         assert(&comm);
         auto row_item = Sto::item(this, item_key_t::row_item_key(reinterpret_cast<internal_elem *>(rid)));
+        if constexpr (mv_column_deltas<value_type>)
+            row_item.clear_flags(row_cell_bit);
         row_item.add_commute(comm);
     }
 
     ins_return_type
     insert_row(const key_type& k, value_type *vptr, bool overwrite = false) {
-        bucket_entry& buck = map_[find_bucket_idx(k)];
-
-        buck.version.lock_exclusive();
-        internal_elem* e = find_in_bucket(buck, k);
+        size_t h = hash(k);
+        map_.grow();
+        bucket_entry& buck = map_.lock_bucket(h);
+        internal_elem* e = find_in_bucket(buck, k, h);
 
         if (e) {
             buck.version.unlock_exclusive();
@@ -800,6 +933,8 @@ public:
             }
 
             if (overwrite) {
+                if constexpr (mv_column_deltas<value_type>)
+                    row_item.clear_flags(row_cell_bit);
                 row_item.template add_write<value_type*>(vptr);
             } else {
                 MvAccess::template read<value_type>(row_item, h);
@@ -809,8 +944,7 @@ public:
         } else {
             // insert the new row to the table and take note of bucket version changes
             auto buck_vers_0 = bucket_version_type(buck.version.unlocked_value());
-            insert_in_bucket(buck, k);
-            internal_elem *new_head = buck.head;
+            internal_elem *new_head = insert_in_bucket(buck, k, h);
             auto buck_vers_1 = bucket_version_type(buck.version.unlocked_value());
 
             buck.version.unlock_exclusive();
@@ -834,11 +968,11 @@ public:
     // until commit time
     del_return_type
     delete_row(const key_type& k) {
-        bucket_entry& buck = map_[find_bucket_idx(k)];
-        bucket_version_type buck_vers = buck.version;
-        fence();
+        size_t h = hash(k);
+        bucket_version_type buck_vers;
+        bucket_entry& buck = map_.read_bucket(h, buck_vers);
 
-        internal_elem* e = find_in_bucket(buck, k);
+        internal_elem* e = find_in_bucket(buck, k, h);
         if (e) {
             auto row_item = Sto::item(this, item_key_t::row_item_key(e));
 
@@ -860,7 +994,7 @@ public:
             if (h->status_is(DELETED))
                 return { true, false };
             row_item.add_write();
-            row_item.add_flags(delete_bit);
+            row_item.clear_flags(row_cell_bit).add_flags(delete_bit);
 
             return { true, true };
         } else {
@@ -874,28 +1008,71 @@ public:
 
     // non-transactional methods
     value_type* nontrans_get(const key_type& k) {
-        bucket_entry& buck = map_[find_bucket_idx(k)];
-        internal_elem* e = find_in_bucket(buck, k);
+        internal_elem* e = map_.nontrans_find(k);
         if (e == nullptr)
             return nullptr;
         return &(e->row.nontrans_access());
     }
 
     void nontrans_put(const key_type& k, const value_type& v) {
-        bucket_entry& buck = map_[find_bucket_idx(k)];
-        buck.version.lock_exclusive();
-        internal_elem *e = find_in_bucket(buck, k);
+        size_t h = hash(k);
+        map_.grow();
+        bucket_entry& buck = map_.lock_bucket(h);
+        internal_elem *e = find_in_bucket(buck, k, h);
         if (e == nullptr) {
-            internal_elem *new_head = new internal_elem(k);
+            internal_elem *new_head = arena_new<internal_elem>(arena_, k);
             new_head->row.nontrans_access() = v;
-            new_head->next = buck.head;
-            buck.head = new_head;
+            map_.link(buck, new_head, h);
         } else {
             e->row.nontrans_access() = v;
         }
         buck.version.unlock_exclusive();
     }
 
+    // checkpointing: the table is scanned in independent ranges of buckets,
+    // each batch inside a transaction that provides the snapshot it copies
+    typedef std::array<TransactionTid::type, 1> checkpoint_tids_type;
+    static constexpr size_t checkpoint_cells = 1;
+
+    size_t checkpoint_ranges() const {
+        return map_.scan_ranges(checkpoint_range_buckets);
+    }
+
+    template <typename Callback>
+    void checkpoint_scan(size_t range, Callback callback) {
+        range_position cursor;
+        checkpoint_scan(range, cursor, 0, callback);
+    }
+    // Scans up to `limit` buckets (0: all) of `range` from `cursor`;
+    // returns false once the range is exhausted
+    template <typename Callback>
+    bool checkpoint_scan(size_t range, range_position& cursor, size_t limit, Callback callback) {
+        auto rtid = txn_read_tid();
+        size_t count = limit ? limit : checkpoint_range_buckets;
+        bool more = map_.scan(range, checkpoint_range_buckets, cursor.bucket, count, [&] (internal_elem* e) {
+            history_type *h = e->row.find(rtid);
+            if (h->status_is(UNUSED) || h->status_is(DELETED))
+                return;
+            callback(e->key, h->v(), checkpoint_tids_type{{h->wtid()}});
+        });
+        cursor.bucket += count;
+        return more;
+    }
+
+    // trim sweeps (mvcc_trim_sweeper) walk the checkpoint ranges in batches
+    // of up to `limit` buckets, adding the number of versions unlinked to
+    // `trimmed`; returns false once the range is exhausted. Each batch runs
+    // inside a transaction, which keeps the rows walked alive.
+    bool trim_scan(size_t range, range_position& cursor, size_t limit, size_t& trimmed) {
+        auto tid = Transaction::mvcc_trim_tid();
+        size_t count = limit ? limit : checkpoint_range_buckets;
+        bool more = map_.scan(range, checkpoint_range_buckets, cursor.bucket, count, [&] (internal_elem* e) {
+            trimmed += e->row.trim(tid);
+        });
+        cursor.bucket += count;
+        return more;
+    }
+
     // TObject interface methods
     bool lock(TransItem& item, Transaction& txn) override {
         assert(!is_bucket(item));
@@ -922,6 +1099,10 @@ public:
                     Sto::commit_tid(), &e->row, nullptr, hprev);
                 h->status_delete();
                 h->set_delete_cb(this, _delete_cb, e);
+            } else if (is_column_write(item)) {
+                auto& w = item.template write_value<column_write>();
+                h = e->row.new_history(
+                    Sto::commit_tid(), &e->row, w.row, w.base, hprev);
             } else {
                 h = e->row.new_history(
                     Sto::commit_tid(), &e->row, wval, hprev);
@@ -957,6 +1138,8 @@ public:
         auto e = key.internal_elem_ptr();
         auto h = item.template write_value<history_type*>();
 
+        if (this->log_enabled())
+            log_history(e->key, h);
         e->row.cp_install(h);
     }
 
@@ -981,89 +1164,136 @@ public:
 private:
     // remove a k-v node during transactions (with locks)
     void _remove(internal_elem *el) {
-        bucket_entry& buck = map_[find_bucket_idx(el->key)];
-        buck.version.lock_exclusive();
-        internal_elem *prev = nullptr;
-        internal_elem *curr = buck.head;
-        while (curr != nullptr && curr != el) {
-            prev = curr;
-            curr = curr->next;
-        }
-        assert(curr);
-        if (prev != nullptr)
-            prev->next = curr->next;
-        else
-            buck.head = curr->next;
+        bucket_entry& buck = map_.lock_bucket(hash(el->key));
+        bool found = map_.unlink(buck, el);
+        assert(found);
+        (void) found;
         buck.version.unlock_exclusive();
-        Transaction::rcu_delete(curr);
+        arena_rcu_delete(arena_, el);
     }
     // non-transactional remove by key
     bool remove(const key_type& k) {
-        bucket_entry& buck = map_[find_bucket_idx(k)];
-        buck.version.lock_exclusive();
-        internal_elem *prev = nullptr;
-        internal_elem *curr = buck.head;
-        while (curr != nullptr && !pred_(curr->key, k)) {
-            prev = curr;
-            curr = curr->next;
-        }
+        size_t h = hash(k);
+        bucket_entry& buck = map_.lock_bucket(h);
+        internal_elem *curr = find_in_bucket(buck, k, h);
         if (curr == nullptr) {
             buck.version.unlock_exclusive();
             return false;
         }
-        if (prev != nullptr)
-            prev->next = curr->next;
-        else
-            buck.head = curr->next;
+        map_.unlink(buck, curr);
         buck.version.unlock_exclusive();
-        delete curr;
+        arena_delete(arena_, curr);
         return true;
     }
 
+    void log_history(const key_type& key, history_type *h) const {
+        if (h->status_is(DELETED))
+            this->log_remove(key);
+        else if (log_column_delta(key, h))
+            return;
+        else if (h->status_is(DELTA))
+            this->log_commute(key, h->c());
+        else
+            this->log_put(key, h->v());
+    }
+
+    bool log_column_delta(const key_type& key, history_type *h) const {
+        if constexpr (mv_column_deltas<value_type>) {
+            if (h->is_column_delta()) {
+                this->log_patch(key, h->patch());
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static bool is_column_write(const TransItem& item) {
+        return mv_column_deltas<value_type> && has_row_cell(item) && item.has_write();
+    }
+
+    // Remembers the row a transaction read, which update_row writes over
+    void remember_read_row(internal_elem* e, const value_type* vp) {
+        TransProxy row_item = Sto::item(this, item_key_t::row_item_key(e));
+        if (!row_item.has_write()) {
+            row_item.add_flags(row_cell_bit);
+            row_item.item().template xwrite_value<const value_type*>() = vp;
+        }
+    }
+
     static void _delete_cb(
             void *index_ptr, void *ele_ptr, void *history_ptr) {
         auto ip = reinterpret_cast<mvcc_unordered_index<K, V, DBParams>*>(index_ptr);
         auto el = reinterpret_cast<internal_elem*>(ele_ptr);
         auto hp = reinterpret_cast<history_type*>(history_ptr);
-        bucket_entry& buck = ip->map_[ip->find_bucket_idx(el->key)];
-        buck.version.lock_exclusive();
-        internal_elem *prev = nullptr;
-        internal_elem *curr = buck.head;
-        while (curr != nullptr && curr != el) {
-            prev = curr;
-            curr = curr->next;
-        }
-        assert(curr);
-        if (prev != nullptr)
-            prev->next = curr->next;
-        else
-            buck.head = curr->next;
+        bucket_entry& buck = ip->map_.lock_bucket(ip->hash(el->key));
+        bool found = ip->map_.unlink(buck, el);
+        assert(found);
+        (void) found;
         if (el->row.is_head(hp)) {
             buck.version.unlock_exclusive();
-            Transaction::rcu_delete(el);
+            arena_rcu_delete(ip->arena_, el);
         } else {
             buck.version.unlock_exclusive();
         }
     }
 
     // insert a k-v node to a bucket
-    void insert_in_bucket(bucket_entry& buck, const key_type& k) {
+    internal_elem *insert_in_bucket(bucket_entry& buck, const key_type& k, size_t h) {
         assert(buck.version.is_locked());
 
-        internal_elem *new_head = new internal_elem(k);
-        internal_elem *curr_head = buck.head;
-
-        new_head->next = curr_head;
-        buck.head = new_head;
+        internal_elem *new_head = arena_new<internal_elem>(arena_, k);
+        map_.link(buck, new_head, h);
 
         buck.version.inc_nonopaque();
+        return new_head;
     }
     // find a key's k-v node (internal_elem) within a bucket
-    internal_elem *find_in_bucket(const bucket_entry& buck, const key_type& k) {
-        internal_elem *curr = buck.head;
-        while (curr && !pred_(curr->key, k))
-            curr = curr->next;
-        return curr;
+    internal_elem *find_in_bucket(const bucket_entry& buck, const key_type& k, size_t h) {
+        return map_.find(buck, k, h);
+    }
+
+    // Runs the lookups of each batch in stages: hashing, reading buckets,
+    // then searching them, with each stage prefetching what the next loads.
+    // The rows found are prefetched too, and registered in a last pass.
+    template <typename Access>
+    bool multi_select(const key_type* keys, size_t n, Access access, sel_return_type* results) {
+        if (!INDEX_MULTI_GET)
+            return select_each(*this, keys, n, access, results);
+        for (size_t base = 0; base < n; base += multi_get_batch) {
+            size_t m = std::min(n - base, multi_get_batch);
+            const key_type* k = keys + base;
+            sel_return_type* r = results + base;
+            size_t hs[multi_get_batch];
+            bucket_entry* bucks[multi_get_batch];
+            bucket_version_type vers[multi_get_batch];
+            internal_elem* elems[multi_get_batch];
+
+            for (size_t i = 0; i != m; ++i) {
+                hs[i] = hash(k[i]);
+                map_.prefetch_bucket(hs[i]);
+            }
+            for (size_t i = 0; i != m; ++i) {
+                bucks[i] = &map_.read_bucket(hs[i], vers[i]);
+                map_.prefetch_elements(*bucks[i], hs[i]);
+            }
+            for (size_t i = 0; i != m; ++i) {
+                elems[i] = find_in_bucket(*bucks[i], k[i], hs[i]);
+                if (elems[i])
+                    prefetch(&elems[i]->row);
+            }
+            for (size_t i = 0; i != m; ++i) {
+                if (elems[i])
+                    r[i] = select_row(reinterpret_cast<uintptr_t>(elems[i]), access);
+                else if (!Sto::read_only()
+                         && !Sto::item(this, make_bucket_key(*bucks[i])).observe(vers[i]))
+                    r[i] = sel_abort;
+                else
+                    r[i] = { true, false, 0, nullptr };
+                if (!std::get<0>(r[i]))
+                    return false;
+            }
+        }
+        return true;
     }
 
     static bool is_phantom(const history_type *h, const TransItem& item) {
@@ -1081,6 +1311,12 @@ private:
         uintptr_t bucket_key = item.key<uintptr_t>();
         return reinterpret_cast<bucket_entry*>(bucket_key & ~bucket_bit);
     }
+    static void prefetch_item(const TransItem& item) {
+        if (is_bucket(item))
+            prefetch(bucket_address(item));
+        else
+            prefetch(item.key<item_key_t>().internal_elem_ptr());
+    }
 
     static TransactionTid::type txn_read_tid() {
         return Sto::read_tid<DBParams::Commute>();
@@ -242,6 +242,16 @@ private:
 
 template <typename DBParams>
 void rubis_loader<DBParams>::load() {
+    bench::load_meter meter;
+#if TPCC_SPLIT_TABLE
+    auto items_const = bench::make_bulk_loader(db.tbl_items_const());
+    auto items_comm = bench::make_bulk_loader(db.tbl_items_comm());
+#else
+    auto items = bench::make_bulk_loader(db.tbl_items());
+#endif
+    auto bids = bench::make_bulk_loader(db.tbl_bids());
+    auto buynow = bench::make_bulk_loader(db.tbl_buynow());
+
     for (uint64_t iid = 1; iid <= constants::num_items; ++iid) {
         item_key ik(iid);
 #if TPCC_SPLIT_TABLE
@@ -256,8 +266,8 @@ void rubis_loader<DBParams>::load() {
         im.max_bid = 40;
         im.end_date = ig.generate_random_date();
 
-        db.tbl_items_const().nontrans_put(ik, ic);
-        db.tbl_items_comm().nontrans_put(ik, im);
+        items_const.add(ik, ic);
+        items_comm.add(ik, im);
 #else
         item_row ir;
         ir.seller = ig.generate_user_id();
@@ -269,7 +279,7 @@ void rubis_loader<DBParams>::load() {
         ir.max_bid = 40;
         ir.end_date = ig.generate_random_date();
 
-        db.tbl_items().nontrans_put(ik, ir);
+        items.add(ik, ir);
 #endif
 
         for (uint64_t i = 0; i < constants::num_bids_per_item; ++i) {
@@ -281,7 +291,7 @@ void rubis_loader<DBParams>::load() {
             br.quantity = 1;
             br.date = ig.generate_random_date();
 
-            db.tbl_bids().nontrans_put(bk, br);
+            bids.add(bk, br);
         }
     }
 
@@ -292,8 +302,18 @@ void rubis_loader<DBParams>::load() {
         bnr.quantity = 1;
         bnr.date = ig.generate_random_date();
 
-        db.tbl_buynow().nontrans_put(bnk, bnr);
+        buynow.add(bnk, bnr);
     }
+
+#if TPCC_SPLIT_TABLE
+    items_const.load();
+    items_comm.load();
+#else
+    items.load();
+#endif
+    bids.load();
+    buynow.load();
+    meter.report();
 }
 
 }
@@ -28,6 +28,9 @@ const Clp_Option options[] = {
         { "commute",      'x', opt_comm,  Clp_NoVal,     Clp_Negate | Clp_Optional },
         { "verbose",      'v', opt_verb,  Clp_NoVal,     Clp_Negate | Clp_Optional },
         { "mix",          'm', opt_mix,   Clp_ValInt,    Clp_Optional },
+        { "log-dir",      'L', opt_ldir,  Clp_ValString, Clp_Optional },
+        { "checkpoint",   'k', opt_ckpt,  Clp_ValInt,    Clp_Optional },
+        { "recover",      'R', opt_recov, Clp_ValString, Clp_Optional },
 };
 
 const char* workload_mix_names[] = { "Full", "NO-only", "NO+P-only" };
@@ -67,7 +70,17 @@ void print_usage(const char *argv_0) {
        << "    Specify workload mix:" << std::endl
        << "    0. Full mix (default)" << std::endl
        << "    1. New-order only" << std::endl
-       << "    2. New-order plus Payment only" << std::endl;
+       << "    2. New-order plus Payment only" << std::endl
+       << "  --log-dir=<DIR> (or -L<DIR>)" << std::endl
+       << "    Enable redo logging to DIR. The benchmark is run twice, without and then with" << std::endl
+       << "    logging, and both throughputs are reported." << std::endl
+       << "  --checkpoint[=<NUM>] (or -k[<NUM>])" << std::endl
+       << "    With --log-dir, take a fuzzy checkpoint halfway through the logged run using" << std::endl
+       << "    NUM threads (default 4)." << std::endl
+       << "  --recover[=<LIST>] (or -R[<LIST>])" << std::endl
+       << "    With --log-dir, rebuild the database from the checkpoint and log after the run," << std::endl
+       << "    once per comma-separated thread count in LIST (default 1,8,32), and report the" << std::endl
+       << "    recovery time per GB of input. Implies --checkpoint." << std::endl;
 
     std::cout << ss.str() << std::flush;
 }
@@ -100,6 +113,34 @@ int main(int argc, const char *const *argv) {
         0
         #endif
     << std::endl;
+    std::cout << "TPCC_SPLIT_YTD: " <<
+        #if TPCC_SPLIT_YTD
+        1
+        #else
+        0
+        #endif
+    << std::endl;
+    std::cout << "TPCC_ROW_ARENA: " <<
+        #if TPCC_ROW_ARENA
+        1
+        #else
+        0
+        #endif
+    << std::endl;
+    std::cout << "BUCKET_FINGERPRINTS: " <<
+        #if BUCKET_FINGERPRINTS
+        1
+        #else
+        0
+        #endif
+    << std::endl;
+    std::cout << "INDEX_MULTI_GET: " <<
+        #if INDEX_MULTI_GET
+        1
+        #else
+        0
+        #endif
+    << std::endl;
     std::cout << "MALLOC: " <<
         #ifdef MALLOC
         MALLOC
@@ -1,8 +1,11 @@
 #pragma once
 
+#include <fstream>
 #include <iostream>
 #include <iomanip>
+#include <memory>
 #include <random>
+#include <sstream>
 #include <string>
 #include <thread>
 
@@ -20,7 +23,9 @@
 #endif
 
 #include "DB_index.hh"
+#include "DB_checkpoint.hh"
 #include "DB_params.hh"
+#include "DB_trim.hh"
 #include "DB_profiler.hh"
 #include "PlatformFeatures.hh"
 
@@ -33,7 +38,7 @@
 // @section: clp parser definitions
 enum {
     opt_dbid = 1, opt_nwhs, opt_nthrs, opt_time, opt_perf, opt_pfcnt, opt_gc,
-    opt_gr, opt_node, opt_comm, opt_verb, opt_mix
+    opt_gr, opt_node, opt_comm, opt_verb, opt_mix, opt_ldir, opt_ckpt, opt_recov
 };
 
 extern const char* workload_mix_names[];
@@ -144,6 +149,22 @@ class tpcc_access;
 #define TPCC_HASH_INDEX 1
 #endif
 
+// Keep w_ytd and d_ytd in integer boxes outside their rows, so that Payment
+// increments them without writing the rows
+#ifndef TPCC_SPLIT_YTD
+#define TPCC_SPLIT_YTD 0
+#endif
+
+#if TPCC_SPLIT_YTD && TPCC_SPLIT_TABLE
+#error "TPCC_SPLIT_YTD needs the unsplit warehouse and district tables"
+#endif
+
+// Allocate each warehouse's rows and buckets from a huge-page arena on the
+// warehouse's home NUMA node
+#ifndef TPCC_ROW_ARENA
+#define TPCC_ROW_ARENA 0
+#endif
+
 template <typename DBParams>
 class tpcc_db {
 public:
@@ -189,15 +210,46 @@ public:
     typedef OIndex<order_key, bench::dummy_row>          no_table_type;
     typedef UIndex<item_key, item_value>                 it_table_type;
     typedef OIndex<history_key, history_value>           ht_table_type;
+#if TPCC_SPLIT_YTD
+    typedef typename integer_box<DBParams>::type         ytd_box_type;
+#endif
 
     explicit inline tpcc_db(int num_whs);
-    explicit inline tpcc_db(const std::string& db_file_name) = delete;
+    // rebuilds the database from the checkpoint and redo log in `log_dir`
+    explicit inline tpcc_db(const std::string& log_dir, int recovery_threads = 1);
     inline ~tpcc_db();
     void thread_init_all();
+    // assigns every table a redo log id
+    void set_log_ids();
+    logged_table_set logged_tables();
+    // records what recovery needs to know besides the tables
+    void write_meta(const std::string& log_dir) const;
+    const db_recovery::stats& recovery_stats() const {
+        return recovery_stats_;
+    }
+
+    // applies f to every table, in a fixed order
+    template <typename F>
+    void for_each_table(F f);
 
     int num_warehouses() const {
         return static_cast<int>(num_whs_);
     }
+    // the node of the CPU set_affinity() gives prepopulator and runner
+    // w_id - 1, which fill and mostly use the warehouse
+    static int home_node(uint64_t w_id) {
+        return static_cast<int>((w_id - 1) % std::max(topo_info.num_nodes, 1));
+    }
+    // the arena of the warehouse's tables, or null for the heap
+    row_arena* home_arena(uint64_t w_id) {
+#if TPCC_ROW_ARENA
+        return arenas_[home_node(w_id)].get();
+#else
+        (void)w_id;
+        return nullptr;
+#endif
+    }
+    void print_arena_stats() const;
 #if TPCC_SPLIT_TABLE
     wc_table_type& tbl_warehouses_const() {
         return tbl_whs_const_;
@@ -242,6 +294,14 @@ public:
     dt_table_type& tbl_districts(uint64_t w_id) {
         return tbl_dts_[w_id - 1];
     }
+#if TPCC_SPLIT_YTD
+    ytd_box_type& warehouse_ytd(uint64_t w_id) {
+        return whs_ytd_[w_id - 1];
+    }
+    ytd_box_type& district_ytd(uint64_t w_id, uint64_t d_id) {
+        return dts_ytd_[(w_id - 1) * NUM_DISTRICTS_PER_WAREHOUSE + d_id - 1];
+    }
+#endif
     cu_table_type& tbl_customers(uint64_t w_id) {
         return tbl_cus_[w_id - 1];
     }
@@ -279,6 +339,7 @@ public:
 
 private:
     size_t num_whs_;
+    std::vector<std::unique_ptr<row_arena>> arenas_;
     it_table_type *tbl_its_;
 
 #if TPCC_SPLIT_TABLE
@@ -302,6 +363,10 @@ private:
     std::vector<ol_table_type> tbl_ols_;
     std::vector<st_table_type> tbl_sts_;
 #endif
+#if TPCC_SPLIT_YTD
+    std::unique_ptr<ytd_box_type[]> whs_ytd_;
+    std::unique_ptr<ytd_box_type[]> dts_ytd_;
+#endif
 
     std::vector<ci_table_type> tbl_cni_;
     std::vector<oi_table_type> tbl_oci_;
@@ -310,6 +375,10 @@ private:
 
     tpcc_oid_generator oid_gen_;
     tpcc_delivery_queue dlvy_queue_;
+    db_recovery::stats recovery_stats_;
+
+    static int read_meta(const std::string& log_dir);
+    void restore_oid_generator();
 
     friend class tpcc_access<DBParams>;
 };
@@ -417,89 +486,180 @@ tpcc_db<DBParams>::tpcc_db(int num_whs)
 #else
       tbl_whs_(256),
 #endif
-      oid_gen_() {
+#if TPCC_SPLIT_YTD
+      whs_ytd_(new ytd_box_type[num_whs]),
+      dts_ytd_(new ytd_box_type[num_whs * NUM_DISTRICTS_PER_WAREHOUSE]),
+#endif
+      oid_gen_(), recovery_stats_() {
     //constexpr size_t num_districts = NUM_DISTRICTS_PER_WAREHOUSE;
     //constexpr size_t num_customers = NUM_CUSTOMERS_PER_DISTRICT * NUM_DISTRICTS_PER_WAREHOUSE;
 
+#if TPCC_ROW_ARENA
+    for (int n = 0; n < std::max(topo_info.num_nodes, 1); ++n)
+        arenas_.emplace_back(new row_arena(n));
+#endif
+
     tbl_its_ = new it_table_type(999983/*NUM_ITEMS * 2*/);
     for (auto i = 0; i < num_whs; ++i) {
+        row_arena* arena = home_arena(i + 1);
 #if TPCC_SPLIT_TABLE
-        tbl_dts_const_.emplace_back(32/*num_districts * 2*/);
-        tbl_dts_comm_.emplace_back(32);
-        tbl_cus_const_.emplace_back(999983/*num_customers * 2*/);
-        tbl_cus_comm_.emplace_back(999983);
-        tbl_ods_const_.emplace_back(999983/*num_customers * 10 * 2*/);
-        tbl_ods_comm_.emplace_back(999983);
-        tbl_ols_const_.emplace_back(999983/*num_customers * 100 * 2*/);
-        tbl_ols_comm_.emplace_back(999983);
-        tbl_sts_const_.emplace_back(999983/*NUM_ITEMS * 2*/);
-        tbl_sts_comm_.emplace_back(999983/*NUM_ITEMS * 2*/);
+        tbl_dts_const_.emplace_back(32/*num_districts * 2*/, arena);
+        tbl_dts_comm_.emplace_back(32, arena);
+        tbl_cus_const_.emplace_back(999983/*num_customers * 2*/, arena);
+        tbl_cus_comm_.emplace_back(999983, arena);
+        tbl_ods_const_.emplace_back(999983/*num_customers * 10 * 2*/, arena);
+        tbl_ods_comm_.emplace_back(999983, arena);
+        tbl_ols_const_.emplace_back(999983/*num_customers * 100 * 2*/, arena);
+        tbl_ols_comm_.emplace_back(999983, arena);
+        tbl_sts_const_.emplace_back(999983/*NUM_ITEMS * 2*/, arena);
+        tbl_sts_comm_.emplace_back(999983/*NUM_ITEMS * 2*/, arena);
 #else
-        tbl_dts_.emplace_back(32/*num_districts * 2*/);
-        tbl_cus_.emplace_back(999983/*num_customers * 2*/);
-        tbl_ods_.emplace_back(999983/*num_customers * 10 * 2*/);
-        tbl_ols_.emplace_back(999983/*num_customers * 100 * 2*/);
-        tbl_sts_.emplace_back(999983/*NUM_ITEMS * 2*/);
+        tbl_dts_.emplace_back(32/*num_districts * 2*/, arena);
+        tbl_cus_.emplace_back(999983/*num_customers * 2*/, arena);
+        tbl_ods_.emplace_back(999983/*num_customers * 10 * 2*/, arena);
+        tbl_ols_.emplace_back(999983/*num_customers * 100 * 2*/, arena);
+        tbl_sts_.emplace_back(999983/*NUM_ITEMS * 2*/, arena);
 #endif
-        tbl_cni_.emplace_back(999983/*num_customers * 2*/);
-        tbl_oci_.emplace_back(999983/*num_customers * 2*/);
-        tbl_nos_.emplace_back(999983/*num_customers * 10 * 2*/);
-        tbl_hts_.emplace_back(999983/*num_customers * 2*/);
+        tbl_cni_.emplace_back(999983/*num_customers * 2*/, arena);
+        tbl_oci_.emplace_back(999983/*num_customers * 2*/, arena);
+        tbl_nos_.emplace_back(999983/*num_customers * 10 * 2*/, arena);
+        tbl_hts_.emplace_back(999983/*num_customers * 2*/, arena);
     }
 }
 
+template <typename DBParams>
+tpcc_db<DBParams>::tpcc_db(const std::string& log_dir, int recovery_threads)
+    : tpcc_db(read_meta(log_dir)) {
+    set_log_ids();
+    auto tables = logged_tables();
+    db_recovery recovery(tables, log_dir, recovery_threads);
+    bool ok = recovery.run();
+    always_assert(ok, "no checkpoint to recover from");
+    recovery_stats_ = recovery.statistics();
+    restore_oid_generator();
+}
+
 template <typename DBParams>
 tpcc_db<DBParams>::~tpcc_db() {
     delete tbl_its_;
 }
 
 template <typename DBParams>
-void tpcc_db<DBParams>::thread_init_all() {
-    tbl_its_->thread_init();
+void tpcc_db<DBParams>::print_arena_stats() const {
+    for (auto& a : arenas_)
+        std::cout << "Row arena on node " << a->node() << ": "
+                  << a->mapped_bytes() / (1 << 20) << " MB mapped, "
+                  << a->huge_bytes() / (1 << 20) << " MB in reserved huge pages" << std::endl;
+}
+
+template <typename DBParams>
+template <typename F>
+void tpcc_db<DBParams>::for_each_table(F f) {
+    f(*tbl_its_);
 #if TPCC_SPLIT_TABLE
-    tbl_whs_const_.thread_init();
-    tbl_whs_comm_.thread_init();
+    f(tbl_whs_const_);
+    f(tbl_whs_comm_);
     for (auto& t : tbl_dts_const_)
-        t.thread_init();
+        f(t);
     for (auto& t : tbl_dts_comm_)
-        t.thread_init();
+        f(t);
     for (auto& t : tbl_cus_const_)
-        t.thread_init();
+        f(t);
     for (auto& t : tbl_cus_comm_)
-        t.thread_init();
+        f(t);
     for (auto& t : tbl_ods_const_)
-        t.thread_init();
+        f(t);
     for (auto& t : tbl_ods_comm_)
-        t.thread_init();
+        f(t);
     for (auto& t : tbl_ols_const_)
-        t.thread_init();
+        f(t);
     for (auto& t : tbl_ols_comm_)
-        t.thread_init();
+        f(t);
     for (auto& t : tbl_sts_const_)
-        t.thread_init();
+        f(t);
     for (auto& t : tbl_sts_comm_)
-        t.thread_init();
+        f(t);
 #else
-    tbl_whs_.thread_init();
+    f(tbl_whs_);
     for (auto& t : tbl_dts_)
-        t.thread_init();
+        f(t);
     for (auto& t : tbl_cus_)
-        t.thread_init();
+        f(t);
     for (auto& t : tbl_ods_)
-        t.thread_init();
+        f(t);
     for (auto& t : tbl_ols_)
-        t.thread_init();
+        f(t);
     for (auto& t : tbl_sts_)
-        t.thread_init();
+        f(t);
 #endif
     for (auto& t : tbl_cni_)
-        t.thread_init();
+        f(t);
     for (auto& t : tbl_oci_)
-        t.thread_init();
+        f(t);
     for (auto& t : tbl_nos_)
-        t.thread_init();
+        f(t);
     for (auto& t : tbl_hts_)
-        t.thread_init();
+        f(t);
+}
+
+template <typename DBParams>
+void tpcc_db<DBParams>::thread_init_all() {
+    for_each_table([] (auto& t) { t.thread_init(); });
+}
+
+template <typename DBParams>
+void tpcc_db<DBParams>::set_log_ids() {
+    // ids follow the table order of for_each_table, so they are stable
+    // across runs with the same warehouse count
+    uint32_t id = 0;
+    for_each_table([&id] (auto& t) { t.set_log_id(++id); });
+}
+
+template <typename DBParams>
+logged_table_set tpcc_db<DBParams>::logged_tables() {
+    logged_table_set tables;
+    for_each_table([&tables] (auto& t) { tables.add(t); });
+    return tables;
+}
+
+template <typename DBParams>
+void tpcc_db<DBParams>::write_meta(const std::string& log_dir) const {
+    std::ofstream meta(log_dir + "/tpcc.meta");
+    meta << num_whs_ << std::endl;
+}
+
+template <typename DBParams>
+int tpcc_db<DBParams>::read_meta(const std::string& log_dir) {
+    int num_whs = 0;
+    std::ifstream meta(log_dir + "/tpcc.meta");
+    meta >> num_whs;
+    always_assert(num_whs > 0, "missing or bad tpcc.meta");
+    return num_whs;
+}
+
+// order ids are handed out outside of transactions; continue after the
+// largest recovered one
+template <typename DBParams>
+void tpcc_db<DBParams>::restore_oid_generator() {
+    thread_init_all();
+    for (uint64_t wid = 1; wid <= num_whs_; ++wid) {
+#if TPCC_SPLIT_TABLE
+        auto& orders = tbl_orders_const(wid);
+#else
+        auto& orders = tbl_orders(wid);
+#endif
+        uint64_t next_oid[NUM_DISTRICTS_PER_WAREHOUSE + 1];
+        std::fill(std::begin(next_oid), std::end(next_oid), 3001);
+        TransactionGuard guard;
+        for (size_t r = 0; r < orders.checkpoint_ranges(); ++r) {
+            orders.checkpoint_scan(r, [&] (const order_key& k, const auto&, const auto&) {
+                uint64_t did = bswap(k.o_d_id);
+                next_oid[did] = std::max<uint64_t>(next_oid[did], bswap(k.o_id) + 1);
+            });
+        }
+        for (uint64_t did = 1; did <= NUM_DISTRICTS_PER_WAREHOUSE; ++did)
+            oid_gen_.set(wid, did, next_oid[did]);
+    }
 }
 
 // @section: db prepopulation functions
@@ -552,6 +712,9 @@ void tpcc_prepopulator<DBParams>::fill_warehouses() {
         wv.w_zip = random_zip_code();
         wv.w_tax = ig.random(0, 2000);
         wv.w_ytd = 30000000;
+#if TPCC_SPLIT_YTD
+        db.warehouse_ytd(wid) = wv.w_ytd;
+#endif
 
         db.tbl_warehouses().nontrans_put(wk, wv);
 #endif
@@ -633,6 +796,9 @@ void tpcc_prepopulator<DBParams>::expand_warehouse(uint64_t wid) {
         dv.d_tax = ig.random(0, 2000);
         dv.d_ytd = 3000000;
         //dv.d_next_o_id = 3001;
+#if TPCC_SPLIT_YTD
+        db.district_ytd(wid, did) = dv.d_ytd;
+#endif
 
         db.tbl_districts(wid).nontrans_put(dk, dv);
 #endif
@@ -911,6 +1077,7 @@ public:
             prepop_thrs.emplace_back(prepopulation_worker, std::ref(db), i);
         for (auto &t : prepop_thrs)
             t.join();
+        db.print_arena_stats();
 
         r = pthread_barrier_destroy(&tpcc_prepopulator<DBParams>::sync_barrier);
         always_assert(r == 0, "pthread_barrier_destroy failed");
@@ -1056,6 +1223,23 @@ public:
         return total_txn_cnt;
     }
 
+    // takes one fuzzy checkpoint after `delay` seconds; checkpointer threads
+    // use the thread ids following the benchmark runners
+    static void run_checkpoint(tpcc_db<DBParams>& db, std::string log_dir, int nthreads,
+                               int first_threadid, double delay) {
+        std::this_thread::sleep_for(std::chrono::duration<double>(delay));
+        auto tables = db.logged_tables();
+        db_checkpointer ckpt(tables, log_dir, nthreads, first_threadid);
+        auto t0 = std::chrono::steady_clock::now();
+        auto epoch = ckpt.run();
+        double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        if (epoch == 0)
+            std::cerr << "Checkpoint failed" << std::endl;
+        else
+            std::cout << "Checkpoint (epoch " << epoch << "): " << ckpt.bytes_written()
+                      << " bytes in " << secs << " s" << std::endl;
+    }
+
     static int execute(int argc, const char *const *argv) {
         std::cout << "*** DBParams::Id = " << DBParams::Id << std::endl;
         std::cout << "*** DBParams::Commute = " << std::boolalpha << DBParams::Commute << std::endl;
@@ -1070,6 +1254,9 @@ public:
         bool enable_gc = false;
         unsigned gc_rate = Transaction::get_epoch_cycle();
         bool verbose = false;
+        std::string log_dir;
+        int ckpt_threads = 0;
+        std::vector<int> recovery_threads;
 
         Clp_Parser *clp = Clp_NewParser(argc, argv, noptions, options);
 
@@ -1113,6 +1300,19 @@ public:
                         mix = 0;
                     }
                     break;
+                case opt_ldir:
+                    log_dir = clp->val.s;
+                    break;
+                case opt_ckpt:
+                    ckpt_threads = clp->have_val ? clp->val.i : 4;
+                    break;
+                case opt_recov: {
+                    std::stringstream list(clp->have_val ? clp->val.s : "1,8,32");
+                    std::string n;
+                    while (std::getline(list, n, ','))
+                        recovery_threads.push_back(std::stoi(n));
+                    break;
+                }
                 default:
                     ::print_usage(argv[0]);
                     ret = 1;
@@ -1124,6 +1324,14 @@ public:
         Clp_DeleteParser(clp);
         if (ret != 0)
             return ret;
+#if TPCC_SPLIT_YTD
+        // the w_ytd and d_ytd boxes are neither logged nor checkpointed, so
+        // recovery would restore stale totals
+        if (!log_dir.empty() || !recovery_threads.empty()) {
+            std::cerr << "--log-dir and --recover are not supported with TPCC_SPLIT_YTD" << std::endl;
+            return 1;
+        }
+#endif
 
         std::cout << "Selected workload mix: " << std::string(workload_mix_names[mix]) << std::endl;
 
@@ -1147,20 +1355,83 @@ public:
         prepopulate_db(db);
         std::cout << "Prepopulation complete." << std::endl;
 
+        bool logging = !log_dir.empty();
+        // recovery starts from a checkpoint taken during the logged run
+        if (logging && !recovery_threads.empty() && ckpt_threads == 0)
+            ckpt_threads = 4;
         std::thread advancer;
         std::cout << "Garbage collection: ";
         if (enable_gc) {
             std::cout << "enabled, running every " << gc_rate / 1000.0 << " ms";
-            Transaction::set_epoch_cycle(gc_rate);
-            advancer = std::thread(&Transaction::epoch_advancer, nullptr);
         } else {
             std::cout << "disabled";
         }
         std::cout << std::endl << std::flush;
+        // the epoch advancer also drives log group commit
+        if (enable_gc || logging) {
+            Transaction::set_epoch_cycle(gc_rate);
+#if STO_RCU_WORKERS
+            // reclamation thread k serves runners k, k + STO_RCU_WORKERS, ...,
+            // which set_affinity places on node k % num_nodes when the number
+            // of reclamation threads is a multiple of the node count
+            Transaction::rcu_reclaimer_start_callback = [] (int k) {
+                set_node_affinity(k);
+            };
+#endif
+            advancer = std::thread(&Transaction::epoch_advancer, nullptr);
+        }
+#if MVCC_TRIMMING
+        // chains of rows no transaction touches any more are trimmed by
+        // per-epoch sweeps, on the thread id following the checkpointers
+        mvcc_trim_sweeper sweeper;
+        int sweeper_id = num_threads + ckpt_threads;
+        if (DBParams::MVCC && enable_gc) {
+            db.for_each_table([&sweeper] (auto& t) { sweeper.add(t); });
+            sweeper.start(sweeper_id);
+        }
+#endif
 
-        prof.start(profiler_mode);
-        auto num_trans = run_benchmark(db, prof, num_threads, time_limit, mix, verbose);
-        prof.finish(num_trans);
+        if (logging) {
+            // baseline run without logging, then the same run with logging
+            db.set_log_ids();
+            std::cout << "Logging: disabled" << std::endl;
+            prof.start(profiler_mode);
+            auto num_trans = run_benchmark(db, prof, num_threads, time_limit, mix, verbose);
+            double tput_off = prof.finish(num_trans);
+
+            if (!TLog::initialize(log_dir))
+                return 1;
+            db.write_meta(log_dir);
+            std::cout << "Logging: enabled, writing to " << log_dir << std::endl;
+            std::thread checkpointer;
+            if (ckpt_threads > 0)
+                checkpointer = std::thread(run_checkpoint, std::ref(db), log_dir,
+                                           ckpt_threads, num_threads, time_limit / 2);
+            prof.start(profiler_mode);
+            num_trans = run_benchmark(db, prof, num_threads, time_limit, mix, verbose);
+            double tput_on = prof.finish(num_trans);
+            if (checkpointer.joinable())
+                checkpointer.join();
+            TLog::shutdown();
+
+            std::cout << "Throughput (logging off): " << tput_off << " txns/sec" << std::endl;
+            std::cout << "Throughput (logging on):  " << tput_on << " txns/sec ("
+                      << 100.0 * tput_on / tput_off << "%), durable epoch "
+                      << TLog::durable_epoch() << std::endl;
+
+            for (int n : recovery_threads) {
+                tpcc_db<DBParams> rdb(log_dir, n);
+                auto& rs = rdb.recovery_stats();
+                double gb = rs.bytes_read / double(1 << 30);
+                std::cout << "Recovery (" << n << " threads): " << rs.seconds << " s, "
+                          << rs.rows_loaded << " rows from " << gb << " GB, "
+                          << rs.seconds / gb << " s/GB" << std::endl;
+            }
+        } else {
+            prof.start(profiler_mode);
+            auto num_trans = run_benchmark(db, prof, num_threads, time_limit, mix, verbose);
+            prof.finish(num_trans);
+        }
 
         size_t remaining_deliveries = 0;
         for (int wh = 1; wh <= db.num_warehouses(); wh++) {
@@ -1168,7 +1439,14 @@ public:
         }
         std::cout << "Remaining unresolved deliveries: " << remaining_deliveries << std::endl;
 
-        if (enable_gc) {
+#if MVCC_TRIMMING
+        if (sweeper.size()) {
+            sweeper.stop();
+            std::cout << "Trim sweeps: " << sweeper.sweeps() << ", "
+                      << sweeper.versions_trimmed() << " versions trimmed" << std::endl;
+        }
+#endif
+        if (enable_gc || logging) {
             Transaction::global_epochs.run = false;
             advancer.join();
         }
@@ -1177,6 +1455,10 @@ public:
         for (int i = 0; i < num_threads; ++i) {
             Transaction::tinfo[i].rcu_set.release_all();
         }
+#if MVCC_TRIMMING
+        if (sweeper.size())
+            Transaction::tinfo[sweeper_id].rcu_set.release_all();
+#endif
 
         return 0;
     }
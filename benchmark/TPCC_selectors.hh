@@ -2,6 +2,7 @@
 
 #include "Sto.hh"
 #include "VersionSelector.hh"
+#include "MVCCColumns.hh"
 #include "TPCC_structs.hh"
 
 namespace ver_sel {
@@ -296,3 +297,32 @@ private:
 
 }; // namespace ver_sel
 
+#if !TPCC_SPLIT_TABLE
+// Payment and Delivery change a few small columns of the wide customer row;
+// with MVCC_COLUMN_DELTAS their versions store just those
+template <>
+struct mv_columns<tpcc::customer_value> {
+    static constexpr bool enabled = true;
+    static constexpr size_t patch_size = 64;
+    static constexpr mv_column columns[] = {
+        MV_COLUMN(tpcc::customer_value, c_first),
+        MV_COLUMN(tpcc::customer_value, c_middle),
+        MV_COLUMN(tpcc::customer_value, c_last),
+        MV_COLUMN(tpcc::customer_value, c_street_1),
+        MV_COLUMN(tpcc::customer_value, c_street_2),
+        MV_COLUMN(tpcc::customer_value, c_city),
+        MV_COLUMN(tpcc::customer_value, c_state),
+        MV_COLUMN(tpcc::customer_value, c_zip),
+        MV_COLUMN(tpcc::customer_value, c_phone),
+        MV_COLUMN(tpcc::customer_value, c_since),
+        MV_COLUMN(tpcc::customer_value, c_credit),
+        MV_COLUMN(tpcc::customer_value, c_credit_lim),
+        MV_COLUMN(tpcc::customer_value, c_discount),
+        MV_COLUMN(tpcc::customer_value, c_balance),
+        MV_COLUMN(tpcc::customer_value, c_ytd_payment),
+        MV_COLUMN(tpcc::customer_value, c_payment_cnt),
+        MV_COLUMN(tpcc::customer_value, c_delivery_cnt),
+        MV_COLUMN(tpcc::customer_value, c_data)
+    };
+};
+#endif
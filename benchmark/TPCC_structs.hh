@@ -53,6 +53,11 @@ public:
         return oid_gens[wid % max_whs][did % max_dts];
     }
 
+    // used when rebuilding a database from its checkpoint and log
+    void set(uint64_t wid, uint64_t did, uint64_t oid) {
+        oid_gens[wid % max_whs][did % max_dts] = oid;
+    }
+
 private:
     uint64_t oid_gens[max_whs][max_dts];
 };
@@ -406,6 +411,10 @@ struct c_data_info {
 struct history_key {
     history_key(uint64_t hid)
         : h_id(bswap(hid)) {}
+    history_key(const lcdf::Str& mt_key) {
+        assert(mt_key.length() == sizeof(*this));
+        memcpy(this, mt_key.data(), sizeof(*this));
+    }
     bool operator==(const history_key& other) const {
         return (h_id == other.h_id);
     }
@@ -422,6 +431,10 @@ struct history_key {
     history_key(uint64_t wid, uint64_t did, uint64_t cid, uint64_t hid)
         : w_id(bswap(static_cast<uint32_t>(wid))), d_id(bswap(static_cast<uint32_t>(did))),
           c_id(bswap(cid)), h_id(bswap(hid)) {}
+    history_key(const lcdf::Str& mt_key) {
+        assert(mt_key.length() == sizeof(*this));
+        memcpy(this, mt_key.data(), sizeof(*this));
+    }
     bool operator==(const history_key& other) const {
         return (w_id == other.w_id && d_id == other.d_id &&
                 c_id == other.c_id && h_id == other.h_id);
@@ -9,6 +9,36 @@
 
 namespace tpcc {
 
+// Looks up the rows of a New-Order's order lines with one select_rows call
+// per supplying warehouse; returns false if the transaction must abort
+template <typename TableOf, typename Key, typename Access, typename Result>
+static bool select_rows_by_warehouse(TableOf table_of, const uint64_t* w_ids,
+                                     const std::vector<Key>& keys, const Access& access,
+                                     Result* results) {
+    bool grouped[15] = {};
+    size_t index[15];
+    Result group_results[15];
+    std::vector<Key> group;
+    group.reserve(keys.size());
+    for (size_t i = 0; i != keys.size(); ++i) {
+        if (grouped[i])
+            continue;
+        group.clear();
+        for (size_t j = i; j != keys.size(); ++j) {
+            if (w_ids[j] == w_ids[i]) {
+                index[group.size()] = j;
+                group.push_back(keys[j]);
+                grouped[j] = true;
+            }
+        }
+        if (!table_of(w_ids[i]).select_rows(group.data(), group.size(), access, group_results))
+            return false;
+        for (size_t g = 0; g != group.size(); ++g)
+            results[index[g]] = group_results[g];
+    }
+    return true;
+}
+
 template <typename DBParams>
 void tpcc_runner<DBParams>::run_txn_neworder() {
 #if TABLE_FINE_GRAINED
@@ -203,13 +233,68 @@ void tpcc_runner<DBParams>::run_txn_neworder() {
 
     TXP_ACCOUNT(txp_tpcc_no_stage4, num_items);
 
+    // the items and stocks of all order lines are looked up in batches.
+    // Order lines may repeat a stock: each stock is looked up once, and a
+    // repeat updates the row the earlier line wrote
+    std::vector<item_key> item_keys;
+    std::vector<stock_key> stock_keys;
+    uint64_t stock_w_ids[15];
+    uint64_t stock_i_ids[15];
+    size_t stock_slots[15];
+    item_keys.reserve(num_items);
+    stock_keys.reserve(num_items);
+    for (uint64_t i = 0; i < num_items; ++i) {
+        item_keys.emplace_back(ol_i_ids[i]);
+        size_t s = 0;
+        while (s != stock_keys.size()
+               && (stock_w_ids[s] != ol_supply_w_ids[i] || stock_i_ids[s] != ol_i_ids[i]))
+            ++s;
+        if (s == stock_keys.size()) {
+            stock_w_ids[s] = ol_supply_w_ids[i];
+            stock_i_ids[s] = ol_i_ids[i];
+            stock_keys.emplace_back(ol_supply_w_ids[i], ol_i_ids[i]);
+        }
+        stock_slots[i] = s;
+    }
+
+    typename tpcc_db<DBParams>::it_table_type::sel_return_type items[15];
+    abort = db.tbl_items().select_rows(item_keys.data(), num_items, RowAccess::ObserveValue, items);
+    CHK(abort);
+
+#if TPCC_SPLIT_TABLE
+    typename tpcc_db<DBParams>::sc_table_type::sel_return_type stocks_const[15];
+    typename tpcc_db<DBParams>::sm_table_type::sel_return_type stocks_comm[15];
+    abort = select_rows_by_warehouse([&] (uint64_t w) -> auto& { return db.tbl_stocks_const(w); },
+                                     stock_w_ids, stock_keys, RowAccess::ObserveValue, stocks_const);
+    CHK(abort);
+    abort = select_rows_by_warehouse([&] (uint64_t w) -> auto& { return db.tbl_stocks_comm(w); },
+                                     stock_w_ids, stock_keys,
+                                     Commute ? RowAccess::None : RowAccess::ObserveValue, stocks_comm);
+    CHK(abort);
+#else
+#if TABLE_FINE_GRAINED
+    std::initializer_list<typename tpcc_db<DBParams>::st_table_type::column_access_t> stock_access =
+        {{st_nc::s_quantity, Commute ? access_t::write : access_t::update},
+         {st_nc::s_ytd, Commute ? access_t::write : access_t::update},
+         {st_nc::s_order_cnt, Commute ? access_t::write : access_t::update},
+         {st_nc::s_remote_cnt, Commute ? access_t::write : access_t::update},
+         {st_nc::s_dists, access_t::read },
+         {st_nc::s_data, access_t::read }};
+#else
+    RowAccess stock_access = RowAccess::ObserveValue;
+#endif
+    typename tpcc_db<DBParams>::st_table_type::sel_return_type stocks[15];
+    abort = select_rows_by_warehouse([&] (uint64_t w) -> auto& { return db.tbl_stocks(w); },
+                                     stock_w_ids, stock_keys, stock_access, stocks);
+    CHK(abort);
+#endif
+
     for (uint64_t i = 0; i < num_items; ++i) {
         uint64_t iid = ol_i_ids[i];
         uint64_t wid = ol_supply_w_ids[i];
         uint64_t qty = ol_quantities[i];
 
-        std::tie(abort, result, std::ignore, value) = db.tbl_items().select_row(item_key(iid), RowAccess::ObserveValue);
-        CHK(abort);
+        std::tie(std::ignore, result, std::ignore, value) = items[i];
         assert(result);
         uint64_t oid = reinterpret_cast<const item_value *>(value)->i_im_id;
         CHK(oid != 0);
@@ -218,8 +303,7 @@ void tpcc_runner<DBParams>::run_txn_neworder() {
         //auto i_data = reinterpret_cast<const item_value *>(value)->i_data;
 
 #if TPCC_SPLIT_TABLE
-        std::tie(abort, result, row, value) = db.tbl_stocks_const(wid).select_row(stock_key(wid, iid), RowAccess::ObserveValue);
-        CHK(abort);
+        std::tie(std::ignore, result, row, value) = stocks_const[stock_slots[i]];
         assert(result);
         auto scv = reinterpret_cast<const stock_const_value*>(value);
         auto s_dist = scv->s_dists[q_d_id - 1];
@@ -229,9 +313,7 @@ void tpcc_runner<DBParams>::run_txn_neworder() {
         //else
         //    out_brand_generic[i] = 'G';
 
-        std::tie(abort, result, row, value) = db.tbl_stocks_comm(wid).select_row(stock_key(wid, iid),
-            Commute ? RowAccess::None : RowAccess::ObserveValue);
-        CHK(abort);
+        std::tie(std::ignore, result, row, value) = stocks_comm[stock_slots[i]];
         assert(result);
         if (Commute) {
             commutators::Commutator<stock_comm_value> comm(qty, wid != q_w_id);
@@ -247,21 +329,10 @@ void tpcc_runner<DBParams>::run_txn_neworder() {
             if (wid != q_w_id)
                 new_smv->s_remote_cnt += 1;
             db.tbl_stocks_comm(wid).update_row(row, new_smv);
+            std::get<3>(stocks_comm[stock_slots[i]]) = new_smv;
         }
 #else
-        std::tie(abort, result, row, value) = db.tbl_stocks(wid).select_row(stock_key(wid, iid),
-#if TABLE_FINE_GRAINED
-            {{st_nc::s_quantity, Commute ? access_t::write : access_t::update},
-             {st_nc::s_ytd, Commute ? access_t::write : access_t::update},
-             {st_nc::s_order_cnt, Commute ? access_t::write : access_t::update},
-             {st_nc::s_remote_cnt, Commute ? access_t::write : access_t::update},
-             {st_nc::s_dists, access_t::read },
-             {st_nc::s_data, access_t::read }}
-#else
-            RowAccess::ObserveValue
-#endif
-        );
-        CHK(abort);
+        std::tie(std::ignore, result, row, value) = stocks[stock_slots[i]];
         assert(result);
         auto sv = reinterpret_cast<const stock_value*>(value);
         int32_t s_quantity = sv->s_quantity;
@@ -286,6 +357,7 @@ void tpcc_runner<DBParams>::run_txn_neworder() {
             if (wid != q_w_id)
                 new_sv->s_remote_cnt += 1;
             db.tbl_stocks(wid).update_row(row, new_sv);
+            std::get<3>(stocks[stock_slots[i]]) = new_sv;
         }
 #endif
 
@@ -446,8 +518,11 @@ void tpcc_runner<DBParams>::run_txn_payment() {
          {wh_nc::w_street_2, access_t::read},
          {wh_nc::w_city, access_t::read},
          {wh_nc::w_state, access_t::read},
-         {wh_nc::w_zip, access_t::read},
-         {wh_nc::w_ytd, Commute ? access_t::write : access_t::update}}
+         {wh_nc::w_zip, access_t::read}
+#if !TPCC_SPLIT_YTD
+         , {wh_nc::w_ytd, Commute ? access_t::write : access_t::update}
+#endif
+        }
 #else
         RowAccess::ObserveValue
 #endif
@@ -463,6 +538,9 @@ void tpcc_runner<DBParams>::run_txn_payment() {
     out_w_zip = wv->w_zip;
 
     // update warehouse ytd
+#if TPCC_SPLIT_YTD
+    CHK(db.warehouse_ytd(q_w_id).increment(h_amount));
+#else
     if (Commute) {
         commutators::Commutator<warehouse_value> commutator(h_amount);
         db.tbl_warehouses().update_row(row, commutator);
@@ -471,6 +549,7 @@ void tpcc_runner<DBParams>::run_txn_payment() {
         new_wv->w_ytd += h_amount;
         db.tbl_warehouses().update_row(row, new_wv);
     }
+#endif
 #endif
 
     // select district row and retrieve district info
@@ -513,8 +592,11 @@ void tpcc_runner<DBParams>::run_txn_payment() {
          {dt_nc::d_street_2, access_t::read},
          {dt_nc::d_city, access_t::read},
          {dt_nc::d_state, access_t::read},
-         {dt_nc::d_zip, access_t::read},
-         {dt_nc::d_ytd, Commute ? access_t::write : access_t::update}}
+         {dt_nc::d_zip, access_t::read}
+#if !TPCC_SPLIT_YTD
+         , {dt_nc::d_ytd, Commute ? access_t::write : access_t::update}
+#endif
+        }
 #else
         RowAccess::ObserveValue
 #endif
@@ -531,6 +613,9 @@ void tpcc_runner<DBParams>::run_txn_payment() {
 
     TXP_INCREMENT(txp_tpcc_pm_stage1);
 
+#if TPCC_SPLIT_YTD
+    CHK(db.district_ytd(q_w_id, q_d_id).increment(h_amount));
+#else
     if (Commute) {
         // update district ytd commutatively
         commutators::Commutator<district_value> commutator(h_amount);
@@ -541,6 +626,7 @@ void tpcc_runner<DBParams>::run_txn_payment() {
         new_dv->d_ytd += h_amount;
         db.tbl_districts(q_w_id).update_row(row, new_dv);
     }
+#endif
 #endif
 
     TXP_INCREMENT(txp_tpcc_pm_stage2);
@@ -730,6 +816,8 @@ void tpcc_runner<DBParams>::run_txn_orderstatus() {
     size_t starts = 0;
 
     TXN {
+    // MVCC then reads at the snapshot read TID without tracking items
+    Sto::declare_read_only();
     ++starts;
 
     bool success, result;
@@ -1154,6 +1242,8 @@ void tpcc_runner<DBParams>::run_txn_stocklevel(){
     size_t starts = 0;
 
     TXN {
+    // MVCC then reads at the snapshot read TID without tracking items
+    Sto::declare_read_only();
     ++starts;
 
     ol_iids.clear();
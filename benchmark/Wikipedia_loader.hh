@@ -8,6 +8,7 @@ namespace wikipedia {
 template <typename DBParams>
 void wikipedia_loader<DBParams>::load() {
     std::cout << "Loading database..." << std::endl;
+    bench::load_meter meter;
 
     wikipedia_loader::initialize_scratch_space((size_t)num_users, (size_t)num_pages);
     load_revision();
@@ -16,11 +17,18 @@ void wikipedia_loader<DBParams>::load() {
     load_watchlist();
     wikipedia_loader::free_scratch_space();
 
+    meter.report();
     std::cout << "Loaded." << std::endl;
 }
 
 template <typename DBParams>
 void wikipedia_loader<DBParams>::load_useracct() {
+#if TPCC_SPLIT_TABLE
+    auto useracct_const = bench::make_bulk_loader(db.tbl_useracct_const());
+    auto useracct_comm = bench::make_bulk_loader(db.tbl_useracct_comm());
+#else
+    auto useracct = bench::make_bulk_loader(db.tbl_useracct());
+#endif
     for (int uid = 1; uid <= num_users; ++uid) {
 #if TPCC_SPLIT_TABLE
         useracct_const_row uc_r;
@@ -40,8 +48,8 @@ void wikipedia_loader<DBParams>::load_useracct() {
         uc_r.user_registration = "null";
         um_r.user_editcount = user_revision_cnts[uid - 1];
 
-        db.tbl_useracct_const().nontrans_put(useracct_key(uid), uc_r);
-        db.tbl_useracct_comm().nontrans_put(useracct_key(uid), um_r);
+        useracct_const.add(useracct_key(uid), uc_r);
+        useracct_comm.add(useracct_key(uid), um_r);
 #else
         useracct_row u_r;
         u_r.user_name = ig.generate_user_name();
@@ -59,13 +67,26 @@ void wikipedia_loader<DBParams>::load_useracct() {
         u_r.user_registration = "null";
         u_r.user_editcount = user_revision_cnts[uid - 1];
 
-        db.tbl_useracct().nontrans_put(useracct_key(uid), u_r);
+        useracct.add(useracct_key(uid), u_r);
 #endif
     }
+#if TPCC_SPLIT_TABLE
+    useracct_const.load();
+    useracct_comm.load();
+#else
+    useracct.load();
+#endif
 }
 
 template <typename DBParams>
 void wikipedia_loader<DBParams>::load_page() {
+#if TPCC_SPLIT_TABLE
+    auto page_const = bench::make_bulk_loader(db.tbl_page_const());
+    auto page_comm = bench::make_bulk_loader(db.tbl_page_comm());
+#else
+    auto page = bench::make_bulk_loader(db.tbl_page());
+#endif
+    auto idx_page = bench::make_bulk_loader(db.idx_page());
     for (int pid = 1; pid <= num_pages; ++pid) {
         int page_ns = ig.generate_page_namespace(pid);
         auto page_title = ig.generate_page_title(pid);
@@ -84,8 +105,8 @@ void wikipedia_loader<DBParams>::load_page() {
         pm_r.page_latest = page_last_rev_ids[pid - 1];
         pm_r.page_len = page_last_rev_lens[pid - 1];
 
-        db.tbl_page_const().nontrans_put(page_key(pid), pc_r);
-        db.tbl_page_comm().nontrans_put(page_key(pid), pm_r);
+        page_const.add(page_key(pid), pc_r);
+        page_comm.add(page_key(pid), pm_r);
 #else
         page_row pg_r;
         pg_r.page_namespace = page_ns;
@@ -99,18 +120,27 @@ void wikipedia_loader<DBParams>::load_page() {
         pg_r.page_latest = page_last_rev_ids[pid - 1];
         pg_r.page_len = page_last_rev_lens[pid - 1];
 
-        db.tbl_page().nontrans_put(page_key(pid), pg_r);
+        page.add(page_key(pid), pg_r);
 #endif
 
         page_idx_row pi_r{};
         pi_r.page_id = pid;
-        db.idx_page().nontrans_put(page_idx_key(page_ns, page_title), pi_r);
+        idx_page.add(page_idx_key(page_ns, page_title), pi_r);
     }
+#if TPCC_SPLIT_TABLE
+    page_const.load();
+    page_comm.load();
+#else
+    page.load();
+#endif
+    idx_page.load();
 }
 
 template <typename DBParams>
 void wikipedia_loader<DBParams>::load_watchlist() {
     std::set<int> user_pages;
+    auto watchlist = bench::make_bulk_loader(db.tbl_watchlist());
+    auto idx_watchlist = bench::make_bulk_loader(db.idx_watchlist());
     for (int uid = 1; uid <= num_users; ++uid) {
         user_pages.clear();
         auto num_watches = ig.generate_num_watches();
@@ -136,14 +166,18 @@ void wikipedia_loader<DBParams>::load_watchlist() {
             watchlist_row wl_r;
             wl_r.wl_notificationtimestamp = "null";
 
-            db.tbl_watchlist().nontrans_put(wl_k, wl_r);
-            db.idx_watchlist().nontrans_put(wl_i_k, watchlist_idx_row());
+            watchlist.add(wl_k, wl_r);
+            idx_watchlist.add(wl_i_k, watchlist_idx_row());
         }
     }
+    watchlist.load();
+    idx_watchlist.load();
 }
 
 template <typename DBParams>
 void wikipedia_loader<DBParams>::load_revision() {
+    auto text = bench::make_bulk_loader(db.tbl_text());
+    auto revision = bench::make_bulk_loader(db.tbl_revision());
 
     for (int pid = 1; pid <= num_pages; ++pid) {
         auto num_revs = ig.generate_num_revisions();
@@ -168,7 +202,7 @@ void wikipedia_loader<DBParams>::load_revision() {
             memcpy(t_r.old_text, old_text.c_str(), old_text_len + 1);
             t_r.old_flags = "utf-8";
             t_r.old_page = pid;
-            db.tbl_text().nontrans_put(t_k, t_r);
+            text.add(t_k, t_r);
 
             revision_key r_k(tr_id);
             revision_row r_r;
@@ -183,12 +217,14 @@ void wikipedia_loader<DBParams>::load_revision() {
             r_r.rev_len = (int)old_text_len;
             r_r.rev_parent_id = 0;
 
-            db.tbl_revision().nontrans_put(r_k, r_r);
+            revision.add(r_k, r_r);
 
             page_last_rev_ids[pid - 1] = tr_id;
             page_last_rev_lens[pid - 1] = tr_id;
         }
     }
+    text.load();
+    revision.load();
 }
 
 }; // namespace wikipedia
\ No newline at end of file
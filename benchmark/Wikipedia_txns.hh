@@ -399,29 +399,25 @@ size_t wikipedia_runner<DBParams>::run_txn_listPageNameSpace(int name_space) {
 
     ++nexecs;
 
-    std::vector<std::pair<int, std::string>> pages;
-
-    auto scan_callback = [&](const page_idx_key& key, const page_idx_row& row) {
-        pages.push_back({row.page_id, std::string(key.page_title.c_str())});
-        return true;
-    };
-
     page_idx_key pk0(name_space, std::string());
     page_idx_key pk1(name_space, std::string(255, (unsigned char)0xff));
-    abort = db.idx_page().template range_scan<decltype(scan_callback), false>(pk0, pk1, scan_callback, RowAccess::ObserveValue, false, 20/*retrieve 20 items*/);
+    auto pages = db.idx_page().template range_cursor<false>(pk0, pk1, RowAccess::ObserveValue, false);
+    abort = pages.next_batch(20/*retrieve 20 items*/);
     TXN_DO(abort);
 
-    for (auto pair : pages) {
+    for (size_t i = 0; i != pages.size(); ++i) {
+        int page_id = pages.row(i).page_id;
+        std::string page_title(pages.key(i).page_title.c_str());
 #if TPCC_SPLIT_TABLE
         std::tie(abort, result, std::ignore, value)
-                = db.tbl_page_const().select_row(page_key(pair.first), RowAccess::ObserveValue);
+                = db.tbl_page_const().select_row(page_key(page_id), RowAccess::ObserveValue);
         TXN_DO(abort);
         assert(result);
         auto pr = reinterpret_cast<const page_const_row *>(value);
-        always_assert(pair.second == std::string(pr->page_title.c_str()));
+        always_assert(page_title == std::string(pr->page_title.c_str()));
 #else
         std::tie(abort, result, std::ignore, value)
-                = db.tbl_page().select_row(page_key(pair.first),
+                = db.tbl_page().select_row(page_key(page_id),
 #if TABLE_FINE_GRAINED
                     {{page_nc::page_title, access_t::read}}
 #else
@@ -431,7 +427,7 @@ size_t wikipedia_runner<DBParams>::run_txn_listPageNameSpace(int name_space) {
         TXN_DO(abort);
         assert(result);
         auto pr = reinterpret_cast<const page_row *>(value);
-        always_assert(pair.second == std::string(pr->page_title.c_str()));
+        always_assert(page_title == std::string(pr->page_title.c_str()));
 #endif
     }
 
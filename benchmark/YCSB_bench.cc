@@ -14,7 +14,7 @@ using bench::db_profiler;
 
 enum {
     opt_dbid = 1, opt_nthrs, opt_mode, opt_time, opt_perf, opt_pfcnt, opt_gc,
-    opt_node, opt_comm
+    opt_node, opt_comm, opt_ldir, opt_mget
 };
 
 static const Clp_Option options[] = {
@@ -27,6 +27,8 @@ static const Clp_Option options[] = {
     { "gc",           'g', opt_gc,    Clp_NoVal,     Clp_Negate| Clp_Optional },
     { "node",         'n', opt_node,  Clp_NoVal,     Clp_Negate| Clp_Optional },
     { "commute",      'x', opt_comm,  Clp_NoVal,     Clp_Negate| Clp_Optional },
+    { "log-dir",      'L', opt_ldir,  Clp_ValString, Clp_Optional },
+    { "multi-get",    'M', opt_mget,  Clp_NoVal,     Clp_Negate| Clp_Optional },
 };
 
 static inline void print_usage(const char *argv_0) {
@@ -50,7 +52,13 @@ static inline void print_usage(const char *argv_0) {
        << "  --node (or -n)" << std::endl
        << "    Enable node tracking (default false)." << std::endl
        << "  --commute (or -x)" << std::endl
-       << "    Enable commutative updates in MVCC (default false)." << std::endl;
+       << "    Enable commutative updates in MVCC (default false)." << std::endl
+       << "  --log-dir=<DIR> (or -L<DIR>)" << std::endl
+       << "    Enable redo logging to DIR. The benchmark is run twice, without and then with" << std::endl
+       << "    logging, and both throughputs are reported." << std::endl
+       << "  --multi-get (or -M)" << std::endl
+       << "    Look up the reads of each transaction that come before its first write in" << std::endl
+       << "    one batch (default false)." << std::endl;
     std::cout << ss.str() << std::flush;
 }
 
@@ -161,6 +169,8 @@ public:
         mode_id mode = mode_id::ReadOnly;
         double time_limit = 10.0;
         bool enable_gc = false;
+        bool multi_get = false;
+        std::string log_dir;
 
         Clp_Parser *clp = Clp_NewParser(argc, argv, arraysize(options), options);
 
@@ -208,6 +218,12 @@ public:
                 break;
             case opt_comm:
                 break;
+            case opt_ldir:
+                log_dir = clp->val.s;
+                break;
+            case opt_mget:
+                multi_get = !clp->negated;
+                break;
             default:
                 print_usage(argv[0]);
                 ret = 1;
@@ -242,22 +258,46 @@ public:
 
         std::vector<ycsb_runner<DBParams>> runners;
         for (int i = 0; i < num_threads; ++i) {
-            runners.emplace_back(i, db, mode);
+            runners.emplace_back(i, db, mode, multi_get);
         }
 
         std::thread advancer;
         std::cout << "Generating workload..." << std::endl;
         workload_generation(runners, mode);
         std::cout << "Done." << std::endl;
-        if (enable_gc) {
+        bool logging = !log_dir.empty();
+        // the epoch advancer also drives log group commit
+        if (enable_gc || logging) {
             Transaction::set_epoch_cycle(1000);
             advancer = std::thread(&Transaction::epoch_advancer, nullptr);
             advancer.detach();
         }
 
-        prof.start(profiler_mode);
-        auto num_trans = run_benchmark(db, prof, runners, time_limit);
-        prof.finish(num_trans);
+        if (logging) {
+            // baseline run without logging, then the same run with logging
+            db.set_log_ids();
+            std::cout << "Logging: disabled" << std::endl;
+            prof.start(profiler_mode);
+            auto num_trans = run_benchmark(db, prof, runners, time_limit);
+            double tput_off = prof.finish(num_trans);
+
+            if (!TLog::initialize(log_dir))
+                return 1;
+            std::cout << "Logging: enabled, writing to " << log_dir << std::endl;
+            prof.start(profiler_mode);
+            num_trans = run_benchmark(db, prof, runners, time_limit);
+            double tput_on = prof.finish(num_trans);
+            TLog::shutdown();
+
+            std::cout << "Throughput (logging off): " << tput_off << " txns/sec" << std::endl;
+            std::cout << "Throughput (logging on):  " << tput_on << " txns/sec ("
+                      << 100.0 * tput_on / tput_off << "%), durable epoch "
+                      << TLog::durable_epoch() << std::endl;
+        } else {
+            prof.start(profiler_mode);
+            auto num_trans = run_benchmark(db, prof, runners, time_limit);
+            prof.finish(num_trans);
+        }
 
         return 0;
     }
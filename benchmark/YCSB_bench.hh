@@ -64,6 +64,16 @@ public:
 #endif
     }
 
+    // assigns every table a redo log id
+    void set_log_ids() {
+#if TPCC_SPLIT_TABLE
+        ycsb_odd_table_.set_log_id(1);
+        ycsb_even_table_.set_log_id(2);
+#else
+        ycsb_table_.set_log_id(1);
+#endif
+    }
+
     void prepopulate();
 
 private:
@@ -96,8 +106,15 @@ template <typename DBParams>
 class ycsb_runner {
 public:
     static constexpr bool Commute = DBParams::Commute;
-    ycsb_runner(int tid, ycsb_db<DBParams>& database, mode_id mid)
-        : db(database), ig(tid), runner_id(tid), mode(mid),
+    static constexpr size_t max_txn_size = 16;
+#if TPCC_SPLIT_TABLE
+    typedef typename ycsb_db<DBParams>::ycsb_half_table_type::sel_return_type sel_return_type;
+#else
+    typedef typename ycsb_db<DBParams>::ycsb_table_type::sel_return_type sel_return_type;
+#endif
+
+    ycsb_runner(int tid, ycsb_db<DBParams>& database, mode_id mid, bool mget = false)
+        : db(database), ig(tid), runner_id(tid), mode(mid), multi_get(mget),
           ud(), dd(), write_threshold() {}
 
     inline void dist_init() {
@@ -135,6 +152,10 @@ private:
     ycsb_input_generator ig;
     int runner_id;
     mode_id mode;
+    // look up the reads before a transaction's first write in batches
+    bool multi_get;
+
+    inline bool select_reads(const ycsb_txn_t& txn, size_t n, sel_return_type* reads);
 
     sampling::StoUniformDistribution<> *ud;
     sampling::StoRandomDistribution<> *dd;
@@ -42,10 +42,61 @@ void ycsb_runner<DBParams>::gen_workload(int txn_size) {
 
 using bench::RowAccess;
 
+// Looks up the keys of the first n operations of `txn`, which are reads,
+// with one select_rows call per table half or column group; returns false
+// if the transaction must abort
+template <typename DBParams>
+bool ycsb_runner<DBParams>::select_reads(const ycsb_txn_t& txn, size_t n, sel_return_type* reads) {
+#if TPCC_SPLIT_TABLE || TABLE_FINE_GRINED
+    static constexpr bool by_parity = true;
+#else
+    static constexpr bool by_parity = false;
+#endif
+    assert(n <= txn.ops.size() && n <= max_txn_size);
+    std::vector<ycsb_key> keys;
+    size_t index[max_txn_size];
+    sel_return_type results[max_txn_size];
+    keys.reserve(n);
+    for (bool parity : {false, true}) {
+        if (parity && !by_parity)
+            break;
+        keys.clear();
+        for (size_t i = 0; i != n; ++i) {
+            auto& op = txn.ops[i];
+            assert(!op.is_write);
+            if (!by_parity || bool(op.col_n % 2) == parity) {
+                index[keys.size()] = i;
+                keys.emplace_back(op.key);
+            }
+        }
+        if (keys.empty())
+            continue;
+#if TPCC_SPLIT_TABLE
+        bool success = db.ycsb_half_tables(parity).select_rows(keys.data(), keys.size(),
+            RowAccess::ObserveValue, results);
+#else
+        bool success = db.ycsb_table().select_rows(keys.data(), keys.size(),
+#if TABLE_FINE_GRINED
+            {{parity ? ycsb_value::NamedColumn::odd_columns : ycsb_value::NamedColumn::even_columns,
+              access_t::read}},
+#else
+            RowAccess::ObserveValue,
+#endif
+            results);
+#endif
+        if (!success)
+            return false;
+        for (size_t k = 0; k != keys.size(); ++k)
+            reads[index[k]] = results[k];
+    }
+    return true;
+}
+
 template <typename DBParams>
 void ycsb_runner<DBParams>::run_txn(const ycsb_txn_t& txn) {
     volatile ycsb_value::col_type output;
     typedef ycsb_value::NamedColumn nm;
+    sel_return_type reads[max_txn_size];
 
     TRANSACTION {
         bool success, result;
@@ -54,6 +105,13 @@ void ycsb_runner<DBParams>::run_txn(const ycsb_txn_t& txn) {
         if (DBParams::MVCC && txn.rw_txn) {
             Sto::mvcc_rw_upgrade();
         }
+        // batching reads past a write would reorder them with it
+        size_t batched = 0;
+        if (multi_get) {
+            while (batched != txn.ops.size() && !txn.ops[batched].is_write)
+                ++batched;
+            TXN_DO(select_reads(txn, batched, reads));
+        }
         for (auto& op : txn.ops) {
             bool col_parity = op.col_n % 2;
             auto col_group = col_parity ? nm::odd_columns : nm::even_columns;
@@ -100,26 +158,30 @@ void ycsb_runner<DBParams>::run_txn(const ycsb_txn_t& txn) {
 #endif
             } else {
                 ycsb_key key(op.key);
+                if (size_t(&op - txn.ops.data()) < batched) {
+                    std::tie(success, result, row, value) = reads[&op - txn.ops.data()];
+                } else {
 #if TPCC_SPLIT_TABLE
-                std::tie(success, result, row, value)
-                    = db.ycsb_half_tables(col_parity).select_row(key,
-                        RowAccess::ObserveValue);
-                TXN_DO(success);
-                assert(result);
-
-                output = reinterpret_cast<const ycsb_half_value*>(value)->cols[op.col_n/2];
+                    std::tie(success, result, row, value)
+                        = db.ycsb_half_tables(col_parity).select_row(key,
+                            RowAccess::ObserveValue);
 #else
-                std::tie(success, result, row, value)
-                    = db.ycsb_table().select_row(key,
+                    std::tie(success, result, row, value)
+                        = db.ycsb_table().select_row(key,
 #if TABLE_FINE_GRINED
-                    {{col_group, access_t::read}}
+                        {{col_group, access_t::read}}
 #else
-                    RowAccess::ObserveValue
+                        RowAccess::ObserveValue
 #endif
-                );
-                TXN_DO(success);
+                    );
+#endif
+                    TXN_DO(success);
+                }
                 assert(result);
 
+#if TPCC_SPLIT_TABLE
+                output = reinterpret_cast<const ycsb_half_value*>(value)->cols[op.col_n/2];
+#else
                 output = reinterpret_cast<const ycsb_value*>(value)->cols[op.col_n];
 #endif
                 (void)output;
@@ -92,6 +92,9 @@ public:
     bool check(TransItem& item, Transaction& txn) override {
         return data_[item.key<size_type>()].vers.cp_check_version(txn, item);
     }
+    const volatile uint64_t* version_word(const TransItem& item) override {
+        return &data_[item.key<size_type>()].vers.value();
+    }
     void install(TransItem& item, Transaction& txn) override {
         size_type i = item.key<size_type>();
         data_[i].v.write(item.write_value<T>());
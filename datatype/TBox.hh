@@ -83,6 +83,9 @@ public:
     bool check(TransItem& item, Transaction& txn) override {
         return vers_.cp_check_version(txn, item);
     }
+    const volatile uint64_t* version_word(const TransItem&) override {
+        return &vers_.value();
+    }
     void install(TransItem& item, Transaction& txn) override {
         v_.write(std::move(item.template write_value<T>()));
         txn.set_version_unlock(vers_, item);
@@ -110,6 +110,9 @@ public:
     bool check(TransItem& item, Transaction& txn) override {
         return vers_.cp_check_version(txn, item);
     }
+    const volatile uint64_t* version_word(const TransItem&) override {
+        return &vers_.value();
+    }
     void install(TransItem& item, Transaction& txn) override {
         T result = item.template write_value<T>();
         if (item.has_flag(delta_bit))
@@ -40,6 +40,11 @@ public:
     // transGet and friends
     bool transGet(size_type i, value_type& ret) const {
         assert(i < N);
+        // read-only transactions read their snapshot untracked
+        if (Sto::read_only()) {
+            ret = data_[i].v.find(Sto::read_tid<false/*!commute*/>())->v();
+            return true;
+        }
         auto item = Sto::item(this, i);
         if (item.has_write()) {
             ret = item.template write_value<T>();
@@ -54,6 +59,13 @@ public:
     }
     value_type transGet_throws(size_type i) const {
         assert(i < N);
+        if (Sto::read_only()) {
+            history_type *h = data_[i].v.find(Sto::read_tid<false/*!commute*/>());
+            if (!h) {
+                throw Transaction::Abort();
+            }
+            return h->v();
+        }
         auto item = Sto::item(this, i);
         if (item.has_write()) {
             return item.template write_value<T>();
@@ -103,7 +115,7 @@ public:
             hprev = v.find(Sto::read_tid<false/*!commute*/>(), false);
         }
         if (Sto::commit_tid() < hprev->rtid()) {
-            TransProxy(txn, item).add_write(nullptr);
+            TransProxy(txn, item).add_write<history_type*>(nullptr);
             return false;
         }
         history_type *h;
@@ -117,7 +129,7 @@ public:
         bool result = v.cp_lock(Sto::commit_tid(), h);
         if (!result && !h->status_is(MvStatus::ABORTED)) {
             v.delete_history(h);
-            TransProxy(txn, item).add_write(nullptr);
+            TransProxy(txn, item).add_write<history_type*>(nullptr);
         } else {
             TransProxy(txn, item).add_write(h);
             TransProxy(txn, item).clear_commute();
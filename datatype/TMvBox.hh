@@ -19,6 +19,9 @@ public:
     }
 
     std::pair<bool, read_type> read_nothrow() const {
+        // read-only transactions read their snapshot untracked
+        if (Sto::read_only())
+            return {true, v_.find(Sto::read_tid<false/*!commute*/>())->v()};
         auto item = Sto::item(this, 0);
         if (item.has_write())
             return {true, item.template write_value<T>()};
@@ -88,7 +91,7 @@ public:
         if (item.has_read()) {
             hprev = item.read_value<history_type*>();
             if (Sto::commit_tid() < hprev->rtid()) {
-                TransProxy(txn, item).add_write(nullptr);
+                TransProxy(txn, item).add_write<history_type*>(nullptr);
                 return false;
             }
         }
@@ -102,7 +105,7 @@ public:
         bool result = v_.cp_lock(Sto::commit_tid(), h);
         if (!result && !h->status_is(MvStatus::ABORTED)) {
             v_.delete_history(h);
-            TransProxy(txn, item).add_write(nullptr);
+            TransProxy(txn, item).add_write<history_type*>(nullptr);
         } else {
             TransProxy(txn, item).add_write(h);
             TransProxy(txn, item).clear_commute();
@@ -157,10 +160,11 @@ public:
         return *this;
     }
 
-    void increment(int64_t delta) {
+    bool increment(int64_t delta) {
         typedef TMvBox<int64_t>::comm_type comm_type;
         auto item = Sto::item(this, 0);
         item.add_commute(comm_type(delta));
+        return true;
     }
 };
 
@@ -0,0 +1,221 @@
+#pragma once
+
+#include <atomic>
+
+#include "Sto.hh"
+
+// An integer that absorbs commutative increments from many threads, by
+// splitting itself when it gets hot (as in Doppel, Narula et al., OSDI '14).
+//
+// Joined, the box is one value under one version, and increments are blind
+// writes to it. Once committing increments have queued up on that version
+// split_contention times, the box splits: each thread then increments its
+// own cache-line slice, under the slice's version, so increments from
+// different threads never conflict. The value is always the main value plus
+// every slice, so increments that chose their side before a phase change
+// stay correct.
+//
+// Reading the whole value while split observes every slice in use, and
+// conflicts with every increment. After merge_reads such reads, a reader
+// reconciles the slices into the main value and the box joins again.
+template <typename V = TNonopaqueVersion>
+class TSplitIntegerBox : public TObject {
+public:
+    typedef int64_t int_type;
+    typedef V version_type;
+
+    // Lock waits on the main version before the box splits
+    static constexpr unsigned split_contention = 64;
+    // Reads of the whole value while split before the box joins again
+    static constexpr unsigned merge_reads = 8;
+
+    TSplitIntegerBox()
+        : vers_(Sto::initialized_tid() | TransactionTid::nonopaque_bit),
+          value_(), split_(false), slices_(nullptr), nslices_(0),
+          contention_(0), split_reads_(0) {}
+    ~TSplitIntegerBox() {
+        delete[] slices_.load();
+    }
+
+    TSplitIntegerBox& operator=(int_type x) {
+        value_ = x;
+        return *this;
+    }
+
+    std::pair<bool, int_type> read() {
+        if (split_.load(std::memory_order_acquire)
+            && split_reads_.fetch_add(1, std::memory_order_relaxed) + 1 >= merge_reads)
+            merge();
+
+        auto item = Sto::item(this, 0);
+        if (!item.observe(vers_))
+            return {false, 0};
+        int_type v = value_;
+        if (item.has_write())
+            v += item.template write_value<int_type>();
+        if (split_.load(std::memory_order_acquire)) {
+            slice* s = slices_.load(std::memory_order_acquire);
+            for (int i = 0; i != nslices_.load(std::memory_order_acquire); ++i) {
+                auto sitem = Sto::item(this, slice_key(i));
+                if (!sitem.observe(s[i].vers))
+                    return {false, 0};
+                v += s[i].value;
+                if (sitem.has_write())
+                    v += sitem.template write_value<int_type>();
+            }
+        }
+        return {true, v};
+    }
+
+    // Returns false if the transaction must abort
+    bool increment(int_type delta) {
+        if (!split_.load(std::memory_order_acquire)) {
+            add_delta(Sto::item(this, 0), delta);
+            return true;
+        }
+        int id = TThread::id();
+        if (id >= nslices_.load(std::memory_order_acquire))
+            use_slices(id + 1);
+        // a merge before this commits folds the slice, so it must abort
+        // this increment
+        auto item = Sto::item(this, slice_key(id));
+        if (!item.observe(slices_.load(std::memory_order_acquire)[id].vers))
+            return false;
+        if (!split_.load(std::memory_order_seq_cst))
+            add_delta(Sto::item(this, 0), delta);
+        else
+            add_delta(item, delta);
+        return true;
+    }
+
+    bool is_split() const {
+        return split_.load(std::memory_order_acquire);
+    }
+
+    int_type nontrans_read() const {
+        int_type v = value_;
+        if (slice* s = slices_.load(std::memory_order_acquire)) {
+            for (int i = 0; i != nslices_.load(std::memory_order_acquire); ++i)
+                v += s[i].value;
+        }
+        return v;
+    }
+
+    // Splits the box regardless of contention
+    void split() {
+        vers_.lock_exclusive();
+        if (!split_.load(std::memory_order_relaxed)) {
+            split_locked();
+            vers_.inc_nonopaque();
+        }
+        vers_.unlock_exclusive();
+    }
+
+    // Reconciles the slices into the main value and joins the box; called
+    // outside the commit of the calling thread's transaction
+    void merge() {
+        vers_.lock_exclusive();
+        if (split_.load(std::memory_order_relaxed)) {
+            // before folding, so increments that still see the box split
+            // observed their slice before the fold
+            split_.store(false, std::memory_order_seq_cst);
+            slice* s = slices_.load(std::memory_order_relaxed);
+            for (int i = 0; i != nslices_.load(std::memory_order_relaxed); ++i) {
+                s[i].vers.lock_exclusive();
+                value_ += s[i].value;
+                s[i].value = 0;
+                s[i].vers.inc_nonopaque();
+                s[i].vers.unlock_exclusive();
+            }
+            contention_.store(0, std::memory_order_relaxed);
+            vers_.inc_nonopaque();
+        }
+        vers_.unlock_exclusive();
+    }
+
+    bool lock(TransItem& item, Transaction& txn) override {
+        if (is_main(item)) {
+            if (vers_.is_locked())
+                contention_.fetch_add(1, std::memory_order_relaxed);
+            return txn.try_lock(item, vers_);
+        }
+        return txn.try_lock(item, slice_of(item).vers);
+    }
+    bool check(TransItem& item, Transaction& txn) override {
+        if (is_main(item))
+            return vers_.cp_check_version(txn, item);
+        return slice_of(item).vers.cp_check_version(txn, item);
+    }
+    void install(TransItem& item, Transaction& txn) override {
+        if (is_main(item)) {
+            value_ += item.write_value<int_type>();
+            if (!split_.load(std::memory_order_relaxed)
+                && contention_.load(std::memory_order_relaxed) >= split_contention)
+                split_locked();
+            txn.set_version_unlock(vers_, item);
+        } else {
+            slice& s = slice_of(item);
+            s.value += item.write_value<int_type>();
+            txn.set_version_unlock(s.vers, item);
+        }
+    }
+    void unlock(TransItem& item) override {
+        if (is_main(item))
+            vers_.cp_unlock(item);
+        else
+            slice_of(item).vers.cp_unlock(item);
+    }
+
+private:
+    struct slice {
+        alignas(CACHE_LINE_SIZE) version_type vers;
+        int_type value;
+
+        slice()
+            : vers(Sto::initialized_tid() | TransactionTid::nonopaque_bit), value() {}
+    };
+
+    version_type vers_;  // Guards value_, split_ and nslices_
+    int_type value_;
+    std::atomic<bool> split_;
+    std::atomic<slice*> slices_;  // MAX_THREADS slices, from the first split
+    std::atomic<int> nslices_;  // Slices in use
+    std::atomic<unsigned> contention_;
+    std::atomic<unsigned> split_reads_;
+
+    static int slice_key(int i) {
+        return i + 1;
+    }
+    static bool is_main(const TransItem& item) {
+        return item.key<int>() == 0;
+    }
+    slice& slice_of(const TransItem& item) {
+        return slices_.load(std::memory_order_relaxed)[item.key<int>() - 1];
+    }
+
+    static void add_delta(TransProxy item, int_type delta) {
+        if (item.has_write())
+            item.template write_value<int_type>() += delta;
+        else
+            item.add_write(delta);
+    }
+
+    // Called with the main version locked, before it changes
+    void split_locked() {
+        if (!slices_.load(std::memory_order_relaxed))
+            slices_.store(new slice[MAX_THREADS], std::memory_order_release);
+        split_reads_.store(0, std::memory_order_relaxed);
+        split_.store(true, std::memory_order_release);
+    }
+
+    // Readers must observe every slice in use, so the main version changes
+    // when more come into use
+    void use_slices(int n) {
+        vers_.lock_exclusive();
+        if (n > nslices_.load(std::memory_order_relaxed)) {
+            nslices_.store(n, std::memory_order_release);
+            vers_.inc_nonopaque();
+        }
+        vers_.unlock_exclusive();
+    }
+};
@@ -122,3 +122,20 @@ void set_affinity(int runner_id) {
     }
 #endif
 }
+
+// Lets the calling thread run on any CPU of NUMA node `node`.
+void set_node_affinity(int node) {
+#if defined(__APPLE__)
+    (void)node;
+#else
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    for (int cpu_id : topo_info.cpu_id_list[node % topo_info.num_nodes])
+        CPU_SET(cpu_id, &cpuset);
+    int rc = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset);
+    if (rc != 0) {
+        std::cerr << "Error calling pthread_setaffinity_np: " << rc << "\n";
+        abort();
+    }
+#endif
+}
@@ -18,6 +18,7 @@
 
 extern void allocator_init();
 extern void set_affinity(int runner_id);
+extern void set_node_affinity(int node);
 extern void discover_topology();
 
 static constexpr uint32_t level_bstr  = 0x80000004;
@@ -2,22 +2,312 @@
 
 #pragma once
 
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+
 #include "MVCCTypes.hh"
 
 namespace commutators { 
 
+//////////////////////////////////////////////
+//
+// Column operations, for rows that don't define their own Commutator
+//
+//////////////////////////////////////////////
+
+// Rows opt in to the generic commutator by declaring how many column
+// operations one update may carry:
+//     static constexpr size_t commute_ops = 2;
+template <typename T, typename = void>
+struct commute_ops : std::integral_constant<size_t, 0> {};
 template <typename T>
-class Commutator {
-public:
-    // Each type must define its own Commutator variant
-    Commutator() = default;
+struct commute_ops<T, std::void_t<decltype(T::commute_ops)>>
+        : std::integral_constant<size_t, T::commute_ops> {};
+
+enum class ColumnOp : uint8_t {
+    add,             // v += x
+    saturating_add,  // v = clamp(v + x, lo, hi)
+    min,             // v = min(v, x)
+    max,             // v = max(v, x)
+    bit_or,          // v |= x
+    bit_and,         // v &= x
+    append,          // appends bytes to a NUL-terminated string, up to its size
+    lww_set          // v = x if x's timestamp is newer than the row's
+};
+
+enum class ColumnType : uint8_t { i8, i16, i32, i64, u8, u16, u32, u64, f32, f64, bytes };
+
+template <typename F>
+constexpr ColumnType column_type() {
+    if constexpr (std::is_floating_point<F>::value) {
+        return sizeof(F) == 4 ? ColumnType::f32 : ColumnType::f64;
+    } else if constexpr (std::is_integral<F>::value) {
+        constexpr bool s = std::is_signed<F>::value;
+        switch (sizeof(F)) {
+        case 1:  return s ? ColumnType::i8 : ColumnType::u8;
+        case 2:  return s ? ColumnType::i16 : ColumnType::u16;
+        case 4:  return s ? ColumnType::i32 : ColumnType::u32;
+        default: return s ? ColumnType::i64 : ColumnType::u64;
+        }
+    } else {
+        return ColumnType::bytes;
+    }
+}
+
+// One operation on one column. Plain data, so commutators holding them can
+// be logged and replayed.
+struct ColumnUpdate {
+    static constexpr size_t operand_size = 24;
+
+    ColumnOp op;
+    ColumnType type;
+    uint16_t size;    // bytes of the value in `operand`
+    uint32_t offset;  // of the column in the row
+    uint32_t aux;     // append: size of the column; lww_set: offset of the
+                      // row's uint64_t timestamp column
+    alignas(8) char operand[operand_size];
 
+    void apply(char* row) const {
+        switch (type) {
+        case ColumnType::i8:  apply_as<int8_t>(row); break;
+        case ColumnType::i16: apply_as<int16_t>(row); break;
+        case ColumnType::i32: apply_as<int32_t>(row); break;
+        case ColumnType::i64: apply_as<int64_t>(row); break;
+        case ColumnType::u8:  apply_as<uint8_t>(row); break;
+        case ColumnType::u16: apply_as<uint16_t>(row); break;
+        case ColumnType::u32: apply_as<uint32_t>(row); break;
+        case ColumnType::u64: apply_as<uint64_t>(row); break;
+        case ColumnType::f32: apply_as<float>(row); break;
+        case ColumnType::f64: apply_as<double>(row); break;
+        case ColumnType::bytes: apply_bytes(row); break;
+        }
+    }
+
+private:
+    template <typename F>
+    F operand_at(size_t pos) const {
+        F x;
+        memcpy(&x, operand + pos, sizeof(F));
+        return x;
+    }
+
+    template <typename F>
+    void apply_as(char* row) const {
+        if (op == ColumnOp::append || op == ColumnOp::lww_set) {
+            apply_bytes(row);
+            return;
+        }
+        F v;
+        memcpy(&v, row + offset, sizeof(F));
+        F x = operand_at<F>(0);
+        switch (op) {
+        case ColumnOp::add:
+            v += x;
+            break;
+        case ColumnOp::saturating_add: {
+            // the delta of an integral column is an int64_t, so unsigned
+            // columns can go down
+            F lo = operand_at<F>(8), hi = operand_at<F>(16);
+            if constexpr (std::is_integral<F>::value) {
+                __int128 sum = __int128(v) + operand_at<int64_t>(0);
+                v = sum < lo ? lo : (sum > hi ? hi : F(sum));
+            } else {
+                v += x;
+                v = v < lo ? lo : (v > hi ? hi : v);
+            }
+            break;
+        }
+        case ColumnOp::min:
+            v = x < v ? x : v;
+            break;
+        case ColumnOp::max:
+            v = x > v ? x : v;
+            break;
+        case ColumnOp::bit_or:
+        case ColumnOp::bit_and:
+            if constexpr (std::is_integral<F>::value) {
+                v = op == ColumnOp::bit_or ? F(v | x) : F(v & x);
+            }
+            break;
+        default:
+            break;
+        }
+        memcpy(row + offset, &v, sizeof(F));
+    }
+
+    void apply_bytes(char* row) const {
+        if (op == ColumnOp::append) {
+            char* s = row + offset;
+            size_t len = strnlen(s, aux);
+            // a column without a terminator is full; leave it alone
+            if (len == aux)
+                return;
+            size_t n = std::min(size_t(size), aux > len ? aux - len - 1 : 0);
+            memcpy(s + len, operand, n);
+            s[len + n] = '\0';
+        } else if (op == ColumnOp::lww_set) {
+            uint64_t ts, row_ts;
+            memcpy(&ts, operand, sizeof(ts));
+            memcpy(&row_ts, row + aux, sizeof(row_ts));
+            if (ts > row_ts) {
+                memcpy(row + offset, operand + sizeof(ts), size);
+                memcpy(row + aux, &ts, sizeof(ts));
+            }
+        } else {
+            always_assert(false, "Arithmetic column operation on a non-arithmetic column.");
+        }
+    }
+};
+
+template <typename T>
+class Commutator;
+
+// Base of the default Commutator: nothing unless T declares commute_ops
+template <typename T, bool = (commute_ops<T>::value > 0)>
+class ColumnCommutator {
+public:
     T& operate(T& v) const {
         always_assert(false, "Should never operate on the default commutator.");
         return v;
     }
 };
 
+// The default Commutator of rows that declare commute_ops: a list of
+// column operations, built by chaining, applied in order:
+//     Commutator<row> comm;
+//     comm.add(&row::balance, -amount).max(&row::last_seen, now);
+//     table.update_row(rid, comm);
+// add, min, max, bit_or, bit_and and lww_set commute with other updates of
+// their kind; saturating_add and append are blind, but their results depend
+// on the order of updates, which is the commit order.
+template <typename T>
+class ColumnCommutator<T, true> {
+public:
+    static constexpr size_t max_ops = commute_ops<T>::value;
+    typedef Commutator<T> comm_type;
+
+    template <typename F, typename X>
+    comm_type& add(F T::*column, X x) {
+        return arith(ColumnOp::add, column, {F(x)});
+    }
+    // Adds, clamping the result to [lo, hi] (by default, F's range)
+    template <typename F, typename X>
+    comm_type& saturating_add(F T::*column, X x,
+                              F lo = std::numeric_limits<F>::lowest(),
+                              F hi = std::numeric_limits<F>::max()) {
+        typedef typename std::conditional<std::is_integral<F>::value, int64_t, F>::type delta_type;
+        comm_type& c = arith(ColumnOp::saturating_add, column, {});
+        ColumnUpdate& u = ops_[n_ - 1];
+        delta_type d(x);
+        memcpy(u.operand, &d, sizeof(d));
+        memcpy(u.operand + 8, &lo, sizeof(F));
+        memcpy(u.operand + 16, &hi, sizeof(F));
+        return c;
+    }
+    template <typename F, typename X>
+    comm_type& min(F T::*column, X x) {
+        return arith(ColumnOp::min, column, {F(x)});
+    }
+    template <typename F, typename X>
+    comm_type& max(F T::*column, X x) {
+        return arith(ColumnOp::max, column, {F(x)});
+    }
+    template <typename F, typename X>
+    comm_type& bit_or(F T::*column, X x) {
+        static_assert(std::is_integral<F>::value, "bit_or needs an integral column");
+        return arith(ColumnOp::bit_or, column, {F(x)});
+    }
+    template <typename F, typename X>
+    comm_type& bit_and(F T::*column, X x) {
+        static_assert(std::is_integral<F>::value, "bit_and needs an integral column");
+        return arith(ColumnOp::bit_and, column, {F(x)});
+    }
+    // Appends `len` bytes to a NUL-terminated string column (a char array or
+    // bench::var_string), dropping what doesn't fit
+    template <typename F>
+    comm_type& append(F T::*column, const char* data, size_t len) {
+        always_assert(len <= ColumnUpdate::operand_size, "Append is too long for a column operation.");
+        ColumnUpdate& u = next(ColumnOp::append, ColumnType::bytes, column, len);
+        u.aux = sizeof(F);
+        memcpy(u.operand, data, len);
+        return self();
+    }
+    // Sets the column to `x` if `ts` is newer than the row's `ts_column`,
+    // which it then becomes
+    template <typename F>
+    comm_type& lww_set(F T::*column, const F& x, uint64_t T::*ts_column, uint64_t ts) {
+        static_assert(std::is_trivially_copyable<F>::value, "lww_set needs a plain column");
+        static_assert(sizeof(F) + sizeof(ts) <= ColumnUpdate::operand_size,
+                      "Column is too wide for lww_set");
+        ColumnUpdate& u = next(ColumnOp::lww_set, ColumnType::bytes, column, sizeof(F));
+        u.aux = offset_of(ts_column);
+        memcpy(u.operand, &ts, sizeof(ts));
+        memcpy(u.operand + sizeof(ts), &x, sizeof(F));
+        return self();
+    }
+
+    size_t size() const {
+        return n_;
+    }
+
+    T& operate(T& v) const {
+        auto row = reinterpret_cast<char*>(&v);
+        for (uint32_t i = 0; i != n_; ++i)
+            ops_[i].apply(row);
+        return v;
+    }
+
+private:
+    comm_type& self() {
+        return static_cast<comm_type&>(*this);
+    }
+
+    template <typename F>
+    static uint32_t offset_of(F T::*column) {
+        alignas(T) static const char base[sizeof(T)] = {};
+        auto row = reinterpret_cast<const T*>(base);
+        return uint32_t(reinterpret_cast<const char*>(&(row->*column)) - base);
+    }
+
+    template <typename F>
+    ColumnUpdate& next(ColumnOp op, ColumnType type, F T::*column, size_t size) {
+        always_assert(n_ < max_ops, "Too many column operations for commute_ops.");
+        ColumnUpdate& u = ops_[n_++];
+        u.op = op;
+        u.type = type;
+        u.size = uint16_t(size);
+        u.offset = offset_of(column);
+        u.aux = 0;
+        return u;
+    }
+
+    template <typename F>
+    comm_type& arith(ColumnOp op, F T::*column, std::initializer_list<F> xs) {
+        static_assert(std::is_arithmetic<F>::value, "Column operation needs an arithmetic column");
+        static_assert(sizeof(F) <= 8, "Column is too wide");
+        ColumnUpdate& u = next(op, column_type<F>(), column, sizeof(F));
+        char* p = u.operand;
+        for (const F& x : xs) {
+            memcpy(p, &x, sizeof(F));
+            p += sizeof(F);
+        }
+        return self();
+    }
+
+    uint32_t n_ = 0;
+    ColumnUpdate ops_[max_ops];
+};
+
+template <typename T>
+class Commutator : public ColumnCommutator<T> {
+public:
+    // Types that don't declare commute_ops must define their own Commutator
+    // variant
+    Commutator() = default;
+};
+
 //////////////////////////////////////////////
 //
 // Commutator type for integral +/- operations
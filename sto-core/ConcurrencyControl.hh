@@ -36,6 +36,11 @@ class VersionDelegate {
     static void txn_set_any_nonopaque(Transaction& txn, bool val) {
         txn.any_nonopaque_ = val;
     }
+#if STO_READ_VERSION_ARRAY
+    static void txn_record_version_read(Transaction& txn, TransItem& item, TransactionTid::type v) {
+        txn.record_version_read(item, v);
+    }
+#endif
 
     static TransactionTid::type& standard_tid(Transaction& txn) {
         return txn.commit_tid_;
@@ -74,6 +79,7 @@ inline TransProxy& TransProxy::add_write() {
         clear_commute();
     }
     if (!has_write()) {
+        always_assert(!t()->read_only_, "write in a read-only transaction");
         item().__or_flags(TransItem::write_bit);
         t()->any_writes_ = true;
     }
@@ -97,6 +103,7 @@ inline TransProxy& TransProxy::add_write(Args&&... args) {
         clear_commute();
     }
     if (!has_write()) {
+        always_assert(!t()->read_only_, "write in a read-only transaction");
         item().__or_flags(TransItem::write_bit);
         item().wdata_ = Packer<T>::pack(t()->buf_, std::forward<Args>(args)...);
         t()->any_writes_ = true;
@@ -155,6 +162,9 @@ inline bool TVersion::observe_read_impl(TransItem &item, bool add_read){
     if (add_read && !item.has_read()) {
         VersionDelegate::item_or_flags(item, TransItem::read_bit);
         VersionDelegate::item_access_rdata(item).v = Packer<TVersion>::pack(t().buf_, std::move(version));
+#if STO_READ_VERSION_ARRAY
+        VersionDelegate::txn_record_version_read(t(), item, version.value());
+#endif
         //item().__or_flags(TransItem::read_bit);
         //item().rdata_ = Packer<TVersion>::pack(t()->buf_, std::move(version));
     }
@@ -177,6 +187,9 @@ inline bool TNonopaqueVersion::observe_read_impl(TransItem& item, bool add_read)
         VersionDelegate::item_or_flags(item, TransItem::read_bit);
         VersionDelegate::item_access_rdata(item).v = Packer<TNonopaqueVersion>::pack(t().buf_, std::move(version));
         VersionDelegate::txn_set_any_nonopaque(t(), true);
+#if STO_READ_VERSION_ARRAY
+        VersionDelegate::txn_record_version_read(t(), item, version.value());
+#endif
         //item().__or_flags(TransItem::read_bit);
         //item().rdata_ = Packer<TNonopaqueVersion>::pack(t()->buf_, std::move(version));
         //t()->any_nonopaque_ = true;
@@ -790,6 +803,12 @@ inline bool Transaction::try_lock(TransItem& item, VersionBase<VersImpl>& vers)
         if (std::is_base_of<TicTocBase<VersImpl>, VersImpl>::value) {
             vers.compute_commit_ts_step(this->tictoc_tid_, true/* write */);
         } else {
+#if STO_DECENTRALIZED_TID
+            // like Silo, commit after every version we overwrite, so
+            // conflicting writes (and their redo records) are ordered by TID;
+            // TicToc versions hold timestamps, not TIDs
+            tid_observed_ = std::max(tid_observed_, vers.value() & ~(TransactionTid::increment_value - 1));
+#endif
             vers.compute_commit_ts_step(this->commit_tid_, true/* write */);
         }
     }
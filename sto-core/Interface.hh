@@ -27,6 +27,37 @@ public:
         (void) item, (void) committed;
     }
     virtual void print(std::ostream& w, const TransItem& item) const;
+
+    // If check() validates `item` with nothing but an OCC version check
+    // (cp_check_version) of one version word, returns that word; such reads
+    // are validated straight from the transaction's read-version array
+    // (STO_READ_VERSION_ARRAY). Called once per read item.
+    virtual const volatile uint64_t* version_word(const TransItem& item) {
+        (void) item;
+        return nullptr;
+    }
+
+    // Batched commit interface (STO_BATCH_COMMIT). The transaction hands
+    // each object all of its items for a commit phase at once, in
+    // tracking-set order. lock_batch and check_batch return the number of
+    // leading items that succeeded; any item after a failed one is left
+    // alone. The defaults make one virtual call per item.
+    virtual unsigned lock_batch(TransItem** items, unsigned n, Transaction& txn) {
+        for (unsigned i = 0; i != n; ++i)
+            if (!lock(*items[i], txn))
+                return i;
+        return n;
+    }
+    virtual unsigned check_batch(TransItem** items, unsigned n, Transaction& txn) {
+        for (unsigned i = 0; i != n; ++i)
+            if (!check(*items[i], txn))
+                return i;
+        return n;
+    }
+    virtual void install_batch(TransItem** items, unsigned n, Transaction& txn) {
+        for (unsigned i = 0; i != n; ++i)
+            install(*items[i], txn);
+    }
 };
 
 typedef TObject Shared;
@@ -0,0 +1,103 @@
+// Column layouts of wide MVCC rows, and the patches of column-delta versions
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "MVCCTypes.hh"
+
+struct mv_column {
+    uint32_t offset;
+    uint32_t size;
+};
+
+#define MV_COLUMN(type, field) \
+    mv_column{uint32_t(offsetof(type, field)), uint32_t(sizeof(((type*) nullptr)->field))}
+
+// Column layout of a row type. Row types opt in to column-delta versions by
+// specializing this with `enabled = true`, their `columns`, listed with
+// MV_COLUMN in NamedColumn order, and `patch_size`, the most bytes of changed
+// columns a version stores as a delta; writes that change more store the
+// whole row.
+template <typename T>
+struct mv_columns {
+    static constexpr bool enabled = false;
+};
+
+// Whether MVCC writes of T may store column-delta versions
+template <typename T>
+constexpr bool mv_column_deltas = MVCC_COLUMN_DELTAS && mv_columns<T>::enabled;
+
+// The changed columns of a row: which ones, and their bytes, packed in
+// column order.
+template <typename T>
+class MvColumnPatch {
+public:
+    typedef mv_columns<T> layout;
+    static constexpr size_t ncolumns = sizeof(layout::columns) / sizeof(mv_column);
+    static constexpr size_t capacity = layout::patch_size;
+    static_assert(ncolumns <= 64, "column deltas support at most 64 columns");
+
+    MvColumnPatch() : mask_(0), size_(0) {}
+
+    bool empty() const {
+        return mask_ == 0;
+    }
+    uint64_t mask() const {
+        return mask_;
+    }
+    size_t size() const {
+        return size_;
+    }
+
+    // Columns whose bytes differ between `a` and `b`
+    static uint64_t diff(const T& a, const T& b) {
+        auto pa = reinterpret_cast<const char*>(&a);
+        auto pb = reinterpret_cast<const char*>(&b);
+        uint64_t mask = 0;
+        for (size_t i = 0; i != ncolumns; ++i) {
+            const mv_column& c = layout::columns[i];
+            if (memcmp(pa + c.offset, pb + c.offset, c.size) != 0)
+                mask |= uint64_t(1) << i;
+        }
+        return mask;
+    }
+
+    // Stores the columns of `v` in `mask`; fails, leaving the patch empty,
+    // if they don't fit or there are none.
+    bool assign(const T& v, uint64_t mask) {
+        size_t n = 0;
+        for (uint64_t m = mask; m; m &= m - 1)
+            n += layout::columns[__builtin_ctzll(m)].size;
+        if (mask == 0 || n > capacity)
+            return false;
+        auto src = reinterpret_cast<const char*>(&v);
+        char* p = data_;
+        for (uint64_t m = mask; m; m &= m - 1) {
+            const mv_column& c = layout::columns[__builtin_ctzll(m)];
+            memcpy(p, src + c.offset, c.size);
+            p += c.size;
+        }
+        mask_ = mask;
+        size_ = n;
+        return true;
+    }
+
+    // Writes the stored columns over those of `v`
+    void apply(T& v) const {
+        auto dst = reinterpret_cast<char*>(&v);
+        const char* p = data_;
+        for (uint64_t m = mask_; m; m &= m - 1) {
+            const mv_column& c = layout::columns[__builtin_ctzll(m)];
+            memcpy(dst + c.offset, p, c.size);
+            p += c.size;
+        }
+    }
+
+private:
+    uint64_t mask_;
+    uint32_t size_;
+    char data_[capacity];
+};
@@ -0,0 +1,119 @@
+// Per-thread slab pools for MVCC versions and their GC arguments
+
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <vector>
+
+#include "compiler.hh"
+
+// Fixed-size storage for objects of type T. Each thread frees into and
+// allocates from its own list, carved out of slabs of `batch` objects.
+// Freed objects are reused once RCU has expired them, since that is when
+// they are freed. A thread that frees more than it allocates (as when other
+// threads run its GC callbacks) moves whole batches to a shared depot, from
+// which allocating threads refill before carving new slabs. Slabs are
+// never returned to the system, and the objects cached by a thread that
+// exits are lost.
+template <typename T>
+class MvPool {
+public:
+    static void* allocate() {
+        cache& c = cache_;
+        if (unlikely(!c.head))
+            c.refill();
+        node* n = c.head;
+        c.head = n->next;
+        --c.count;
+        return n;
+    }
+
+    static void deallocate(void* p) {
+        cache& c = cache_;
+        node* n = static_cast<node*>(p);
+        n->next = c.head;
+        c.head = n;
+        if (unlikely(++c.count >= 2 * batch))
+            c.spill();
+    }
+
+private:
+    struct node {
+        node* next;
+    };
+
+    static constexpr size_t align = alignof(T) > alignof(node) ? alignof(T) : alignof(node);
+    static constexpr size_t size = (sizeof(T) + align - 1) / align * align;
+    static constexpr unsigned batch = size >= 512 ? 32 : 16384 / size;
+
+    struct cache {
+        node* head = nullptr;
+        unsigned count = 0;
+
+        void refill() {
+            {
+                std::lock_guard<std::mutex> guard(depot_lock_);
+                if (!depot_.empty()) {
+                    head = depot_.back();
+                    depot_.pop_back();
+                    count = batch;
+                    return;
+                }
+            }
+            char* slab = static_cast<char*>(
+                ::operator new(size * batch, std::align_val_t(align)));
+            for (unsigned i = batch; i != 0; --i) {
+                node* n = reinterpret_cast<node*>(slab + (i - 1) * size);
+                n->next = head;
+                head = n;
+            }
+            count = batch;
+        }
+
+        // Moves one batch to the depot.
+        void spill() {
+            node* first = head;
+            node* last = head;
+            for (unsigned i = 1; i != batch; ++i)
+                last = last->next;
+            head = last->next;
+            last->next = nullptr;
+            count -= batch;
+            std::lock_guard<std::mutex> guard(depot_lock_);
+            depot_.push_back(first);
+        }
+    };
+
+    static thread_local cache cache_;
+    static std::mutex depot_lock_;
+    static std::vector<node*> depot_;  // lists of `batch` objects each
+};
+
+template <typename T>
+thread_local typename MvPool<T>::cache MvPool<T>::cache_;
+template <typename T>
+std::mutex MvPool<T>::depot_lock_;
+template <typename T>
+std::vector<typename MvPool<T>::node*> MvPool<T>::depot_;
+
+// Gives a class storage from its MvPool when MVCC_POOLING is on.
+#if MVCC_POOLING
+#define MV_POOLED(type)                                                 \
+    static void* operator new(size_t sz) {                              \
+        assert(sz == sizeof(type));                                     \
+        (void) sz;                                                      \
+        return MvPool<type>::allocate();                                \
+    }                                                                   \
+    static void* operator new(size_t, void* p) {                        \
+        return p;                                                       \
+    }                                                                   \
+    static void operator delete(void* p) {                              \
+        MvPool<type>::deallocate(p);                                    \
+    }
+#else
+#define MV_POOLED(type)
+#endif
@@ -5,6 +5,8 @@
 #include <stack>
 
 #include "MVCCTypes.hh"
+#include "MVCCColumns.hh"
+#include "MVCCPool.hh"
 #include "TRcu.hh"
 
 // Status types of MvHistory elements
@@ -30,12 +32,110 @@ template <typename T>
 struct MvLocation {
     MvObject<T>* obj;
     TransactionTid::type tid;
+
+    MV_POOLED(MvLocation<T>)
 };
 
 template <typename T>
 struct MvDelLocation {
     MvObject<T>* obj;
     MvHistory<T>* h_del;
+
+    MV_POOLED(MvDelLocation<T>)
+};
+
+// A replaced version kept for snapshots that may read it: those below `tid`
+template <typename T>
+struct MvRetired {
+    MvHistory<T>* h;
+    TransactionTid::type tid;
+
+    MV_POOLED(MvRetired<T>)
+};
+
+// Value storage of a version
+template <typename T, bool Columns = mv_column_deltas<T>>
+class MvValue {
+public:
+    MvValue() : v_() {}
+    explicit MvValue(std::nullptr_t) : v_() {}
+    explicit MvValue(const T& v) : v_(v) {}
+    explicit MvValue(T&& v) : v_(std::move(v)) {}
+
+    T* get() {
+        return &v_;
+    }
+    void set(const T& v) {
+        v_ = v;
+    }
+    bool is_patch() const {
+        return false;
+    }
+
+private:
+    T v_;
+};
+
+// Rows that may have column-delta versions keep the value out of line, so
+// that a delta version, which holds only a patch, stays small. A delta gets
+// a value once it is flattened; the patch stays, since concurrent flattens
+// of newer versions may be applying it.
+template <typename T>
+class MvValue<T, true> {
+public:
+    MvValue() : v_(make()) {}
+    explicit MvValue(std::nullptr_t) : v_(nullptr) {}
+    explicit MvValue(const T& v) : v_(make(v)) {}
+    explicit MvValue(T&& v) : v_(make(std::move(v))) {}
+    MvValue(const MvValue&) = delete;
+    MvValue& operator=(const MvValue&) = delete;
+    ~MvValue() {
+        if (v_) {
+            destroy(v_);
+        }
+    }
+
+    T* get() {
+        return v_;
+    }
+    void set(const T& v) {
+        if (v_) {
+            *v_ = v;
+        } else {
+            v_ = make(v);
+        }
+    }
+    bool is_patch() const {
+        return !patch_.empty();
+    }
+    const MvColumnPatch<T>& patch() const {
+        return patch_;
+    }
+    // Stores only the columns of `v` in `mask`; fails if they don't fit
+    bool assign_patch(const T& v, uint64_t mask) {
+        return patch_.assign(v, mask);
+    }
+
+private:
+    template <typename... Args>
+    static T* make(Args&&... args) {
+#if MVCC_POOLING
+        return new (MvPool<T>::allocate()) T(std::forward<Args>(args)...);
+#else
+        return new T(std::forward<Args>(args)...);
+#endif
+    }
+    static void destroy(T* v) {
+#if MVCC_POOLING
+        v->~T();
+        MvPool<T>::deallocate(v);
+#else
+        delete v;
+#endif
+    }
+
+    T* v_;
+    MvColumnPatch<T> patch_;
 };
 
 template <typename T>
@@ -47,6 +147,8 @@ public:
     typedef MvObject<T> object_type;
     typedef commutators::Commutator<T> comm_type;
 
+    MV_POOLED(history_type)
+
     MvHistory() = delete;
     explicit MvHistory(object_type *obj) : MvHistory(0, obj, nullptr) {}
     explicit MvHistory(
@@ -80,12 +182,33 @@ public:
         }
 
         if (nvp) {
-            v_ = *nvp;
+            v_.set(*nvp);
+        }
+    }
+    // Writes *nvp over *base, the value the writer read: as a column delta
+    // when the changed columns fit in a patch, whole otherwise
+    explicit MvHistory(
+            type ntid, object_type *obj, const T *nvp, const T *base,
+            history_type *nprev)
+            : obj_(obj), v_(nullptr), gc_enqueued_(false), prev_(nprev),
+              status_(PENDING), rtid_(ntid), wtid_(ntid), delete_cb(nullptr) {
+        if (prev_) {
+            always_assert(
+                is_valid_prev(prev_),
+                "Cannot write MVCC history with wtid earlier than prev wtid.");
+        }
+
+        if constexpr (mv_column_deltas<T>) {
+            if (v_.assign_patch(*nvp, MvColumnPatch<T>::diff(*nvp, *base))) {
+                status_delta();
+                return;
+            }
         }
+        v_.set(*nvp);
     }
     explicit MvHistory(
             type ntid, object_type *obj, comm_type &&c, history_type *nprev = nullptr)
-            : obj_(obj), c_(c), v_(), gc_enqueued_(false), prev_(nprev),
+            : obj_(obj), c_(c), v_(nullptr), gc_enqueued_(false), prev_(nprev),
               status_(PENDING), rtid_(ntid), wtid_(ntid), delete_cb(nullptr) {
         if (prev_) {
             always_assert(
@@ -132,9 +255,22 @@ public:
 
     inline void hard_gc_push(const bool inlined) {
         assert(gc_enqueued_.load());
+        if (Transaction::mvcc_retention()) {
+            // whatever replaced this version has a TID below tid_ceiling()
+            auto retired = new MvRetired<T>();
+            retired->h = this;
+            retired->tid = Transaction::tid_ceiling();
+            Transaction::rcu_call(gc_retained_cb, retired);
+        } else {
+            gc_release(inlined);
+        }
+    }
+
+    // Frees the version, an epoch from now
+    inline void gc_release(const bool inlined) {
         if (inlined) {
 #if MVCC_INLINING
-            Transaction::rcu_call(gc_inlined_cb, this);
+            object()->release_inlined();
 #else
             assert(false);
 #endif
@@ -274,16 +410,41 @@ public:
         if (status_is(DELTA)) {
             enflatten();
         }
-        return v_;
+        return *v_.get();
     }
 
     inline T* vp() {
         if (status_is(DELTA)) {
             enflatten();
         }
-        return &v_;
+        return v_.get();
     }
 
+    // Value for a read by the running transaction. A committed column delta
+    // is rebuilt in the transaction's scratch memory, so it stays small,
+    // unless the rebuild steps past column_flattening_length versions or
+    // more; then it is flattened in place.
+    inline T* vp_txn();
+
+    // Commutator of a DELTA version
+    inline const comm_type& c() const {
+        return c_;
+    }
+
+    // Whether this is a column-delta version (flattened or not)
+    inline bool is_column_delta() const {
+        return v_.is_patch();
+    }
+
+    // Changed columns of a column-delta version
+    inline const MvColumnPatch<T>& patch() const {
+        return v_.patch();
+    }
+
+    // How many versions a column delta is rebuilt from before vp_txn()
+    // flattens it instead
+    static constexpr size_t column_flattening_length = 8;
+
 #if SAFE_FLATTEN
     inline T* vp_safe_flatten();
 #endif
@@ -297,6 +458,15 @@ private:
     static void delete_prep_cb(void *ptr) {
         auto location = reinterpret_cast<MvDelLocation<T>*>(ptr);
         history_type* hd = location->h_del;  // DELETED version
+        if (Transaction::mvcc_retention()
+            && hd->wtid() > Transaction::mvcc_trim_tid()
+            && Transaction::global_epochs.run) {
+            // snapshots from before the delete may still read the row;
+            // wait for the epoch the retention window passes it
+            Transaction::rcu_call_at(Transaction::mvcc_release_epoch(hd->wtid()),
+                                     delete_prep_cb, location);
+            return;
+        }
         history_type* h = location->obj->h_;
         while (h) {
             if (h == hd) {
@@ -314,23 +484,45 @@ private:
         delete location;
     }
 
-    // Initializes the flattening process
+    // Flattens this version for a reader, which waits for it
     inline void enflatten() {
+        uint64_t start = txp_count >= txp_mvcc_flat_read_cycles ? read_tsc() : 0;
+        size_t n = flatten_in_place();
+        TXP_INCREMENT(txp_mvcc_flat_read_runs);
+        TXP_ACCOUNT(txp_mvcc_flat_read_cycles, start ? read_tsc() - start : 0);
+#if MVCC_ADAPTIVE_FLATTENING
+        if (n)
+            object()->flattened_on_read(n);
+#else
+        (void) n;
+#endif
+    }
+
+    // Initializes the flattening process. Returns how many DELTA versions
+    // were applied, or 0 if another thread flattened this one.
+    inline size_t flatten_in_place() {
         T v{};
+        size_t n = 0;
         if (status_is(COMMITTED_DELTA)) {
             assert(prev());
             TXP_INCREMENT(txp_mvcc_flat_runs);
 #if CU_READ_AT_PRESENT
-            prev()->flatten(v, wtid_);
+            n = prev()->flatten(v, wtid_) + 1;
 #else
-            prev()->flatten(v);
+            n = prev()->flatten(v) + 1;
 #endif
-            v = c_.operate(v);
+            apply_delta(v);
         }
+        publish(v);
+        return n;
+    }
+
+    // Makes `v` the value of this delta, unless another thread does first
+    inline void publish(const T& v) {
         MvStatus expected = COMMITTED_DELTA;
         if (status_.compare_exchange_strong(expected, LOCKED_COMMITTED_DELTA)) {
             TXP_INCREMENT(txp_mvcc_flat_commits);
-            v_ = v;
+            v_.set(v);
             status(COMMITTED);
         } else {
             TXP_INCREMENT(txp_mvcc_flat_spins);
@@ -339,10 +531,25 @@ private:
         }
     }
 
+    // Applies this DELTA version to the value below it
+    inline void apply_delta(T& v) const {
+        if constexpr (mv_column_deltas<T>) {
+            if (v_.is_patch()) {
+                v_.patch().apply(v);
+                return;
+            }
+        }
+        v = c_.operate(v);
+    }
+
+    // Computes into `v` the value of this version from those below it.
+    // Flattening hands the versions it steps past to GC, since the flattened
+    // version ends every later search; a mere rebuild (`collect` false)
+    // leaves them. Returns how many versions were stepped past.
 #if CU_READ_AT_PRESENT
-    void flatten(T &v, type next_wtid) {
+    size_t flatten(T &v, type next_wtid, bool collect = true) {
 #else
-    void flatten(T &v) {
+    size_t flatten(T &v, bool collect = true) {
 #endif
         std::stack<history_type*> trace;
         history_type* curr = this;
@@ -375,44 +582,91 @@ private:
 #endif
             trace.push(curr);
             TXP_INCREMENT(txp_mvcc_flat_versions);
-            curr->gc_push(object()->is_inlined(curr));
+            if (collect) {
+                curr->gc_push(object()->is_inlined(curr));
+            }
         }
+        size_t n = trace.size() - 1;
         while (!trace.empty()) {
             auto h = trace.top();
             trace.pop();
 
             if (h->status_is(COMMITTED)) {
                 if (h->status_is(DELTA)) {
-                    v = h->c_.operate(v);
+                    h->apply_delta(v);
                 } else if (!h->status_is(COMMITTED_DELETED)) {
-                    v = h->v_;
+                    v = *h->v_.get();
                 }
             }
 
         }
+        return n;
     }
 
-    static void gc_inlined_cb(void *ptr) {
-        history_type* h = static_cast<history_type*>(ptr);
-        assert(h->gc_enqueued_.load());
-        h->object()->ih_.status_unused();
+    static void gc_retained_cb(void *ptr) {
+        auto retired = static_cast<MvRetired<T>*>(ptr);
+        if (retired->tid > Transaction::mvcc_trim_tid()
+            && Transaction::global_epochs.run) {
+            // a snapshot may still read it until the retention window
+            // passes it
+            Transaction::rcu_call_at(Transaction::mvcc_release_epoch(retired->tid),
+                                     gc_retained_cb, retired);
+            return;
+        }
+        history_type* h = retired->h;
+        delete retired;
+        h->gc_release(h->object()->is_inlined(h));
     }
 
     static void gc_time_flattening_cb(void *ptr) {
         auto location = static_cast<MvLocation<T>*>(ptr);
         history_type* h = location->obj->head();
+#if MVCC_ADAPTIVE_FLATTENING
+        // whether readers got to the versions from the queued one up
+        bool read = false;
+#endif
         while (h && !h->status_is(COMMITTED_DELTA, COMMITTED) &&
                 (h->wtid() > location->tid)) {
+#if MVCC_ADAPTIVE_FLATTENING
+            read = read || h->was_read();
+#endif
             h = h->prev();
         }
 
+        // Versions above the queued one may still be pending, and so may
+        // versions linked below it later; flattening over a pending one
+        // would drop its delta and hand it to GC while its writer runs
         if (h && (h->wtid() == location->tid) &&
-                h->status_is(COMMITTED_DELTA) && !h->is_gc_enqueued()) {
-            h->enflatten();
+                h->status_is(COMMITTED_DELTA) && !h->is_gc_enqueued() &&
+                !h->pending_below()) {
+#if MVCC_ADAPTIVE_FLATTENING
+            if (!read && !h->was_read())
+                location->obj->flattened_unread();
+#endif
+            TXP_INCREMENT(txp_mvcc_flat_gc_runs);
+            h->flatten_in_place();
         }
         delete location;
     }
 
+    // Whether a transaction read this version, or a reader flattened a
+    // later one over it
+    inline bool was_read() const {
+        return rtid_.load(std::memory_order_relaxed) > wtid_;
+    }
+
+    // Whether a version between this one and the flat version it builds on
+    // is still pending
+    inline bool pending_below() const {
+        for (history_type* p = prev();
+                p && !p->status_is(COMMITTED_DELTA, COMMITTED); p = p->prev()) {
+            if (p->status_is(PENDING)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
     // Returns true if the given prev pointer would be a valid prev element
     inline bool is_valid_prev(const history_type* prev) const {
         return prev->wtid_ <= wtid_;
@@ -434,7 +688,7 @@ private:
 
     object_type * const obj_;  // Parent object
     comm_type c_;
-    T v_;
+    MvValue<T> v_;
 
     std::atomic<bool> gc_enqueued_;  // Whether this element is on the GC queue
     std::atomic<history_type*> prev_;
@@ -454,14 +708,29 @@ public:
     typedef MvHistory<T> history_type;
     typedef const T& read_type;
     typedef TransactionTid::type type;
+    typedef TRcuSet::epoch_type epoch_type;
+    typedef TRcuSet::signed_epoch_type signed_epoch_type;
 
     // How many consecutive DELTA versions will be allowed before flattening
     static constexpr uint64_t gc_flattening_length = 257;
 
+#if MVCC_ADAPTIVE_FLATTENING
+    // Bounds and starting point of the per-object flattening length
+    static constexpr uint32_t min_flattening_length = 4;
+    static constexpr uint32_t max_flattening_length = 1024;
+    static constexpr uint32_t initial_flattening_length = 16;
+
+    // How many consecutive DELTA versions are currently allowed before
+    // flattening
+    uint32_t flattening_length() const {
+        return flattening_length_.load(std::memory_order_relaxed);
+    }
+#endif
+
 #if MVCC_INLINING
     MvObject() : h_(&ih_), ih_(this) {
         if (std::is_trivial<T>::value) {
-            ih_.v_ = T();
+            ih_.v_.set(T());
             ih_.status_delete();
         } else {
             ih_.status_delete();
@@ -484,7 +753,7 @@ public:
 #else
     MvObject() : h_(new history_type(this)) {
         if (std::is_trivial<T>::value) {
-            h_.load()->v_ = T();
+            h_.load()->v_.set(T());
             h_.load()->status_delete();
         } else {
             h_.load()->status_delete();
@@ -519,19 +788,77 @@ public:
 
     class InvalidState {};
 
+    // How many versions find() may step past before it trims the chain
+    static constexpr size_t trim_walk_length = 4;
+
     // Aborts currently-pending head version; returns true if the head version
     // is pending and false otherwise.
     bool abort(history_type* h) {
         if (h) {
             if (!h->status_is(MvStatus::PENDING)) {
+#if MVCC_TRIMMING
+                // aborted in cp_lock, after linking
+                if (h->status_is(ABORTED)) {
+                    enqueue_for_trim();
+                }
+#endif
                 return false;
             }
 
             h->status_abort();
+#if MVCC_TRIMMING
+            enqueue_for_trim();
+#endif
         }
         return true;
     }
 
+    // Unlinks the versions no transaction can read any more, given that none
+    // reads below `tid`: runs of aborted versions at or below `tid`, and
+    // everything below the newest committed version at or below `tid`.
+    // Writers never link new versions below `tid`, so only trimmers write
+    // the prev_ pointers changed here; a run is unlinked with one CAS on the
+    // prev_ of the (unaborted) version above it, which concurrent trims of
+    // the same chain race on. Returns the number of versions unlinked.
+    size_t trim(const type tid) {
+        size_t n = 0;
+        std::atomic<history_type*>* link = &h_;
+        history_type* h = link->load(std::memory_order_acquire);
+        while (h && !h->is_gc_enqueued()) {
+            if (h->wtid() <= tid && h->status_is(ABORTED)) {
+                history_type* next = h->prev();
+                while (next && !next->is_gc_enqueued()
+                       && next->status_is(ABORTED)) {
+                    next = next->prev();
+                }
+                history_type* first = h;
+                if (link->compare_exchange_strong(first, next)) {
+                    while (h != next) {
+                        history_type* prev = h->prev();
+                        h->gc_push(is_inlined(h));
+                        h = prev;
+                        ++n;
+                    }
+                }
+                h = link->load(std::memory_order_acquire);
+                continue;
+            }
+            if (h->wtid() <= tid && h->status_is(COMMITTED_DELTA, COMMITTED)) {
+                // what's below was already handed to GC when h installed
+                history_type* prev = h->prev();
+                if (prev) {
+                    h->prev_.compare_exchange_strong(prev, nullptr);
+                }
+                break;
+            }
+            link = &h->prev_;
+            h = link->load(std::memory_order_acquire);
+        }
+        TXP_INCREMENT(txp_mvcc_trim_runs);
+        TXP_ACCOUNT(txp_mvcc_trim_versions, n);
+        return n;
+    }
+
     const T& access(const type tid) const {
         return find(tid)->v();
     }
@@ -587,7 +914,7 @@ public:
             while (!prev->status_is(COMMITTED)) {
                 prev = prev->prev();
             }
-            if (!(delta_counter++ % gc_flattening_length)) {
+            if (flattening_due()) {
                 h->enqueue_for_flattening();
             }
         }
@@ -621,6 +948,12 @@ public:
                 next = t;
                 t = *target;
             }
+            // Nothing links onto the inlined version once it is garbage:
+            // GC only clears the pointers to it from above the newest
+            // committed version (see unlink_inlined)
+            if (is_inlined(t) && t->is_gc_enqueued()) {
+                return false;
+            }
 
             // Properly link h's prev_
             h->prev_.store(t, std::memory_order_relaxed);
@@ -669,6 +1002,7 @@ public:
     // regardless of status
     history_type* find(const type tid, const bool wait=true) const {
         history_type* h = head();
+        size_t steps = 0;
 
         /* TODO: use something smarter than a linear scan */
         while (h) {
@@ -686,10 +1020,17 @@ public:
                 }
             }
             h = h->prev();
+            ++steps;
         }
 
         assert(h);
 
+        account_walk(steps);
+#if MVCC_TRIMMING
+        if (steps > trim_walk_length) {
+            const_cast<MvObject<T>*>(this)->trim(Transaction::mvcc_trim_tid());
+        }
+#endif
         return h;
     }
 
@@ -717,10 +1058,9 @@ public:
     template <typename... Args>
     history_type* new_history(Args&&... args) {
 #if MVCC_INLINING
-        auto status = ih_.status();
-        if (status == UNUSED &&
-                ih_.status_.compare_exchange_strong(status, PENDING)) {
+        if (claim_inlined()) {
             // Use inlined history element
+            ih_.~history_type();
             new (&ih_) history_type(std::forward<Args>(args)...);
             return &ih_;
         }
@@ -767,6 +1107,119 @@ public:
     }
 
 protected:
+    // Counts a DELTA install; returns whether it is time to queue a
+    // gc-time flattening
+    bool flattening_due() {
+#if MVCC_ADAPTIVE_FLATTENING
+        if (delta_counter.fetch_add(1, std::memory_order_relaxed) + 1
+                < flattening_length_.load(std::memory_order_relaxed)) {
+            return false;
+        }
+        delta_counter.store(0, std::memory_order_relaxed);
+        return true;
+#else
+        return !(delta_counter++ % gc_flattening_length);
+#endif
+    }
+
+#if MVCC_ADAPTIVE_FLATTENING
+    // A reader had to flatten `n` DELTA versions itself: those below are
+    // flat now, and when readers walk long chains, the background flattens
+    // sooner.
+    void flattened_on_read(size_t n) {
+        delta_counter.store(0, std::memory_order_relaxed);
+        uint32_t len = flattening_length_.load(std::memory_order_relaxed);
+        if (n > min_flattening_length && len > min_flattening_length) {
+            flattening_length_.store(std::max(len / 2, min_flattening_length),
+                                     std::memory_order_relaxed);
+        }
+    }
+
+    // Nobody read the versions a gc-time flattening was about to flatten:
+    // the object is written more than it is read, so flatten later.
+    void flattened_unread() {
+        uint32_t len = flattening_length_.load(std::memory_order_relaxed);
+        if (len < max_flattening_length) {
+            flattening_length_.store(std::min(len * 2, max_flattening_length),
+                                     std::memory_order_relaxed);
+        }
+    }
+#endif
+
+    // Chain-length histogram: versions stepped past per find()
+    static void account_walk(size_t steps) {
+        if (steps == 0) {
+            TXP_INCREMENT(txp_mvcc_find_0);
+        } else if (steps == 1) {
+            TXP_INCREMENT(txp_mvcc_find_1);
+        } else if (steps <= 3) {
+            TXP_INCREMENT(txp_mvcc_find_3);
+        } else if (steps <= 7) {
+            TXP_INCREMENT(txp_mvcc_find_7);
+        } else if (steps <= 15) {
+            TXP_INCREMENT(txp_mvcc_find_15);
+        } else {
+            TXP_INCREMENT(txp_mvcc_find_long);
+        }
+        TXP_ACCOUNT(txp_mvcc_find_max, steps);
+    }
+
+#if MVCC_INLINING
+    // The inlined version is garbage from now. No callback frees it: the
+    // next write to the object reuses it once the epoch after this one has
+    // passed, so nothing touches the object after its last write.
+    void release_inlined() {
+        ih_free_epoch_.store(Transaction::global_epochs.global_epoch.load(),
+                             std::memory_order_release);
+    }
+
+    // Claims the inlined version for a new version, if it was never linked
+    // or is garbage that no reader can reach any more
+    bool claim_inlined() {
+        auto status = ih_.status();
+        if (status == UNUSED)
+            return ih_.status_.compare_exchange_strong(status, PENDING);
+        epoch_type e = ih_free_epoch_.load(std::memory_order_acquire);
+        if (e && signed_epoch_type(Transaction::global_epochs.active_epoch.load() - e) > 0
+                && ih_free_epoch_.compare_exchange_strong(e, 0)) {
+            unlink_inlined();
+            return true;
+        }
+        return false;
+    }
+
+    // Clears the pointer to the inlined version, which is about to be reused,
+    // so that it can't be linked into the chain twice. Only a version at or
+    // above the newest committed one can still point to it, since cp_lock
+    // links nothing onto it once it is garbage. The search ends there: what
+    // is below a committed version is garbage too, and may already be freed.
+    void unlink_inlined() {
+        history_type* h = head();
+        while (h && h != &ih_ && !h->is_gc_enqueued()) {
+            history_type* prev = h->prev();
+            if (prev == &ih_) {
+                h->prev_.compare_exchange_strong(prev, nullptr);
+                break;
+            }
+            if (h->status_is(COMMITTED_DELTA, COMMITTED)) {
+                break;
+            }
+            h = prev;
+        }
+    }
+#endif
+
+#if MVCC_TRIMMING
+    // Trims the chain in the background, an epoch from now
+    void enqueue_for_trim() {
+        Transaction::rcu_call(trim_cb, this);
+    }
+
+    static void trim_cb(void* ptr) {
+        static_cast<MvObject<T>*>(ptr)->trim(Transaction::mvcc_trim_tid());
+    }
+#endif
+
     // Spin-wait on interested item
     void wait_if_pending(const history_type* h) const {
         while (h->status_is(MvStatus::PENDING)) {
@@ -775,11 +1228,16 @@ protected:
         }
     }
 
-    std::atomic<uint64_t> delta_counter;  // For gc-time flattening
+    std::atomic<uint64_t> delta_counter {0};  // For gc-time flattening
+#if MVCC_ADAPTIVE_FLATTENING
+    std::atomic<uint32_t> flattening_length_ {initial_flattening_length};
+#endif
     std::atomic<history_type*> h_;
 
 #if MVCC_INLINING
     history_type ih_;  // Inlined version
+    // Global epoch when ih_ became garbage, 0 while it isn't
+    std::atomic<epoch_type> ih_free_epoch_ {0};
 #endif
 
     friend class MvHistory<T>;
@@ -795,6 +1253,25 @@ T* MvHistory<T>::vp_safe_flatten() {
             return nullptr;
         enflatten();
     }
-    return &v_;
+    return v_.get();
 }
 #endif
+
+template <typename T>
+T* MvHistory<T>::vp_txn() {
+    if constexpr (mv_column_deltas<T>) {
+        if (v_.is_patch() && status_is(COMMITTED_DELTA) && Sto::in_progress()) {
+            T* v = Sto::tx_alloc<T>();
+#if CU_READ_AT_PRESENT
+            size_t n = prev()->flatten(*v, wtid_, false);
+#else
+            size_t n = prev()->flatten(*v, false);
+#endif
+            if (n < column_flattening_length) {
+                apply_delta(*v);
+                return v;
+            }
+        }
+    }
+    return vp();
+}
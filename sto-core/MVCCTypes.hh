@@ -18,6 +18,36 @@ template <typename T> class MvHistory;
 
 // Generic contained for MVCC abstractions applied to a given object
 template <typename T> class MvObject;
+// Store a version inside each MvObject, used whenever it is free, so that
+// objects that aren't written concurrently need no separate allocation.
+// A write reuses that version once the epoch after it was replaced has
+// passed (see MvObject::claim_inlined).
 #ifndef MVCC_INLINING
 #define MVCC_INLINING 0
 #endif
+
+// Allocate versions and GC arguments from per-thread pools (see MvPool)
+#ifndef MVCC_POOLING
+#define MVCC_POOLING 1
+#endif
+
+// Unlink versions below the trim watermark (Transaction::mvcc_trim_tid())
+// from chains that find() walks far into, and from chains with aborted
+// versions an epoch after the abort (see MvObject::trim); the benchmarks
+// also sweep whole tables once an epoch (bench::mvcc_trim_sweeper)
+#ifndef MVCC_TRIMMING
+#define MVCC_TRIMMING 0
+#endif
+
+// Adapt how many DELTA versions each object allows before flattening them
+// in the background to how its readers use it, instead of a fixed
+// MvObject::gc_flattening_length
+#ifndef MVCC_ADAPTIVE_FLATTENING
+#define MVCC_ADAPTIVE_FLATTENING 1
+#endif
+
+// Let writes to rows with a column layout (mv_columns<T>) store only the
+// columns that changed, as column-delta versions
+#ifndef MVCC_COLUMN_DELTAS
+#define MVCC_COLUMN_DELTAS 0
+#endif
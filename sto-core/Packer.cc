@@ -28,3 +28,15 @@ void TransactionBuffer::hard_clear(bool delete_all) {
         e_ = 0;
     }
 }
+
+void TransactionBuffer::rewind(size_t size) {
+    while (e_ && size < linked_size_) {
+        elt* e = e_;
+        e_ = e->next;
+        e->clear();
+        delete[] (char*) e;
+        linked_size_ -= e_->pos;
+    }
+    if (e_)
+        e_->clear(size - linked_size_);
+}
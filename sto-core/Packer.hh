@@ -49,7 +49,7 @@ class TransactionBuffer {
 
 public:
     TransactionBuffer()
-        : e_(), linked_size_(0) {
+        : e_(), linked_size_(0), preserve_(false) {
     }
     ~TransactionBuffer() {
         if (e_)
@@ -73,6 +73,17 @@ public:
         if (e_ && e_->pos)
             hard_clear(false);
     }
+    // Destroys the objects allocated after the buffer was `size` bytes long
+    void rewind(size_t size);
+
+    // While set, repacking allocates a fresh object rather than overwriting
+    // the old one, so older references keep their values (for savepoints)
+    bool preserving() const {
+        return preserve_;
+    }
+    void set_preserve(bool preserve) {
+        preserve_ = preserve;
+    }
 
 private:
     static constexpr size_t default_capacity = 4080;
@@ -90,18 +101,19 @@ private:
     };
     struct elt : public elthdr {
         char buf[0];
-        void clear() {
-            size_t off = 0;
+        void clear(size_t from = 0) {
+            size_t off = from;
             while (off < pos) {
                 itemhdr* i = (itemhdr*) &buf[off];
                 i->destroyer(i + 1);
                 off += i->size;
             }
-            pos = 0;
+            pos = from;
         }
     };
     elt* e_;
     size_t linked_size_;
+    bool preserve_;
 
     item* get_space(size_t needed) {
         if (!e_ || e_->pos + needed > e_->capacity)
@@ -175,11 +187,15 @@ template <typename T> struct Packer<T, false> {
         else
             return buf.template allocate<UniqueKey<T> >(x);
     }
-    static void* repack(TransactionBuffer&, void* p, const T& x) {
+    static void* repack(TransactionBuffer& buf, void* p, const T& x) {
+        if (buf.preserving())
+            return pack(buf, x);
         unpack(p) = x;
         return p;
     }
-    static void* repack(TransactionBuffer&, void* p, T&& x) {
+    static void* repack(TransactionBuffer& buf, void* p, T&& x) {
+        if (buf.preserving())
+            return pack(buf, std::move(x));
         unpack(p) = std::move(x);
         return p;
     }
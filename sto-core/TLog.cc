@@ -0,0 +1,198 @@
+#include "TLog.hh"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+std::atomic<bool> TLog::enabled_(false);
+std::string TLog::dir_;
+TLogBuffer TLog::buffers_[MAX_THREADS];
+std::atomic<TLog::epoch_type> TLog::durable_epoch_(0);
+std::mutex TLog::mutex_;
+std::condition_variable TLog::flush_cv_;
+std::condition_variable TLog::durable_cv_;
+TLog::epoch_type TLog::requested_epoch_ = 0;
+bool TLog::stop_ = false;
+std::thread TLog::flusher_;
+int TLog::durable_fd_ = -1;
+
+TLogBuffer::~TLogBuffer() {
+    free(buf_);
+    free(fbuf_);
+    if (fd_ >= 0)
+        close(fd_);
+}
+
+void TLogBuffer::grow(size_t need) {
+    size_t ncap = cap_ ? cap_ : (1 << 20);
+    while (ncap < need)
+        ncap <<= 1;
+    char* nbuf = reinterpret_cast<char*>(realloc(buf_, ncap));
+    always_assert(nbuf, "out of memory growing log buffer");
+    buf_ = nbuf;
+    cap_ = ncap;
+}
+
+void TLogBuffer::steal() {
+    assert(flen_ == 0);
+    acquire();
+    std::swap(buf_, fbuf_);
+    std::swap(cap_, fcap_);
+    flen_ = len_;
+    len_ = 0;
+    release();
+}
+
+bool TLogBuffer::write_out() {
+    size_t off = 0;
+    while (off != flen_) {
+        ssize_t r = write(fd_, fbuf_ + off, flen_ - off);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r < 0)
+            return false;
+        off += r;
+    }
+    flen_ = 0;
+    return true;
+}
+
+std::string TLog::file_name(const std::string& dir, int threadid) {
+    return dir + "/sto-log." + std::to_string(threadid);
+}
+
+std::string TLog::durable_file_name(const std::string& dir) {
+    return dir + "/sto-log.durable";
+}
+
+TLog::epoch_type TLog::read_durable_epoch(const std::string& dir) {
+    epoch_type e = 0;
+    int fd = open(durable_file_name(dir).c_str(), O_RDONLY);
+    if (fd >= 0) {
+        if (pread(fd, &e, sizeof(e), 0) != sizeof(e))
+            e = 0;
+        close(fd);
+    }
+    return e;
+}
+
+bool TLog::initialize(const std::string& dir) {
+    assert(!enabled_);
+    if (mkdir(dir.c_str(), 0777) != 0 && errno != EEXIST) {
+        perror(dir.c_str());
+        return false;
+    }
+    durable_fd_ = open(durable_file_name(dir).c_str(), O_WRONLY | O_CREAT, 0666);
+    if (durable_fd_ < 0) {
+        perror(dir.c_str());
+        return false;
+    }
+    dir_ = dir;
+    stop_ = false;
+    requested_epoch_ = 0;
+    durable_epoch_ = 0;
+    enabled_ = true;
+    flusher_ = std::thread(&TLog::flusher_main);
+    return true;
+}
+
+void TLog::shutdown() {
+    if (!enabled_)
+        return;
+    {
+        std::lock_guard<std::mutex> lk(mutex_);
+        stop_ = true;
+    }
+    flush_cv_.notify_one();
+    flusher_.join();
+    for (auto& b : buffers_)
+        if (b.fd_ >= 0) {
+            close(b.fd_);
+            b.fd_ = -1;
+        }
+    close(durable_fd_);
+    durable_fd_ = -1;
+    {
+        // under mutex_, so a waiter can't miss it between test and sleep
+        std::lock_guard<std::mutex> lk(mutex_);
+        enabled_ = false;
+    }
+    durable_cv_.notify_all();
+}
+
+void TLog::epoch_advanced(epoch_type new_epoch) {
+    {
+        std::lock_guard<std::mutex> lk(mutex_);
+        requested_epoch_ = new_epoch;
+    }
+    flush_cv_.notify_one();
+}
+
+void TLog::wait_durable(epoch_type e) {
+    if (durable_epoch() >= e)
+        return;
+    std::unique_lock<std::mutex> lk(mutex_);
+    durable_cv_.wait(lk, [e] () { return durable_epoch() >= e || !enabled_; });
+}
+
+void TLog::flusher_main() {
+    epoch_type handled = 0;
+    while (true) {
+        epoch_type target;
+        bool stopping;
+        {
+            std::unique_lock<std::mutex> lk(mutex_);
+            flush_cv_.wait(lk, [&] () { return stop_ || requested_epoch_ != handled; });
+            target = requested_epoch_;
+            stopping = stop_;
+        }
+        if (stopping) {
+            // workers are done: everything buffered is final
+            epoch_type last = durable_epoch();
+            for (auto& b : buffers_)
+                last = std::max(last, b.last_epoch());
+            flush_all(last);
+            break;
+        }
+        // The global epoch is already `target`, so every transaction that
+        // has not yet begun its log record commits in `target` or later.
+        flush_all(target - 1);
+        handled = target;
+    }
+}
+
+void TLog::flush_all(epoch_type durable) {
+    bool written[MAX_THREADS] = {};
+    for (int i = 0; i != MAX_THREADS; ++i) {
+        TLogBuffer& b = buffers_[i];
+        b.steal();
+        if (b.flen_ == 0)
+            continue;
+        if (b.fd_ < 0) {
+            b.fd_ = open(file_name(dir_, i).c_str(), O_WRONLY | O_CREAT | O_APPEND, 0666);
+            always_assert(b.fd_ >= 0, "cannot open redo log file");
+        }
+        bool ok = b.write_out();
+        always_assert(ok, "redo log write failed");
+        written[i] = true;
+    }
+    for (int i = 0; i != MAX_THREADS; ++i)
+        if (written[i]) {
+            bool ok = fdatasync(buffers_[i].fd_) == 0;
+            always_assert(ok, "redo log sync failed");
+        }
+
+    if (durable > durable_epoch()) {
+        bool ok = pwrite(durable_fd_, &durable, sizeof(durable), 0) == sizeof(durable)
+            && fdatasync(durable_fd_) == 0;
+        always_assert(ok, "durable epoch write failed");
+        std::lock_guard<std::mutex> lk(mutex_);
+        durable_epoch_.store(durable, std::memory_order_release);
+    }
+    durable_cv_.notify_all();
+}
@@ -0,0 +1,257 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "compiler.hh"
+#include "TThread.hh"
+
+// Redo logging with epoch-based group commit.
+//
+// Every worker thread appends the writes of its committing transactions to a
+// private log buffer during the install phase of Transaction::try_commit. The
+// epoch advancer wakes the log flusher at every epoch boundary; the flusher
+// steals the filled buffers, writes them to one log file per worker and syncs
+// them. Once that completes, every transaction whose commit epoch precedes the
+// epoch in which the buffers were stolen is durable, and the durable epoch
+// watermark is raised accordingly. Workers never wait for the disk.
+//
+// On-disk format, repeated per committed transaction:
+//   TLogRecord header, then `nentries` x (TLogEntry, key bytes, value bytes)
+// The durable epoch is persisted next to the log files after every flush;
+// recovery ignores records from later epochs (they may be partially written).
+
+enum class TLogOp : uint16_t {
+    put = 1,      // value is the full row image
+    put_cell = 2, // value is a row image; only `cell` is to be installed
+    remove = 3,   // no value
+    commute = 4,  // value is a commutator to be applied to the existing row
+    patch = 5     // value is a column patch to be applied to the existing row
+};
+
+struct TLogRecord {
+    uint64_t epoch;
+    uint64_t tid;
+    uint32_t nentries;
+    uint32_t length;    // bytes of entries following this header
+};
+
+struct TLogEntry {
+    uint32_t table_id;
+    TLogOp op;
+    uint16_t cell;
+    uint32_t key_length;
+    uint32_t value_length;
+};
+
+class __attribute__((aligned(128))) TLogBuffer {
+public:
+    typedef uint64_t epoch_type;
+
+    TLogBuffer()
+        : buf_(nullptr), len_(0), cap_(0), rec_start_(0), nentries_(0),
+          in_record_(false), epoch_(0), last_epoch_(0), lock_(false),
+          fbuf_(nullptr), flen_(0), fcap_(0), fd_(-1) {
+    }
+    TLogBuffer(const TLogBuffer&) = delete;
+    ~TLogBuffer();
+
+    // Starts the log record of a committing transaction. Must be called
+    // before the transaction's writes become visible. The commit epoch is
+    // read under the buffer lock so that the flusher never steals a buffer
+    // that is about to receive a record from an earlier epoch.
+    void begin(const std::atomic<epoch_type>& global_epoch) {
+        acquire();
+        epoch_ = global_epoch.load(std::memory_order_acquire);
+        rec_start_ = len_;
+        nentries_ = 0;
+        in_record_ = true;
+        reserve(sizeof(TLogRecord));
+        len_ += sizeof(TLogRecord);
+    }
+
+    void append(uint32_t table_id, TLogOp op, uint16_t cell,
+                const void* key, uint32_t key_length,
+                const void* value, uint32_t value_length) {
+        if (!in_record_)
+            return;
+        TLogEntry entry{table_id, op, cell, key_length, value_length};
+        reserve(sizeof(entry) + key_length + value_length);
+        memcpy(buf_ + len_, &entry, sizeof(entry));
+        len_ += sizeof(entry);
+        memcpy(buf_ + len_, key, key_length);
+        len_ += key_length;
+        if (value_length) {
+            memcpy(buf_ + len_, value, value_length);
+            len_ += value_length;
+        }
+        ++nentries_;
+    }
+
+    // Seals the current record. Records without entries are dropped.
+    void commit(uint64_t tid) {
+        if (nentries_ == 0) {
+            len_ = rec_start_;
+        } else {
+            TLogRecord rec{epoch_, tid, nentries_,
+                           uint32_t(len_ - rec_start_ - sizeof(TLogRecord))};
+            memcpy(buf_ + rec_start_, &rec, sizeof(rec));
+            last_epoch_ = epoch_;
+        }
+        in_record_ = false;
+        release();
+    }
+
+    bool in_record() const {
+        return in_record_;
+    }
+    // Epoch of the last transaction logged by this thread.
+    epoch_type last_epoch() const {
+        return last_epoch_;
+    }
+
+private:
+    char* buf_;
+    size_t len_;
+    size_t cap_;
+    size_t rec_start_;
+    uint32_t nentries_;
+    bool in_record_;
+    epoch_type epoch_;
+    epoch_type last_epoch_;
+    std::atomic<bool> lock_;
+
+    // owned by the flusher
+    char* fbuf_;
+    size_t flen_;
+    size_t fcap_;
+    int fd_;
+
+    void acquire() {
+        while (lock_.exchange(true, std::memory_order_acquire))
+            relax_fence();
+    }
+    void release() {
+        lock_.store(false, std::memory_order_release);
+    }
+    void reserve(size_t n) {
+        if (len_ + n > cap_)
+            grow(len_ + n);
+    }
+    void grow(size_t need);
+
+    // Exchanges the worker buffer with the (empty) flush buffer.
+    void steal();
+    // Writes out the stolen buffer. Returns false on I/O errors.
+    bool write_out();
+
+    friend class TLog;
+};
+
+class TLog {
+public:
+    typedef TLogBuffer::epoch_type epoch_type;
+
+    // Starts the flusher; log files are created under `dir`, one per worker
+    // thread, as soon as that thread logs something. Logging stays disabled
+    // until this is called.
+    static bool initialize(const std::string& dir);
+    // Flushes everything still buffered and stops the flusher. All
+    // transactions committed before the call are durable afterwards.
+    static void shutdown();
+
+    static bool enabled() {
+        return enabled_.load(std::memory_order_acquire);
+    }
+    static TLogBuffer& buffer(int threadid) {
+        return buffers_[threadid];
+    }
+    // Appends to the record of the calling thread's committing transaction.
+    static void append(uint32_t table_id, TLogOp op, uint16_t cell,
+                       const void* key, uint32_t key_length,
+                       const void* value, uint32_t value_length) {
+        buffers_[TThread::id()].append(table_id, op, cell, key, key_length, value, value_length);
+    }
+
+    // Called by the epoch advancer right after the global epoch moves to
+    // `new_epoch`; wakes the flusher.
+    static void epoch_advanced(epoch_type new_epoch);
+
+    // Every transaction with commit epoch <= durable_epoch() is on disk.
+    static epoch_type durable_epoch() {
+        return durable_epoch_.load(std::memory_order_acquire);
+    }
+    // Epoch of the last transaction committed (and logged) by `threadid`.
+    static epoch_type commit_epoch(int threadid) {
+        return buffers_[threadid].last_epoch();
+    }
+    // Blocks until epoch `e` is durable.
+    static void wait_durable(epoch_type e);
+
+    static std::string file_name(const std::string& dir, int threadid);
+    static std::string durable_file_name(const std::string& dir);
+    // Durable epoch recorded in `dir`, 0 if none.
+    static epoch_type read_durable_epoch(const std::string& dir);
+
+private:
+    static std::atomic<bool> enabled_;
+    static std::string dir_;
+    static TLogBuffer buffers_[MAX_THREADS];
+    static std::atomic<epoch_type> durable_epoch_;
+
+    static std::mutex mutex_;
+    static std::condition_variable flush_cv_;
+    static std::condition_variable durable_cv_;
+    static epoch_type requested_epoch_;
+    static bool stop_;
+    static std::thread flusher_;
+    static int durable_fd_;
+
+    static void flusher_main();
+    static void flush_all(epoch_type durable);
+};
+
+// Mixin for TObjects that emit redo records. Objects without a log id (0)
+// are not logged.
+class TLogged {
+public:
+    void set_log_id(uint32_t id) {
+        log_id_ = id;
+    }
+    uint32_t log_id() const {
+        return log_id_;
+    }
+
+protected:
+    bool log_enabled() const {
+        return log_id_ != 0 && TLog::enabled();
+    }
+    template <typename K, typename V>
+    void log_put(const K& key, const V& value) const {
+        TLog::append(log_id_, TLogOp::put, 0, &key, sizeof(K), &value, sizeof(V));
+    }
+    template <typename K, typename V>
+    void log_put_cell(const K& key, int cell, const V& value) const {
+        TLog::append(log_id_, TLogOp::put_cell, cell, &key, sizeof(K), &value, sizeof(V));
+    }
+    template <typename K>
+    void log_remove(const K& key) const {
+        TLog::append(log_id_, TLogOp::remove, 0, &key, sizeof(K), nullptr, 0);
+    }
+    // `cell` is the cell whose version the commutator updates
+    template <typename K, typename C>
+    void log_commute(const K& key, const C& comm, int cell = 0) const {
+        TLog::append(log_id_, TLogOp::commute, cell, &key, sizeof(K), &comm, sizeof(C));
+    }
+    // `patch` is the MvColumnPatch of a column-delta version
+    template <typename K, typename P>
+    void log_patch(const K& key, const P& patch) const {
+        TLog::append(log_id_, TLogOp::patch, 0, &key, sizeof(K), &patch, sizeof(P));
+    }
+
+private:
+    uint32_t log_id_ = 0;
+};
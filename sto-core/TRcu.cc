@@ -1,20 +1,32 @@
 #include "TRcu.hh"
 
 #include <limits>
+#include <thread>
 
 TRcuSet::TRcuSet()
-    : clean_epoch_(0) {
+    : clean_epoch_(0), nadded_(0), nremoved_(0), returned_(nullptr), nlent_(0),
+      later_(nullptr) {
     unsigned capacity = (4080 - sizeof(TRcuGroup)) / sizeof(TRcuGroup::TRcuElement);
-    current_ = first_ = TRcuGroup::make(capacity);
+    current_ = first_ = TRcuGroup::make(capacity, this);
     // ngroups_ = 1;
 }
 
 TRcuSet::~TRcuSet() {
+    // reclamation threads still hold pointers to this set
+    wait_returned();
+    delete later_;
+    later_ = nullptr;
     while (first_) {
         TRcuGroup* next = first_->next_;
         TRcuGroup::free(first_);
         first_ = next;
     }
+    for (TRcuGroup* g = returned_.load(); g; ) {
+        TRcuGroup* next = g->next_;
+        TRcuGroup::free(g);
+        g = next;
+    }
+    returned_ = nullptr;
     current_ = nullptr;
     // ngroups_ = 0;
 }
@@ -42,15 +54,21 @@ void TRcuSet::check() {
 }
 
 void TRcuSet::grow() {
-    if (!current_->next_) {
-        unsigned capacity = (16368 - sizeof(TRcuGroup)) / sizeof(TRcuGroup::TRcuElement);
-        current_->next_ = TRcuGroup::make(capacity);
-        // ++ngroups_;
-    }
+    if (!current_->next_)
+        current_->next_ = make_group();
     current_ = current_->next_;
     assert(current_->head_ == 0 && current_->tail_ == 0);
 }
 
+TRcuGroup* TRcuSet::make_group() {
+    // prefer the (empty) groups reclamation threads gave back
+    if (TRcuGroup* g = returned_.exchange(nullptr, std::memory_order_acquire))
+        return g;
+    unsigned capacity = (16368 - sizeof(TRcuGroup)) / sizeof(TRcuGroup::TRcuElement);
+    // ++ngroups_;
+    return TRcuGroup::make(capacity, this);
+}
+
 inline bool TRcuGroup::clean_until(epoch_type max_epoch) {
     while (head_ != tail_ && signed_epoch_type(max_epoch - e_[head_].u.epoch) > 0) {
         ++head_;
@@ -67,19 +85,29 @@ inline bool TRcuGroup::clean_until(epoch_type max_epoch) {
 }
 
 void TRcuSet::hard_clean_until(epoch_type max_epoch) {
+    if (later_)
+        later_->clean_until(max_epoch);
     TRcuGroup* empty_head = nullptr;
     TRcuGroup* empty_tail = nullptr;
+    size_t n = 0;
     // clean [first_, current_]
-    while (first_->clean_until(max_epoch)) {
+    while (true) {
+        unsigned size = first_->tail_ - first_->head_;
+        bool empty = first_->clean_until(max_epoch);
+        n += size - (first_->tail_ - first_->head_);
+        if (!empty)
+            break;
         if (!empty_head)
             empty_head = first_;
         empty_tail = first_;
         if (first_ == current_) {
             first_ = current_ = empty_head;
+            count(nremoved_, n);
             return;
         }
         first_ = first_->next_;
     }
+    count(nremoved_, n);
     // hook empties after current_; everything after current_ guaranteed empty
     if (empty_head) {
         empty_tail->next_ = current_->next_;
@@ -87,6 +115,71 @@ void TRcuSet::hard_clean_until(epoch_type max_epoch) {
     }
 }
 
+void TRcuSet::hard_hand_off_until(epoch_type max_epoch, TRcuQueue& q, size_t limit) {
+    if (later_)
+        later_->clean_until(max_epoch);
+    TRcuGroup* head = nullptr;
+    TRcuGroup* tail = nullptr;
+    size_t n = 0;
+    // a group's elements are no newer than its last epoch, so a group
+    // expires all at once; groups partly expired wait for the rest
+    while (first_->head_ != first_->tail_
+           && signed_epoch_type(max_epoch - first_->epoch_) > 0) {
+        TRcuGroup* g = first_;
+        bool last = g == current_;
+        if (last && !g->next_)
+            g->next_ = make_group();
+        first_ = g->next_;
+        if (last)
+            current_ = first_;
+        n += g->tail_ - g->head_;
+        g->next_ = nullptr;
+        if (tail)
+            tail->next_ = g;
+        else
+            head = g;
+        tail = g;
+        if (last)
+            break;
+    }
+    if (!head)
+        return;
+    count(nremoved_, n);
+    size_t ngroups = 0;
+    for (TRcuGroup* g = head; g; g = g->next_)
+        ++ngroups;
+    nlent_.fetch_add(ngroups, std::memory_order_relaxed);
+    if (!q.push(head, tail, n, limit)) {
+        nlent_.fetch_sub(ngroups, std::memory_order_relaxed);
+        // no reclamation thread, or it's behind: clean up here
+        while (head) {
+            TRcuGroup* next = head->next_;
+            head->run_all();
+            head->next_ = current_->next_;
+            current_->next_ = head;
+            head = next;
+        }
+    }
+}
+
+void TRcuSet::wait_returned() const {
+    while (nlent_.load(std::memory_order_acquire))
+        std::this_thread::yield();
+}
+
 void TRcuSet::release_all() {
-    hard_clean_until(std::numeric_limits<epoch_type>::max());
+    wait_returned();
+    if (later_)
+        later_->release_all();
+    // not hard_clean_until(max epoch): epochs compare modulo wraparound,
+    // so no epoch is before that one
+    size_t n = 0;
+    for (TRcuGroup* g = first_; ; g = g->next_) {
+        n += g->tail_ - g->head_;
+        g->run_all();
+        if (g == current_)
+            break;
+    }
+    count(nremoved_, n);
+    current_ = first_;
 }
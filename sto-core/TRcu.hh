@@ -1,9 +1,12 @@
 #pragma once
 
 #include <new>
+#include <atomic>
 #include "compiler.hh"
 #include <assert.h>
 
+class TRcuSet;
+
 struct TRcuGroup {
     typedef uint64_t epoch_type;
     typedef int64_t signed_epoch_type;
@@ -21,25 +24,22 @@ struct TRcuGroup {
     unsigned capacity_;
     epoch_type epoch_;
     TRcuGroup* next_;
+    TRcuSet* owner_;
     TRcuElement e_[1];
 
 private:
-    TRcuGroup(unsigned capacity)
-        : head_(0), tail_(0), capacity_(capacity), next_(nullptr) {
+    TRcuGroup(unsigned capacity, TRcuSet* owner)
+        : head_(0), tail_(0), capacity_(capacity), next_(nullptr), owner_(owner) {
     }
     TRcuGroup(const TRcuGroup&) = delete;
     ~TRcuGroup() {
-        while (head_ != tail_) {
-            if (e_[head_].function)
-                e_[head_].function(e_[head_].u.argument);
-            ++head_;
-        }
+        run_all();
     }
 
 public:
-    static TRcuGroup* make(unsigned capacity) {
+    static TRcuGroup* make(unsigned capacity, TRcuSet* owner) {
         void* x = new char[sizeof(TRcuGroup) + sizeof(TRcuElement) * (capacity - 1)];
-        return new(x) TRcuGroup(capacity);
+        return new(x) TRcuGroup(capacity, owner);
     }
     static void free(TRcuGroup* g) {
         g->~TRcuGroup();
@@ -59,6 +59,67 @@ public:
         ++tail_;
     }
     inline bool clean_until(epoch_type max_epoch);
+    // Runs every remaining callback, whatever its epoch, and empties the group.
+    void run_all() {
+        while (head_ != tail_) {
+            if (e_[head_].function)
+                e_[head_].function(e_[head_].u.argument);
+            ++head_;
+        }
+        head_ = tail_ = 0;
+    }
+};
+
+// Expired groups handed from TRcuSets to a reclamation thread: a stack any
+// thread may push onto and only the reclamation thread takes from. A closed
+// or overfull queue refuses pushes; its callers run the callbacks themselves.
+class TRcuQueue {
+public:
+    TRcuQueue()
+        : head_(closed()), backlog_(0) {
+    }
+
+    // Pushes the chain `first`...`last` holding `n` elements, unless more
+    // than `limit` elements are queued already.
+    bool push(TRcuGroup* first, TRcuGroup* last, size_t n, size_t limit) {
+        if (backlog() > limit)
+            return false;
+        TRcuGroup* head = head_.load(std::memory_order_relaxed);
+        do {
+            if (head == closed())
+                return false;
+            last->next_ = head;
+        } while (!head_.compare_exchange_weak(head, first,
+                                              std::memory_order_release,
+                                              std::memory_order_relaxed));
+        backlog_.fetch_add(n, std::memory_order_relaxed);
+        return true;
+    }
+    // Takes every queued group; closes the queue if `close`.
+    TRcuGroup* take(bool close = false) {
+        TRcuGroup* head = head_.exchange(close ? closed() : nullptr,
+                                         std::memory_order_acquire);
+        return head == closed() ? nullptr : head;
+    }
+    void open() {
+        TRcuGroup* head = closed();
+        head_.compare_exchange_strong(head, nullptr);
+    }
+    void retire(size_t n) {
+        backlog_.fetch_sub(n, std::memory_order_relaxed);
+    }
+    // Elements pushed but not yet retired.
+    size_t backlog() const {
+        return backlog_.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<TRcuGroup*> head_;
+    std::atomic<size_t> backlog_;
+
+    static TRcuGroup* closed() {
+        return reinterpret_cast<TRcuGroup*>(uintptr_t(1));
+    }
 };
 
 class TRcuSet {
@@ -72,28 +133,76 @@ public:
     void add(epoch_type epoch, void (*function)(void*), void* argument) {
         if (unlikely(current_->tail_ + 2 > current_->capacity_))
             grow();
+        unsigned tail = current_->tail_;
         current_->add(epoch, function, argument);
+        count(nadded_, current_->tail_ - tail);
+    }
+    // Like add, for callbacks due in a later epoch than the current one.
+    // They wait in a set of their own, so they don't hold back the
+    // callbacks added after them; clean_until and hand_off_until run them
+    // on the owner once `epoch` expires.
+    void add_later(epoch_type epoch, void (*function)(void*), void* argument) {
+        if (!later_)
+            later_ = new TRcuSet;
+        later_->add(epoch, function, argument);
     }
     void clean_until(epoch_type max_epoch) {
         if (clean_epoch_ != max_epoch)
             hard_clean_until(max_epoch);
         clean_epoch_ = max_epoch;
     }
+    // Like clean_until, but pushes groups whose elements have all expired
+    // onto `q` for a reclamation thread instead of running their callbacks
+    // (unless `q` holds more than `limit` elements).
+    void hand_off_until(epoch_type max_epoch, TRcuQueue& q, size_t limit) {
+        if (clean_epoch_ != max_epoch)
+            hard_hand_off_until(max_epoch, q, limit);
+        clean_epoch_ = max_epoch;
+    }
+    // Gives back a group emptied by a reclamation thread, for reuse.
+    void return_group(TRcuGroup* g) {
+        TRcuGroup* head = returned_.load(std::memory_order_relaxed);
+        do {
+            g->next_ = head;
+        } while (!returned_.compare_exchange_weak(head, g,
+                                                  std::memory_order_release,
+                                                  std::memory_order_relaxed));
+        nlent_.fetch_sub(1, std::memory_order_release);
+    }
     epoch_type clean_epoch() const {
         return clean_epoch_;
     }
+    // Elements (callbacks and epoch marks) added but not yet run or handed
+    // off. Other threads may read this while the owner runs.
+    size_t pending() const {
+        return nadded_.load(std::memory_order_relaxed)
+            - nremoved_.load(std::memory_order_relaxed);
+    }
 
-    // Clean up all RcuSet items (equivalent to calling destructor).
+    // Clean up all RcuSet items (equivalent to calling destructor). Like
+    // the destructor, waits for groups handed off to come back first.
     void release_all();
 private:
     TRcuGroup* current_;
     TRcuGroup* first_;
     epoch_type clean_epoch_;
+    std::atomic<size_t> nadded_;
+    std::atomic<size_t> nremoved_;
+    std::atomic<TRcuGroup*> returned_;
+    std::atomic<size_t> nlent_;   // groups handed off and not returned
+    TRcuSet* later_;              // add_later's callbacks, if any
     // unsigned ngroups_;
 
     TRcuSet(const TRcuSet&) = delete;
     TRcuSet& operator=(const TRcuSet&) = delete;
     void check();
     void grow();
+    TRcuGroup* make_group();
     void hard_clean_until(epoch_type max_epoch);
+    void hard_hand_off_until(epoch_type max_epoch, TRcuQueue& q, size_t limit);
+    void wait_returned() const;
+    // only the owner writes the counters
+    static void count(std::atomic<size_t>& c, size_t n) {
+        c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
 };
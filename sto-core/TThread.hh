@@ -1,6 +1,8 @@
 #pragma once
 
+#include <atomic>
 #include <cassert>
+#include <cstdint>
 #include <random>
 #include <ContentionManager.hh>
 
@@ -31,6 +33,10 @@ class TThread {
     static __thread int the_id;
     static __thread bool always_allocate_;
     static __thread int hashsize_;
+    // Registry of the thread ids in use: bit i is set once some thread has
+    // called set_id(i). Id 0, the default, is always registered.
+    static constexpr int active_words = (MAX_THREADS + 63) / 64;
+    static std::atomic<uint64_t> active_[active_words];
 public:
     static __thread Transaction* txn;
     static PercentGen gen[];
@@ -38,9 +44,29 @@ public:
     static int id() {
         return the_id;
     }
-    static void set_id(int id) {
-        assert(id >= 0 && id < 128);
+    // Sets this thread's id and registers it, unless `registered` is false
+    // (for helper threads that run no transactions).
+    static void set_id(int id, bool registered = true) {
+        assert(id >= 0 && id < MAX_THREADS);
         the_id = id;
+        if (!registered)
+            return;
+        uint64_t bit = uint64_t(1) << (id % 64);
+        if (!(active_[id / 64].load(std::memory_order_relaxed) & bit))
+            active_[id / 64].fetch_or(bit);
+    }
+    // Calls `f(id)` for every registered thread id, in increasing order.
+    // Scans of per-thread state use this instead of visiting all
+    // MAX_THREADS slots.
+    template <typename F>
+    static void for_each_active(F f) {
+        for (int w = 0; w != active_words; ++w) {
+            uint64_t mask = active_[w].load(std::memory_order_acquire);
+            while (mask) {
+                f(w * 64 + __builtin_ctzll(mask));
+                mask &= mask - 1;
+            }
+        }
     }
     static bool always_allocate() {
         return always_allocate_;
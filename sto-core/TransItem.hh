@@ -15,6 +15,7 @@ class MvAccess;
 class TransProxy;
 
 class CicadaHashtable;
+class TsetIndex;
 
 template <typename VersImpl>
 class VersionBase;
@@ -50,9 +51,9 @@ class TransItem {
     static constexpr flags_type special_mask = owner_mask | cl_bit | read_bit | write_bit | lock_bit | predicate_bit | stash_bit | commute_bit | mvhistory_bit;
 
 
-    TransItem() : s_(), key_(), rdata_(), wdata_(), mode_(CCMode::none) {};
+    TransItem() : s_(), key_(), rdata_(), wdata_(), mode_(CCMode::none), vslot_() {};
     TransItem(TObject* owner, void* k)
-        : s_(reinterpret_cast<ownerstore_type>(owner)), key_(k), rdata_(), wdata_(), mode_(CCMode::none) {
+        : s_(reinterpret_cast<ownerstore_type>(owner)), key_(k), rdata_(), wdata_(), mode_(CCMode::none), vslot_() {
     }
 
     TObject* owner() const {
@@ -83,6 +84,10 @@ class TransItem {
     bool locked_at_commit() const {
         return flags() & cl_bit;
     }
+    // true if the read is validated from the transaction's read-version array
+    bool in_read_array() const {
+        return vslot_ != 0;
+    }
     bool same_item(const TransItem& x) const {
         return !((s_ ^ x.s_) & owner_mask) && key_ == x.key_;
     }
@@ -278,6 +283,7 @@ private:
     uintptr_t ts_origin_; // only used by TicToc
 
     CCMode mode_;
+    unsigned vslot_; // 1 + index in Transaction's read-version array, or 0
 
     void __rm_flags(flags_type flags) {
         s_ = s_ & ~flags;
@@ -292,6 +298,7 @@ private:
     friend class MvAccess;
     friend class VersionDelegate;
     friend class CicadaHashtable;
+    friend class TsetIndex;
 };
 
 class TransProxy {
@@ -345,10 +352,7 @@ class TransProxy {
     template <typename T>
     inline bool add_read_opaque(T rdata);
 
-    inline TransProxy& clear_read() {
-        item().__rm_flags(TransItem::read_bit);
-        return *this;
-    }
+    inline TransProxy& clear_read();
     template <typename T>
     inline TransProxy& update_read(T old_rdata, T new_rdata);
 
@@ -493,10 +497,7 @@ class TransProxy {
         return item().stash_value<T>(std::move(default_value));
     }
 
-    TransProxy& remove_read() { // XXX should also cleanup_read
-        item().__rm_flags(TransItem::read_bit);
-        return *this;
-    }
+    inline TransProxy& remove_read(); // XXX should also cleanup_read
     TransProxy& remove_write() { // XXX should also cleanup_write
         item().__rm_flags(TransItem::write_bit);
         return *this;
@@ -40,6 +40,21 @@ private:
         zone_hdr *next;
     };
 
+public:
+    // The allocation point, for rewinding to a savepoint
+    struct position_type {
+        zone_hdr *zone;
+        size_t next_avail;
+        size_t capacity;
+        size_t total_capacity;
+    };
+
+    position_type position() const {
+        return position_type{zone_tail, tail_next_avail, tail_capacity, total_capacity};
+    }
+
+    inline void rewind(const position_type& pos);
+
 protected:
     size_t tail_next_avail;
     size_t tail_capacity;
@@ -126,3 +141,22 @@ void TransScratch::clear() {
     zone_head = zone_tail = single_zone;
 }
 
+
+void TransScratch::rewind(const position_type& pos) {
+    // free the zones allocated since
+    zone_hdr *curr = pos.zone ? pos.zone->next : zone_head;
+    while (curr != nullptr) {
+        auto next_zone = curr->next;
+        delete[] reinterpret_cast<char *>(curr);
+        curr = next_zone;
+    }
+    if (pos.zone)
+        pos.zone->next = nullptr;
+    else
+        zone_head = nullptr;
+
+    zone_tail = pos.zone;
+    tail_next_avail = pos.next_avail;
+    tail_capacity = pos.capacity;
+    total_capacity = pos.total_capacity;
+}
@@ -1,7 +1,9 @@
 #include "Sto.hh"
 #include <typeinfo>
 #include <bitset>
+#include <algorithm>
 #include <fstream>
+#include <thread>
 
 #include <sys/resource.h>
 #include <sys/time.h>
@@ -11,6 +13,7 @@
 Transaction::testing_type Transaction::testing;
 threadinfo_t Transaction::tinfo[MAX_THREADS];
 __thread int TThread::the_id;
+std::atomic<uint64_t> TThread::active_[TThread::active_words] = {1};
 PercentGen TThread::gen[MAX_THREADS];
 
 Transaction::epoch_state __attribute__((aligned(128))) Transaction::global_epochs = {
@@ -20,8 +23,25 @@ __thread Transaction *TThread::txn = nullptr;
 std::function<void(threadinfo_t::epoch_type)> Transaction::epoch_advance_callback;
 TransactionTid::type __attribute__((aligned(128))) Transaction::_TID = 3 * TransactionTid::increment_value;
 std::atomic<TransactionTid::type> __attribute__((aligned(128))) Transaction::_RTID(Transaction::_TID - TransactionTid::increment_value);
+#if STO_DECENTRALIZED_TID
+std::atomic<TransactionTid::type> __attribute__((aligned(128))) Transaction::_RTID_claim(Transaction::_RTID.load());
+uint64_t Transaction::tsc_base = read_tsc();
+#endif
    // reserve TransactionTid::increment_value for prepopulated
 unsigned Transaction::us_per_epoch = 100000;  // Defaults to 100ms
+std::atomic<TransactionTid::type> Transaction::trim_tid_(0);
+TransactionTid::type Transaction::trim_next_tid_ = 0;
+unsigned Transaction::retention_epochs_ = 0;
+TransactionTid::type Transaction::retention_start_tid_ = 0;
+TransactionTid::type Transaction::epoch_tids_[Transaction::epoch_tid_history];
+std::mutex Transaction::snapshot_lock_;
+uint64_t Transaction::stats_start_tsc_ = read_tsc();
+#if STO_RCU_WORKERS
+std::atomic<unsigned> Transaction::us_this_epoch(100000);
+TRcuQueue Transaction::rcu_queues[STO_RCU_WORKERS];
+#endif
+size_t Transaction::rcu_backlog_target = 1 << 16;
+std::function<void(int)> Transaction::rcu_reclaimer_start_callback;
 
 static void __attribute__((used)) check_static_assertions() {
     static_assert(sizeof(threadinfo_t) % 128 == 0, "threadinfo is 2-cache-line aligned");
@@ -35,11 +55,21 @@ void Transaction::initialize() {
 #if SAFE_FLATTEN
     write_tid_inf_ = 0;
 #endif
-#if CICADA_HASHTABLE == 0 && defined(TRANSACTION_HASHTABLE)
+#if CICADA_HASHTABLE == 0 && TRANSACTION_HASHTABLE
     bzero(hashtable_, sizeof(hashtable_));
 #endif
     commit_tid_ = 0;
     prev_commit_tid_ = 0;
+#if STO_READ_VERSION_ARRAY
+    nvreads_ = 0;
+#endif
+    sp_items_ = nullptr;
+    sp_nitems_ = sp_items_capacity_ = 0;
+    sp_depth_ = 0;
+#if STO_BATCH_COMMIT
+    batch_ = nullptr;
+    batch_capacity_ = 0;
+#endif
     for (unsigned i = 0; i != tset_initial_capacity / tset_chunk; ++i)
         tset_[i] = &tset0_[i * tset_chunk];
     for (unsigned i = tset_initial_capacity / tset_chunk; i != arraysize(tset_); ++i)
@@ -53,6 +83,10 @@ Transaction::~Transaction() {
     for (unsigned i = 0; i != arraysize(tset_); ++i, live += tset_chunk)
         if (live != tset_[i])
             delete[] tset_[i];
+    free(sp_items_);
+#if STO_BATCH_COMMIT
+    free(batch_);
+#endif
 }
 
 void Transaction::refresh_tset_chunk() {
@@ -68,45 +102,183 @@ void* Transaction::epoch_advancer(void*) {
     if (fetch_and_add(&num_epoch_advancers, 1) != 0)
         std::cerr << "WARNING: more than one epoch_advancer thread\n";
 
+#if STO_RCU_WORKERS
+    std::thread reclaimers[STO_RCU_WORKERS];
+    for (int k = 0; k != STO_RCU_WORKERS; ++k) {
+        rcu_queues[k].open();
+        reclaimers[k] = std::thread(rcu_reclaimer, k);
+    }
+    us_this_epoch = us_per_epoch;
+#endif
+
     // don't bother epoch'ing til things have picked up
     usleep(us_per_epoch);
     while (global_epochs.run) {
         epoch_type ge = global_epochs.global_epoch.load();
         epoch_type re = global_epochs.global_epoch.load();
         epoch_type ae = global_epochs.read_epoch.load();
-        for (auto& t : tinfo) {
-            auto twepoch = t.write_snapshot_epoch.load();
-            auto trepoch = t.epoch.load();
+        for_each_epoch_thread([&] (int i) {
+            auto twepoch = tinfo[i].write_snapshot_epoch.load();
+            auto trepoch = tinfo[i].epoch.load();
             if (twepoch != 0 && signed_epoch_type(twepoch - re) < 0) {
                 re = twepoch;
             }
             if (trepoch != 0 && signed_epoch_type(trepoch - ae) < 0) {
                 ae = trepoch;
             }
-        }
+        });
         global_epochs.global_epoch = std::max(ge + 1, epoch_type(1));
         global_epochs.read_epoch = re;
         global_epochs.active_epoch = ae;
-        global_epochs.recent_tid = _TID;
+#if STO_DECENTRALIZED_TID
+        // keeps tid_floor() within an epoch of the clock; snapshots leave
+        // _RTID alone, so it advances here
+        claim_shared_tid(clock_tid());
+        epoch_advance_once();
+#endif
+        global_epochs.recent_tid = tid_floor();
+        epoch_tids_[global_epochs.global_epoch % epoch_tid_history] =
+            global_epochs.recent_tid - TransactionTid::increment_value;
+        {
+            std::lock_guard<std::mutex> guard(snapshot_lock_);
+            trim_tid_ = trim_next_tid_;
+            trim_next_tid_ = compute_rtid_inf();
+            if (unsigned r = retention_epochs_) {
+                // keep what snapshots within the window read
+                epoch_type ge = global_epochs.global_epoch;
+                tid_type window = std::max(tid_at_epoch(ge - r), retention_start_tid_);
+                trim_next_tid_ = std::min(trim_next_tid_, window);
+            }
+        }
+
+        if (TLog::enabled())
+            TLog::epoch_advanced(global_epochs.global_epoch);
 
         if (epoch_advance_callback)
             epoch_advance_callback(global_epochs.global_epoch);
 
+#if STO_RCU_WORKERS
+        // Halve the epoch while the RCU backlog is above target, so garbage
+        // expires in smaller batches; grow it back once the backlog is low.
+        size_t backlog = 0, nthreads = 0;
+        for_each_epoch_thread([&] (int i) {
+            backlog += tinfo[i].rcu_set.pending();
+            ++nthreads;
+        });
+        for (auto& q : rcu_queues)
+            backlog += q.backlog();
+        unsigned us = std::min(us_this_epoch.load(), us_per_epoch);
+        if (backlog > rcu_backlog_target * nthreads)
+            us = std::max(us / 2, std::max(us_per_epoch / 16, 1U));
+        else if (backlog < rcu_backlog_target * nthreads / 4)
+            us = std::min(us * 2, us_per_epoch);
+        us_this_epoch = us;
+        usleep(us);
+#else
         usleep(us_per_epoch);
+#endif
     }
 
+#if STO_RCU_WORKERS
+    for (auto& r : reclaimers)
+        r.join();
+#endif
+
     fetch_and_add(&num_epoch_advancers, -1);
     return NULL;
 }
 
+#if STO_RCU_WORKERS
+void Transaction::rcu_reclaimer(int k) {
+    TThread::set_id(rcu_reclaimer_id(k), false);
+    if (rcu_reclaimer_start_callback)
+        rcu_reclaimer_start_callback(k);
+    threadinfo_t& thr = tinfo[TThread::id()];
+    TRcuQueue& q = rcu_queues[k];
+    while (true) {
+        // drain the queue one last time once the advancer stops; later
+        // hand-offs find it closed and clean up inline
+        bool stop = !global_epochs.run;
+        TRcuGroup* g = q.take(stop);
+        bool idle = !g;
+        // callbacks read versions and enqueue more garbage, as they would
+        // from a transaction's start()
+        thr.write_snapshot_epoch = global_epochs.global_epoch.load();
+        thr.epoch = global_epochs.read_epoch.load();
+        while (g) {
+            TRcuGroup* next = g->next_;
+            size_t n = g->tail_ - g->head_;
+            g->run_all();
+            q.retire(n);
+            g->owner_->return_group(g);
+            g = next;
+        }
+        thr.rcu_set.clean_until(global_epochs.active_epoch.load());
+        thr.epoch = 0;
+        thr.write_snapshot_epoch = 0;
+        if (stop)
+            break;
+        if (idle)
+            usleep(std::max(current_epoch_cycle() / 8, 100U));
+    }
+}
+#endif
+
+#if STO_DECENTRALIZED_TID
+// The newest TID any registered thread has taken. Each took its TID, and
+// set last_wtid, before finishing its commit.
+static Transaction::tid_type newest_taken_tid() {
+    Transaction::tid_type want = 0;
+    fence();
+    TThread::for_each_active([&] (int i) {
+        want = std::max(want, Transaction::tinfo[i].last_wtid);
+    });
+    return want;
+}
+
+Transaction::tid_type Transaction::claim_snapshot() {
+    // Claim a snapshot that includes every commit finished so far, even on
+    // threads that run ahead of the clock, in this thread's own claim.
+    // Writers that miss the claim are caught by the scan below.
+    tid_type claim = claim_tid(newest_taken_tid());
+    // _RTID, published by the epoch advancer, is as good a snapshot
+    tid_type rtid = _RTID.load(std::memory_order_acquire);
+    if (rtid >= claim)
+        return rtid;
+    tid_type min_wtid = claim + TransactionTid::increment_value;
+    TThread::for_each_active([&] (int i) {
+        acquire_fence();
+        tid_type wtid = tinfo[i].wtid;
+        if (wtid != 0 && wtid < min_wtid)
+            min_wtid = wtid;
+    });
+    return std::max(rtid, min_wtid - TransactionTid::increment_value);
+}
+#endif
+
 void Transaction::epoch_advance_once() {
-    tid_type min_wtid = _TID;
-    for (auto& t : tinfo) {
-        fence();
-        tid_type wtid = t.wtid;
+#if STO_DECENTRALIZED_TID
+    // As claim_snapshot, but with the shared claim, and publishing _RTID
+    tid_type claim = _RTID_claim.load(std::memory_order_acquire);
+    tid_type want = newest_taken_tid();
+    if (want > claim)
+        claim = claim_shared_tid(want);
+    fence();
+    tid_type min_wtid = claim + TransactionTid::increment_value;
+#else
+    tid_type min_wtid = tid_floor();
+#endif
+    // _RTID caches the last result: if it is already just below the bound,
+    // no scan can raise it
+    if (_RTID.load(std::memory_order_acquire) + TransactionTid::increment_value >= min_wtid)
+        return;
+    fence();
+    TThread::for_each_active([&] (int i) {
+        acquire_fence();
+        tid_type wtid = tinfo[i].wtid;
         if (wtid != 0 && wtid < min_wtid)
             min_wtid = wtid;
-    }
+    });
     fence();
     if (min_wtid > 0) {
         tid_type next = min_wtid - TransactionTid::increment_value;
@@ -117,21 +289,113 @@ void Transaction::epoch_advance_once() {
     }
 }
 
+void Transaction::set_mvcc_retention(unsigned epochs) {
+    std::lock_guard<std::mutex> guard(snapshot_lock_);
+    // versions replaced before now may be gone already
+    if (epochs && !retention_epochs_)
+        retention_start_tid_ = tid_ceiling();
+    retention_epochs_ = std::min(epochs, epoch_tid_history - 1);
+}
+
+Transaction::tid_type Transaction::snapshot_floor() {
+    // without retention, versions older than _RTID expire as usual
+    if (!retention_epochs_)
+        return _RTID.load();
+    return std::max({trim_tid_.load(), trim_next_tid_, retention_start_tid_});
+}
+
+Transaction::epoch_type Transaction::mvcc_release_epoch(tid_type tid) {
+    epoch_type ge = global_epochs.global_epoch.load();
+    epoch_type first = ge + 1;
+    for (epoch_type e = ge; tid_at_epoch(e) > tid; --e)
+        first = e;
+    // trim_tid_ follows the window an epoch late
+    return first + retention_epochs_ + 1;
+}
+
+bool Transaction::declare_snapshot(tid_type tid) {
+    declare_read_only();
+    // under the lock, so the next watermark either sees this snapshot's read
+    // TID or was published before the check
+    std::lock_guard<std::mutex> guard(snapshot_lock_);
+    if (tid < snapshot_floor() || tid >= fresh_tid_floor())
+        return false;
+    tinfo[TThread::id()].rtid = read_tid_ = tid;
+    return true;
+}
+
 Transaction::tid_type Transaction::compute_rtid_inf() {
     tid_type rtid_inf = _RTID;
 
     // Find an infimum for the rtid
-    for (auto &ti : tinfo) {
+    TThread::for_each_active([&] (int i) {
+        auto& ti = tinfo[i];
         if (!rtid_inf) {
             rtid_inf = ti.rtid.load();
         } else if (ti.rtid) {
             rtid_inf = std::min(rtid_inf, ti.rtid.load());
         }
-    }
+    });
 
     return rtid_inf;
 }
 
+#if STO_BATCH_COMMIT
+void Transaction::group_by_owner(TransItem** items, unsigned n) const {
+    // std::stable_sort would allocate a buffer; instead, items of one owner
+    // keep their order by tracking-set position, found in the first chunk
+    // for all but large transactions
+    std::sort(items, items + n, [this](TransItem* a, TransItem* b) {
+        if (a->owner() != b->owner())
+            return std::less<TObject*>()(a->owner(), b->owner());
+        return tset_index(a) < tset_index(b);
+    });
+}
+#endif
+
+#if STO_READ_VERSION_ARRAY
+TransItem* Transaction::check_version_reads(bool committing, unsigned first) {
+    // Version words are loaded a block at a time, prefetched well ahead,
+    // and compared in straight-line code the compiler can vectorize.
+    // Entries whose version changed or is locked fall back to their
+    // owner's check(), which has the final word.
+    constexpr unsigned block = 8;
+    constexpr unsigned distance = 16;
+    constexpr TransactionTid::type ignored = TransactionTid::increment_value - 1;
+    TXP_ACCOUNT(txp_total_check_read, nvreads_ - first);
+    for (unsigned i = first; i < first + distance && i < nvreads_; ++i)
+        prefetch(const_cast<const TransactionTid::type*>(vread_word_[i]));
+    for (unsigned b = first; b < nvreads_; b += block) {
+        unsigned n = std::min(block, nvreads_ - b);
+        TransactionTid::type cur[block];
+        for (unsigned i = 0; i != n; ++i) {
+            if (b + i + distance < nvreads_)
+                prefetch(const_cast<const TransactionTid::type*>(vread_word_[b + i + distance]));
+            cur[i] = *vread_word_[b + i];
+        }
+        TransactionTid::type changed = 0;
+        for (unsigned i = 0; i != n; ++i)
+            changed |= ((cur[i] ^ vread_value_[b + i]) & ~ignored)
+                | (cur[i] & TransactionTid::lock_bit);
+        if (likely(!changed))
+            continue;
+        for (unsigned i = 0; i != n; ++i) {
+            if (!(((cur[i] ^ vread_value_[b + i]) & ~ignored)
+                  | (cur[i] & TransactionTid::lock_bit)))
+                continue;
+            TransItem* it = vread_item_[b + i];
+            // reads locked before commit need no validation
+            if (committing && it->needs_unlock() && !it->locked_at_commit())
+                continue;
+            if (!it->owner()->check(*it, *this)
+                && (!may_duplicate_items_ || !preceding_duplicate_read(it)))
+                return it;
+        }
+    }
+    return nullptr;
+}
+#endif
+
 bool Transaction::preceding_duplicate_read(TransItem* needle) const {
     const TransItem* it = nullptr;
     for (unsigned tidx = 0; ; ++tidx) {
@@ -175,12 +439,43 @@ bool Transaction::hard_check_opacity(TransItem* item, TransactionTid::type t) {
         TXP_INCREMENT(txp_hco_invalid);
 
     state_ = s_opacity_check;
-    start_tid_ = _TID;
+    unsigned first = 0;
+#if STO_READ_VERSION_ARRAY
+    unsigned vfirst = 0;
+#endif
+#if STO_INCREMENTAL_OPACITY
+    // Reads validated at opacity_tid_ can only have changed since through a
+    // commit with a TID at or above it (its locks were visible to that
+    // check otherwise). If no such TID was handed out, only reads added
+    // since need checking. Nonopaque versions change without a commit TID,
+    // so once one is in sight every later check is full.
+    if ((t & TransactionTid::nonopaque_bit) || any_nonopaque_)
+        opacity_full_ = true;
+    if (!opacity_full_ && opacity_tid_ && opacity_tid_ == start_tid_
+        && !tids_assigned_since(start_tid_)) {
+        TXP_INCREMENT(txp_hco_incremental);
+        first = opacity_checked_;
+# if STO_READ_VERSION_ARRAY
+        vfirst = opacity_vchecked_;
+# endif
+    } else
+#endif
+    {
+        start_tid_ = fresh_tid_floor();
+    }
     release_fence();
+#if STO_READ_VERSION_ARRAY
+    if (check_version_reads(false, vfirst)) {
+        mark_abort_because(item, "opacity check");
+        goto abort;
+    }
+#endif
     TransItem* it = nullptr;
-    for (unsigned tidx = 0; tidx != tset_size_; ++tidx) {
-        it = (tidx % tset_chunk ? it + 1 : tset_[tidx / tset_chunk]);
+    for (unsigned tidx = first; tidx != tset_size_; ++tidx) {
+        it = (tidx % tset_chunk && tidx != first ? it + 1 : &tset_[tidx / tset_chunk][tidx % tset_chunk]);
         if (it->has_read()) {
+            if (it->in_read_array())
+                continue;
             TXP_INCREMENT(txp_total_check_read);
             if (!it->owner()->check(*it, *this)
                 && (!may_duplicate_items_ || !preceding_duplicate_read(it))) {
@@ -195,6 +490,13 @@ bool Transaction::hard_check_opacity(TransItem* item, TransactionTid::type t) {
             }
         }
     }
+#if STO_INCREMENTAL_OPACITY
+    opacity_tid_ = start_tid_;
+    opacity_checked_ = tset_size_;
+# if STO_READ_VERSION_ARRAY
+    opacity_vchecked_ = nvreads_;
+# endif
+#endif
     state_ = s_in_progress;
     return true;
 }
@@ -315,6 +617,101 @@ unlock_all:
     //COZ_PROGRESS;
 }
 
+Transaction::savepoint_type Transaction::savepoint() {
+    assert(state_ == s_in_progress);
+    savepoint_type sp;
+    sp.depth = ++sp_depth_;
+    sp.tset_size = tset_size_;
+    sp.tset_next = tset_next_;
+    sp.items = sp_nitems_;
+    if (sp_nitems_ + tset_size_ > sp_items_capacity_) {
+        sp_items_capacity_ = std::max(2 * sp_items_capacity_, sp_nitems_ + tset_size_);
+        sp_items_ = (TransItem*) realloc((void*) sp_items_, sp_items_capacity_ * sizeof(TransItem));
+        always_assert(sp_items_);
+    }
+    for (unsigned tidx = 0; tidx < tset_size_; tidx += tset_chunk) {
+        unsigned n = std::min(tset_chunk, tset_size_ - tidx);
+        memcpy((void*) &sp_items_[sp_nitems_], tset_[tidx / tset_chunk], n * sizeof(TransItem));
+        sp_nitems_ += n;
+    }
+    sp.buf_size = buf_.buffer_size();
+    sp.scratch_pos = scratch_.position();
+#if STO_READ_VERSION_ARRAY
+    sp.nvreads = nvreads_;
+#endif
+    sp.any_writes = any_writes_;
+    sp.any_nonopaque = any_nonopaque_;
+    sp.may_duplicate_items = may_duplicate_items_;
+    // keep the buffered values the copies refer to
+    buf_.set_preserve(true);
+    return sp;
+}
+
+void Transaction::rollback_to(const savepoint_type& sp) {
+    assert(state_ == s_in_progress && sp.depth <= sp_depth_);
+    // drop the items added since the savepoint; their owners clean up and
+    // release any locks taken during execution, as on abort
+    TransItem* it = &tset_[tset_size_ / tset_chunk][tset_size_ % tset_chunk];
+    for (unsigned tidx = tset_size_; tidx != sp.tset_size; --tidx) {
+        it = (tidx % tset_chunk ? it - 1 : &tset_[(tidx - 1) / tset_chunk][tset_chunk - 1]);
+        if (it->has_write())
+            it->owner()->cleanup(*it, false);
+        if (it->needs_unlock())
+            it->owner()->unlock(*it);
+        forget_item_hash(*it, tidx - 1);
+    }
+#if CICADA_HASHTABLE
+    cht_.truncate(sp.tset_size);
+#elif STO_TSET_INDEX
+    tsi_.truncate(sp.tset_size);
+#endif
+
+    // restore the earlier items
+    const TransItem* saved = sp_items_ + sp.items;
+    for (unsigned tidx = 0; tidx != sp.tset_size; ++tidx, ++saved) {
+        it = (tidx % tset_chunk ? it + 1 : tset_[tidx / tset_chunk]);
+        if (it->has_write() && !saved->has_write())
+            it->owner()->cleanup(*it, false);
+        if (it->needs_unlock() && !saved->needs_unlock())
+            it->owner()->unlock(*it);
+        memcpy((void*) it, saved, sizeof(TransItem));
+#if STO_READ_VERSION_ARRAY
+        // the entry may have been forgotten since
+        if (it->vslot_) {
+            vread_word_[it->vslot_ - 1] = it->owner()->version_word(*it);
+            vread_value_[it->vslot_ - 1] = it->read_value<TransactionTid::type>();
+            vread_item_[it->vslot_ - 1] = it;
+        }
+#endif
+    }
+
+    tset_size_ = sp.tset_size;
+    tset_next_ = sp.tset_next;
+#if STO_READ_VERSION_ARRAY
+    nvreads_ = sp.nvreads;
+#endif
+#if STO_INCREMENTAL_OPACITY
+    // checked reads may have changed under the checkpoint
+    opacity_tid_ = 0;
+#endif
+    any_writes_ = sp.any_writes;
+    any_nonopaque_ = sp.any_nonopaque;
+    may_duplicate_items_ = sp.may_duplicate_items;
+    sp_nitems_ = sp.items + sp.tset_size;
+    sp_depth_ = sp.depth;
+    buf_.rewind(sp.buf_size);
+    scratch_.rewind(sp.scratch_pos);
+    TXP_INCREMENT(txp_savepoint_rollbacks);
+}
+
+void Transaction::release_savepoint(const savepoint_type& sp) {
+    assert(state_ == s_in_progress && sp.depth <= sp_depth_);
+    sp_nitems_ = sp.items;
+    sp_depth_ = sp.depth - 1;
+    if (!sp_depth_)
+        buf_.set_preserve(false);
+}
+
 bool Transaction::try_commit() {
 #if STO_TSC_PROFILE
     TimeKeeper<tc_commit> tk;
@@ -350,13 +747,22 @@ bool Transaction::try_commit() {
     unsigned writeset[tset_size_];
     unsigned nwriteset = 0;
     writeset[0] = tset_size_;
+#if STO_BATCH_COMMIT
+    if (tset_size_ > batch_capacity_) {
+        batch_capacity_ = std::max(2 * batch_capacity_, tset_size_);
+        batch_ = (TransItem**) realloc((void*) batch_, batch_capacity_ * sizeof(TransItem*));
+        always_assert(batch_);
+    }
+    TransItem** batch = batch_;
+#endif
 
     TransItem* it = nullptr;
+    TLogBuffer* logbuf = nullptr;
     for (unsigned tidx = 0; tidx != tset_size_; ++tidx) {
         it = (tidx % tset_chunk ? it + 1 : tset_[tidx / tset_chunk]);
         if (it->has_write()) {
             writeset[nwriteset++] = tidx;
-#if !STO_SORT_WRITESET
+#if !STO_SORT_WRITESET && !STO_BATCH_COMMIT
             if (nwriteset == 1) {
                 first_write_ = writeset[0];
                 state_ = s_committing_locked;
@@ -393,7 +799,31 @@ bool Transaction::try_commit() {
     first_write_ = writeset[0];
 
     //phase1
-#if STO_SORT_WRITESET
+#if STO_BATCH_COMMIT
+    if (nwriteset) {
+        state_ = s_committing_locked;
+        unsigned n = 0;
+        for (unsigned i = 0; i != nwriteset; ++i) {
+            TransItem* me = &tset_[writeset[i] / tset_chunk][writeset[i] % tset_chunk];
+            if (me->needs_unlock())
+                me->__or_flags(TransItem::lock_bit | TransItem::cl_bit);
+            else
+                batch[n++] = me;
+        }
+        group_by_owner(batch, n);
+        for (unsigned i = 0; i != n; ) {
+            unsigned end = owner_group_end(batch, i, n);
+            unsigned nlocked = batch[i]->owner()->lock_batch(batch + i, end - i, *this);
+            for (unsigned j = i; j != i + nlocked; ++j)
+                batch[j]->__or_flags(TransItem::lock_bit | TransItem::cl_bit);
+            if (i + nlocked != end) {
+                mark_abort_because(batch[i + nlocked], "commit lock");
+                goto abort;
+            }
+            i = end;
+        }
+    }
+#elif STO_SORT_WRITESET
     std::sort(writeset, writeset + nwriteset, [&] (unsigned i, unsigned j) {
         TransItem* ti = &tset_[i / tset_chunk][i % tset_chunk];
         TransItem* tj = &tset_[j / tset_chunk][j % tset_chunk];
@@ -422,9 +852,42 @@ bool Transaction::try_commit() {
 #endif
 
     //phase2
+#if STO_READ_VERSION_ARRAY
+    if (TransItem* failed = check_version_reads(true)) {
+        mark_abort_because(failed, "commit check");
+        goto abort;
+    }
+#endif
+#if STO_BATCH_COMMIT
+    {
+        unsigned n = 0;
+        for (unsigned tidx = 0; tidx != tset_size_; ++tidx) {
+            it = (tidx % tset_chunk ? it + 1 : tset_[tidx / tset_chunk]);
+            if (it->has_read() && (it->locked_at_commit() || !it->needs_unlock())
+                && !it->in_read_array()) {
+                TXP_INCREMENT(txp_total_check_read);
+                batch[n++] = it;
+            }
+        }
+        group_by_owner(batch, n);
+        for (unsigned i = 0; i != n; ) {
+            unsigned end = owner_group_end(batch, i, n);
+            unsigned failed = i + batch[i]->owner()->check_batch(batch + i, end - i, *this);
+            if (failed == end)
+                i = end;
+            else if (may_duplicate_items_ && preceding_duplicate_read(batch[failed]))
+                i = failed + 1;
+            else {
+                mark_abort_because(batch[failed], "commit check");
+                goto abort;
+            }
+        }
+    }
+#else
     for (unsigned tidx = 0; tidx != tset_size_; ++tidx) {
         it = (tidx % tset_chunk ? it + 1 : tset_[tidx / tset_chunk]);
-        if (it->has_read() && (it->locked_at_commit() || !it->needs_unlock())) {
+        if (it->has_read() && (it->locked_at_commit() || !it->needs_unlock())
+            && !it->in_read_array()) {
             TXP_INCREMENT(txp_total_check_read);
             if (!it->owner()->check(*it, *this)
                 && (!may_duplicate_items_ || !preceding_duplicate_read(it))) {
@@ -433,11 +896,29 @@ bool Transaction::try_commit() {
             }
         }
     }
+#endif
 
     // fence();
 
     //phase3
-#if STO_SORT_WRITESET
+    // objects append their redo records while installing
+    if (nwriteset && TLog::enabled()) {
+        logbuf = &TLog::buffer(threadid_);
+        logbuf->begin(global_epochs.global_epoch);
+    }
+#if STO_BATCH_COMMIT
+    if (nwriteset) {
+        for (unsigned i = 0; i != nwriteset; ++i)
+            batch[i] = &tset_[writeset[i] / tset_chunk][writeset[i] % tset_chunk];
+        TXP_ACCOUNT(txp_total_w, nwriteset);
+        group_by_owner(batch, nwriteset);
+        for (unsigned i = 0; i != nwriteset; ) {
+            unsigned end = owner_group_end(batch, i, nwriteset);
+            batch[i]->owner()->install_batch(batch + i, end - i, *this);
+            i = end;
+        }
+    }
+#elif STO_SORT_WRITESET
     for (unsigned tidx = first_write_; tidx != tset_size_; ++tidx) {
         it = &tset_[tidx / tset_chunk][tidx % tset_chunk];
         if (it->has_write()) {
@@ -458,6 +939,9 @@ bool Transaction::try_commit() {
         }
     }
 #endif
+    // log records of TicToc writes are ordered by their commit timestamp
+    if (logbuf)
+        logbuf->commit(tictoc_tid_ ? tictoc_tid_ : commit_tid());
 
     // fence();
     stop(true, writeset, nwriteset);
@@ -516,17 +1000,18 @@ void Transaction::print_stats() {
                 100.0 * (double) out.p(txp_commit_time_nonopaque) / txc_commit_attempts);
     }
     if (txp_count >= txp_hco_abort)
-        fprintf(stderr, "$ %llu HCO (%llu lock, %llu invalid, %llu aborts) out of %llu check attempts (%.3f%%)\n",
-                out.p(txp_hco), out.p(txp_hco_lock), out.p(txp_hco_invalid), out.p(txp_hco_abort), out.p(txp_tco),
+        fprintf(stderr, "$ %llu HCO (%llu lock, %llu invalid, %llu incremental, %llu aborts) out of %llu check attempts (%.3f%%)\n",
+                out.p(txp_hco), out.p(txp_hco_lock), out.p(txp_hco_invalid), out.p(txp_hco_incremental),
+                out.p(txp_hco_abort), out.p(txp_tco),
                 100.0 * (double) out.p(txp_hco) / out.p(txp_tco));
     if (txp_count >= txp_hash_collision)
-        fprintf(stderr, "$ %llu (%.3f%%) hash collisions, %llu second level\n", out.p(txp_hash_collision),
+        fprintf(stderr, "$ %llu (%.3f%%) hash collisions, %llu second level, %llu items searched\n", out.p(txp_hash_collision),
                 100.0 * (double) out.p(txp_hash_collision) / out.p(txp_hash_find),
-                out.p(txp_hash_collision2));
+                out.p(txp_hash_collision2), out.p(txp_total_searched));
     if (txp_count >= txp_total_transbuffer)
         fprintf(stderr, "$ %llu max buffer per txn, %llu total buffer\n",
                 out.p(txp_max_transbuffer), out.p(txp_total_transbuffer));
-    if (txp_count >= txp_mvcc_flat_spins) {
+    if (txp_count >= txp_mvcc_flat_gc_runs) {
         fprintf(stderr, "$ MVCC flattening profiles:\n");
         fprintf(stderr, "$       Enflatten runs: %llu\n", out.p(txp_mvcc_flat_runs));
         fprintf(stderr, "$   Flattened versions: %llu\n", out.p(txp_mvcc_flat_versions));
@@ -534,6 +1019,19 @@ void Transaction::print_stats() {
         fprintf(stderr, "$      Committing runs: %llu\n", out.p(txp_mvcc_flat_commits));
         fprintf(stderr, "$        Spinning runs: %llu\n", out.p(txp_mvcc_flat_spins));
         fprintf(stderr, "$     Avg spins/commit: %.3f\n", 1.0 * out.p(txp_mvcc_flat_spins) / out.p(txp_mvcc_flat_commits));
+        fprintf(stderr, "$   Read-path flattens: %llu, %llu cycles (%.0f/flatten)\n", out.p(txp_mvcc_flat_read_runs),
+                out.p(txp_mvcc_flat_read_cycles), 1.0 * out.p(txp_mvcc_flat_read_cycles) / out.p(txp_mvcc_flat_read_runs));
+        fprintf(stderr, "$    GC-time flattens: %llu\n", out.p(txp_mvcc_flat_gc_runs));
+    }
+    if (txp_count >= txp_mvcc_trim_versions) {
+        double seconds = (read_tsc() - stats_start_tsc_) / (PROC_TSC_FREQ * BILLION);
+        fprintf(stderr, "$ MVCC versions stepped past per find: 0: %llu, 1: %llu, 2-3: %llu, 4-7: %llu, 8-15: %llu, 16+: %llu, max %llu\n",
+                out.p(txp_mvcc_find_0), out.p(txp_mvcc_find_1), out.p(txp_mvcc_find_3),
+                out.p(txp_mvcc_find_7), out.p(txp_mvcc_find_15), out.p(txp_mvcc_find_long),
+                out.p(txp_mvcc_find_max));
+        fprintf(stderr, "$ MVCC chain trims: %llu, %llu versions trimmed (%.0f/s)\n",
+                out.p(txp_mvcc_trim_runs), out.p(txp_mvcc_trim_versions),
+                out.p(txp_mvcc_trim_versions) / seconds);
     }
     if (txp_count >= txp_tpcc_st_aborts) {
         fprintf(stderr, "$ TPCC txn profiles: commits(aborts), abort rate\n");
@@ -569,7 +1067,9 @@ void Transaction::print_stats() {
         fprintf(stderr, "$      Check Abort 1: %llu\n", out.p(txp_tpcc_check_abort1));
         fprintf(stderr, "$      Check Abort 2: %llu\n", out.p(txp_tpcc_check_abort2));
     }
-    fprintf(stderr, "$ %llu next commit-tid\n", (unsigned long long) _TID);
+    if (txp_count >= txp_savepoint_rollbacks)
+        fprintf(stderr, "$ %llu savepoint rollbacks\n", out.p(txp_savepoint_rollbacks));
+    fprintf(stderr, "$ %llu next commit-tid\n", (unsigned long long) tid_floor());
 
 #if STO_TSC_PROFILE
     tc_counters out_tcs = tc_counters_combined();
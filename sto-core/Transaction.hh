@@ -4,6 +4,7 @@
 #include "compiler.hh"
 #include "small_vector.hh"
 #include "TRcu.hh"
+#include "TLog.hh"
 #include "ContentionManager.hh"
 #include "TransScratch.hh"
 #include "VersionBase.hh"
@@ -16,6 +17,7 @@
 #include <sstream>
 #include <fstream>
 #include <atomic>
+#include <mutex>
 
 //#include <coz.h>
 
@@ -54,6 +56,38 @@
 #define STO_SORT_WRITESET 0
 #endif
 
+// Commit by handing each TObject all of its items per phase
+// (lock_batch/check_batch/install_batch) instead of one call per item.
+#ifndef STO_BATCH_COMMIT
+#define STO_BATCH_COMMIT 0
+#endif
+
+// Validate plain OCC reads from a compact array of version word addresses and
+// observed values (see TObject::version_word) instead of one check() per item.
+#ifndef STO_READ_VERSION_ARRAY
+#define STO_READ_VERSION_ARRAY 0
+#endif
+
+// Opacity checks revalidate only the reads added since the last check, as
+// long as no commit TID has been handed out in between.
+#ifndef STO_INCREMENTAL_OPACITY
+#define STO_INCREMENTAL_OPACITY 1
+#endif
+
+// Index the tracking set with an open-addressing table that grows with it
+// instead of the fixed hashtable_ (see TsetIndex); read_item() then never
+// adds duplicate items. Faster for small transactions, slower for large ones.
+#ifndef STO_TSET_INDEX
+#define STO_TSET_INDEX 0
+#endif
+
+// Number of reclamation threads the epoch advancer starts. Workers hand
+// their expired RCU groups to them instead of running the callbacks in
+// start(), and the epoch length adapts to the RCU backlog. 0 disables.
+#ifndef STO_RCU_WORKERS
+#define STO_RCU_WORKERS 0
+#endif
+
 #ifndef DEBUG_SKEW
 #define DEBUG_SKEW 0
 #endif
@@ -94,6 +128,12 @@
 #define CU_READ_AT_PRESENT 1
 #endif
 
+// Commit TIDs assembled from the time stamp counter and the thread id, instead
+// of a fetch-and-add on the shared _TID counter.
+#ifndef STO_DECENTRALIZED_TID
+#define STO_DECENTRALIZED_TID 0
+#endif
+
 #if TPCC_SPLIT_TABLE
 #if TABLE_FINE_GRAINED
 #error "Split table and fine-grained table can't be enabled at the same time!"
@@ -102,7 +142,11 @@
 
 #define CONSISTENCY_CHECK 0
 #define ASSERT_TX_SIZE 0
+#if STO_TSET_INDEX
+#define TRANSACTION_HASHTABLE 0
+#else
 #define TRANSACTION_HASHTABLE 1
+#endif
 //#define TRANSACTION_FILTER 0
 
 #if ASSERT_TX_SIZE
@@ -136,6 +180,16 @@
             __txn_guard.start();                  \
             Sto::mvcc_rw_upgrade();
 
+#define ROTRANSACTION                             \
+    do {                                          \
+        __label__ abort_in_progress;              \
+        __label__ try_commit;                     \
+        __label__ after_commit;                   \
+        TransactionLoopGuard __txn_guard;         \
+        while (1) {                               \
+            __txn_guard.start();                  \
+            Sto::declare_read_only();
+
 #define RETRY(retry)                              \
             goto try_commit;                      \
 abort_in_progress:                                \
@@ -171,6 +225,14 @@ if (!(trans_op))             \
             Sto::mvcc_rw_upgrade();               \
             try {
 
+#define ROTRANSACTION_E                           \
+    do {                                          \
+        TransactionLoopGuard __txn_guard;         \
+        while (1) {                               \
+            __txn_guard.start();                  \
+            Sto::declare_read_only();             \
+            try {
+
 #define RETRY_E(retry)                            \
                 if (__txn_guard.try_commit())     \
                     break;                        \
@@ -192,6 +254,7 @@ if (!(trans_op)) {throw Transaction::Abort();}
 
 #define TXN   TRANSACTION_E
 #define RWTXN RWTRANSACTION_E
+#define ROTXN ROTRANSACTION_E
 #define CHK   TXN_DO_E
 #define TEND  RETRY_E
 
@@ -199,6 +262,7 @@ if (!(trans_op)) {throw Transaction::Abort();}
 
 #define TXN   TRANSACTION
 #define RWTXN RWTRANSACTION
+#define ROTXN ROTRANSACTION
 #define CHK   TXN_DO
 #define TEND  RETRY
 
@@ -226,12 +290,25 @@ enum txp {
     txp_hco,
     txp_hco_lock,
     txp_hco_invalid,
+    txp_hco_incremental,
     txp_hco_abort,
     // STO_PROFILE_COUNTERS > 1 only
     txp_mvcc_flat_runs,
     txp_mvcc_flat_versions,
     txp_mvcc_flat_commits,
     txp_mvcc_flat_spins,
+    txp_mvcc_flat_read_runs,
+    txp_mvcc_flat_read_cycles,
+    txp_mvcc_flat_gc_runs,
+    txp_mvcc_find_0,
+    txp_mvcc_find_1,
+    txp_mvcc_find_3,
+    txp_mvcc_find_7,
+    txp_mvcc_find_15,
+    txp_mvcc_find_long,
+    txp_mvcc_find_max,
+    txp_mvcc_trim_runs,
+    txp_mvcc_trim_versions,
     txp_tpcc_no_aborts,
     txp_tpcc_no_commits,
     txp_tpcc_no_stage1,
@@ -285,6 +362,7 @@ enum txp {
     txp_rcu_free_impl,
     txp_dealloc_performed,
     txp_rtid_atomic,
+    txp_savepoint_rollbacks,
 #if !STO_PROFILE_COUNTERS
     txp_count = 0
 #elif STO_PROFILE_COUNTERS == 1
@@ -296,7 +374,7 @@ enum txp {
 typedef uint64_t txp_counter_type;
 
 inline constexpr bool txp_is_max(unsigned p) {
-    return p == txp_max_set || p == txp_max_transbuffer;
+    return p == txp_max_set || p == txp_max_transbuffer || p == txp_mvcc_find_max;
 }
 
 template <unsigned P, unsigned N, bool Less = (P < N)> struct txp_helper;
@@ -394,6 +472,10 @@ struct __attribute__((aligned(128))) threadinfo_t {
     std::atomic<epoch_type> epoch;
     std::atomic<tid_type> rtid;
     tid_type wtid;
+#if STO_DECENTRALIZED_TID
+    tid_type last_wtid;  // last commit TID handed to this thread
+    std::atomic<tid_type> claim;  // commits from now on take TIDs above it
+#endif
     TRcuSet rcu_set;
     // XXX(NH): these should be vectors so multiple data structures can register
     // callbacks for these
@@ -403,6 +485,10 @@ struct __attribute__((aligned(128))) threadinfo_t {
     tc_counters tcs_;
     threadinfo_t()
         : write_snapshot_epoch(0), epoch(0), wtid(0) {
+#if STO_DECENTRALIZED_TID
+        last_wtid = 0;
+        claim = 0;
+#endif
     }
 };
 
@@ -449,6 +535,7 @@ public:
 
     inline TransItem* find(TObject* owner, void* key) const;
     inline void put(TObject* owner, void* key, uint32_t idx);
+    inline void truncate(uint32_t size);
     void clear() { access_bucket_count_ = 0; }
 
 private:
@@ -469,6 +556,83 @@ private:
     mutable std::vector<AccessBucket> access_buckets_;
 };
 
+// Tracking-set index for STO_TSET_INDEX. A linear-probing table of item
+// indexes kept at most half full, doubling by reinserting the items; each
+// transaction starts at the size the previous one needed, shrinking
+// gradually after large ones. As in Transaction::hashtable_, a slot holds
+// base_ + index + 1 and anything at or below base_ is empty, so neither
+// starting over nor rebuilding clears the table.
+class TsetIndex {
+public:
+    static constexpr uint32_t initial_capacity = 64;
+
+    explicit TsetIndex(Transaction& t)
+        : txn_(t), slots_(nullptr), allocated_(0), mask_(initial_capacity - 1),
+          size_(0), base_(0), top_(0) {
+    }
+    ~TsetIndex() {
+        free(slots_);
+    }
+
+    inline TransItem* find(TObject* owner, void* key) const;
+    inline void put(TObject* owner, void* key, uint32_t idx);
+    inline void truncate(uint32_t size);
+    void clear() {
+        if (size_ || mask_ != initial_capacity - 1) {
+            uint32_t capacity = mask_ + 1;
+            if (capacity > initial_capacity && 8 * size_ < capacity)
+                capacity /= 2;
+            reset(capacity);
+        }
+    }
+
+private:
+    // Xor-shifts keep a dense range of small keys (array indexes) on
+    // distinct slots while folding higher pointer bits into the low ones.
+    static uint64_t hash_(const TObject* owner, void* key) {
+        uint64_t n = reinterpret_cast<uintptr_t>(key)
+            ^ (reinterpret_cast<uintptr_t>(owner) >> 4) * 0x9e3779b97f4a7c15ULL;
+        return n ^ (n >> 5) ^ (n >> 13);
+    }
+    inline TransItem* item_at(uint32_t idx) const;
+
+    // starts over with `capacity` empty slots
+    void reset(uint32_t capacity) {
+        if (capacity > allocated_) {
+            free(slots_);
+            allocated_ = std::max(capacity, allocated_ * 2);
+            slots_ = reinterpret_cast<uint32_t*>(calloc(allocated_, sizeof(uint32_t)));
+            base_ = top_ = 0;
+        }
+        base_ += top_;
+        top_ = 0;
+        if (base_ > UINT32_MAX / 2) {
+            memset(slots_, 0, allocated_ * sizeof(uint32_t));
+            base_ = 0;
+        }
+        mask_ = capacity - 1;
+        size_ = 0;
+    }
+    void insert(uint64_t h, uint32_t idx) {
+        uint32_t i = h & mask_;
+        while (slots_[i] > base_)
+            i = (i + 1) & mask_;
+        slots_[i] = base_ + idx + 1;
+        top_ = std::max(top_, idx + 1);
+        ++size_;
+    }
+    // reindexes items [0, n) in `capacity` slots
+    inline void rebuild(uint32_t capacity, uint32_t n);
+
+    Transaction& txn_;
+    uint32_t* slots_;
+    uint32_t allocated_;
+    uint32_t mask_;
+    uint32_t size_;
+    uint32_t base_;
+    uint32_t top_;
+};
+
 class Transaction {
 public:
     typedef TransactionTid::type tid_type;
@@ -491,12 +655,60 @@ public:
         bool run;
     } global_epochs;
 private:
+#if STO_DECENTRALIZED_TID
+    // Decentralized TID layout (value bits): |CLOCK 45|THREAD 7|. The clock
+    // counts units of 2^tid_tsc_shift TSC cycles since startup (a month at
+    // 3GHz). A thread that commits faster than the clock ticks takes the next
+    // unit, so the TIDs of a thread increase strictly, and TIDs of different
+    // threads differ in the thread bits. Stored versions keep their TIDs, so
+    // the clock cannot be rebased: once it nears the end of the TID space,
+    // clock_tid() stops the process rather than hand out TIDs that wrap.
+    //
+    // Snapshot readers first raise their own claim (tinfo[].claim) to the
+    // newest TID any thread has taken, then scan tinfo for commits in
+    // flight; writers publish their TID, then make sure it exceeds every
+    // claim. One of the two always sees the other, so no TID at or below a
+    // claimed snapshot is handed out afterwards, and a snapshot includes
+    // every commit finished before it. Only the epoch advancer raises the
+    // shared _RTID_claim and _RTID, once an epoch; snapshots and commits
+    // write only their own thread's tinfo.
+    static constexpr unsigned tid_thread_bits = 7;
+    static constexpr unsigned tid_tsc_shift = 8;
+    static constexpr tid_type tid_unit = TransactionTid::increment_value << tid_thread_bits;
+    static_assert(MAX_THREADS <= (1 << tid_thread_bits), "too many threads for the TID layout");
+    // clock units before TIDs overflow, less room for threads that run ahead
+    // of the clock
+    static constexpr uint64_t tid_clock_limit = TransactionTid::max_value / tid_unit - (uint64_t(1) << 32);
+    static uint64_t tsc_base;
+#endif
     static tid_type _TID;
     static std::atomic<tid_type> _RTID;
+#if STO_DECENTRALIZED_TID
+    static std::atomic<tid_type> _RTID_claim;
+#endif
     static unsigned us_per_epoch;  // Defaults to 100ms
+    static std::atomic<tid_type> trim_tid_;
+    static tid_type trim_next_tid_;  // trim_tid_ from the next epoch on
+    static unsigned retention_epochs_;
+    static tid_type retention_start_tid_;
+    static constexpr unsigned epoch_tid_history = 16384;
+    static tid_type epoch_tids_[epoch_tid_history];  // recent_tid, by epoch
+    static std::mutex snapshot_lock_;  // orders snapshots and trim_next_tid_
+    static uint64_t stats_start_tsc_;
+#if STO_RCU_WORKERS
+    static std::atomic<unsigned> us_this_epoch;  // adapted, at most us_per_epoch
+    static TRcuQueue rcu_queues[STO_RCU_WORKERS];
+#endif
 public:
+    // RCU elements pending per thread above which epochs shorten; workers
+    // clean up themselves while 8x that is queued for their reclamation
+    // thread (STO_RCU_WORKERS only).
+    static size_t rcu_backlog_target;
 
     static std::function<void(threadinfo_t::epoch_type)> epoch_advance_callback;
+    // Called on each reclamation thread as it starts, with its index k; it
+    // serves the threads whose id is k modulo STO_RCU_WORKERS.
+    static std::function<void(int)> rcu_reclaimer_start_callback;
 
     static txp_counters txp_counters_combined() {
         txp_counters out;
@@ -527,6 +739,7 @@ public:
             tinfo[i].p_.reset();
             tinfo[i].tcs_.reset();
         }
+        stats_start_tsc_ = read_tsc();
     }
 
     template <typename T>
@@ -548,7 +761,145 @@ public:
 
     static void* epoch_advancer(void*);
     static void epoch_advance_once();
+#if STO_RCU_WORKERS
+    static void rcu_reclaimer(int k);
+    // Thread id of reclamation thread `k`, from the top of the id space.
+    // These ids are not registered with TThread.
+    static int rcu_reclaimer_id(int k) {
+        return MAX_THREADS - 1 - k;
+    }
+#endif
+    // Calls `f(id)` for every registered thread id and, with
+    // STO_RCU_WORKERS, every reclamation thread id: the threads whose
+    // epochs and RCU sets the epoch advancer follows.
+    template <typename F>
+    static void for_each_epoch_thread(F f) {
+        TThread::for_each_active(f);
+#if STO_RCU_WORKERS
+        for (int k = 0; k != STO_RCU_WORKERS; ++k)
+            f(rcu_reclaimer_id(k));
+#endif
+    }
     static tid_type compute_rtid_inf();
+
+    // No transaction reads MVCC versions below this TID: compute_rtid_inf()
+    // (capped by the retention window) as of the previous epoch, so that
+    // transactions that loaded _RTID just before it was computed have since
+    // published their read TIDs. 0 until the epoch advancer has run twice.
+    static tid_type mvcc_trim_tid() {
+        return trim_tid_.load(std::memory_order_acquire);
+    }
+
+    // Keeps the MVCC versions that snapshots up to `epochs` epochs old read
+    // (see declare_snapshot) from being reclaimed. 0, the default, keeps
+    // only what running transactions read. At most epoch_tid_history.
+    static void set_mvcc_retention(unsigned epochs);
+    static unsigned mvcc_retention() {
+        return retention_epochs_;
+    }
+    // A TID below every commit TID handed out since epoch `e` began: a
+    // snapshot there sees exactly the commits of earlier epochs. 0 if `e` is
+    // not one of the last epoch_tid_history.
+    static tid_type tid_at_epoch(epoch_type e) {
+        epoch_type ge = global_epochs.global_epoch.load();
+        if (signed_epoch_type(ge - e) < 0 || ge - e >= epoch_tid_history)
+            return 0;
+        return epoch_tids_[e % epoch_tid_history];
+    }
+    // The oldest TID declare_snapshot accepts.
+    static tid_type snapshot_floor();
+    // An epoch by whose expiry mvcc_trim_tid() has passed `tid`, unless
+    // transactions still read below it: the retention window passes `tid`
+    // retention_epochs_ epochs after the first epoch whose TIDs follow it.
+    static epoch_type mvcc_release_epoch(tid_type tid);
+
+    // Lower bound on every commit TID assigned from now on.
+    static tid_type tid_floor() {
+#if STO_DECENTRALIZED_TID
+        return std::max(_RTID_claim.load(std::memory_order_acquire),
+                        tinfo[TThread::id()].claim.load(std::memory_order_acquire))
+            + TransactionTid::increment_value;
+#else
+        return _TID;
+#endif
+    }
+    // Above the TIDs of earlier commits, without claiming anything (with
+    // STO_DECENTRALIZED_TID, unless a thread runs a clock unit ahead).
+    static tid_type tid_ceiling() {
+#if STO_DECENTRALIZED_TID
+        return clock_tid() + 2 * tid_unit;
+#else
+        return _TID;
+#endif
+    }
+    // Like tid_floor(), but also above the TIDs of earlier commits.
+    static tid_type fresh_tid_floor() {
+#if STO_DECENTRALIZED_TID
+        return claim_tid(clock_tid()) + TransactionTid::increment_value;
+#else
+        return _TID;
+#endif
+    }
+#if STO_DECENTRALIZED_TID
+    static tid_type clock_tid() {
+        uint64_t units = (read_tsc() - tsc_base) >> tid_tsc_shift;
+        always_assert(units < tid_clock_limit, "decentralized TID clock exhausted");
+        return units * tid_unit;
+    }
+    // Raises this thread's claim to at least `t`; returns the highest
+    // claim it knows of, which commit TIDs from now on exceed.
+    static tid_type claim_tid(tid_type t) {
+        auto& claim = tinfo[TThread::id()].claim;
+        tid_type c = std::max(claim.load(std::memory_order_relaxed),
+                              _RTID_claim.load(std::memory_order_acquire));
+        if (c >= t)
+            return c;
+        claim.store(t, std::memory_order_relaxed);
+        // before any scan for commits in flight
+        fence();
+        return t;
+    }
+    // Raises _RTID_claim to at least `t` (epoch advancer only).
+    static tid_type claim_shared_tid(tid_type t) {
+        tid_type c = _RTID_claim.load(std::memory_order_acquire);
+        while (c < t && !_RTID_claim.compare_exchange_weak(c, t))
+            /* retry */;
+        return std::max(c, t);
+    }
+    // The highest claim of any thread; commits check their TIDs against it.
+    static tid_type claim_ceiling() {
+        tid_type c = _RTID_claim.load(std::memory_order_acquire);
+        TThread::for_each_active([&] (int i) {
+            c = std::max(c, tinfo[i].claim.load(std::memory_order_acquire));
+        });
+        return c;
+    }
+    static tid_type claim_snapshot();
+#endif
+    // Read TID for a new snapshot: above every commit finished so far, and
+    // below every commit TID handed out from now on.
+    static tid_type snapshot_tid() {
+#if STO_DECENTRALIZED_TID
+        return claim_snapshot();
+#else
+        epoch_advance_once();
+        return _RTID.load();
+#endif
+    }
+    // True if a commit TID at or above `floor`, an earlier lower bound on
+    // future commit TIDs, may have been handed out since.
+    static bool tids_assigned_since(tid_type floor) {
+#if STO_DECENTRALIZED_TID
+        fence();
+        bool assigned = false;
+        TThread::for_each_active([&] (int i) {
+            assigned = assigned || tinfo[i].last_wtid >= floor || tinfo[i].wtid >= floor;
+        });
+        return assigned;
+#else
+        return _TID != floor;
+#endif
+    }
     template <typename T>
     static void rcu_delete(T* x) {
         auto& thr = tinfo[TThread::id()];
@@ -570,9 +921,21 @@ public:
         auto& thr = tinfo[TThread::id()];
         thr.rcu_set.add(thr.write_snapshot_epoch, function, argument);
     }
+    // Like rcu_call, but once `epoch` has expired
+    static void rcu_call_at(epoch_type epoch, void (*function)(void*), void* argument) {
+        tinfo[TThread::id()].rcu_set.add_later(epoch, function, argument);
+    }
     static void rcu_quiesce() {
         tinfo[TThread::id()].epoch = 0;
     }
+    // For a thread that runs no more transactions: its thread id stays
+    // registered, so its last epochs would otherwise hold back read_epoch
+    // and active_epoch for good.
+    static void rcu_thread_exit() {
+        auto& thr = tinfo[TThread::id()];
+        thr.epoch = 0;
+        thr.write_snapshot_epoch = 0;
+    }
 
 #if STO_PROFILE_COUNTERS
     template <unsigned P> static void txp_account(txp_counter_type n) {
@@ -594,6 +957,15 @@ public:
     static unsigned get_epoch_cycle() {
         return us_per_epoch;
     }
+    // The length of the current epoch, which with STO_RCU_WORKERS may be
+    // shorter than get_epoch_cycle().
+    static unsigned current_epoch_cycle() {
+#if STO_RCU_WORKERS
+        return us_this_epoch.load(std::memory_order_relaxed);
+#else
+        return us_per_epoch;
+#endif
+    }
 
     static void set_epoch_cycle(const unsigned us) {
         fence();
@@ -609,7 +981,7 @@ private:
     void initialize();
 
     Transaction()
-        : threadid_(TThread::id()), is_test_(false), cht_(*this) {
+        : threadid_(TThread::id()), is_test_(false), cht_(*this), tsi_(*this) {
         initialize();
         start();
     }
@@ -618,13 +990,13 @@ private:
     static testing_type testing;
 
     Transaction(int threadid, const testing_type&)
-        : threadid_(threadid), is_test_(true), restarted(false), cht_(*this) {
+        : threadid_(threadid), is_test_(true), restarted(false), cht_(*this), tsi_(*this) {
         initialize();
         start();
     }
 
     Transaction(bool)
-        : threadid_(TThread::id()), is_test_(false), restarted(false), cht_(*this) {
+        : threadid_(TThread::id()), is_test_(false), restarted(false), cht_(*this), tsi_(*this) {
         initialize();
         state_ = s_aborted;
     }
@@ -646,7 +1018,13 @@ private:
         //thr.epoch = global_epochs.global_epoch;
         thr.write_snapshot_epoch = global_epochs.global_epoch.load();
         thr.epoch = global_epochs.read_epoch.load();
+#if STO_RCU_WORKERS
+        thr.rcu_set.hand_off_until(global_epochs.active_epoch.load(),
+                                   rcu_queues[TThread::id() % STO_RCU_WORKERS],
+                                   rcu_backlog_target * 8);
+#else
         thr.rcu_set.clean_until(global_epochs.active_epoch.load());
+#endif
         thr.rtid = thr.wtid = 0;
         if (thr.trans_start_callback)
             thr.trans_start_callback();
@@ -654,6 +1032,9 @@ private:
         tset_size_ = 0;
         tset_next_ = tset0_;
         cht_.clear();
+#if STO_TSET_INDEX
+        tsi_.clear();
+#endif
 #if CICADA_HASHTABLE == 0 && TRANSACTION_HASHTABLE
         if (hash_base_ >= hash_size) {
             memset(hashtable_, 0, sizeof(hashtable_));
@@ -668,13 +1049,29 @@ private:
         any_writes_ = any_nonopaque_ = may_duplicate_items_ = false;
         first_write_ = 0;
         mvcc_rw = false;
+        read_only_ = false;
+        if (sp_depth_) {
+            sp_nitems_ = 0;
+            sp_depth_ = 0;
+            buf_.set_preserve(false);
+        }
         if (commit_tid_ > 0)
             prev_commit_tid_ = commit_tid_;
 #if SAFE_FLATTEN
         write_tid_inf_ = 0;
 #endif
         start_tid_ = read_tid_ = commit_tid_ = 0;
+#if STO_INCREMENTAL_OPACITY
+        opacity_tid_ = 0;
+        opacity_full_ = false;
+#endif
         tictoc_tid_ = 0;
+#if STO_DECENTRALIZED_TID
+        tid_observed_ = 0;
+#endif
+#if STO_READ_VERSION_ARRAY
+        nvreads_ = 0;
+#endif
         buf_.clear();
 #if STO_DEBUG_ABORTS
         abort_item_ = nullptr;
@@ -714,6 +1111,8 @@ private:
     void allocate_item_update_hash(const TObject* obj, void* xkey) {
 #if CICADA_HASHTABLE
         cht_.put(const_cast<TObject *>(obj), xkey, tset_size_ - 1);
+#elif STO_TSET_INDEX
+        tsi_.put(const_cast<TObject *>(obj), xkey, tset_size_ - 1);
 #else
 #if TRANSACTION_HASHTABLE
         unsigned hi = hash(obj, xkey);
@@ -772,7 +1171,7 @@ private:
 
     template <typename T>
     TransProxy item_inlined(const TObject* obj, T key) {
-#if CICADA_HASHTABLE
+#if CICADA_HASHTABLE || STO_TSET_INDEX
         return item(obj, key);
 #else
 #if TRANSACTION_HASHTABLE
@@ -825,6 +1224,10 @@ private:
     // in the set in some cases
     template <typename T>
     TransProxy read_item(const TObject* obj, T key) {
+#if STO_TSET_INDEX
+        // lookups are cheap enough to keep the set duplicate-free
+        return item(obj, std::move(key));
+#endif
         void* xkey = Packer<T>::pack_unique(buf_, std::move(key));
         TransItem* ti = nullptr;
         if (any_writes_) {
@@ -863,6 +1266,8 @@ private:
 #endif
 #if CICADA_HASHTABLE
         return cht_.find(obj, xkey);
+#elif STO_TSET_INDEX
+        return tsi_.find(obj, xkey);
 #else
 #if TRANSACTION_HASHTABLE
         TXP_INCREMENT(txp_hash_find);
@@ -899,6 +1304,69 @@ private:
    }
 
     bool preceding_duplicate_read(TransItem *it) const;
+    void forget_item_hash(const TransItem& item, unsigned tidx) {
+#if CICADA_HASHTABLE == 0 && TRANSACTION_HASHTABLE
+        unsigned hi = hash(item.owner(), item.key_);
+        for (int steps = 0; steps < TRANSACTION_HASHTABLE; ++steps) {
+            if (hashtable_[hi] == uint16_t(hash_base_ + tidx + 1)) {
+                hashtable_[hi] = 0;
+                return;
+            }
+            hi = (hi + hash_step) % hash_size;
+        }
+#else
+        (void) item, (void) tidx;
+#endif
+    }
+#if STO_READ_VERSION_ARRAY
+    void record_version_read(TransItem& item, TransactionTid::type v) {
+        if (nvreads_ == vread_capacity)
+            return;
+        if (auto word = item.owner()->version_word(item)) {
+            vread_word_[nvreads_] = word;
+            vread_value_[nvreads_] = v;
+            vread_item_[nvreads_] = &item;
+            item.vslot_ = ++nvreads_;
+        }
+    }
+    void forget_version_read(TransItem& item) {
+        if (item.vslot_) {
+            // the entry stays, but always validates
+            vread_word_[item.vslot_ - 1] = &vread_dead_;
+            vread_value_[item.vslot_ - 1] = vread_dead_;
+            item.vslot_ = 0;
+        }
+    }
+    void refresh_version_read(TransItem& item) {
+        if (item.vslot_)
+            vread_value_[item.vslot_ - 1] = item.read_value<TransactionTid::type>();
+    }
+    // Returns the first read from entry `first` on that fails validation,
+    // or nullptr
+    TransItem* check_version_reads(bool committing, unsigned first = 0);
+#endif
+#if STO_BATCH_COMMIT
+    // Sorts `items`, which are in tracking-set order, by owner, keeping
+    // each owner's items in that order
+    void group_by_owner(TransItem** items, unsigned n) const;
+    // Position of `item` in the tracking set
+    unsigned tset_index(const TransItem* item) const {
+        uintptr_t p = reinterpret_cast<uintptr_t>(item);
+        for (unsigned c = 0; ; ++c) {
+            uintptr_t base = reinterpret_cast<uintptr_t>(tset_[c]);
+            if (p >= base && p < base + tset_chunk * sizeof(TransItem))
+                return c * tset_chunk + (p - base) / sizeof(TransItem);
+        }
+    }
+    // Returns the end of the owner group starting at `first`
+    static unsigned owner_group_end(TransItem** items, unsigned first, unsigned n) {
+        TObject* owner = items[first]->owner();
+        unsigned last = first + 1;
+        while (last != n && items[last]->owner() == owner)
+            ++last;
+        return last;
+    }
+#endif
 
 public:
 #if STO_DEBUG_ABORTS
@@ -954,6 +1422,33 @@ public:
         return &scratch_.allocate<T>();
     }
 
+    // Savepoints. rollback_to(sp) undoes every tracking-set change made
+    // since savepoint() returned sp -- new items are discarded, earlier
+    // items get back their flags and values, and buffer and tx_alloc space
+    // is reclaimed -- and leaves the transaction running from that point.
+    // sp stays valid; rolling back to or releasing a savepoint invalidates
+    // the ones taken after it. Taking a savepoint copies the tracking set.
+    // A savepoint cannot survive an abort: once an access throws Abort, the
+    // whole transaction restarts as usual.
+    struct savepoint_type {
+        unsigned depth;
+        unsigned tset_size;
+        TransItem* tset_next;
+        size_t items;      // index of the tracking-set copy in sp_items_
+        size_t buf_size;
+        TransScratch::position_type scratch_pos;
+#if STO_READ_VERSION_ARRAY
+        unsigned nvreads;
+#endif
+        bool any_writes;
+        bool any_nonopaque;
+        bool may_duplicate_items;
+    };
+
+    savepoint_type savepoint();
+    void rollback_to(const savepoint_type& sp);
+    void release_savepoint(const savepoint_type& sp);
+
     // opacity checking
     // These function will eventually help us track the commit TID when we
     // have no opacity, or for GV7 opacity.
@@ -972,7 +1467,7 @@ public:
         assert(state_ <= s_committing_locked);
         TXP_INCREMENT(txp_tco);
         if (!start_tid_)
-            start_tid_ = _TID;
+            start_tid_ = tid_floor();
         if (!TransactionTid::try_check_opacity(start_tid_, v)
             && state_ < s_committing)
             return hard_check_opacity(&item, v);
@@ -991,7 +1486,7 @@ public:
     bool check_opacity(TransactionTid::type v) {
         assert(state_ <= s_committing_locked);
         if (!start_tid_)
-            start_tid_ = _TID;
+            start_tid_ = tid_floor();
         if (!TransactionTid::try_check_opacity(start_tid_, v)
             && state_ < s_committing)
             return hard_check_opacity(nullptr, v);
@@ -999,7 +1494,7 @@ public:
     }
 
     bool check_opacity() {
-        return check_opacity(_TID);
+        return check_opacity(tid_floor());
     }
 
     // flips the manual rw flag for mvcc
@@ -1007,16 +1502,36 @@ public:
         mvcc_rw = true;
     }
 
+    // Declares that the transaction will not write (a write aborts the
+    // program); must come before its first access. MVCC objects then read
+    // the snapshot at read_tid() without tracking items; OCC objects track
+    // their reads as usual.
+    void declare_read_only() {
+        assert(state_ == s_in_progress && !tset_size_ && !mvcc_rw);
+        read_only_ = true;
+    }
+    bool read_only() const {
+        return read_only_;
+    }
+
+    // Declares a read-only transaction that reads MVCC objects as of `tid`;
+    // must come before its first access. Returns false, leaving the
+    // transaction read-only at the present, if the versions at `tid` may
+    // have been reclaimed (tid < snapshot_floor()) or `tid` may still be
+    // handed to a commit. Until the transaction ends, the versions it reads
+    // are kept. OCC objects are still read at the present.
+    bool declare_snapshot(tid_type tid);
+
 #if SAFE_FLATTEN
     tid_type write_tid_inf() const {
         if (!write_tid_inf_) {
-            tid_type min_wtid = _TID;
-            for (auto& t : tinfo) {
+            tid_type min_wtid = tid_floor();
+            TThread::for_each_active([&] (int i) {
                 acquire_fence();
-                tid_type wtid = t.wtid;
+                tid_type wtid = tinfo[i].wtid;
                 if (wtid != 0 && wtid < min_wtid)
                     min_wtid = wtid;
-            }
+            });
             write_tid_inf_ = min_wtid;
         }
         return write_tid_inf_;
@@ -1033,36 +1548,32 @@ public:
             threadinfo_t& thr = tinfo[TThread::id()];
 #if SAFE_FLATTEN
             if (mvcc_rw) {
-                thr.rtid = read_tid_ = _TID;
+                thr.rtid = read_tid_ = present_tid();
             } else {
-                epoch_advance_once();
-                thr.rtid = read_tid_ = _RTID.load();
+                thr.rtid = read_tid_ = snapshot_tid();
             }
             // Can't we just get the most recent tid (_TID?)
 #else
 #if CU_READ_AT_PRESENT
             // Experimental: always read at the present for mvcc r/w transactions.
             if (mvcc_rw) {
-                thr.rtid = read_tid_ = _TID;
+                thr.rtid = read_tid_ = present_tid();
             } else {
-                epoch_advance_once();
-                thr.rtid = read_tid_ = _RTID;
+                thr.rtid = read_tid_ = snapshot_tid();
             }
 #else
             if constexpr (!Commute) {
                 if (mvcc_rw) {
                     //thr.rtid = read_tid_ = std::max(_RTID.load(), prev_commit_tid_);
-                    thr.rtid = read_tid_ = _TID;
+                    thr.rtid = read_tid_ = present_tid();
                 } else {
-                    epoch_advance_once();
-                    thr.rtid = read_tid_ = _RTID;
+                    thr.rtid = read_tid_ = snapshot_tid();
                 }
             } else {
                 // When we use CU we can't do the timestamp hack above because
                 // flattening delta versions require the invariant that all
                 // reads never observe information based on pending versions
-                epoch_advance_once();
-                thr.rtid = read_tid_ = _RTID;
+                thr.rtid = read_tid_ = snapshot_tid();
             }
 #endif
 #endif
@@ -1070,11 +1581,38 @@ public:
         return read_tid_;
     }
 
+    // the most recent TID a read-write transaction may read at
+    static tid_type present_tid() {
+#if STO_DECENTRALIZED_TID
+        return std::max(clock_tid(), tinfo[TThread::id()].last_wtid);
+#else
+        return _TID;
+#endif
+    }
+
     // transaction is now a read-write transaction
     tid_type write_tid() const {
         if (!commit_tid_) {
             threadinfo_t& thr = tinfo[TThread::id()];
+#if STO_DECENTRALIZED_TID
+            // Publish the TID, then check it against every snapshot claim.
+            tid_type claim = std::max(_RTID_claim.load(std::memory_order_acquire),
+                                      thr.claim.load(std::memory_order_relaxed));
+            while (true) {
+                tid_type base = std::max({thr.last_wtid, read_tid_, tid_observed_, claim, clock_tid()});
+                tid_type tid = (base / tid_unit + 1) * tid_unit
+                    + TThread::id() * TransactionTid::increment_value;
+                thr.wtid = tid;
+                fence();
+                claim = claim_ceiling();
+                if (claim < tid) {
+                    thr.last_wtid = commit_tid_ = tid;
+                    break;
+                }
+            }
+#else
             thr.wtid = commit_tid_ = fetch_and_add(&_TID, TransactionTid::increment_value);
+#endif
         }
         return commit_tid_;
     }
@@ -1221,7 +1759,16 @@ private:
     TransItem* tset_next_;
     unsigned tset_size_;
     mutable bool mvcc_rw;  // manual MVCC read-write flag
+    bool read_only_;       // declared read-only
     mutable tid_type start_tid_;
+#if STO_INCREMENTAL_OPACITY
+    // start_tid_ at the last opacity check (0 if none), the tracking set and
+    // read-version array sizes then, and whether every check must be full
+    tid_type opacity_tid_;
+    unsigned opacity_checked_;
+    unsigned opacity_vchecked_;
+    bool opacity_full_;
+#endif
 #if SAFE_FLATTEN
     mutable tid_type write_tid_inf_;
 #endif
@@ -1229,6 +1776,9 @@ private:
     mutable tid_type commit_tid_;
     mutable tid_type prev_commit_tid_;
     mutable tid_type tictoc_tid_; // commit tid reserved for TicToc
+#if STO_DECENTRALIZED_TID
+    tid_type tid_observed_; // largest version overwritten so far
+#endif
 public:
     mutable TransactionBuffer buf_;
     mutable TransScratch scratch_;
@@ -1244,12 +1794,35 @@ private:
 #endif
     TransItem* tset_[tset_max_capacity / tset_chunk];
     CicadaHashtable cht_;
+    TsetIndex tsi_;
 #if CICADA_HASHTABLE == 0
 #if TRANSACTION_HASHTABLE
     uint16_t hashtable_[hash_size];
 #endif
 #endif
     TransItem tset0_[tset_initial_capacity];
+    // Tracking-set copies for the live savepoints, oldest first. TransItems
+    // are not assignable, so the copies are bytewise.
+    TransItem* sp_items_;
+    size_t sp_nitems_;
+    size_t sp_items_capacity_;
+    unsigned sp_depth_;
+#if STO_BATCH_COMMIT
+    // commit batches, grown to the largest tracking set committed
+    TransItem** batch_;
+    unsigned batch_capacity_;
+#endif
+#if STO_READ_VERSION_ARRAY
+    // Reads of plain OCC versions, in observation order: the version word,
+    // the observed value and the item. Reads beyond the capacity are
+    // validated by their owners as usual.
+    static constexpr unsigned vread_capacity = 1024;
+    static constexpr TransactionTid::type vread_dead_ = 0;
+    unsigned nvreads_;
+    const volatile TransactionTid::type* vread_word_[vread_capacity];
+    TransactionTid::type vread_value_[vread_capacity];
+    TransItem* vread_item_[vread_capacity];
+#endif
 
     bool hard_check_opacity(TransItem* item, TransactionTid::type t);
     void stop(bool committed, unsigned* writes, unsigned nwrites);
@@ -1260,6 +1833,7 @@ private:
     friend class TestTransaction;
     friend class MvHistoryBase;
     friend class CicadaHashtable;
+    friend class TsetIndex;
 
     friend class VersionDelegate;
 };
@@ -1334,6 +1908,64 @@ void CicadaHashtable::put(TObject* owner, void* xkey, uint32_t idx) {
     bkt->idx[bkt->count++] = idx;
 }
 
+void CicadaHashtable::truncate(uint32_t size) {
+    // drop the entries of items at or after `size`; emptied overflow
+    // buckets stay chained
+    for (uint16_t bkt_id = 0; bkt_id < access_bucket_count_; ++bkt_id) {
+        AccessBucket* bkt = &access_buckets_[bkt_id];
+        uint16_t n = 0;
+        for (uint16_t i = 0; i < bkt->count; ++i)
+            if (bkt->idx[i] < size)
+                bkt->idx[n++] = bkt->idx[i];
+        bkt->count = n;
+    }
+}
+
+TransItem* TsetIndex::item_at(uint32_t idx) const {
+    if (likely(idx < txn_.tset_initial_capacity))
+        return &txn_.tset0_[idx];
+    return &txn_.tset_[idx / txn_.tset_chunk][idx % txn_.tset_chunk];
+}
+
+TransItem* TsetIndex::find(TObject* owner, void* key) const {
+    TXP_INCREMENT(txp_hash_find);
+    if (!size_)
+        return nullptr;
+    for (uint32_t i = hash_(owner, key) & mask_, steps = 0; slots_[i] > base_;
+         i = (i + 1) & mask_, ++steps) {
+        TransItem* ti = item_at(slots_[i] - base_ - 1);
+        TXP_INCREMENT(txp_total_searched);
+        if (ti->owner() == owner && ti->key_ == key)
+            return ti;
+        if (!steps)
+            TXP_INCREMENT(txp_hash_collision);
+        else
+            TXP_INCREMENT(txp_hash_collision2);
+    }
+    return nullptr;
+}
+
+void TsetIndex::put(TObject* owner, void* key, uint32_t idx) {
+    if (!slots_)
+        reset(initial_capacity);
+    if (2 * (size_ + 1) > mask_ + 1)
+        rebuild(2 * (mask_ + 1), idx);
+    insert(hash_(owner, key), idx);
+}
+
+void TsetIndex::truncate(uint32_t size) {
+    if (slots_)
+        rebuild(mask_ + 1, size);
+}
+
+void TsetIndex::rebuild(uint32_t capacity, uint32_t n) {
+    reset(capacity);
+    for (uint32_t idx = 0; idx != n; ++idx) {
+        TransItem* ti = item_at(idx);
+        insert(hash_(ti->owner(), ti->key_), idx);
+    }
+}
+
 
 template <int T, bool tmp_stats>
 inline void TimeKeeper<T, tmp_stats>::sync_thread_counter() {
@@ -1451,6 +2083,20 @@ public:
         TThread::txn->mvcc_rw_upgrade();
     }
 
+    static void declare_read_only() {
+        always_assert(in_progress());
+        TThread::txn->declare_read_only();
+    }
+
+    static bool read_only() {
+        return TThread::txn->read_only();
+    }
+
+    static bool declare_snapshot(TransactionTid::type tid) {
+        always_assert(in_progress());
+        return TThread::txn->declare_snapshot(tid);
+    }
+
 #if SAFE_FLATTEN
     static TransactionTid::type write_tid_inf() {
         return TThread::txn->write_tid_inf();
@@ -1488,6 +2134,21 @@ public:
         return TThread::txn->tx_alloc<T>();
     }
 
+    static Transaction::savepoint_type savepoint() {
+        always_assert(in_progress());
+        return TThread::txn->savepoint();
+    }
+
+    static void rollback_to(const Transaction::savepoint_type& sp) {
+        always_assert(in_progress());
+        TThread::txn->rollback_to(sp);
+    }
+
+    static void release_savepoint(const Transaction::savepoint_type& sp) {
+        always_assert(in_progress());
+        TThread::txn->release_savepoint(sp);
+    }
+
     static void print_read_set_size(const char* stage_name) {
         printf("stage-%s: tset_size=%u\n", stage_name, TThread::txn->tset_size_);
     }
@@ -1534,6 +2195,11 @@ class TransactionGuard {
     TransactionGuard() {
         Sto::start_transaction();
     }
+    explicit TransactionGuard(bool read_only) {
+        Sto::start_transaction();
+        if (read_only)
+            Sto::declare_read_only();
+    }
     ~TransactionGuard() {
         Sto::commit();
         Sto::delete_transaction();
@@ -1601,10 +2267,30 @@ inline bool TransProxy::add_read_opaque(T rdata) {
     return true;
 }
 
+inline TransProxy& TransProxy::clear_read() {
+    item().__rm_flags(TransItem::read_bit);
+#if STO_READ_VERSION_ARRAY
+    t()->forget_version_read(item());
+#endif
+    return *this;
+}
+
+inline TransProxy& TransProxy::remove_read() {
+    item().__rm_flags(TransItem::read_bit);
+#if STO_READ_VERSION_ARRAY
+    t()->forget_version_read(item());
+#endif
+    return *this;
+}
+
 template <typename T>
 inline TransProxy& TransProxy::update_read(T old_rdata, T new_rdata) {
-    if (has_read() && this->read_value<T>() == old_rdata)
+    if (has_read() && this->read_value<T>() == old_rdata) {
         item().rdata_.v = Packer<T>::repack(t()->buf_, item().rdata_.v, new_rdata);
+#if STO_READ_VERSION_ARRAY
+        t()->refresh_version_read(item());
+#endif
+    }
     return *this;
 }
 
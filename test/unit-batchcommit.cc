@@ -0,0 +1,141 @@
+#undef NDEBUG
+#include <cassert>
+#include <algorithm>
+#include "Sto.hh"
+#include "TArray.hh"
+
+// Counts the batched commit calls try_commit makes on an object. With
+// STO_BATCH_COMMIT, each phase reaches every owner once with all of its items;
+// otherwise the per-item interface is used and the batch calls never happen.
+
+class CountingArray : public TArray<int, 16> {
+public:
+    int nlock_batch = 0, ncheck_batch = 0, ninstall_batch = 0;
+    unsigned nlocked = 0, nchecked = 0, ninstalled = 0;
+    unsigned fail_after = ~0U;
+
+    void reset() {
+        nlock_batch = ncheck_batch = ninstall_batch = 0;
+        nlocked = nchecked = ninstalled = 0;
+        fail_after = ~0U;
+    }
+
+    unsigned lock_batch(TransItem** items, unsigned n, Transaction& txn) override {
+        ++nlock_batch;
+        nlocked += n;
+        // pretend the lock after the first `fail_after` items is contended
+        return TObject::lock_batch(items, std::min(n, fail_after), txn);
+    }
+    unsigned check_batch(TransItem** items, unsigned n, Transaction& txn) override {
+        ++ncheck_batch;
+        nchecked += n;
+        return TObject::check_batch(items, n, txn);
+    }
+    void install_batch(TransItem** items, unsigned n, Transaction& txn) override {
+        ++ninstall_batch;
+        ninstalled += n;
+        TObject::install_batch(items, n, txn);
+    }
+};
+
+static CountingArray a, b;
+
+void testGrouping() {
+    {
+        TransactionGuard t;
+        a[0] = 1;
+        b[0] = 1;
+        a[1] = 2;
+        b[1] = 2;
+        a[2] = 3;
+        a[3] = 4;
+        int x = a[8] + b[8];
+        (void) x;
+    }
+#if STO_BATCH_COMMIT
+    assert(a.nlock_batch == 1 && a.nlocked == 4);
+    assert(b.nlock_batch == 1 && b.nlocked == 2);
+#if !STO_READ_VERSION_ARRAY
+    assert(a.ncheck_batch == 1 && a.nchecked == 1);
+    assert(b.ncheck_batch == 1 && b.nchecked == 1);
+#endif
+    assert(a.ninstall_batch == 1 && a.ninstalled == 4);
+    assert(b.ninstall_batch == 1 && b.ninstalled == 2);
+#else
+    assert(a.nlock_batch == 0 && a.ncheck_batch == 0 && a.ninstall_batch == 0);
+    assert(b.nlock_batch == 0 && b.ncheck_batch == 0 && b.ninstall_batch == 0);
+#endif
+
+    {
+        TransactionGuard t;
+        assert(a[0] == 1 && a[3] == 4 && b[1] == 2);
+    }
+    a.reset();
+    b.reset();
+    printf("PASS: %s\n", __FUNCTION__);
+}
+
+void testPartialLockAbort() {
+#if STO_BATCH_COMMIT
+    a.fail_after = 2;
+#endif
+    {
+        TestTransaction t(0);
+        for (int i = 0; i != 4; ++i)
+            a[i] = 10 + i;
+#if STO_BATCH_COMMIT
+        assert(!t.try_commit());
+#else
+        assert(t.try_commit());
+#endif
+    }
+    a.reset();
+
+    // the locks taken before the failure were released
+    {
+        TransactionGuard t;
+        for (int i = 0; i != 4; ++i)
+            a[i] = 20 + i;
+    }
+    {
+        TransactionGuard t;
+        for (int i = 0; i != 4; ++i)
+            assert(a[i] == 20 + i);
+    }
+    a.reset();
+    printf("PASS: %s\n", __FUNCTION__);
+}
+
+void testCheckFailure() {
+    TestTransaction t1(0);
+    int x = a[5];
+    (void) x;
+    b[5] = 1;
+
+    TestTransaction t2(1);
+    a[5] = 7;
+    assert(t2.try_commit());
+
+    t1.use();
+    assert(!t1.try_commit());
+#if STO_BATCH_COMMIT
+    assert(b.ninstall_batch == 0);
+#endif
+#if STO_BATCH_COMMIT && !STO_READ_VERSION_ARRAY
+    assert(a.ncheck_batch == 1);
+#endif
+    {
+        TransactionGuard t;
+        assert(b[5] == 0);
+    }
+    a.reset();
+    b.reset();
+    printf("PASS: %s\n", __FUNCTION__);
+}
+
+int main() {
+    testGrouping();
+    testPartialLockAbort();
+    testCheckFailure();
+    return 0;
+}
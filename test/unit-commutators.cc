@@ -0,0 +1,126 @@
+#undef NDEBUG
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include "Sto.hh"
+#include "TMvBox.hh"
+
+// The default Commutator of rows that declare commute_ops applies chained
+// column operations, as blind writes that MVCC turns into delta versions.
+
+using commutators::Commutator;
+
+struct account {
+    static constexpr size_t commute_ops = 4;
+
+    int64_t balance;
+    uint32_t hits;
+    int16_t credit;
+    double peak;
+    uint16_t flags;
+    char log[12];
+    uint64_t name_ts;
+    char name[8];
+};
+
+std::ostream& operator<<(std::ostream& w, const account& a) {
+    return w << "{account " << a.balance << "}";
+}
+
+static account make_account() {
+    account a;
+    memset(&a, 0, sizeof(a));
+    a.balance = 100;
+    a.credit = 10;
+    a.flags = 0x0f;
+    strcpy(a.log, "ab");
+    strcpy(a.name, "old");
+    a.name_ts = 5;
+    return a;
+}
+
+void testOps() {
+    static_assert(std::is_empty<Commutator<std::string>>::value,
+                  "rows without commute_ops keep an empty commutator");
+    static_assert(std::is_trivially_copyable<Commutator<account>>::value,
+                  "commutators are logged as bytes");
+
+    account a = make_account();
+    Commutator<account> c;
+    c.add(&account::balance, -30).add(&account::hits, 1)
+     .max(&account::peak, 2.5).bit_or(&account::flags, 0x30);
+    assert(c.size() == 4);
+    c.operate(a);
+    assert(a.balance == 70 && a.hits == 1 && a.peak == 2.5 && a.flags == 0x3f);
+
+    Commutator<account> d;
+    d.min(&account::peak, 1.5).bit_and(&account::flags, 0x31)
+     .saturating_add(&account::credit, 32760).saturating_add(&account::hits, -5, 0u, 10u);
+    d.operate(a);
+    assert(a.peak == 1.5 && a.flags == 0x31);
+    assert(a.credit == INT16_MAX && a.hits == 0);
+    printf("PASS: %s\n", __FUNCTION__);
+}
+
+void testAppendAndSet() {
+    account a = make_account();
+    char newer[8] = "new", older[8] = "older";
+    Commutator<account> c;
+    c.append(&account::log, "cdefgh", 6).append(&account::log, "ijklmn", 6)
+     .lww_set(&account::name, newer, &account::name_ts, 9)
+     .lww_set(&account::name, older, &account::name_ts, 7);
+    c.operate(a);
+    // the log keeps its terminator, and the later write lost
+    assert(strcmp(a.log, "abcdefghijk") == 0);
+    assert(strcmp(a.name, "new") == 0 && a.name_ts == 9);
+
+    // a full log without a terminator is left alone, bytes past it too
+    account b = make_account(), before;
+    memset(b.log, 'x', sizeof(b.log));
+    reinterpret_cast<char*>(&b)[offsetof(account, log) + sizeof(b.log)] = 'z';
+    memcpy(&before, &b, sizeof(b));
+    Commutator<account> d;
+    d.append(&account::log, "y", 1);
+    d.operate(b);
+    assert(memcmp(&b, &before, sizeof(b)) == 0);
+    printf("PASS: %s\n", __FUNCTION__);
+}
+
+void testMvDeltas() {
+    static TMvBox<account> box(make_account());
+    {
+        // two blind updates of the same row both commit
+        TestTransaction t1(1);
+        Commutator<account> c1;
+        c1.add(&account::balance, 5).max(&account::peak, 3.0);
+        Sto::item(&box, 0).add_commute(c1);
+        TestTransaction t2(2);
+        Commutator<account> c2;
+        c2.add(&account::balance, 7).max(&account::peak, 2.0);
+        Sto::item(&box, 0).add_commute(c2);
+        assert(t2.try_commit());
+        t1.use();
+        assert(t1.try_commit());
+    }
+    TThread::set_id(0);
+    MvHistory<account>* h;
+    {
+        TransactionGuard t;
+        h = TMvBoxAccess::head(box);
+    }
+    assert(h->status_is(COMMITTED_DELTA));
+    {
+        TransactionGuard t;
+        account a = box;
+        assert(a.balance == 112 && a.peak == 3.0);
+    }
+    printf("PASS: %s\n", __FUNCTION__);
+}
+
+int main() {
+    testOps();
+    testAppendAndSet();
+    testMvDeltas();
+    return 0;
+}
@@ -0,0 +1,172 @@
+#undef NDEBUG
+#include <atomic>
+#include <cassert>
+#include <thread>
+#include <vector>
+#include <numaif.h>
+#include "Sto.hh"
+#include "DB_arena.hh"
+
+// Row arenas hand out cache-line aligned rows from huge-page regions bound
+// to a NUMA node, reuse freed rows, and back bucket arrays. Also reports
+// the cost of allocating rows from an arena and from the heap.
+
+using bench::row_arena;
+using bench::arena_allocator;
+
+struct row {
+    uint64_t key;
+    char data[200];
+};
+
+// The node of the page holding `p`, which must have been touched
+static int node_of(void* p) {
+    int status = -1;
+    long r = move_pages(0, 1, &p, nullptr, &status, 0);
+    assert(r == 0);
+    return status;
+}
+
+void testRows() {
+    row_arena arena;
+    row* a = bench::arena_new<row>(&arena);
+    row* b = bench::arena_new<row>(&arena);
+    assert(reinterpret_cast<uintptr_t>(a) % CACHE_LINE_SIZE == 0);
+    assert(reinterpret_cast<uintptr_t>(b) % CACHE_LINE_SIZE == 0);
+    assert(b != a);
+    a->key = 1;
+    b->key = 2;
+    bench::arena_delete(&arena, a);
+    // freed rows come back first
+    row* c = bench::arena_new<row>(&arena);
+    assert(c == a && b->key == 2);
+    assert(arena.mapped_bytes() == row_arena::region_size);
+    bench::arena_delete(&arena, b);
+    bench::arena_delete(&arena, c);
+    // without an arena, rows come from the heap
+    row* d = bench::arena_new<row>(nullptr);
+    bench::arena_delete<row>(nullptr, d);
+    printf("PASS: %s\n", __FUNCTION__);
+}
+
+void testNode() {
+    if (numa_available() < 0) {
+        printf("PASS: %s (no NUMA)\n", __FUNCTION__);
+        return;
+    }
+    int node = numa_max_node();
+    row_arena arena(node);
+    row* r = bench::arena_new<row>(&arena);
+    r->key = 1;
+    assert(node_of(r) == node);
+
+    typedef std::vector<uint64_t, arena_allocator<uint64_t>> bucket_vector;
+    bucket_vector buckets {arena_allocator<uint64_t>(&arena)};
+    buckets.resize(1 << 20);
+    buckets[12345] = 1;
+    assert(node_of(&buckets[12345]) == node);
+    assert(arena.mapped_bytes() == row_arena::region_size + (8 << 20));
+    buckets = bucket_vector {arena_allocator<uint64_t>(&arena)};
+    assert(arena.mapped_bytes() == row_arena::region_size);
+    printf("PASS: %s\n", __FUNCTION__);
+}
+
+// Threads free each other's rows
+void testThreads() {
+    constexpr int nthreads = 4, n = 20000;
+    row_arena arena;
+    std::vector<std::vector<row*>> rows(nthreads);
+    std::vector<std::thread> threads;
+    for (int t = 0; t != nthreads; ++t)
+        threads.emplace_back([&, t] () {
+            for (int i = 0; i != n; ++i) {
+                row* r = bench::arena_new<row>(&arena);
+                r->key = t * n + i;
+                rows[t].push_back(r);
+            }
+        });
+    for (auto& th : threads)
+        th.join();
+    threads.clear();
+    size_t mapped = arena.mapped_bytes();
+    std::atomic<int> freed(0);
+    for (int t = 0; t != nthreads; ++t)
+        threads.emplace_back([&, t] () {
+            auto& mine = rows[(t + 1) % nthreads];
+            for (int i = 0; i != n; ++i) {
+                assert(mine[i]->key == uint64_t((t + 1) % nthreads * n + i));
+                bench::arena_delete(&arena, mine[i]);
+            }
+            // and, once every thread has freed its rows, reuse them
+            ++freed;
+            while (freed != nthreads)
+                relax_fence();
+            for (int i = 0; i != n; ++i)
+                mine[i] = bench::arena_new<row>(&arena);
+        });
+    for (auto& th : threads)
+        th.join();
+    assert(arena.mapped_bytes() == mapped);
+    printf("PASS: %s\n", __FUNCTION__);
+}
+
+// One thread allocates what another frees: the frees go back to the arena,
+// and the allocating thread reuses them instead of mapping more
+void testRemoteFrees() {
+    constexpr int rounds = 50, n = 20000;
+    row_arena arena;
+    std::vector<row*> rows(n);
+    size_t mapped = 0;
+    for (int r = 0; r != rounds; ++r) {
+        for (int i = 0; i != n; ++i)
+            rows[i] = bench::arena_new<row>(&arena);
+        if (r == 0)
+            mapped = arena.mapped_bytes();
+        std::thread freer([&] () {
+            for (int i = 0; i != n; ++i)
+                bench::arena_delete(&arena, rows[i]);
+        });
+        freer.join();
+    }
+    assert(arena.mapped_bytes() == mapped);
+    printf("PASS: %s\n", __FUNCTION__);
+}
+
+void reportAllocation() {
+    constexpr int n = 1000000, nreads = 1000000;
+    std::vector<row*> rows(n);
+    row_arena arena(numa_available() < 0 ? -1 : 0);
+    for (row_arena* a : {(row_arena*) nullptr, &arena}) {
+        auto start = read_tsc();
+        for (int i = 0; i != n; ++i) {
+            rows[i] = bench::arena_new<row>(a);
+            rows[i]->key = i;
+        }
+        auto alloc_ticks = read_tsc() - start;
+        start = read_tsc();
+        uint64_t sum = 0, x = 88172645463325252ULL;
+        for (int i = 0; i != nreads; ++i) {
+            x ^= x << 13;
+            x ^= x >> 7;
+            x ^= x << 17;
+            sum += rows[x % n]->key;
+        }
+        auto read_ticks = read_tsc() - start;
+        for (int i = 0; i != n; ++i)
+            bench::arena_delete(a, rows[i]);
+        printf("%s: %.0f cycles per row allocation, %.0f cycles per random row read (%lu)\n",
+               a ? "arena" : "heap", double(alloc_ticks) / n,
+               double(read_ticks) / nreads, sum % 10);
+    }
+    printf("arena: %zu MB mapped, %zu MB in reserved huge pages\n",
+           arena.mapped_bytes() >> 20, arena.huge_bytes() >> 20);
+}
+
+int main() {
+    testRows();
+    testNode();
+    testThreads();
+    testRemoteFrees();
+    reportAllocation();
+    return 0;
+}
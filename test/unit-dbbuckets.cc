@@ -0,0 +1,327 @@
+#undef NDEBUG
+#include <cassert>
+#include <functional>
+#include <thread>
+#include <vector>
+#include "Sto.hh"
+#include "DB_buckets.hh"
+
+// The unordered indexes' bucket map grows a few buckets at a time while
+// rows go in, keeps every row findable meanwhile, and aborts only the
+// absent-key lookups whose buckets moved; with either bucket layout. Also
+// reports the cost of inserts into a growing map, and of lookups in each
+// layout, one at a time and in batches.
+
+struct elem {
+    elem* next;
+    uint64_t key;
+
+    explicit elem(uint64_t k) : next(nullptr), key(k) {}
+};
+
+template <bool F, typename Hash = std::hash<uint64_t>>
+using map_type = bench::bucket_map<elem, uint64_t, TNonopaqueVersion,
+                                   Hash, std::equal_to<uint64_t>, F>;
+
+template <bool F, typename Hash = std::hash<uint64_t>>
+static map_type<F, Hash> make_map(size_t size) {
+    return map_type<F, Hash>(size, nullptr, Hash(), std::equal_to<uint64_t>());
+}
+
+// as an index's insert_row does
+template <typename Map>
+static elem* insert(Map& map, uint64_t k) {
+    size_t h = map.hash(k);
+    map.grow();
+    auto& b = map.lock_bucket(h);
+    elem* e = map.find(b, k, h);
+    if (!e) {
+        e = new elem(k);
+        map.link(b, e, h);
+        b.version.inc_nonopaque();
+    }
+    b.version.unlock_exclusive();
+    return e;
+}
+
+template <typename Map>
+static elem* find(Map& map, uint64_t k) {
+    size_t h = map.hash(k);
+    TNonopaqueVersion vers;
+    return map.find(map.read_bucket(h, vers), k, h);
+}
+
+// as an index's select_rows does, in stages that prefetch for the next
+constexpr size_t batch = 16;
+
+template <typename Map>
+static void find_batch(Map& map, const uint64_t* keys, elem** found) {
+    size_t hs[batch];
+    typename Map::bucket* bs[batch];
+    TNonopaqueVersion vers[batch];
+    for (size_t i = 0; i != batch; ++i) {
+        hs[i] = map.hash(keys[i]);
+        map.prefetch_bucket(hs[i]);
+    }
+    for (size_t i = 0; i != batch; ++i) {
+        bs[i] = &map.read_bucket(hs[i], vers[i]);
+        map.prefetch_elements(*bs[i], hs[i]);
+    }
+    for (size_t i = 0; i != batch; ++i)
+        found[i] = map.find(*bs[i], keys[i], hs[i]);
+}
+
+// Owns the bucket items of absent-key lookups
+template <bool F>
+class lookups : public TObject {
+public:
+    typedef typename map_type<F>::bucket bucket;
+
+    explicit lookups(map_type<F>& map) : map_(map) {}
+
+    // returns false if the transaction must abort
+    bool absent(uint64_t k) {
+        TNonopaqueVersion vers;
+        bucket& b = map_.read_bucket(map_.hash(k), vers);
+        assert(!map_.find(b, k, map_.hash(k)));
+        return Sto::item(this, &b).observe(vers);
+    }
+
+    bool lock(TransItem&, Transaction&) override {
+        return false;
+    }
+    bool check(TransItem& item, Transaction& txn) override {
+        return item.key<bucket*>()->version.cp_check_version(txn, item);
+    }
+    void install(TransItem&, Transaction&) override {}
+    void unlock(TransItem&) override {}
+
+private:
+    map_type<F>& map_;
+};
+
+template <bool F>
+void testGrow() {
+    auto map = make_map<F>(4);
+    std::vector<elem*> elems;
+    for (uint64_t k = 0; k != 1000; ++k) {
+        elems.push_back(insert(map, k * 7));
+        // every row so far stays findable while buckets move
+        if (k % 97 == 0)
+            for (uint64_t j = 0; j <= k; ++j)
+                assert(map.nontrans_find(j * 7) == elems[j]);
+    }
+    assert(map.size() == 1000 && map.nbuckets() >= 512);
+    assert(insert(map, 7) == elems[1] && map.size() == 1000);
+    for (uint64_t k = 0; k != 1000; ++k) {
+        assert(find(map, k * 7) == elems[k]);
+        assert(!map.nontrans_find(k * 7 + 1));
+    }
+    for (elem* e : elems)
+        delete e;
+    printf("PASS: %s<%d>\n", __FUNCTION__, F);
+}
+
+// Puts every key in bucket 0, with one tag
+struct same_hash {
+    size_t operator()(uint64_t) const {
+        return 0;
+    }
+};
+
+void testFingerprints() {
+    auto map = make_map<true, same_hash>(16);
+    std::vector<elem*> elems;
+    for (uint64_t k = 0; k != 8; ++k)
+        elems.push_back(insert(map, k));
+    for (uint64_t k = 0; k != 8; ++k)
+        assert(find(map, k) == elems[k]);
+    assert(!find(map, 8));
+    // removing from a slot and from the chain; freed slots are reused
+    auto& b = map.lock_bucket(map.hash(0));
+    assert(map.unlink(b, elems[1]) && map.unlink(b, elems[6]));
+    assert(!map.unlink(b, elems[6]));
+    b.version.unlock_exclusive();
+    assert(!find(map, 1) && !find(map, 6) && find(map, 7) == elems[7]);
+    elem* e = insert(map, 9);
+    assert(find(map, 9) == e && b.slots[1] == e);
+    assert(map.size() == 7);
+    printf("PASS: %s\n", __FUNCTION__);
+}
+
+template <bool F>
+void testPhantoms() {
+    auto map = make_map<F>(64);
+    for (uint64_t k = 0; k != 64; ++k)
+        insert(map, k * 64);
+    lookups<F> l(map);
+    {
+        TestTransaction t1(1);
+        // bucket 1, which the first batch moves
+        assert(l.absent(1));
+        TestTransaction t2(2);
+        // bucket 40, which it does not
+        assert(l.absent(40));
+        TThread::set_id(0);
+        // the map grows, then moves buckets 0 to 7
+        insert(map, 64 * 64);
+        assert(map.nbuckets() == 64);
+        insert(map, 65 * 64);
+        assert(map.nbuckets() == 128);
+        insert(map, 66 * 64);
+        t1.use();
+        assert(!t1.try_commit());
+        t2.use();
+        assert(t2.try_commit());
+    }
+    {
+        // lookups after the move see the new table, and conflict with
+        // inserts into it
+        TestTransaction t1(1);
+        assert(l.absent(1 + 128));
+        TThread::set_id(0);
+        insert(map, 1);
+        t1.use();
+        assert(!t1.try_commit());
+    }
+    printf("PASS: %s<%d>\n", __FUNCTION__, F);
+}
+
+template <bool F>
+void testScan() {
+    constexpr size_t range_buckets = 16;
+    auto map = make_map<F>(48);
+    for (uint64_t k = 0; k != 200; ++k)
+        insert(map, k);
+    std::vector<int> seen(200, 0);
+    {
+        // scan in the middle of growing
+        TransactionGuard t;
+        for (size_t r = 0; r != map.scan_ranges(range_buckets); ++r)
+            map.scan(r, range_buckets, [&] (elem* e) { ++seen[e->key]; });
+    }
+    for (int n : seen)
+        assert(n == 1);
+    printf("PASS: %s<%d>\n", __FUNCTION__, F);
+}
+
+template <bool F>
+void testThreads() {
+    constexpr int nthreads = 4, n = 50000;
+    auto map = make_map<F>(16);
+    std::vector<std::thread> threads;
+    for (int t = 0; t != nthreads; ++t)
+        threads.emplace_back([&, t] () {
+            TThread::set_id(t);
+            for (uint64_t i = 0; i != n; ++i) {
+                uint64_t k = i * nthreads + t;
+                insert(map, k);
+                // while other threads move buckets
+                if (i > 100)
+                    assert(map.nontrans_find(k - 100 * nthreads));
+            }
+        });
+    for (auto& th : threads)
+        th.join();
+    assert(map.size() == nthreads * n);
+    for (uint64_t k = 0; k != nthreads * n; ++k)
+        assert(map.nontrans_find(k));
+    printf("PASS: %s<%d>\n", __FUNCTION__, F);
+}
+
+void reportGrowth() {
+    constexpr uint64_t n = 1000000;
+    for (size_t size : {size_t(1024), size_t(n)}) {
+        auto map = make_map<false>(size);
+        auto start = read_tsc();
+        for (uint64_t k = 0; k != n; ++k)
+            insert(map, k * 0x9E3779B97F4A7C15ULL);
+        auto insert_ticks = read_tsc() - start;
+        start = read_tsc();
+        uint64_t found = 0, x = 88172645463325252ULL;
+        for (uint64_t i = 0; i != n; ++i) {
+            x ^= x << 13;
+            x ^= x >> 7;
+            x ^= x << 17;
+            found += map.nontrans_find((x % n) * 0x9E3779B97F4A7C15ULL) != nullptr;
+        }
+        auto lookup_ticks = read_tsc() - start;
+        assert(found == n);
+        printf("%zu initial buckets: %.0f cycles per insert, %.0f cycles per lookup, %zu buckets at end\n",
+               size, double(insert_ticks) / n, double(lookup_ticks) / n, map.nbuckets());
+    }
+}
+
+// Rows as big as index rows, so that lookups that load rows miss the cache
+struct big_elem : elem {
+    char row[192];
+
+    explicit big_elem(uint64_t k) : elem(k) {}
+};
+
+template <bool F, typename Hash>
+void reportLookups(const char* name) {
+    constexpr uint64_t n = 4000000, nlookups = 2000000;
+    auto map = make_map<F, Hash>(n);
+    std::vector<uint64_t> keys(n);
+    uint64_t x = 88172645463325252ULL;
+    auto next = [&] () {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        return x;
+    };
+    for (auto& k : keys) {
+        k = next() >> 1;
+        size_t h = map.hash(k);
+        auto& b = map.lock_bucket(h);
+        map.link(b, new big_elem(k), h);
+        b.version.unlock_exclusive();
+    }
+    for (bool present : {true, false}) {
+        uint64_t found = 0;
+        auto start = read_tsc();
+        for (uint64_t i = 0; i != nlookups; ++i) {
+            uint64_t r = next();
+            // absent keys have the top bit set
+            uint64_t k = present ? keys[r % n] : r | (1ULL << 63);
+            found += find(map, k) != nullptr;
+        }
+        auto ticks = read_tsc() - start;
+        assert(found == (present ? nlookups : 0));
+        printf("%s: %.0f cycles per %s lookup\n", name,
+               double(ticks) / nlookups, present ? "present" : "absent");
+    }
+    uint64_t found = 0;
+    auto start = read_tsc();
+    for (uint64_t i = 0; i != nlookups; i += batch) {
+        uint64_t ks[batch];
+        elem* es[batch];
+        for (auto& k : ks)
+            k = keys[next() % n];
+        find_batch(map, ks, es);
+        for (elem* e : es)
+            found += e != nullptr;
+    }
+    auto ticks = read_tsc() - start;
+    assert(found == nlookups);
+    printf("%s: %.0f cycles per present lookup, in batches of %zu\n", name,
+           double(ticks) / nlookups, batch);
+}
+
+int main() {
+    testGrow<false>();
+    testGrow<true>();
+    testFingerprints();
+    testPhantoms<false>();
+    testPhantoms<true>();
+    testScan<false>();
+    testScan<true>();
+    testThreads<false>();
+    testThreads<true>();
+    reportGrowth();
+    reportLookups<false, std::hash<uint64_t>>("chained, std::hash");
+    reportLookups<false, bench::xxh_hash<uint64_t>>("chained, xxHash");
+    reportLookups<true, bench::xxh_hash<uint64_t>>("fingerprints, xxHash");
+    return 0;
+}
@@ -0,0 +1,189 @@
+#undef NDEBUG
+#include <cassert>
+#include <map>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "DB_bulk.hh"
+
+// Bulk loaders put each row once, from threads that own disjoint key ranges
+// (ordered indexes) or hashes (unordered ones); in key order for ordered
+// indexes; and with the last row added winning among equal keys. Also
+// reports load throughput.
+
+// Big-endian, so that byte order is key order, as in the benchmarks' keys
+struct key {
+    uint8_t bytes[8];
+
+    key(uint64_t k) {
+        for (int i = 0; i != 8; ++i)
+            bytes[i] = uint8_t(k >> (56 - 8 * i));
+    }
+    uint64_t value() const {
+        uint64_t k = 0;
+        for (int i = 0; i != 8; ++i)
+            k = (k << 8) | bytes[i];
+        return k;
+    }
+};
+
+// Records which thread put each key, and in what order
+template <bool Ordered>
+class fake_index {
+public:
+    typedef key key_type;
+    typedef uint64_t value_type;
+
+    static void thread_init() {
+        thread_id() = next_thread++;
+    }
+    size_t hash(const key_type& k) const {
+        return std::hash<uint64_t>()(k.value());
+    }
+
+    void nontrans_put(const key_type& k, const value_type& v) {
+        std::lock_guard<std::mutex> guard(lock);
+        rows[k.value()] = v;
+        ++puts[k.value()];
+        order[thread_id()].push_back(k.value());
+    }
+
+    std::mutex lock;
+    std::map<uint64_t, uint64_t> rows;
+    std::unordered_map<uint64_t, int> puts;
+    std::map<int, std::vector<uint64_t>> order;
+
+private:
+    static std::atomic<int> next_thread;
+
+    static int& thread_id() {
+        static thread_local int id = -1;
+        return id;
+    }
+};
+
+template <bool Ordered>
+std::atomic<int> fake_index<Ordered>::next_thread {0};
+
+namespace bench {
+template <>
+struct loads_in_order<fake_index<true>> : std::true_type {};
+}
+
+template <bool Ordered>
+void testLoad() {
+    constexpr uint64_t nkeys = 100000;
+    fake_index<Ordered> index;
+    bench::bulk_loader<fake_index<Ordered>> loader(index);
+    std::mt19937_64 rng(1);
+    // every key in random order; some twice, where the second row wins
+    std::vector<uint64_t> keys;
+    for (uint64_t k = 0; k != nkeys; ++k)
+        keys.push_back(k * 3);
+    std::shuffle(keys.begin(), keys.end(), rng);
+    for (uint64_t k : keys)
+        loader.add(k, k % 7 == 0 ? 0 : k);
+    for (uint64_t k : keys)
+        if (k % 7 == 0)
+            loader.add(k, k);
+    size_t n = loader.size();
+    assert(loader.load(4) == n && loader.size() == 0);
+
+    assert(index.rows.size() == nkeys);
+    for (auto& row : index.rows)
+        assert(row.second == row.first);
+    assert(index.order.size() == 4);
+    for (auto& o : index.order) {
+        for (size_t i = 1; i < o.second.size(); ++i) {
+            if (Ordered)
+                assert(o.second[i - 1] <= o.second[i]);
+            else
+                assert(index.hash(o.second[i]) % 4 == index.hash(o.second[0]) % 4);
+        }
+    }
+    // equal keys go to one thread
+    for (auto& p : index.puts)
+        assert(p.second == (p.first % 7 == 0 ? 2 : 1));
+    if (Ordered) {
+        // key ranges do not overlap
+        std::vector<std::pair<uint64_t, uint64_t>> ranges;
+        for (auto& o : index.order)
+            ranges.emplace_back(o.second.front(), o.second.back());
+        std::sort(ranges.begin(), ranges.end());
+        for (size_t i = 1; i != ranges.size(); ++i)
+            assert(ranges[i - 1].second < ranges[i].first);
+    }
+    printf("PASS: %s<%d>\n", __FUNCTION__, Ordered);
+}
+
+// Few rows load on the calling thread
+void testSmall() {
+    fake_index<true> index;
+    bench::bulk_loader<fake_index<true>> loader(index);
+    for (uint64_t k : {5, 3, 9, 3})
+        loader.add(k, k);
+    assert(loader.load(8) == 4);
+    assert(index.order.size() == 1 && index.order.begin()->first == -1);
+    assert((index.order[-1] == std::vector<uint64_t>{3, 3, 5, 9}));
+    assert(loader.load() == 0);
+    printf("PASS: %s\n", __FUNCTION__);
+}
+
+// A tree index on one thread, to compare puts in the order rows come with
+// puts in key order
+class map_index {
+public:
+    typedef key key_type;
+    typedef uint64_t value_type;
+
+    static void thread_init() {}
+
+    void nontrans_put(const key_type& k, const value_type& v) {
+        rows_[k.value()] = v;
+    }
+
+private:
+    std::map<uint64_t, uint64_t> rows_;
+};
+
+namespace bench {
+template <>
+struct loads_in_order<map_index> : std::true_type {};
+}
+
+void reportLoad() {
+    constexpr uint64_t n = 2000000;
+    std::vector<uint64_t> keys(n);
+    std::mt19937_64 rng(1);
+    for (auto& k : keys)
+        k = rng();
+    {
+        map_index index;
+        bench::load_meter meter;
+        for (uint64_t i = 0; i != n; ++i)
+            index.nontrans_put(keys[i], i);
+        bench::load_meter::loaded_rows() += n;
+        printf("nontrans_put: ");
+        meter.report();
+    }
+    {
+        map_index index;
+        bench::bulk_loader<map_index> loader(index);
+        bench::load_meter meter;
+        for (uint64_t i = 0; i != n; ++i)
+            loader.add(keys[i], i);
+        loader.load(1);
+        printf("bulk_loader: ");
+        meter.report();
+    }
+}
+
+int main() {
+    testLoad<true>();
+    testLoad<false>();
+    testSmall();
+    reportLoad();
+    return 0;
+}
@@ -0,0 +1,184 @@
+#undef NDEBUG
+#include <cassert>
+#include <string>
+#include <thread>
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <ftw.h>
+
+#include "DB_index.hh"
+#include "DB_structs.hh"
+#include "DB_params.hh"
+#include "DB_checkpoint.hh"
+
+struct coarse_grained_row {
+    enum class NamedColumn : int { aa = 0, bb, cc };
+
+    uint64_t aa;
+    uint64_t bb;
+    uint64_t cc;
+
+    coarse_grained_row() : aa(), bb(), cc() {}
+
+    coarse_grained_row(uint64_t a, uint64_t b, uint64_t c)
+            : aa(a), bb(b), cc(c) {}
+};
+
+struct key_type {
+    uint64_t id;
+
+    explicit key_type(uint64_t key) : id(bench::bswap(key)) {}
+    explicit key_type(const lcdf::Str& mt_key) {
+        assert(mt_key.length() == sizeof(*this));
+        memcpy(this, mt_key.data(), sizeof(*this));
+    }
+    operator lcdf::Str() const {
+        return lcdf::Str((const char *)this, sizeof(*this));
+    }
+};
+
+using CoarseIndex = bench::ordered_index<key_type, coarse_grained_row, db_params::db_default_params>;
+using MVIndex = bench::mvcc_ordered_index<key_type, coarse_grained_row, db_params::db_mvcc_params>;
+using RowAccess = bench::RowAccess;
+
+static std::string make_log_dir() {
+    char tmpl[] = "/tmp/sto-ckpt-XXXXXX";
+    char* dir = mkdtemp(tmpl);
+    assert(dir);
+    return std::string(dir);
+}
+
+static void remove_log_dir(const std::string& dir) {
+    auto remove_entry = [] (const char* path, const struct stat*, int, struct FTW*) {
+        return remove(path);
+    };
+    int r = nftw(dir.c_str(), remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+    assert(r == 0);
+}
+
+template <typename IndexType>
+void update(IndexType& idx, uint64_t key, uint64_t aa) {
+    TestTransaction t(0);
+    bool success, found;
+    uintptr_t row;
+    const coarse_grained_row *value;
+    std::tie(success, found, row, value) = idx.select_row(key_type(key), RowAccess::UpdateValue);
+    assert(success && found);
+    auto new_row = Sto::tx_alloc(value);
+    new_row->aa = aa;
+    idx.update_row(row, new_row);
+    assert(t.try_commit());
+}
+
+template <typename IndexType>
+void test_recovery() {
+    std::string dir = make_log_dir();
+    IndexType idx;
+    idx.thread_init();
+    idx.set_log_id(1);
+    for (uint64_t i = 1; i <= 10; ++i)
+        idx.nontrans_put(key_type(i), coarse_grained_row(i, i, i));
+
+    // without the redo log, nothing could repair a fuzzy copy
+    {
+        bench::logged_table_set tables;
+        tables.add(idx);
+        bench::db_checkpointer ckpt(tables, dir, 2, 4);
+        assert(ckpt.run() == 0);
+    }
+
+    bool ok = TLog::initialize(dir);
+    assert(ok);
+    Transaction::set_epoch_cycle(1000);
+    Transaction::global_epochs.run = true;
+    std::thread advancer(&Transaction::epoch_advancer, nullptr);
+
+    // before the checkpoint
+    update(idx, 1, 100);
+    uint64_t end_epoch;
+    {
+        bench::logged_table_set tables;
+        tables.add(idx);
+        bench::db_checkpointer ckpt(tables, dir, 2, 4);
+        auto epoch = ckpt.run();
+        assert(epoch != 0);
+        assert(ckpt.bytes_written() > 0);
+
+        // the checkpoint is durable through the epoch its scan ended in
+        bench::checkpoint_files::checkpoint_manifest m;
+        FILE* f = fopen(bench::checkpoint_files::manifest(
+            bench::checkpoint_files::checkpoint_dir(dir, epoch)).c_str(), "rb");
+        assert(f && fread(&m, sizeof(m), 1, f) == 1);
+        fclose(f);
+        assert(m.begin_epoch == epoch && m.end_epoch >= epoch);
+        assert(TLog::durable_epoch() >= m.end_epoch);
+        end_epoch = m.end_epoch;
+
+        // the finished workers don't hold back reclamation
+        Transaction::rcu_thread_exit();
+        auto ge = Transaction::global_epochs.global_epoch.load();
+        for (int i = 0; i != 1000 && Transaction::signed_epoch_type(
+                 Transaction::global_epochs.active_epoch.load() - ge) <= 0; ++i)
+            usleep(1000);
+        assert(Transaction::signed_epoch_type(Transaction::global_epochs.active_epoch.load() - ge) > 0);
+    }
+    // after the checkpoint, only in the log
+    update(idx, 2, 200);
+    update(idx, 1, 101);
+    {
+        TestTransaction t(0);
+        coarse_grained_row row_value(20, 20, 20);
+        bool success, found;
+        std::tie(success, found) = idx.insert_row(key_type(20), &row_value);
+        assert(success && !found);
+        std::tie(success, found) = idx.delete_row(key_type(3));
+        assert(success && found);
+        assert(t.try_commit());
+    }
+
+    Transaction::global_epochs.run = false;
+    advancer.join();
+    TLog::shutdown();
+
+    IndexType recovered;
+    recovered.set_log_id(1);
+    bench::logged_table_set tables;
+    tables.add(recovered);
+    bench::db_recovery recovery(tables, dir, 2);
+    ok = recovery.run();
+    assert(ok);
+    assert(recovery.statistics().rows_loaded == 10);
+    recovered.thread_init();
+
+    assert(recovered.nontrans_get(key_type(1))->aa == 101);
+    assert(recovered.nontrans_get(key_type(2))->aa == 200);
+    assert(recovered.nontrans_get(key_type(3)) == nullptr);
+    assert(recovered.nontrans_get(key_type(20))->cc == 20);
+    for (uint64_t i = 4; i <= 10; ++i)
+        assert(recovered.nontrans_get(key_type(i))->bb == i);
+
+    // a checkpoint that ends past the durable epoch is never used
+    auto durable = TLog::read_durable_epoch(dir);
+    auto epoch = recovery.statistics().checkpoint_epoch;
+    assert(bench::checkpoint_files::latest_checkpoint(dir, end_epoch - 1) == 0);
+    std::string cdir = bench::checkpoint_files::checkpoint_dir(dir, durable + 1);
+    int r = mkdir(cdir.c_str(), 0777);
+    assert(r == 0);
+    bench::checkpoint_files::checkpoint_manifest late{durable + 1, durable + 2};
+    FILE* f = fopen(bench::checkpoint_files::manifest(cdir).c_str(), "wb");
+    assert(f && fwrite(&late, sizeof(late), 1, f) == 1);
+    fclose(f);
+    assert(bench::checkpoint_files::latest_checkpoint(dir, durable) == epoch);
+
+    // run the callbacks queued for the indexes while they still exist
+    Transaction::tinfo[TThread::id()].rcu_set.release_all();
+    remove_log_dir(dir);
+    printf("PASS: %s\n", __FUNCTION__);
+}
+
+int main() {
+    test_recovery<CoarseIndex>();
+    test_recovery<MVIndex>();
+    return 0;
+}
@@ -1,6 +1,7 @@
 #include "DB_index.hh"
 #include "DB_structs.hh"
 #include "DB_params.hh"
+#include "DB_trim.hh"
 
 struct coarse_grained_row {
     enum class NamedColumn : int { aa = 0, bb, cc };
@@ -19,6 +20,10 @@ struct key_type {
     uint64_t id;
 
     explicit key_type(uint64_t key) : id(bench::bswap(key)) {}
+    explicit key_type(const lcdf::Str& mt_key) {
+        assert(mt_key.length() == sizeof(*this));
+        memcpy(this, mt_key.data(), sizeof(*this));
+    }
     operator lcdf::Str() const {
         return lcdf::Str((const char *)this, sizeof(*this));
     }
@@ -334,6 +339,303 @@ void test_mvcc_snapshot() {
     printf("pass %s\n", __FUNCTION__);
 }
 
+template <typename IndexType>
+void init_scan_index(IndexType& idx) {
+    for (uint64_t i = 1; i <= 10; ++i)
+        idx.nontrans_put(key_type(i * 10), coarse_grained_row(i, i, i));
+}
+
+// Reads the rest of a cursor's range, appending the rows' aa
+template <typename Cursor>
+bool scan_rest(Cursor& c, int n, std::vector<uint64_t>& out) {
+    while (!c.done()) {
+        if (!c.next_batch(n))
+            return false;
+        assert(c.size() <= size_t(n));
+        for (size_t i = 0; i != c.size(); ++i)
+            out.push_back(c.row(i).aa);
+    }
+    return true;
+}
+
+template <typename IndexType>
+void test_scan_cursor() {
+    typedef std::vector<uint64_t> rows;
+    IndexType idx;
+    idx.thread_init();
+    init_scan_index(idx);
+
+    {
+        // batches resume after the previous batch's last key; the end is
+        // exclusive
+        TestTransaction t(0);
+        auto c = idx.template range_cursor<false>(key_type(10), key_type(100), RowAccess::ObserveValue);
+        assert(c.next_batch(4));
+        assert(c.size() == 4 && !c.done());
+        rows out;
+        for (size_t i = 0; i != c.size(); ++i)
+            out.push_back(c.row(i).aa);
+        assert(scan_rest(c, 4, out));
+        assert((out == rows {1, 2, 3, 4, 5, 6, 7, 8, 9}));
+        // a full last batch leaves an empty one
+        auto c2 = idx.template range_cursor<false>(key_type(10), key_type(90), RowAccess::ObserveValue);
+        out.clear();
+        assert(scan_rest(c2, 4, out));
+        assert((out == rows {1, 2, 3, 4, 5, 6, 7, 8}));
+        assert(t.try_commit());
+    }
+
+    {
+        // seek restarts at a key, inclusive
+        TestTransaction t(0);
+        auto c = idx.template range_cursor<false>(key_type(10), key_type(1000), RowAccess::ObserveValue);
+        assert(c.next_batch(2));
+        assert(c.size() == 2 && c.row(1).aa == 2);
+        c.seek(key_type(70));
+        rows out;
+        assert(scan_rest(c, 2, out));
+        assert((out == rows {7, 8, 9, 10}));
+        c.seek(key_type(25));
+        assert(c.next_batch(1));
+        assert(c.size() == 1 && c.row(0).aa == 3 && !c.done());
+        assert(t.try_commit());
+    }
+
+    {
+        // reverse cursors run down from the first key
+        TestTransaction t(0);
+        auto c = idx.template range_cursor<true>(key_type(100), key_type(10), RowAccess::ObserveValue);
+        rows out;
+        assert(scan_rest(c, 3, out));
+        assert((out == rows {10, 9, 8, 7, 6, 5, 4, 3, 2}));
+        c.seek(key_type(35));
+        out.clear();
+        assert(scan_rest(c, 3, out));
+        assert((out == rows {3, 2}));
+        assert(t.try_commit());
+    }
+
+    {
+        // a deleted row is skipped, also as the last key of a batch, and
+        // the next batch resumes after it. MVCC indexes keep the row until
+        // its deletion is collected; the others unlink it at commit
+        TestTransaction t1(0);
+        bool success, found;
+        std::tie(success, found) = idx.delete_row(key_type(30));
+        assert(success && found);
+        assert(t1.try_commit());
+
+        TestTransaction t(0);
+        auto c = idx.template range_cursor<false>(key_type(10), key_type(1000), RowAccess::ObserveValue);
+        assert(c.next_batch(3));
+        rows out;
+        for (size_t i = 0; i != c.size(); ++i)
+            out.push_back(c.row(i).aa);
+        if (std::is_same<IndexType, MVIndex>::value)
+            assert(c.size() == 2 && c.key(1).id == key_type(20).id && !c.done());
+        assert(scan_rest(c, 3, out));
+        assert((out == rows {1, 2, 4, 5, 6, 7, 8, 9, 10}));
+        auto r = idx.template range_cursor<true>(key_type(50), key_type(0), RowAccess::ObserveValue);
+        out.clear();
+        assert(scan_rest(r, 2, out));
+        assert((out == rows {5, 4, 2, 1}));
+        assert(t.try_commit());
+    }
+
+    {
+        // an insert into a batch already read is a phantom, even once the
+        // cursor has moved past it
+        TestTransaction t1(0);
+        auto c = idx.template range_cursor<false>(key_type(10), key_type(1000), RowAccess::ObserveValue);
+        assert(c.next_batch(3));
+
+        TestTransaction t2(1);
+        coarse_grained_row row_value(15, 15, 15);
+        bool success, found;
+        std::tie(success, found) = idx.insert_row(key_type(15), &row_value);
+        assert(success && !found);
+        assert(t2.try_commit());
+
+        t1.use();
+        rows out;
+        assert(!scan_rest(c, 3, out) || !t1.try_commit());
+    }
+
+    {
+        // without phantom protection, the insert goes unnoticed
+        TestTransaction t1(0);
+        auto c = idx.template range_cursor<false>(key_type(10), key_type(1000), RowAccess::ObserveValue, false);
+        assert(c.next_batch(3));
+
+        TestTransaction t2(1);
+        coarse_grained_row row_value(16, 16, 16);
+        bool success, found;
+        std::tie(success, found) = idx.insert_row(key_type(16), &row_value);
+        assert(success && !found);
+        assert(t2.try_commit());
+
+        t1.use();
+        rows out;
+        assert(scan_rest(c, 3, out));
+        assert(t1.try_commit());
+    }
+
+    Transaction::tinfo[0].rcu_set.release_all();
+    Transaction::tinfo[1].rcu_set.release_all();
+    printf("pass %s<%s>\n", __FUNCTION__,
+           std::is_same<IndexType, MVIndex>::value ? "MVIndex" : "CoarseIndex");
+}
+
+// MVCC scans track the rows they read unless asked for RowAccess::None;
+// committing a tracked read advances the version's read timestamp
+void test_mvcc_scan_access() {
+    MVIndex mi;
+    mi.thread_init();
+    init_scan_index(mi);
+
+    for (RowAccess access : {RowAccess::ObserveValue, RowAccess::None}) {
+        bool success, found;
+        uintptr_t row;
+        const coarse_grained_row *value;
+        MVIndex::history_type* h;
+        {
+            TestTransaction t(0);
+            std::tie(success, found, row, value) = mi.select_row(key_type(20), RowAccess::None);
+            assert(success && found);
+            h = reinterpret_cast<MVIndex::internal_elem*>(row)->row.head();
+            assert(t.try_commit());
+        }
+        auto rtid = h->rtid();
+
+        // the scan's reads are checked, and so tracked, once t1 writes
+        TestTransaction t1(0);
+        auto c = mi.range_cursor<false>(key_type(10), key_type(40), access, false);
+        assert(c.next_batch(8));
+        assert(c.size() == 3 && c.done() && c.row(1).aa == 2);
+        std::tie(success, found, row, value) = mi.select_row(key_type(80), RowAccess::UpdateValue);
+        assert(success && found);
+        mi.update_row(row, Sto::tx_alloc(value));
+        assert(t1.try_commit());
+        assert((h->rtid() > rtid) == (access != RowAccess::None));
+    }
+
+    Transaction::tinfo[0].rcu_set.release_all();
+    Transaction::tinfo[1].rcu_set.release_all();
+    printf("pass %s\n", __FUNCTION__);
+}
+
+// Checkpoint scans proceed in batches that resume after the last key
+template <typename IndexType>
+void test_checkpoint_batches() {
+    IndexType idx;
+    idx.thread_init();
+    init_scan_index(idx);
+    std::vector<uint64_t> keys;
+    bench::range_position cursor;
+    size_t batches = 0;
+    for (bool more = true; more; ++batches) {
+        TestTransaction t(0);
+        more = idx.checkpoint_scan(0, cursor, 3, [&] (const key_type& k, const auto&, const auto&) {
+            keys.push_back(bench::bswap(k.id));
+        });
+        assert(t.try_commit());
+    }
+    assert(batches == 4);
+    assert(keys.size() == 10);
+    for (uint64_t i = 0; i != 10; ++i)
+        assert(keys[i] == (i + 1) * 10);
+    printf("pass %s\n", __FUNCTION__);
+}
+
+// Versions of failed commits stay linked in the rows' chains until a sweep
+// trims them
+void test_mvcc_trim_sweep() {
+    MVIndex mi;
+    mi.thread_init();
+    init_cindex(mi);
+    bench::mvcc_trim_sweeper sweeper;
+    sweeper.add(mi);
+    FineIndex fi;
+    sweeper.add(fi);
+    assert(sweeper.size() == 1);
+
+    Transaction::set_epoch_cycle(1000);
+    Transaction::global_epochs.run = true;
+    std::thread advancer(&Transaction::epoch_advancer, nullptr);
+
+    bool success, found;
+    uintptr_t row;
+    const coarse_grained_row *value;
+    TBox<int> box;
+    size_t naborts = 0;
+    TransactionTid::type last_tid = 0;
+    for (uint64_t k = 1; k <= 4; ++k) {
+        // t1 links a version of row k, then fails to validate its read of
+        // the box
+        TestTransaction t1(0);
+        assert(box == 0);
+        std::tie(success, found, row, value) = mi.select_row(key_type(k), RowAccess::UpdateValue);
+        assert(success && found);
+        auto new_row = Sto::tx_alloc(value);
+        new_row->aa = 0;
+        mi.update_row(row, new_row);
+
+        TestTransaction t2(1);
+        box = 1;
+        assert(t2.try_commit());
+        box.nontrans_write(0);
+
+        t1.use();
+        assert(!t1.try_commit());
+        last_tid = std::max(last_tid, t1.get_tx().write_tid());
+        ++naborts;
+    }
+
+    // the watermark passes them once both threads read at newer TIDs
+    for (int i = 0; i != 2000 && Transaction::mvcc_trim_tid() < last_tid; ++i) {
+        for (int threadid = 0; threadid != 2; ++threadid) {
+            TestTransaction t(threadid);
+            std::tie(success, found, row, value) = mi.select_row(key_type(5), RowAccess::ObserveValue);
+            assert(success && found);
+            assert(t.try_commit());
+        }
+        usleep(1000);
+    }
+    assert(Transaction::mvcc_trim_tid() >= last_tid);
+    size_t trimmed = sweeper.sweep();
+#if !MVCC_TRIMMING
+    // nothing but the sweep trims them
+    assert(trimmed == naborts);
+#else
+    assert(trimmed <= naborts);
+#endif
+    assert(sweeper.sweep() == 0);
+    assert(sweeper.sweeps() == 2 && sweeper.versions_trimmed() == trimmed);
+    for (uint64_t k = 1; k <= 4; ++k)
+        assert(mi.nontrans_get(key_type(k))->aa == k);
+
+    // budgeted sweeps resume where they stopped: 10 rows take 4 steps of 3
+    for (int i = 0; i != 3; ++i) {
+        sweeper.sweep_rows(3);
+        assert(sweeper.sweeps() == 2);
+    }
+    sweeper.sweep_rows(3);
+    assert(sweeper.sweeps() == 3);
+
+    // the sweeper thread sweeps once an epoch
+    sweeper.start(2);
+    for (int i = 0; i != 2000 && sweeper.sweeps() < 7; ++i)
+        usleep(1000);
+    sweeper.stop();
+    assert(sweeper.sweeps() >= 7);
+
+    Transaction::global_epochs.run = false;
+    advancer.join();
+    for (int i = 0; i != 3; ++i)
+        Transaction::tinfo[i].rcu_set.release_all();
+    printf("pass %s\n", __FUNCTION__);
+}
+
 int main() {
     test_coarse_basic();
     test_coarse_read_my_split();
@@ -343,6 +645,12 @@ int main() {
     test_fine_conflict1();
     test_fine_conflict2();
     test_mvcc_snapshot();
+    test_scan_cursor<CoarseIndex>();
+    test_scan_cursor<MVIndex>();
+    test_mvcc_scan_access();
+    test_checkpoint_batches<CoarseIndex>();
+    test_checkpoint_batches<MVIndex>();
+    test_mvcc_trim_sweep();
     printf("All tests pass!\n");
     return 0;
 }
@@ -0,0 +1,121 @@
+#undef NDEBUG
+#include <cassert>
+#include <thread>
+#include "Sto.hh"
+#include "TMvBox.hh"
+
+// With MVCC_ADAPTIVE_FLATTENING, each object adapts how many DELTA versions
+// it allows before flattening them in the background: objects nobody reads
+// flatten later, objects whose readers walk long chains flatten sooner.
+// Background flattening never steps over a pending delta. Also
+// reports the time readers of a hot counter spend flattening (needs
+// STO_PROFILE_COUNTERS=2).
+
+typedef MvObject<int64_t> object_type;
+typedef object_type::history_type history_type;
+typedef history_type::comm_type comm_type;
+
+static object_type obj1(0);
+static object_type obj2(0);
+static object_type obj3(0);
+
+static history_type* increment(object_type& obj, TransactionTid::type tid) {
+    history_type* h = obj.new_history(tid, &obj, comm_type(1), nullptr);
+    bool locked = obj.cp_lock(tid, h);
+    assert(locked);
+    obj.cp_install(h);
+    return h;
+}
+
+// Runs the queued gc-time flattenings
+static void run_callbacks() {
+    Transaction::tinfo[TThread::id()].rcu_set.release_all();
+}
+
+void testUnreadObject() {
+    TransactionTid::type tid = 0;
+    for (int i = 0; i != 1 << 14; ++i) {
+        increment(obj1, tid += 10);
+        if (i % 64 == 0)
+            run_callbacks();
+    }
+    run_callbacks();
+#if MVCC_ADAPTIVE_FLATTENING
+    assert(obj1.flattening_length() == object_type::max_flattening_length);
+#endif
+    assert(obj1.find(tid)->v() == 1 << 14);
+    printf("PASS: %s\n", __FUNCTION__);
+}
+
+void testReadObject() {
+    TransactionTid::type tid = 0;
+    for (int i = 1; i <= 1 << 10; ++i) {
+        increment(obj2, tid += 10);
+        // a reader every 16 writes flattens what the background didn't
+        if (i % 16 == 0)
+            assert(obj2.find(tid)->v() == i);
+        if (i % 64 == 0)
+            run_callbacks();
+    }
+#if MVCC_ADAPTIVE_FLATTENING
+    assert(obj2.flattening_length() == object_type::min_flattening_length);
+#endif
+    printf("PASS: %s\n", __FUNCTION__);
+}
+
+// A gc-time flattening leaves a delta alone while one under it is pending,
+// rather than dropping the pending increment and freeing its version
+void testPendingBelow() {
+    history_type* p = obj3.new_history(10, &obj3, comm_type(1), nullptr);
+    bool locked = obj3.cp_lock(10, p);
+    assert(locked);
+    history_type* d = increment(obj3, 20);
+    assert(d->prev() == p);
+    d->enqueue_for_flattening();
+    run_callbacks();
+    assert(d->status_is(COMMITTED_DELTA) && !p->is_gc_enqueued());
+
+    obj3.cp_install(p);
+    d->enqueue_for_flattening();
+    run_callbacks();
+    assert(d->status_is(COMMITTED) && !d->status_is(DELTA));
+    assert(obj3.find(30)->v() == 2);
+    printf("PASS: %s\n", __FUNCTION__);
+}
+
+void reportHotCounter() {
+    constexpr int nreads = 20000, writes_per_read = 32;
+    static TMvCommuteIntegerBox box;
+    box.nontrans_write(0);
+    Transaction::set_epoch_cycle(100);
+    Transaction::global_epochs.run = true;
+    std::thread advancer(&Transaction::epoch_advancer, nullptr);
+    Transaction::clear_stats();
+    uint64_t read_ticks = 0;
+    for (int r = 0; r != nreads; ++r) {
+        for (int w = 0; w != writes_per_read; ++w) {
+            TransactionGuard t;
+            box.increment(1);
+        }
+        auto start = read_tsc();
+        {
+            TransactionGuard t;
+            assert(box == int64_t(r + 1) * writes_per_read);
+        }
+        read_ticks += read_tsc() - start;
+    }
+    Transaction::global_epochs.run = false;
+    advancer.join();
+    printf("MVCC_ADAPTIVE_FLATTENING=%d: %.0f cycles per read\n",
+           MVCC_ADAPTIVE_FLATTENING, double(read_ticks) / nreads);
+    if (txp_count >= txp_mvcc_flat_gc_runs)
+        Transaction::print_stats();
+}
+
+int main() {
+    testUnreadObject();
+    testReadObject();
+    testPendingBelow();
+    reportHotCounter();
+    return 0;
+}
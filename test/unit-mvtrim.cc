@@ -0,0 +1,177 @@
+#undef NDEBUG
+#include <cassert>
+#include <thread>
+#include <unistd.h>
+#include "Sto.hh"
+#include "TMvBox.hh"
+
+// MvObject::trim unlinks aborted versions and the tails below committed
+// versions once no transaction can read them; with MVCC_TRIMMING, long
+// find() walks and aborts trim chains without being asked. Reusing the
+// inlined version unlinks it from the version above it. Also reports the
+// chain-length histogram and trim rate of a write load (needs
+// STO_PROFILE_COUNTERS=2).
+
+typedef MvObject<int> object_type;
+typedef object_type::history_type history_type;
+
+static object_type obj1(0);
+static object_type obj2(0);
+static object_type obj3(0);
+static object_type obj4(0);
+static TMvBox<int> boxes[4];
+
+static size_t chain_length(object_type& obj) {
+    size_t n = 0;
+    for (history_type* h = obj.head(); h; h = h->prev())
+        ++n;
+    return n;
+}
+
+static history_type* write(object_type& obj, TransactionTid::type tid, int value, bool commit) {
+    history_type* h = obj.new_history(tid, &obj, value);
+    bool locked = obj.cp_lock(tid, h);
+    assert(locked);
+    if (commit)
+        obj.cp_install(h);
+    else
+        obj.abort(h);
+    return h;
+}
+
+static void start_advancer(std::thread& advancer, unsigned us) {
+    Transaction::set_epoch_cycle(us);
+    Transaction::global_epochs.run = true;
+    advancer = std::thread(&Transaction::epoch_advancer, nullptr);
+}
+
+static void stop_advancer(std::thread& advancer) {
+    Transaction::global_epochs.run = false;
+    advancer.join();
+}
+
+// Version TIDs used by hand stay below the initial _RTID, so the trim
+// watermark passes them as soon as the advancer has published one.
+static void wait_for_watermark(TransactionTid::type tid) {
+    while (Transaction::mvcc_trim_tid() < tid)
+        usleep(1000);
+}
+
+void testTrim() {
+    history_type* c1 = write(obj1, 10, 1, true);
+    write(obj1, 20, 2, false);
+    write(obj1, 30, 3, false);
+    assert(chain_length(obj1) == 4);
+    assert(obj1.find(40) == c1);
+
+    // the watermark separates the aborted versions
+    // (and the initial version, handed to GC when c1 installed, is cut off)
+    assert(obj1.trim(25) == 1);
+    assert(chain_length(obj1) == 2 && obj1.find(40) == c1);
+    assert(obj1.trim(35) == 1);
+    assert(obj1.head() == c1);
+
+    // below a committed version, the tail its install handed to GC is cut
+    history_type* c4 = write(obj1, 40, 4, true);
+    assert(chain_length(obj1) == 2);
+    assert(obj1.trim(35) == 0 && chain_length(obj1) == 2);
+    assert(obj1.trim(40) == 0 && chain_length(obj1) == 1);
+    assert(obj1.head() == c4 && obj1.find(50)->v() == 4);
+    printf("PASS: %s\n", __FUNCTION__);
+}
+
+void testLongFind() {
+    std::thread advancer;
+    start_advancer(advancer, 1000);
+    wait_for_watermark(100);
+    stop_advancer(advancer);
+
+    for (int i = 1; i <= 8; ++i)
+        write(obj2, 10 * i, i, false);
+    assert(chain_length(obj2) == 9);
+    auto long_finds = TXP_INSPECT(txp_mvcc_find_15);
+    assert(obj2.find(100)->v() == 0);
+    if (txp_count >= txp_mvcc_trim_versions)
+        assert(TXP_INSPECT(txp_mvcc_find_15) == long_finds + 1);
+#if MVCC_TRIMMING
+    assert(chain_length(obj2) == 1);
+#else
+    assert(chain_length(obj2) == 9);
+#endif
+    printf("PASS: %s\n", __FUNCTION__);
+}
+
+void testBackgroundTrim() {
+#if MVCC_TRIMMING
+    std::thread advancer;
+    start_advancer(advancer, 1000);
+    wait_for_watermark(100);
+    for (int i = 1; i <= 3; ++i)
+        write(obj3, 10 * i, i, false);
+    assert(chain_length(obj3) == 4);
+    // the aborts' callbacks run once their epoch expires
+    for (int i = 0; i != 2000 && chain_length(obj3) != 1; ++i) {
+        {
+            TransactionGuard t;
+            boxes[0] = i;
+        }
+        usleep(1000);
+    }
+    stop_advancer(advancer);
+    assert(chain_length(obj3) == 1 && obj3.find(100)->v() == 0);
+#endif
+    printf("PASS: %s\n", __FUNCTION__);
+}
+
+// GC of the inlined version clears the pointer to it even below a
+// committed version, so reusing it can't close a cycle
+void testUnlinkInlined() {
+#if MVCC_INLINING
+    history_type* ih = obj4.head();
+    assert(obj4.is_inlined(ih));
+    history_type* c2 = write(obj4, 20, 2, true);
+    // c2 made the inlined version garbage: nothing links onto it
+    history_type* p = obj4.new_history(15, &obj4, 1);
+    bool locked = obj4.cp_lock(15, p);
+    assert(!locked && c2->prev() == ih);
+    obj4.delete_history(p);
+
+    // the next write after an epoch reuses it, unlinked from c2
+    auto e = Transaction::global_epochs.global_epoch.load() + 1;
+    Transaction::global_epochs.global_epoch = e;
+    Transaction::global_epochs.read_epoch = e;
+    Transaction::global_epochs.active_epoch = e;
+    history_type* c3 = write(obj4, 30, 3, true);
+    assert(c3 == ih && c2->prev() == nullptr);
+    assert(chain_length(obj4) == 2);
+    assert(obj4.find(40)->v() == 3);
+#endif
+    printf("PASS: %s\n", __FUNCTION__);
+}
+
+void reportTrimRate() {
+    constexpr int ntxns = 200000;
+    std::thread advancer;
+    start_advancer(advancer, 1000);
+    Transaction::clear_stats();
+    auto start = read_tsc();
+    for (int i = 0; i != ntxns; ++i) {
+        TransactionGuard t;
+        boxes[i % 4] = boxes[(i + 1) % 4] + 1;
+    }
+    auto ticks = read_tsc() - start;
+    stop_advancer(advancer);
+    printf("MVCC_TRIMMING=%d: %.0f cycles per transaction\n",
+           MVCC_TRIMMING, double(ticks) / ntxns);
+    if (txp_count >= txp_mvcc_trim_versions)
+        Transaction::print_stats();
+}
+
+int main() {
+    testTrim();
+    testLongFind();
+    testBackgroundTrim();
+    testUnlinkInlined();
+    reportTrimRate();
+    return 0;
+}
@@ -0,0 +1,204 @@
+#undef NDEBUG
+#include <cassert>
+#include <algorithm>
+#include <thread>
+#include <vector>
+#include <sys/resource.h>
+#include "Sto.hh"
+#include "TBox.hh"
+
+// Every RCU callback runs exactly once whether workers run them in start()
+// or hand them to reclamation threads (STO_RCU_WORKERS), release_all waits
+// for those handed off, and callbacks due later wait apart. Also reports
+// transaction latency and peak RSS under a garbage-heavy load.
+
+static constexpr int nworkers = 4;
+static TBox<int> boxes[nworkers + 1];
+static std::atomic<long> ncalled;
+static std::atomic<long> nreclaimed;
+
+static void count_cb(void*) {
+    ++ncalled;
+    if (TThread::id() >= MAX_THREADS - STO_RCU_WORKERS)
+        ++nreclaimed;
+}
+
+static void start_advancer(std::thread& advancer, unsigned us) {
+    Transaction::set_epoch_cycle(us);
+    Transaction::global_epochs.run = true;
+    advancer = std::thread(&Transaction::epoch_advancer, nullptr);
+}
+
+static void stop_advancer(std::thread& advancer) {
+    Transaction::global_epochs.run = false;
+    advancer.join();
+    // what hasn't expired yet is still in the workers' sets
+    for (int id = 1; id <= nworkers; ++id)
+        Transaction::tinfo[id].rcu_set.release_all();
+}
+
+void testAllCallbacksRun() {
+    constexpr int ntxns = 20000;
+    ncalled = nreclaimed = 0;
+    std::thread advancer;
+    start_advancer(advancer, 1000);
+    std::vector<std::thread> workers;
+    for (int id = 1; id <= nworkers; ++id)
+        workers.emplace_back([id] {
+            TThread::set_id(id);
+            for (int i = 0; i != ntxns; ++i) {
+                TransactionGuard t;
+                boxes[id] = i;
+                Transaction::rcu_call(count_cb, nullptr);
+            }
+        });
+    for (auto& w : workers)
+        w.join();
+    stop_advancer(advancer);
+    assert(ncalled == long(nworkers) * ntxns);
+#if STO_RCU_WORKERS
+    assert(nreclaimed > 0);
+#else
+    assert(nreclaimed == 0);
+#endif
+    printf("%ld of %ld callbacks run by reclamation threads\n",
+           nreclaimed.load(), ncalled.load());
+    printf("PASS: %s\n", __FUNCTION__);
+}
+
+// release_all returns only once the callbacks handed to reclamation threads
+// have run; those threads take no registered thread ids
+static void slow_cb(void* counter) {
+    usleep(20);
+    ++*static_cast<std::atomic<long>*>(counter);
+}
+
+void testReleaseWaits() {
+    std::thread advancer;
+    start_advancer(advancer, 1000);
+    std::vector<std::thread> workers;
+    for (int id = 1; id <= nworkers; ++id)
+        workers.emplace_back([id] {
+            TThread::set_id(id);
+            std::atomic<long> ncalled(0);
+            // long enough for groups to expire and be handed off
+            auto until = Transaction::global_epochs.global_epoch.load() + 20;
+            long n = 0;
+            for (; Transaction::global_epochs.global_epoch < until; ++n) {
+                TransactionGuard t;
+                boxes[id] = n;
+                Transaction::rcu_call(slow_cb, &ncalled);
+            }
+            Transaction::tinfo[id].rcu_set.release_all();
+            assert(ncalled == n);
+        });
+    for (auto& w : workers)
+        w.join();
+    TThread::for_each_active([] (int i) {
+        assert(i < MAX_THREADS - STO_RCU_WORKERS);
+    });
+    stop_advancer(advancer);
+    printf("PASS: %s\n", __FUNCTION__);
+}
+
+// Callbacks added for a later epoch hold back none added after them, run
+// from clean_until and hand_off_until once their epoch expires, and run on
+// release_all
+static std::vector<int> later_order;
+static void push_cb(void* tag) {
+    later_order.push_back(*static_cast<int*>(tag));
+}
+
+void testAddLater() {
+    int tags[] = {1, 2, 3};
+    TRcuSet set;
+    set.add_later(10, push_cb, &tags[0]);
+    set.add(3, push_cb, &tags[1]);
+    set.clean_until(5);
+    assert((later_order == std::vector<int>{2}));
+    set.clean_until(10);
+    assert(later_order.size() == 1);
+    TRcuQueue q;
+    set.hand_off_until(11, q, 0);
+    assert((later_order == std::vector<int>{2, 1}));
+
+    set.add_later(20, push_cb, &tags[2]);
+    set.release_all();
+    assert((later_order == std::vector<int>{2, 1, 3}));
+    printf("PASS: %s\n", __FUNCTION__);
+}
+
+static void garbage_load(int ntxns, unsigned per_txn, std::vector<uint64_t>& latency) {
+    std::vector<std::thread> workers;
+    std::vector<std::vector<uint64_t>> lat(nworkers);
+    for (int id = 1; id <= nworkers; ++id)
+        workers.emplace_back([&, id] {
+            TThread::set_id(id);
+            auto& l = lat[id - 1];
+            l.reserve(ntxns);
+            for (int i = 0; i != ntxns; ++i) {
+                auto start = read_tsc();
+                {
+                    TransactionGuard t;
+                    boxes[id] = i;
+                    for (unsigned j = 0; j != per_txn; ++j)
+                        Transaction::rcu_free(malloc(256));
+                }
+                l.push_back(read_tsc() - start);
+            }
+        });
+    for (auto& w : workers)
+        w.join();
+    for (auto& l : lat)
+        latency.insert(latency.end(), l.begin(), l.end());
+}
+
+void testAdaptiveEpoch() {
+#if STO_RCU_WORKERS
+    auto target = Transaction::rcu_backlog_target;
+    Transaction::rcu_backlog_target = 64;
+    std::thread advancer;
+    start_advancer(advancer, 20000);
+    unsigned shortest = Transaction::get_epoch_cycle();
+    std::thread watcher([&] {
+        while (Transaction::global_epochs.run) {
+            shortest = std::min(shortest, Transaction::current_epoch_cycle());
+            usleep(1000);
+        }
+    });
+    std::vector<uint64_t> latency;
+    garbage_load(20000, 16, latency);
+    stop_advancer(advancer);
+    watcher.join();
+    Transaction::rcu_backlog_target = target;
+    assert(shortest < Transaction::get_epoch_cycle());
+    printf("epoch shortened to %u us of %u\n", shortest, Transaction::get_epoch_cycle());
+#endif
+    printf("PASS: %s\n", __FUNCTION__);
+}
+
+void reportLatency() {
+    std::thread advancer;
+    start_advancer(advancer, 20000);
+    std::vector<uint64_t> latency;
+    garbage_load(50000, 64, latency);
+    stop_advancer(advancer);
+    std::sort(latency.begin(), latency.end());
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    printf("%d reclamation threads: median %llu, p99 %llu, p99.9 %llu, max %llu cycles/txn; peak RSS %ld KB\n",
+           STO_RCU_WORKERS,
+           (unsigned long long) latency[latency.size() / 2],
+           (unsigned long long) latency[latency.size() * 99 / 100],
+           (unsigned long long) latency[latency.size() * 999 / 1000],
+           (unsigned long long) latency.back(), ru.ru_maxrss);
+}
+
+int main() {
+    testAllCallbacksRun();
+    testReleaseWaits();
+    testAddLater();
+    testAdaptiveEpoch();
+    reportLatency();
+    return 0;
+}
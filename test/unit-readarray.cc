@@ -0,0 +1,94 @@
+#undef NDEBUG
+#include <cassert>
+#include "Sto.hh"
+#include "TArray.hh"
+#include "TBox.hh"
+
+// Read validation must reach the same verdicts whether reads go through the
+// read-version array (STO_READ_VERSION_ARRAY) or their owners' check(),
+// including reads past the array's capacity.
+
+static constexpr int N = 2000;
+static TArray<int, N> a;
+
+static void fill() {
+    TransactionGuard t;
+    for (int i = 0; i != N; ++i)
+        a[i] = i;
+}
+
+void testLargeReadOnly() {
+    fill();
+    {
+        TransactionGuard t;
+        long sum = 0;
+        for (int i = 0; i != N; ++i)
+            sum += a[i];
+        assert(sum == long(N) * (N - 1) / 2);
+    }
+    printf("PASS: %s\n", __FUNCTION__);
+}
+
+void testConflict() {
+    for (int victim : {5, N - 5}) {
+        TBox<int> out;
+        TestTransaction t1(0);
+        long sum = 0;
+        for (int i = 0; i != N; ++i)
+            sum += a[i];
+        out = sum;
+
+        TestTransaction t2(1);
+        a[victim] = -1;
+        assert(t2.try_commit());
+
+        t1.use();
+        assert(!t1.try_commit());
+        fill();
+    }
+    printf("PASS: %s\n", __FUNCTION__);
+}
+
+void testReadWrite() {
+    {
+        TransactionGuard t;
+        for (int i = 0; i != 10; ++i)
+            a[i] = a[i] + a[i + 10];
+    }
+    {
+        TransactionGuard t;
+        for (int i = 0; i != 10; ++i)
+            assert(a[i] == 2 * i + 10);
+    }
+    fill();
+    printf("PASS: %s\n", __FUNCTION__);
+}
+
+void testOpacity() {
+    try {
+        TestTransaction t1(0);
+        int x = a[3];
+        assert(x == 3);
+
+        TestTransaction t2(1);
+        a[3] = 30;
+        a[4] = 40;
+        assert(t2.try_commit());
+
+        t1.use();
+        x = a[4];
+        assert(false && "shouldn't get here");
+    } catch (Transaction::Abort e) {
+        TestTransaction::hard_reset();
+    }
+    fill();
+    printf("PASS: %s\n", __FUNCTION__);
+}
+
+int main() {
+    testLargeReadOnly();
+    testConflict();
+    testReadWrite();
+    testOpacity();
+    return 0;
+}
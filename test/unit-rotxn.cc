@@ -0,0 +1,108 @@
+#undef NDEBUG
+#include <cassert>
+#include <vector>
+#include "Sto.hh"
+#include "TArray.hh"
+#include "TBox.hh"
+#include "TMvArray.hh"
+#include "TMvBox.hh"
+
+// Declared read-only transactions read MVCC objects at their snapshot without
+// tracking items; their OCC reads are tracked and validated as usual.
+
+static constexpr int N = 16;
+static TMvBox<int> mb;
+static TMvArray<int, N> ma;
+static TArray<int, N> a;
+static TBox<int> other;
+
+static void fill() {
+    TransactionGuard t;
+    mb = 1;
+    for (int i = 0; i != N; ++i) {
+        ma[i] = i;
+        a[i] = i;
+    }
+}
+
+static unsigned nitems() {
+    auto sp = Sto::savepoint();
+    Sto::release_savepoint(sp);
+    return sp.tset_size;
+}
+
+void testMvccUntracked() {
+    fill();
+    {
+        TransactionGuard t(true);
+        assert(Sto::read_only());
+        int sum = mb;
+        for (int i = 0; i != N; ++i)
+            sum += ma[i];
+        assert(sum == 1 + N * (N - 1) / 2);
+        assert(nitems() == 0);
+    }
+    {
+        TransactionGuard t;
+        assert(!Sto::read_only());
+        int x = ma[0];
+        (void) x;
+        assert(nitems() == 1);
+    }
+    printf("PASS: %s\n", __FUNCTION__);
+}
+
+void testOccTracked() {
+    fill();
+    {
+        TransactionGuard t(true);
+        int x = a[0];
+        (void) x;
+        assert(nitems() == 1);
+    }
+    {
+        // other commits don't fail it
+        TestTransaction t1(0);
+        Sto::declare_read_only();
+        assert(a[3] == 3);
+
+        TestTransaction t2(1);
+        other = other + 1;
+        assert(t2.try_commit());
+
+        t1.use();
+        assert(a[4] == 4);
+        assert(t1.try_commit());
+    }
+    {
+        // its reads are revalidated when a newer version comes into sight
+        TestTransaction t1(0);
+        try {
+            Sto::declare_read_only();
+            assert(a[3] == 3);
+
+            TestTransaction t2(1);
+            a[3] = 30;
+            a[4] = 40;
+            assert(t2.try_commit());
+
+            t1.use();
+            int x = a[4];
+            (void) x;
+            assert(false && "shouldn't get here");
+        } catch (Transaction::Abort e) {
+            Sto::silent_abort();
+        }
+        Sto::start_transaction();
+        Sto::declare_read_only();
+        assert(a[3] == 30 && a[4] == 40);
+        assert(t1.try_commit());
+    }
+    printf("PASS: %s\n", __FUNCTION__);
+}
+
+int main() {
+    testMvccUntracked();
+    testOccTracked();
+    return 0;
+}
@@ -0,0 +1,209 @@
+#undef NDEBUG
+#include <cassert>
+#include <string>
+#include "Sto.hh"
+#include "TArray.hh"
+#include "TBox.hh"
+
+// Rolling back to a savepoint must leave the transaction exactly as it was
+// when the savepoint was taken: later items gone (also from the hash
+// table), earlier items with their old flags and values.
+
+static constexpr int N = 1024;
+static TArray<int, N> a;
+
+static void fill() {
+    TransactionGuard t;
+    for (int i = 0; i != N; ++i)
+        a[i] = i;
+}
+
+void testRollbackWrites() {
+    // local: a static TBox<std::string> would be destroyed after the
+    // thread RCU sets its destructor uses
+    TBox<std::string> s;
+    s.nontrans_write("initial");
+    fill();
+    {
+        TransactionGuard t;
+        a[0] = 100;
+        s = "before";
+        auto sp = Sto::savepoint();
+        a[0] = 200;
+        a[1] = 201;
+        s = "after";
+        // past the first tracking-set chunk
+        for (int i = 2; i != 700; ++i)
+            a[i] = -i;
+        Sto::rollback_to(sp);
+        assert(a[0] == 100 && a[1] == 1 && a[699] == 699);
+        assert(s.read() == "before");
+        a[2] = 102;
+    }
+    {
+        TransactionGuard t;
+        assert(a[0] == 100 && a[1] == 1 && a[2] == 102 && a[699] == 699);
+    }
+    assert(s.nontrans_read() == "before");
+    printf("PASS: %s\n", __FUNCTION__);
+}
+
+void testRollbackReads() {
+    fill();
+    {
+        // a read discarded by the rollback does not need to validate
+        TestTransaction t1(0);
+        int x = a[10];
+        auto sp = Sto::savepoint();
+        x += a[20];
+        a[11] = x;
+        Sto::rollback_to(sp);
+
+        TestTransaction t2(1);
+        a[20] = -1;
+        assert(t2.try_commit());
+
+        t1.use();
+        a[12] = x;
+        assert(t1.try_commit());
+    }
+    {
+        // ... but the same key accessed again afterwards does
+        TestTransaction t1(0);
+        auto sp = Sto::savepoint();
+        int x = a[30];
+        Sto::rollback_to(sp);
+        x += a[30];
+        a[31] = x;
+
+        TestTransaction t2(1);
+        a[30] = -1;
+        assert(t2.try_commit());
+
+        t1.use();
+        assert(!t1.try_commit());
+    }
+    {
+        TransactionGuard t;
+        assert(a[11] == 11 && a[12] == 30 && a[31] == 31);
+    }
+    printf("PASS: %s\n", __FUNCTION__);
+}
+
+void testNested() {
+    fill();
+    {
+        TransactionGuard t;
+        auto outer = Sto::savepoint();
+        a[0] = 1000;
+        auto inner = Sto::savepoint();
+        a[0] = 2000;
+        a[1] = 2001;
+        Sto::rollback_to(inner);
+        assert(a[0] == 1000 && a[1] == 1);
+        a[1] = 1001;
+        Sto::release_savepoint(inner);
+        a[2] = 1002;
+        Sto::rollback_to(outer);
+        assert(a[0] == 0 && a[1] == 1 && a[2] == 2);
+        a[3] = 1003;
+        Sto::release_savepoint(outer);
+    }
+    {
+        TransactionGuard t;
+        assert(a[0] == 0 && a[1] == 1 && a[2] == 2 && a[3] == 1003);
+    }
+    printf("PASS: %s\n", __FUNCTION__);
+}
+
+// An order pipeline: every line takes stock, then optionally reserves the
+// item, which optionally adds a bonus. An optional step that finds it went
+// over its cap is undone. With savepoints only that step is undone;
+// without, the whole order restarts and skips the step the next time.
+
+static constexpr int nlines = 32;
+static TArray<int, nlines> stock, reserved, bonus, rcap, bcap;
+
+static void reset_orders() {
+    TransactionGuard t;
+    for (int i = 0; i != nlines; ++i) {
+        stock[i] = 100;
+        reserved[i] = bonus[i] = 0;
+        rcap[i] = i % 5 == 4 ? 0 : 1;
+        bcap[i] = i % 3 == 2 ? 0 : 10;
+    }
+}
+
+static int run_order(bool use_savepoints) {
+    bool skip_reserve[nlines] = {}, skip_bonus[nlines] = {};
+    int steps = 0;
+    TRANSACTION_E {
+        for (int i = 0; i != nlines; ++i) {
+            ++steps;
+            stock[i] = stock[i] - 1;
+            if (skip_reserve[i])
+                continue;
+            Transaction::savepoint_type reserve, add_bonus;
+            if (use_savepoints)
+                reserve = Sto::savepoint();
+            ++steps;
+            reserved[i] = reserved[i] + 1;
+            if (!skip_bonus[i]) {
+                if (use_savepoints)
+                    add_bonus = Sto::savepoint();
+                ++steps;
+                bonus[i] = bonus[i] + 10;
+                if (bonus[i] > bcap[i]) {
+                    if (!use_savepoints) {
+                        skip_bonus[i] = true;
+                        throw Transaction::Abort();
+                    }
+                    Sto::rollback_to(add_bonus);
+                }
+                if (use_savepoints)
+                    Sto::release_savepoint(add_bonus);
+            }
+            if (reserved[i] > rcap[i]) {
+                if (!use_savepoints) {
+                    skip_reserve[i] = true;
+                    throw Transaction::Abort();
+                }
+                Sto::rollback_to(reserve);
+            }
+            if (use_savepoints)
+                Sto::release_savepoint(reserve);
+        }
+    } RETRY_E(true);
+    return steps;
+}
+
+static void check_orders() {
+    TransactionGuard t;
+    for (int i = 0; i != nlines; ++i) {
+        assert(stock[i] == 99);
+        bool reserves = i % 5 != 4;
+        assert(reserved[i] == reserves);
+        assert(bonus[i] == (reserves && i % 3 != 2 ? 10 : 0));
+    }
+}
+
+void testReexecution() {
+    reset_orders();
+    int restart_steps = run_order(false);
+    check_orders();
+    reset_orders();
+    int savepoint_steps = run_order(true);
+    check_orders();
+    printf("order with %d lines: %d steps executed with savepoints, %d restarting\n",
+           nlines, savepoint_steps, restart_steps);
+    assert(savepoint_steps < restart_steps);
+    printf("PASS: %s\n", __FUNCTION__);
+}
+
+int main() {
+    testRollbackWrites();
+    testRollbackReads();
+    testNested();
+    testReexecution();
+    return 0;
+}
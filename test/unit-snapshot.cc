@@ -0,0 +1,198 @@
+#undef NDEBUG
+#include <cassert>
+#include <thread>
+#include <unistd.h>
+#include "Sto.hh"
+#include "TMvArray.hh"
+#include "TMvBox.hh"
+
+// Read-only transactions declared at a past TID (Sto::declare_snapshot) read
+// MVCC objects as of that TID, as long as the retention window kept the
+// versions they need. Also reports the cost of reading a large array at an
+// old snapshot while it is rewritten.
+
+static constexpr int N = 1024;
+static TMvBox<int> box;
+static TMvArray<int, N> arr;
+
+static void start_advancer(std::thread& advancer, unsigned us) {
+    Transaction::set_epoch_cycle(us);
+    Transaction::global_epochs.run = true;
+    advancer = std::thread(&Transaction::epoch_advancer, nullptr);
+}
+
+static void stop_advancer(std::thread& advancer) {
+    Transaction::global_epochs.run = false;
+    advancer.join();
+}
+
+// Lets a few epochs go by, running transactions so the thread's RCU
+// callbacks run and _RTID advances.
+static void pass_epochs(int n) {
+    auto e = Transaction::global_epochs.global_epoch.load();
+    while (Transaction::global_epochs.global_epoch.load() - e < unsigned(n)) {
+        {
+            TransactionGuard t;
+            int x = box;
+            (void) x;
+        }
+        usleep(500);
+    }
+}
+
+// A TID at which the snapshot sees everything committed so far
+static TransactionTid::type snapshot_now() {
+    pass_epochs(1);
+    return Transaction::tid_at_epoch(Transaction::global_epochs.global_epoch.load());
+}
+
+static void write_all(int value) {
+    TransactionGuard t;
+    box = value;
+    for (int i = 0; i != N; ++i)
+        arr[i] = value + i;
+}
+
+static int read_box_at(TransactionTid::type tid) {
+    TransactionGuard t;
+    bool ok = Sto::declare_snapshot(tid);
+    assert(ok);
+    return box;
+}
+
+void testPastSnapshots() {
+    TransactionTid::type tids[4];
+    for (int v = 0; v != 4; ++v) {
+        write_all(v);
+        tids[v] = snapshot_now();
+    }
+    // the replaced versions outlive many epochs
+    pass_epochs(20);
+    for (int v = 0; v != 4; ++v) {
+        TransactionGuard t;
+        assert(Sto::declare_snapshot(tids[v]));
+        assert(box == v);
+        for (int i = 0; i != N; ++i)
+            assert(arr[i] == v + i);
+    }
+    {
+        TransactionGuard t;
+        assert(box == 3);
+    }
+    printf("PASS: %s\n", __FUNCTION__);
+}
+
+void testSnapshotBounds() {
+    auto tid = snapshot_now();
+    {
+        // from before retention was turned on
+        TransactionGuard t;
+        assert(!Sto::declare_snapshot(Sto::initialized_tid()));
+        assert(Sto::read_only());
+    }
+    {
+        // the future may still change
+        TransactionGuard t;
+        assert(!Sto::declare_snapshot(Transaction::tid_ceiling() + (1 << 20)));
+    }
+    assert(read_box_at(tid) == 3);
+    printf("PASS: %s\n", __FUNCTION__);
+}
+
+void testWriteDuringSnapshot() {
+    auto tid = snapshot_now();
+    TestTransaction t1(1);
+    assert(Sto::declare_snapshot(tid));
+    assert(box == 3);
+    {
+        TestTransaction t2(2);
+        box = 4;
+        assert(t2.try_commit());
+    }
+    t1.use();
+    assert(box == 3);
+    assert(t1.try_commit());
+    // threads 1 and 2 are done; don't let them hold back the epochs
+    for (int id = 1; id <= 2; ++id) {
+        Transaction::tinfo[id].epoch = 0;
+        Transaction::tinfo[id].write_snapshot_epoch = 0;
+    }
+    TThread::set_id(0);
+    assert(read_box_at(tid) == 3);
+    printf("PASS: %s\n", __FUNCTION__);
+}
+
+void testWindowExpires() {
+    auto tid = snapshot_now();
+    write_all(5);
+    Transaction::set_mvcc_retention(2);
+    pass_epochs(6);
+    assert(Transaction::snapshot_floor() > tid);
+    {
+        TransactionGuard t;
+        assert(!Sto::declare_snapshot(tid));
+        assert(box == 5);
+    }
+    printf("PASS: %s\n", __FUNCTION__);
+}
+
+static TransactionTid::type trim_tid_seen;
+static void record_trim_tid(void*) {
+    trim_tid_seen = Transaction::mvcc_trim_tid();
+}
+
+// Versions kept for snapshots wait for the epoch the window passes them
+void testReleaseEpoch() {
+    Transaction::set_mvcc_retention(3);
+    auto tid = snapshot_now();
+    auto e = Transaction::mvcc_release_epoch(tid);
+    assert(TRcuSet::signed_epoch_type(e - Transaction::global_epochs.global_epoch) >= 3);
+    trim_tid_seen = 0;
+    Transaction::rcu_call_at(e, record_trim_tid, nullptr);
+    for (int i = 0; i != 1000 && !trim_tid_seen; ++i)
+        pass_epochs(1);
+    assert(trim_tid_seen >= tid);
+    Transaction::set_mvcc_retention(1000);
+    printf("PASS: %s\n", __FUNCTION__);
+}
+
+void reportSnapshotScan() {
+    constexpr int rounds = 200;
+    // with STO_RCU_WORKERS, the write backlog would shorten the epochs, and
+    // the window with them, below the length of the run
+    Transaction::rcu_backlog_target = size_t(1) << 40;
+    Transaction::set_mvcc_retention(1000);
+    pass_epochs(1);
+    auto tid = snapshot_now();
+    uint64_t scan_ticks = 0;
+    for (int r = 0; r != rounds; ++r) {
+        write_all(r);
+        auto start = read_tsc();
+        {
+            TransactionGuard t;
+            assert(Sto::declare_snapshot(tid));
+            long sum = 0;
+            for (int i = 0; i != N; ++i)
+                sum += arr[i];
+            assert(sum == long(N) * (N - 1) / 2 + long(N) * 5);
+        }
+        scan_ticks += read_tsc() - start;
+    }
+    printf("%.1f cycles per read %d versions back\n",
+           double(scan_ticks) / (rounds * N), rounds / 2);
+}
+
+int main() {
+    std::thread advancer;
+    start_advancer(advancer, 1000);
+    Transaction::set_mvcc_retention(1000);
+    testPastSnapshots();
+    testSnapshotBounds();
+    testWriteDuringSnapshot();
+    testWindowExpires();
+    testReleaseEpoch();
+    reportSnapshotScan();
+    Transaction::set_mvcc_retention(0);
+    stop_advancer(advancer);
+    return 0;
+}
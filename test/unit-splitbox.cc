@@ -0,0 +1,145 @@
+#undef NDEBUG
+#include <cassert>
+#include <thread>
+#include <vector>
+#include "Sto.hh"
+#include "TSplitIntegerBox.hh"
+
+// A split integer box takes increments from each thread in that thread's
+// slice once it is split, and reconciles the slices into one value when
+// readers need it whole. Also reports commits and aborts of threads that
+// increment one box, joined and split.
+
+typedef TSplitIntegerBox<> box_type;
+
+static int64_t read(box_type& box) {
+    TransactionGuard t;
+    auto r = box.read();
+    assert(r.first);
+    return r.second;
+}
+
+void testJoined() {
+    box_type box;
+    box = 10;
+    {
+        TestTransaction t1(1);
+        assert(box.increment(3) && box.increment(4));
+        TestTransaction t2(2);
+        assert(box.increment(5));
+        // blind increments don't conflict
+        assert(t2.try_commit());
+        t1.use();
+        assert(t1.try_commit());
+    }
+    TThread::set_id(0);
+    assert(!box.is_split() && read(box) == 22);
+    printf("PASS: %s\n", __FUNCTION__);
+}
+
+void testSplit() {
+    box_type box;
+    box = 10;
+    box.split();
+    assert(box.is_split());
+    {
+        TestTransaction t1(1);
+        assert(box.increment(3));
+        TestTransaction t2(2);
+        assert(box.increment(5));
+        auto r = box.read();
+        assert(r.first && r.second == 15);
+        assert(t2.try_commit());
+        t1.use();
+        assert(t1.try_commit());
+    }
+    {
+        // a whole read conflicts with increments to any slice
+        TestTransaction t1(1);
+        auto r = box.read();
+        assert(r.first && r.second == 18);
+        TestTransaction t2(2);
+        assert(box.increment(1));
+        assert(t2.try_commit());
+        t1.use();
+        assert(!t1.try_commit());
+    }
+    TThread::set_id(0);
+    assert(box.nontrans_read() == 19);
+    printf("PASS: %s\n", __FUNCTION__);
+}
+
+void testMerge() {
+    box_type box;
+    box.split();
+    {
+        TestTransaction t1(1);
+        assert(box.increment(2));
+        assert(t1.try_commit());
+    }
+    {
+        // an increment that chose a slice before the merge must abort
+        TestTransaction t1(1);
+        assert(box.increment(7));
+        TThread::set_id(0);
+        box.merge();
+        t1.use();
+        assert(!t1.try_commit());
+    }
+    TThread::set_id(0);
+    assert(!box.is_split() && read(box) == 2);
+
+    // enough whole reads join the box again
+    box.split();
+    {
+        TestTransaction t1(3);
+        assert(box.increment(4));
+        assert(t1.try_commit());
+    }
+    TThread::set_id(0);
+    for (unsigned i = 0; i != box_type::merge_reads; ++i)
+        assert(read(box) == 6);
+    assert(!box.is_split());
+    printf("PASS: %s\n", __FUNCTION__);
+}
+
+static void increments(box_type& box, int id, int n, uint64_t& attempts) {
+    TThread::set_id(id);
+    for (int i = 0; i != n; ++i) {
+        TRANSACTION_E {
+            ++attempts;
+            TXN_DO_E(box.increment(1));
+        } RETRY_E(true);
+    }
+}
+
+void reportIncrements(bool split) {
+    constexpr int nthreads = 4, n = 100000;
+    box_type box;
+    if (split)
+        box.split();
+    std::vector<uint64_t> attempts(nthreads * 8, 0);
+    std::vector<std::thread> threads;
+    auto start = read_tsc();
+    for (int i = 0; i != nthreads; ++i)
+        threads.emplace_back(increments, std::ref(box), i + 1, n, std::ref(attempts[i * 8]));
+    for (auto& t : threads)
+        t.join();
+    auto ticks = read_tsc() - start;
+    uint64_t total = 0;
+    for (int i = 0; i != nthreads; ++i)
+        total += attempts[i * 8];
+    assert(box.nontrans_read() == int64_t(nthreads) * n);
+    printf("%s: %d commits, %lu aborts, %.0f cycles per commit, split at end %d\n",
+           split ? "split" : "joined", nthreads * n, total - nthreads * n,
+           double(ticks) / (nthreads * n), box.is_split());
+}
+
+int main() {
+    testJoined();
+    testSplit();
+    testMerge();
+    reportIncrements(false);
+    reportIncrements(true);
+    return 0;
+}
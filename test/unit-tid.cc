@@ -0,0 +1,133 @@
+#undef NDEBUG
+#include <cassert>
+#include <algorithm>
+#include <thread>
+#include <vector>
+#include "Sto.hh"
+#include "TBox.hh"
+
+// Commit TIDs must be unique, increase within each thread, and never fall
+// below the floor observed before the transaction started. Snapshot read
+// TIDs lie between finished commits and later ones.
+
+static constexpr int nthreads = 8;
+static constexpr int ntrans = 20000;
+
+static TBox<int> boxes[nthreads];
+static std::vector<TransactionTid::type> tids[nthreads];
+
+static void run_writer(int id) {
+    TThread::set_id(id);
+    auto& out = tids[id];
+    out.reserve(ntrans);
+    for (int i = 0; i != ntrans; ++i) {
+        auto floor = Transaction::tid_floor();
+        TransactionGuard t;
+        boxes[id] = i;
+        auto tid = Sto::write_tid();
+        assert(tid >= floor);
+        assert(!(tid & (TransactionTid::increment_value - 1)));
+        out.push_back(tid);
+    }
+}
+
+void testUniqueTids() {
+    Transaction::set_epoch_cycle(1000);
+    Transaction::global_epochs.run = true;
+    std::thread advancer(&Transaction::epoch_advancer, nullptr);
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i != nthreads; ++i)
+        threads.emplace_back(run_writer, i);
+    for (auto& t : threads)
+        t.join();
+
+    Transaction::global_epochs.run = false;
+    advancer.join();
+
+    std::vector<TransactionTid::type> all;
+    for (int i = 0; i != nthreads; ++i) {
+        assert(tids[i].size() == size_t(ntrans));
+        for (size_t j = 1; j != tids[i].size(); ++j)
+            assert(tids[i][j] > tids[i][j - 1]);
+        all.insert(all.end(), tids[i].begin(), tids[i].end());
+    }
+    std::sort(all.begin(), all.end());
+    assert(std::adjacent_find(all.begin(), all.end()) == all.end());
+
+    printf("PASS: %s\n", __FUNCTION__);
+}
+
+void testReadTidBound() {
+    TThread::set_id(0);
+    TransactionTid::type rtid;
+    {
+        TransactionGuard t;
+        rtid = Sto::read_tid<false>();
+        int x = boxes[1];
+        (void) x;
+    }
+    // snapshot read TIDs lie below every later commit TID
+    for (int i = 0; i != 100; ++i) {
+        TransactionGuard t;
+        boxes[0] = i;
+        assert(Sto::write_tid() > rtid);
+    }
+
+    // ... and below the TIDs of transactions still committing
+    std::atomic<int> phase(0);
+    TransactionTid::type inflight = 0;
+    std::thread writer([&] () {
+        TThread::set_id(1);
+        TransactionGuard t;
+        boxes[1] = 1;
+        inflight = Sto::write_tid();
+        phase = 1;
+        while (phase != 2)
+            relax_fence();
+    });
+    while (phase != 1)
+        relax_fence();
+    for (int i = 0; i != 100; ++i) {
+        TransactionGuard t;
+        assert(Sto::read_tid<false>() < inflight);
+    }
+    phase = 2;
+    writer.join();
+
+    // ... and above the TIDs of commits other threads finished before them
+    for (int i = 0; i != 100; ++i) {
+        TransactionTid::type tid;
+        TThread::set_id(1);
+        {
+            TransactionGuard t;
+            boxes[1] = i;
+            tid = Sto::write_tid();
+        }
+        TThread::set_id(0);
+        TransactionGuard t;
+        assert(Sto::read_tid<false>() >= tid);
+    }
+
+    printf("PASS: %s\n", __FUNCTION__);
+}
+
+void testActiveThreads() {
+    std::thread([] () { TThread::set_id(77); }).join();
+    std::vector<int> ids;
+    TThread::for_each_active([&] (int i) { ids.push_back(i); });
+    // 0 is the default id; 1..nthreads-1 and 77 were set above
+    assert(ids.size() == size_t(nthreads + 1));
+    for (int i = 0; i != nthreads; ++i)
+        assert(ids[i] == i);
+    assert(ids.back() == 77);
+
+    printf("PASS: %s\n", __FUNCTION__);
+}
+
+int main() {
+    testUniqueTids();
+    testReadTidBound();
+    testActiveThreads();
+    return 0;
+}
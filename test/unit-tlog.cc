@@ -0,0 +1,151 @@
+#undef NDEBUG
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <cassert>
+#include <vector>
+#include <thread>
+#include <stdlib.h>
+#include <stdio.h>
+#include <ftw.h>
+#include "Sto.hh"
+#include "TBox.hh"
+
+// TBox that emits a redo record, keyed by its log id, on every install
+template <typename T>
+class TLoggedBox : public TBox<T>, public TLogged {
+public:
+    explicit TLoggedBox(uint32_t id) {
+        set_log_id(id);
+    }
+    using TBox<T>::operator=;
+    void install(TransItem& item, Transaction& txn) override {
+        TBox<T>::install(item, txn);
+        if (log_enabled())
+            log_put(log_id(), this->nontrans_read());
+    }
+};
+
+struct log_entry {
+    TLogRecord rec;
+    TLogEntry entry;
+    uint32_t key;
+    int value;
+};
+
+static std::vector<log_entry> read_log(const std::string& dir, int threadid) {
+    std::vector<log_entry> out;
+    std::ifstream f(TLog::file_name(dir, threadid), std::ios::binary);
+    TLogRecord rec;
+    while (f.read(reinterpret_cast<char*>(&rec), sizeof(rec))) {
+        for (uint32_t i = 0; i != rec.nentries; ++i) {
+            log_entry le;
+            le.rec = rec;
+            f.read(reinterpret_cast<char*>(&le.entry), sizeof(le.entry));
+            assert(le.entry.key_length == sizeof(le.key));
+            assert(le.entry.value_length == sizeof(le.value));
+            f.read(reinterpret_cast<char*>(&le.key), sizeof(le.key));
+            f.read(reinterpret_cast<char*>(&le.value), sizeof(le.value));
+            out.push_back(le);
+        }
+    }
+    return out;
+}
+
+static std::string make_log_dir() {
+    char tmpl[] = "/tmp/sto-tlog-XXXXXX";
+    char* dir = mkdtemp(tmpl);
+    assert(dir);
+    return std::string(dir);
+}
+
+static void remove_log_dir(const std::string& dir) {
+    auto remove_entry = [] (const char* path, const struct stat*, int, struct FTW*) {
+        return remove(path);
+    };
+    int r = nftw(dir.c_str(), remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+    assert(r == 0);
+}
+
+void testLogRecords() {
+    std::string dir = make_log_dir();
+    TLoggedBox<int> a(1), b(2);
+    TBox<int> unlogged;
+
+    bool ok = TLog::initialize(dir);
+    assert(ok);
+    {
+        TestTransaction t(0);
+        a = 10;
+        b = 20;
+        assert(t.try_commit());
+    }
+    {
+        // aborted transactions leave no trace
+        TestTransaction t1(0);
+        int x = a;
+        b = x + 1;
+        TestTransaction t2(0);
+        a = 11;
+        assert(t2.try_commit());
+        assert(!t1.try_commit());
+    }
+    {
+        // neither do transactions that write no logged object
+        TestTransaction t(0);
+        unlogged = 5;
+        assert(t.try_commit());
+    }
+    TLog::shutdown();
+    assert(!TLog::enabled());
+
+    auto log = read_log(dir, 0);
+    assert(log.size() == 3);
+    assert(log[0].rec.nentries == 2 && log[1].rec.nentries == 2);
+    assert(log[0].rec.tid == log[1].rec.tid);
+    assert(log[0].key + log[1].key == 3);
+    assert(log[0].entry.op == TLogOp::put);
+    assert(log[2].rec.nentries == 1);
+    assert(log[2].key == 1 && log[2].value == 11);
+    assert(log[2].rec.tid > log[0].rec.tid);
+    assert(log[2].rec.epoch >= log[0].rec.epoch);
+    assert(TLog::durable_epoch() >= log[2].rec.epoch);
+
+    remove_log_dir(dir);
+    printf("PASS: %s\n", __FUNCTION__);
+}
+
+void testDurableEpoch() {
+    std::string dir = make_log_dir();
+    TLoggedBox<int> a(1);
+
+    bool ok = TLog::initialize(dir);
+    assert(ok);
+    Transaction::set_epoch_cycle(1000);
+    Transaction::global_epochs.run = true;
+    std::thread advancer(&Transaction::epoch_advancer, nullptr);
+
+    for (int i = 0; i != 10; ++i) {
+        {
+            TransactionGuard t;
+            a = i;
+        }
+        auto e = TLog::commit_epoch(TThread::id());
+        TLog::wait_durable(e);
+        assert(TLog::durable_epoch() >= e);
+        assert(read_log(dir, TThread::id()).size() == size_t(i + 1));
+    }
+
+    Transaction::global_epochs.run = false;
+    advancer.join();
+    TLog::shutdown();
+
+    remove_log_dir(dir);
+    printf("PASS: %s\n", __FUNCTION__);
+}
+
+int main() {
+    testLogRecords();
+    testDurableEpoch();
+    return 0;
+}
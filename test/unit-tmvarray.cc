@@ -3,6 +3,7 @@
 #include <iostream>
 #include <assert.h>
 #include <vector>
+#include <thread>
 #include "Sto.hh"
 #include "TMvArray.hh"
 #include "TMvBox.hh"
@@ -246,6 +247,14 @@ void testOpacity1() {
     printf("PASS: %s\n", __FUNCTION__);
 }
 
+// As the epoch advancer would, once no thread is in a transaction
+static void advance_epochs() {
+    auto e = Transaction::global_epochs.global_epoch.load() + 1;
+    Transaction::global_epochs.global_epoch = e;
+    Transaction::global_epochs.read_epoch = e;
+    Transaction::global_epochs.active_epoch = e;
+}
+
 void testMvInline() {
     TMvArray<int, 10> f;
     for (int i = 0; i < 10; i++) {
@@ -266,6 +275,7 @@ void testMvInline() {
     assert(v0 != v1);
 
     Transaction::epoch_advance_once();
+    advance_epochs();
 
     {
         TestTransaction t2(2);
@@ -286,6 +296,17 @@ void benchArray64() {
     for (int i = 0; i < 64; ++i)
         a.nontrans_put(i, 0);
 
+    // reclaim the replaced versions as the benchmark goes; the test
+    // transactions above left their threads in old epochs
+    for (int id = 0; id != 3; ++id) {
+        Transaction::tinfo[id].epoch = 0;
+        Transaction::tinfo[id].write_snapshot_epoch = 0;
+    }
+    TThread::set_id(0);
+    Transaction::set_epoch_cycle(1000);
+    Transaction::global_epochs.run = true;
+    std::thread advancer(&Transaction::epoch_advancer, nullptr);
+
     const unsigned long niters = 1000;
     double before = gettime_d();
     for (unsigned long iter = 0; iter < niters; ++iter) {
@@ -299,10 +320,36 @@ void benchArray64() {
         }
     }
     double after = gettime_d();
+    Transaction::global_epochs.run = false;
+    advancer.join();
 
     printf("NS PER ITER (iter = 1000tx): %g\n", (after - before) * 1.0e9 / niters);
 }
 
+void benchReads() {
+    // rows with a single committed version, read at random: with
+    // MVCC_INLINING that version is in the array itself
+    constexpr unsigned n = 1 << 18;
+    static TMvArray<int, n> a;  // too big for the stack
+    for (unsigned i = 0; i < n; ++i)
+        a.nontrans_put(i, i);
+
+    const unsigned long ntxns = 100000;
+    unsigned x = 1;
+    long sum = 0;
+    auto start = read_tsc();
+    for (unsigned long t = 0; t < ntxns; ++t) {
+        TransactionGuard guard(true);
+        for (int i = 0; i < 16; ++i) {
+            x = x * 1103515245 + 12345;
+            sum += a[(x >> 8) % n];
+        }
+    }
+    auto ticks = read_tsc() - start;
+    assert(sum > 0);
+    printf("MVCC_INLINING=%d: %.1f cycles per random read\n",
+           MVCC_INLINING, double(ticks) / (ntxns * 16));
+}
 
 int main() {
     testSimpleInt();
@@ -318,5 +365,6 @@ int main() {
     testMvInline();
 #endif
     benchArray64();
+    benchReads();
     return 0;
 }
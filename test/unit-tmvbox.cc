@@ -333,6 +333,14 @@ void testMvCommute2() {
     printf("PASS: %s\n", __FUNCTION__);
 }
 
+// As the epoch advancer would, once no thread is in a transaction
+static void advance_epochs() {
+    auto e = Transaction::global_epochs.global_epoch.load() + 1;
+    Transaction::global_epochs.global_epoch = e;
+    Transaction::global_epochs.read_epoch = e;
+    Transaction::global_epochs.active_epoch = e;
+}
+
 void testMvInline() {
     TMvBox<int> box;
     box.nontrans_write(0);
@@ -351,6 +359,7 @@ void testMvInline() {
     assert(v0 != v1);
 
     Transaction::epoch_advance_once();
+    advance_epochs();
 
     {
         TestTransaction t2(2);
@@ -363,6 +372,39 @@ void testMvInline() {
     assert(v1 != v2);
     assert(v0 == v2);
 
+    Transaction::epoch_advance_once();
+
+    {
+        // ... linked into the chain only once
+        TestTransaction t3(3);
+        auto h = TMvBoxAccess::head(box);
+        assert(t3.try_commit());
+        assert(&h->v() == v2);
+        assert(h->prev() && &h->prev()->v() == v1);
+        assert(!h->prev()->prev());
+    }
+
+    printf("PASS: %s\n", __FUNCTION__);
+}
+
+void testMvInlineString() {
+    TMvBox<std::string> box;
+    for (int i = 0; i < 16; ++i) {
+        {
+            TestTransaction t(1);
+            box = std::string(40, 'a' + i);
+            assert(t.try_commit());
+        }
+        assert(box.nontrans_access() == std::string(40, 'a' + i));
+        if (i % 2)
+            advance_epochs();
+    }
+    {
+        TransactionGuard t;
+        std::string s = box;
+        assert(s == std::string(40, 'a' + 15));
+    }
+
     printf("PASS: %s\n", __FUNCTION__);
 }
 
@@ -436,6 +478,7 @@ int main() {
     testCommuteGC();
 #if MVCC_INLINING
     testMvInline();
+    testMvInlineString();
 #endif
     return 0;
 }
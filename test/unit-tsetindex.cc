@@ -0,0 +1,125 @@
+#undef NDEBUG
+#include <cassert>
+#include "Sto.hh"
+#include "TArray.hh"
+#include "TBox.hh"
+
+// Item lookups must find exactly the items added so far, whatever the
+// tracking-set size, with either index. Also reports the index's lookup
+// cost for a few transaction sizes (collision counts need
+// STO_PROFILE_COUNTERS).
+
+static constexpr int N = 8192;
+static TArray<int, N> a;
+static TBox<int> boxes[64];
+
+static unsigned nitems() {
+    auto sp = Sto::savepoint();
+    Sto::release_savepoint(sp);
+    return sp.tset_size;
+}
+
+void testGrowth() {
+    {
+        TransactionGuard t;
+        for (int i = 0; i != N; ++i)
+            a[i] = i;
+        assert(nitems() == unsigned(N));
+    }
+    {
+        TransactionGuard t;
+        // interleave two owners so items of both share the index
+        for (int i = 0; i != N; i += 2) {
+            a[i] = a[i] + 1;
+            boxes[i % 64] = i;
+        }
+        assert(nitems() == unsigned(N / 2 + 32));
+        for (int i = 0; i != N; i += 2)
+            assert(Sto::check_item(&a, i) && !Sto::check_item(&a, i + 1));
+    }
+    {
+        TransactionGuard t;
+        for (int i = 0; i != N; ++i)
+            assert(a[i] == i + !(i & 1));
+        assert(nitems() == unsigned(N));
+    }
+    printf("PASS: %s\n", __FUNCTION__);
+}
+
+void testSmallAfterLarge() {
+    {
+        TransactionGuard t;
+        for (int i = 0; i != N; ++i)
+            a[i] = 0;
+    }
+    {
+        // a small transaction must not see the large one's items
+        TransactionGuard t;
+        assert(!Sto::check_item(&a, 100));
+        a[1] = 1;
+        assert(Sto::check_item(&a, 1) && !Sto::check_item(&a, 100));
+        assert(nitems() == 1);
+    }
+    printf("PASS: %s\n", __FUNCTION__);
+}
+
+void testRollback() {
+    TransactionGuard t;
+    for (int i = 0; i != 40; ++i)
+        a[i] = i;
+    auto sp = Sto::savepoint();
+    for (int i = 40; i != 1000; ++i)
+        a[i] = i;
+    Sto::rollback_to(sp);
+    assert(nitems() == 40);
+    assert(Sto::check_item(&a, 39) && !Sto::check_item(&a, 40) && !Sto::check_item(&a, 999));
+    a[999] = 1;
+    assert(Sto::check_item(&a, 999) && nitems() == 41);
+    printf("PASS: %s\n", __FUNCTION__);
+}
+
+void testReadItem() {
+    TransactionGuard t;
+    Sto::read_item(&a, 5);
+    Sto::read_item(&a, 5);
+#if STO_TSET_INDEX
+    assert(nitems() == 1);
+#else
+    assert(nitems() == 2);
+#endif
+    printf("PASS: %s\n", __FUNCTION__);
+}
+
+void reportLookupCost() {
+    // strided keys, so neighbouring items don't share hash buckets by luck
+    for (int n : {8, 64, 512, 4096}) {
+        auto finds = TXP_INSPECT(txp_hash_find);
+        auto collisions = TXP_INSPECT(txp_hash_collision);
+        auto searched = TXP_INSPECT(txp_total_searched);
+        int rounds = 2 * N / n;
+        auto start = read_tsc();
+        for (int r = 0; r != rounds; ++r) {
+            TransactionGuard t;
+            int sum = 0;
+            for (int pass = 0; pass != 2; ++pass)
+                for (int i = 0; i != n; ++i)
+                    sum += a[(i * 2053 + r) % N];
+            (void) sum;
+        }
+        auto ticks = read_tsc() - start;
+        finds = TXP_INSPECT(txp_hash_find) - finds;
+        printf("%5d items: %6.1f cycles/access, %llu collisions, %.2f items searched per lookup\n",
+               n, double(ticks) / (2.0 * n * rounds),
+               (unsigned long long) (TXP_INSPECT(txp_hash_collision) - collisions),
+               finds ? double(TXP_INSPECT(txp_total_searched) - searched) / finds : 0.0);
+    }
+}
+
+int main() {
+    testGrowth();
+    testSmallAfterLarge();
+    testRollback();
+    testReadItem();
+    reportLookupCost();
+    return 0;
+}